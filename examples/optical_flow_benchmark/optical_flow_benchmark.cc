@@ -0,0 +1,115 @@
+// BoB robotics includes
+#include "plog/Log.h"
+#include "common/timer.h"
+#include "imgproc/opencv_optical_flow.h"
+#include "imgproc/opencv_sparse_optical_flow.h"
+#include "imgproc/roll.h"
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+
+// Standard C includes
+#include <cmath>
+
+// Standard C++ includes
+#include <vector>
+
+using namespace BoBRobotics;
+using namespace BoBRobotics::ImgProc;
+
+/*
+ * Compares the speed and accuracy of dense Farneback flow (OpenCVOpticalFlow)
+ * and sparse Lucas-Kanade flow (OpenCVSparseOpticalFlow) on a synthetic
+ * panorama rotating at a known rate, with flow measured at the same points.
+ */
+namespace
+{
+constexpr int NumFrames = 200;
+constexpr int PixelsPerFrame = 1;
+
+// A smooth random texture, so that there's something to track everywhere
+cv::Mat makeTexture(const cv::Size &size)
+{
+    cv::Mat texture(size, CV_8UC1);
+    cv::randu(texture, cv::Scalar(0), cv::Scalar(255));
+    cv::GaussianBlur(texture, texture, cv::Size(5, 5), 1.5);
+    cv::normalize(texture, texture, 0, 255, cv::NORM_MINMAX);
+    return texture;
+}
+
+std::vector<cv::Mat> makeFrames(const cv::Size &size)
+{
+    const auto texture = makeTexture(size);
+    std::vector<cv::Mat> frames(NumFrames);
+    for (int i = 0; i < NumFrames; i++) {
+        roll(texture, frames[i], (i * PixelsPerFrame) % size.width);
+    }
+    return frames;
+}
+
+// Rolling the image leftwards gives a flow of -PixelsPerFrame everywhere
+double endpointError(const cv::Point2f &flow)
+{
+    return std::hypot(flow.x + PixelsPerFrame, flow.y);
+}
+}   // Anonymous namespace
+
+int bobMain(int, char **)
+{
+    const cv::Size gridSize(30, 5);
+    for (const cv::Size &res : { cv::Size(90, 25), cv::Size(180, 50), cv::Size(360, 100) }) {
+        const auto frames = makeFrames(res);
+
+        // Dense flow, sampled at the points the sparse flow uses
+        OpenCVSparseOpticalFlow sparse(res, gridSize);
+        double denseTime = 0.0, denseError = 0.0;
+        {
+            OpenCVOpticalFlow dense(res);
+            for (const auto &frame : frames) {
+                {
+                    TimerAccumulate<> timer(denseTime);
+                    if (!dense.calculate(frame)) {
+                        continue;
+                    }
+                }
+
+                for (const auto &point : sparse.getPoints()) {
+                    const cv::Point p(point);
+                    denseError += endpointError({ dense.getFlowX().at<float>(p), dense.getFlowY().at<float>(p) });
+                }
+            }
+        }
+
+        double sparseTime = 0.0, sparseError = 0.0, rotationError = 0.0;
+        size_t numLost = 0;
+        for (const auto &frame : frames) {
+            {
+                TimerAccumulate<> timer(sparseTime);
+                if (!sparse.calculate(frame)) {
+                    continue;
+                }
+            }
+
+            for (size_t i = 0; i < sparse.getPoints().size(); i++) {
+                if (sparse.getStatus()[i]) {
+                    sparseError += endpointError(sparse.getFlow()[i]);
+                } else {
+                    numLost++;
+                }
+            }
+
+            const double rotation = sparse.estimateEgoMotion().rotation.value();
+            rotationError += std::abs(rotation + 360.0 * PixelsPerFrame / res.width);
+        }
+
+        const double numSamples = (double) (NumFrames - 1) * gridSize.area();
+        LOGI << "Resolution: " << res.width << "x" << res.height;
+        LOGI << "    Farneback:    " << denseTime / NumFrames << " ms/frame, mean error "
+             << denseError / numSamples << " px";
+        LOGI << "    Lucas-Kanade: " << sparseTime / NumFrames << " ms/frame, mean error "
+             << sparseError / (numSamples - numLost) << " px (" << numLost << " points lost)";
+        LOGI << "    Ego-motion rotation error: " << rotationError / (NumFrames - 1) << " degrees";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Standard C includes
+#include <cstddef>
+#include <cstdint>
+
+// Standard C++ includes
+#include <string>
+
+namespace BoBRobotics {
+//----------------------------------------------------------------------------
+// BoBRobotics::FNV1aHash
+//----------------------------------------------------------------------------
+/*!
+ * \brief Incrementally computes a 64-bit FNV-1a hash
+ *
+ * This is quick and good enough to tell whether cached data is out of date
+ * or to name cache files, but it is not a cryptographic hash.
+ */
+class FNV1aHash
+{
+public:
+    //! Add size bytes of data to the hash
+    FNV1aHash &add(const void *data, size_t size);
+
+    //! Add the characters of a string (but not its length) to the hash
+    FNV1aHash &add(const std::string &str);
+
+    //! The hash of everything added so far
+    uint64_t get() const;
+
+private:
+    uint64_t m_Hash = 0xcbf29ce484222325ULL;
+}; // FNV1aHash
+
+//! Hash a string with 64-bit FNV-1a
+uint64_t
+hashString(const std::string &str);
+
+//! Format a 64-bit value (e.g. a hash) as 16 hex digits
+std::string
+toHexString(uint64_t value);
+} // BoBRobotics
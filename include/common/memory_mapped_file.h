@@ -0,0 +1,57 @@
+#pragma once
+
+// Third-party includes
+#include "third_party/path.h"
+
+// Standard C includes
+#include <cstddef>
+#include <cstdint>
+
+namespace BoBRobotics {
+//----------------------------------------------------------------------------
+// BoBRobotics::MemoryMappedFile
+//----------------------------------------------------------------------------
+/*!
+ * \brief A read-only view of a whole file, mapped into memory
+ *
+ * The contents of the file are paged in by the OS on demand, so opening even a
+ * very large file is effectively free. The mapping is released when the object
+ * is destroyed; share it with std::shared_ptr if views into it need to outlive
+ * the object which opened it.
+ */
+class MemoryMappedFile
+{
+public:
+    MemoryMappedFile(const filesystem::path &filePath);
+    ~MemoryMappedFile();
+
+    MemoryMappedFile(const MemoryMappedFile &) = delete;
+    MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+    //! Get a pointer to the start of the file's contents
+    const uint8_t *data() const { return m_Data; }
+
+    //! Get the size of the file in bytes
+    size_t size() const { return m_Size; }
+
+    //! Get a pointer to an offset into the file, checking it is in range
+    template<class T = uint8_t>
+    const T *at(size_t offset, size_t count = 1) const
+    {
+        checkRange(offset, sizeof(T) * count);
+        return reinterpret_cast<const T *>(m_Data + offset);
+    }
+
+    const filesystem::path &getPath() const { return m_Path; }
+
+private:
+    const filesystem::path m_Path;
+    const uint8_t *m_Data = nullptr;
+    size_t m_Size = 0;
+#ifdef _WIN32
+    void *m_FileHandle = nullptr, *m_MappingHandle = nullptr;
+#endif
+
+    void checkRange(size_t offset, size_t length) const;
+}; // MemoryMappedFile
+} // BoBRobotics
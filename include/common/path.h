@@ -6,6 +6,10 @@
 // Standard C includes
 #include <ctime>
 
+// Standard C++ includes
+#include <functional>
+#include <string>
+
 namespace BoBRobotics {
 namespace Path {
 //! Get the path of the folder containing the currently running program
@@ -41,5 +45,21 @@ getNewPath(const std::tm &currentTime,
            const filesystem::path &rootPath = getProgramDirectory(),
            const std::string &extension = "");
 
+//! Extension of the temporary files written by writeFileAtomically()
+constexpr const char *TempFileExtension = "tmp";
+
+/*!
+ * \brief Write a file so that other processes never see it partly written
+ *
+ * writeFile is called to write the data to a temporary file next to filePath,
+ * which is then renamed to filePath. The temporary file's name is unique, so
+ * several processes can write the same file at once. If writeFile throws, or
+ * the file can't be renamed, the temporary file is removed and the exception
+ * (or a std::runtime_error) is thrown.
+ */
+void
+writeFileAtomically(const filesystem::path &filePath,
+                    const std::function<void(const filesystem::path &tempPath)> &writeFile);
+
 } // Path
 } // BoBRobotics
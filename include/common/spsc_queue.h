@@ -0,0 +1,148 @@
+#pragma once
+
+// Standard C++ includes
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace BoBRobotics {
+//----------------------------------------------------------------------------
+// BoBRobotics::SPSCQueue
+//----------------------------------------------------------------------------
+/*!
+ * \brief A bounded queue for passing items from one thread to another
+ *
+ * Only one thread may push and only one may pop. Items are kept in a ring
+ * buffer and passing them doesn't take a lock, so it's cheap enough to use
+ * for every frame of a video stream. Threads only sleep, on a condition
+ * variable, when the queue is empty (for pop()) or full (for push()).
+ */
+template<class T>
+class SPSCQueue
+{
+public:
+    explicit SPSCQueue(size_t capacity)
+      : m_Items(capacity + 1)
+    {}
+
+    //! Add an item if there's room, without blocking
+    bool tryPush(T &item)
+    {
+        const size_t tail = m_Tail.load(std::memory_order_relaxed);
+        const size_t next = increment(tail);
+        if (next == m_Head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        m_Items[tail] = std::move(item);
+        m_Tail.store(next, std::memory_order_seq_cst);
+        wake(m_PopperWaiting);
+        return true;
+    }
+
+    //! Take the oldest item if there is one, without blocking
+    bool tryPop(T &item)
+    {
+        const size_t head = m_Head.load(std::memory_order_relaxed);
+        if (head == m_Tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        item = std::move(m_Items[head]);
+        m_Head.store(increment(head), std::memory_order_seq_cst);
+        wake(m_PusherWaiting);
+        return true;
+    }
+
+    //! Add an item, waiting for room; returns false if the queue has been closed
+    bool push(T &item)
+    {
+        while (!tryPush(item)) {
+            if (!wait(m_PusherWaiting, [this]() { return !isFull(); })) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //! Take the oldest item, waiting for one; returns false once the queue is closed and empty
+    bool pop(T &item)
+    {
+        while (!tryPop(item)) {
+            if (!wait(m_PopperWaiting, [this]() { return !isEmpty(); })) {
+                return tryPop(item);
+            }
+        }
+        return true;
+    }
+
+    //! Stop both threads waiting; pop() still returns anything left in the queue
+    void close()
+    {
+        std::lock_guard<std::mutex> lock{ m_Mutex };
+        m_Closed = true;
+        m_Changed.notify_all();
+    }
+
+    bool isEmpty() const
+    {
+        return m_Head.load() == m_Tail.load();
+    }
+
+    bool isFull() const
+    {
+        return increment(m_Tail.load()) == m_Head.load();
+    }
+
+    size_t capacity() const
+    {
+        return m_Items.size() - 1;
+    }
+
+private:
+    std::vector<T> m_Items;
+
+    // Kept on separate cache lines, as they're written by different threads
+    std::atomic<size_t> m_Head{ 0 };
+    char m_Padding1[64];
+    std::atomic<size_t> m_Tail{ 0 };
+    char m_Padding2[64];
+
+    std::atomic<bool> m_PusherWaiting{ false }, m_PopperWaiting{ false };
+    std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+    bool m_Closed = false;
+
+    size_t increment(size_t index) const
+    {
+        return (index + 1 == m_Items.size()) ? 0 : index + 1;
+    }
+
+    /*
+     * The waiting flag is set before the waiting thread checks the queue
+     * again and read after the other thread updates it (both sequentially
+     * consistent), so either the waiting thread sees the change or the other
+     * thread sees the flag and wakes it.
+     */
+    template<class Predicate>
+    bool wait(std::atomic<bool> &waiting, const Predicate &ready)
+    {
+        std::unique_lock<std::mutex> lock{ m_Mutex };
+        waiting = true;
+        m_Changed.wait(lock, [&]() { return m_Closed || ready(); });
+        waiting = false;
+        return !m_Closed;
+    }
+
+    void wake(std::atomic<bool> &waiting)
+    {
+        if (waiting) {
+            std::lock_guard<std::mutex> lock{ m_Mutex };
+            m_Changed.notify_all();
+        }
+    }
+}; // SPSCQueue
+} // BoBRobotics
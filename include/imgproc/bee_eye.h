@@ -10,6 +10,9 @@
 // Standard C includes
 #include <cmath>
 
+// Standard C++ includes
+#include <vector>
+
 namespace BoBRobotics {
 namespace ImgProc {
 namespace BeeEye {
@@ -19,44 +22,92 @@ namespace BeeEye {
  *        an input image.
  *
  * This is based on Andy Giger's model.
+ *
+ * The eye model is compiled into a lookup table giving, for each output pixel,
+ * the offset of the input pixel it comes from, with masked pixels and pixels
+ * outside the input already excluded. Transforming an image is then a single
+ * gather pass, which writes into the caller's output image without allocating
+ * once it has the right size and type.
  */
 class Map
 {
 public:
-    //! Create x and y pixel maps
+    //! Create the lookup table for input images of size imageSize
     template<size_t eyeDataLength>
     Map(const float (&eyeData)[eyeDataLength][4], const int (&eyeSize)[2],
         const int (&imageSize)[2], bool useMask = true)
+      : m_InputSize(imageSize[0], imageSize[1])
     {
-        cv::Size sz_out(eyeSize[0], eyeSize[1]);
-        if (useMask) {
-            const auto maskPath = Path::getResourcesPath() / "bee_eye_mask.png";
-            m_Mask = cv::imread(maskPath.str(), cv::IMREAD_GRAYSCALE);
-            BOB_ASSERT(!m_Mask.empty()); // Check file loaded successfully
-            BOB_ASSERT(m_Mask.type() == CV_8UC1);
-            cv::resize(m_Mask, m_Mask, sz_out);
-        }
-
-        m_MapX.create(sz_out, CV_32FC1);
-        m_MapY.create(sz_out, CV_32FC1);
+        // Pixels which the eye model doesn't cover are left black
+        const cv::Size sz_out(eyeSize[0], eyeSize[1]);
+        m_Coordinates = cv::Mat(sz_out, CV_32SC2, cv::Scalar(-1, -1));
+        const auto setCoordinates = [this](float row, float col, float x, float y) {
+            /*
+             * Pixels are indexed linearly, as they always have been, so
+             * columns past the edge of the eye wrap onto the next row
+             */
+            const auto index = static_cast<size_t>(row) * m_Coordinates.cols + static_cast<size_t>(col);
+            if (index < m_Coordinates.total()) {
+                m_Coordinates.ptr<cv::Vec2i>()[index] = { static_cast<int>(x), static_cast<int>(y) };
+            }
+        };
         for (size_t i = 0; i < eyeDataLength; i++) {
             // left eye
-            m_MapX.at<float>(eyeData[i][3], 15 + eyeData[i][2]) = floor(eyeData[i][0]);
-            m_MapY.at<float>(eyeData[i][3], 15 + eyeData[i][2]) = floor(eyeData[i][1]);
+            setCoordinates(eyeData[i][3], 15 + eyeData[i][2],
+                           floor(eyeData[i][0]), floor(eyeData[i][1]));
 
             // right eye
-            m_MapX.at<float>(eyeData[i][3],
-                             720 - 316 - eyeSize[0] - eyeData[i][2]) = imageSize[0] - floor(eyeData[i][0]);
-            m_MapY.at<float>(eyeData[i][3],
-                             720 - 316 - eyeSize[0] - eyeData[i][2]) = floor(eyeData[i][1]);
+            setCoordinates(eyeData[i][3], 720 - 316 - eyeSize[0] - eyeData[i][2],
+                           imageSize[0] - floor(eyeData[i][0]), floor(eyeData[i][1]));
+        }
+
+        if (useMask) {
+            const auto maskPath = Path::getResourcesPath() / "bee_eye_mask.png";
+            cv::Mat mask = cv::imread(maskPath.str(), cv::IMREAD_GRAYSCALE);
+            BOB_ASSERT(!mask.empty()); // Check file loaded successfully
+            BOB_ASSERT(mask.type() == CV_8UC1);
+            cv::resize(mask, mask, sz_out);
+            m_Coordinates.setTo(cv::Scalar(-1, -1), mask);
         }
+
+        createLUT(m_InputSize);
     }
 
-    //! Takes an input image and transforms it with the Giger bee-eye transform
+    /**!
+     * \brief Takes an input image and transforms it with the Giger bee-eye
+     *        transform
+     *
+     * out is only reallocated if it isn't already the size of the eye and
+     * the type of in. Input images should usually be of the size given to the
+     * constructor; other sizes work, but the lookup table has to be rebuilt
+     * whenever the size changes.
+     */
     void getEyeView(const cv::Mat &in, cv::Mat &out);
 
+    /**!
+     * \brief Transforms many images at once, in parallel
+     *
+     * Images are split between threads, rather than each image being split
+     * up, which is more efficient for large numbers of small images. out is
+     * resized to match in and its elements are reused where possible.
+     */
+    void getEyeViews(const std::vector<cv::Mat> &in, std::vector<cv::Mat> &out);
+
+    //! The size of the images produced
+    cv::Size getEyeSize() const;
+
 private:
-    cv::Mat m_MapX, m_MapY, m_Mask;
+    // The input pixel for each output pixel, or (-1, -1) if it should be black
+    cv::Mat m_Coordinates;
+
+    // The same, as offsets into an image of size m_InputSize (-1 if black)
+    cv::Mat m_LUT;
+    cv::Size m_InputSize;
+
+    void createLUT(const cv::Size &inputSize);
+
+    // Look up rows of out in input, which must be continuous
+    void gather(const cv::Mat &input, cv::Mat &out, const cv::Range &rows) const;
 }; // Map
 } // BeeEye
 } // ImgProc
@@ -3,10 +3,15 @@
 // OpenCV
 #include <opencv2/opencv.hpp>
 
+// Standard C includes
+#include <cstdint>
+
 // Standard C++ includes
 #include <algorithm>
+#include <array>
 #include <bitset>
-
+#include <utility>
+#include <vector>
 
 namespace BoBRobotics {
 namespace ImgProc {
@@ -42,6 +47,89 @@ distance(const std::bitset<64> &hash1, const std::bitset<64> &hash2)
     return distance;
 }
 
+/**!
+ * \brief Computes the DCT hashes of many images at once, in parallel
+ *
+ * Gives the same hashes as computeHash(), but only the DCT coefficients which
+ * the hash uses are computed, rather than the whole DCT. Images can be CV_8UC1
+ * or CV_32FC1; as the hash only depends on the relative sizes of coefficients,
+ * 8-bit images needn't be converted to float or rescaled first.
+ *
+ * The coefficients are summed in double precision, whereas cv::dct() works in
+ * float and in a different order, so a coefficient within rounding error of
+ * the median can fall on the other side of it. The hashes are therefore not
+ * guaranteed to be bit-identical to computeHash()'s; in practice they differ
+ * by at most one bit, and only rarely.
+ */
+std::vector<std::bitset<64>>
+computeHashes(const std::vector<cv::Mat> &images);
+
+/**!
+ * \brief Computes hashes of a panoramic image at numRotations evenly spaced
+ *        rotations
+ *
+ * Hash i is for the image rolled leftwards (as by ImgProc::roll()) by
+ * i * image.cols / numRotations pixels. Most of the work is shared between
+ * rotations, so this is much faster than rolling the image and hashing it
+ * for each rotation. As with computeHashes(), a hash may differ from
+ * computeHash()'s for the rolled image by a bit.
+ */
+std::vector<std::bitset<64>>
+computeRotatedHashes(const cv::Mat &image, size_t numRotations);
+
+/**!
+ * \brief Get the smallest distance between hash and any of rotatedHashes (as
+ *        computed by computeRotatedHashes()), along with which rotation it was
+ */
+std::pair<int, size_t>
+rotatedDistance(const std::vector<std::bitset<64>> &rotatedHashes,
+                const std::bitset<64> &hash);
+
+//----------------------------------------------------------------------------
+// BoBRobotics::ImgProc::DCTHash::HashIndex
+//----------------------------------------------------------------------------
+/**!
+ * \brief An index for finding the nearest hashes by Hamming distance, without
+ *        comparing against every hash
+ *
+ * This is a multi-index hash table: each hash is split into four 16-bit
+ * substrings, which are indexed separately. If two hashes are within distance
+ * d, at least one pair of substrings must be within d / 4, so only hashes
+ * sharing a nearby substring need to be compared.
+ */
+class HashIndex
+{
+public:
+    explicit HashIndex(const std::vector<std::bitset<64>> &hashes);
+
+    //! Number of hashes in the index
+    size_t size() const;
+
+    //! Get the k nearest hashes to query as (index, distance) pairs, nearest first
+    std::vector<std::pair<size_t, int>> nearest(const std::bitset<64> &query, size_t k) const;
+
+    //! Get all hashes within maxDistance of query as (index, distance) pairs, nearest first
+    std::vector<std::pair<size_t, int>> withinDistance(const std::bitset<64> &query,
+                                                       int maxDistance) const;
+
+private:
+    static constexpr int NumTables = 4;
+    static constexpr int SubstringBits = 64 / NumTables;
+
+    std::vector<uint64_t> m_Hashes;
+
+    // For each table, the hashes with each substring value, as in a CSR matrix
+    std::array<std::vector<uint32_t>, NumTables> m_Offsets, m_Indices;
+
+    template<class Func>
+    void searchSubstringDistance(uint64_t query, int substringDistance, const Func &func) const;
+
+    static uint16_t getSubstring(uint64_t hash, int table)
+    {
+        return static_cast<uint16_t>(hash >> (table * SubstringBits));
+    }
+}; // HashIndex
+
 } // DCTHash
 } // ImgProc
 } // BoBRobotics
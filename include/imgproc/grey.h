@@ -0,0 +1,24 @@
+#pragma once
+
+// Standard C includes
+#include <cstdint>
+
+namespace BoBRobotics {
+namespace ImgProc {
+/*!
+ * \brief Convert one 8-bit BGR pixel to greyscale
+ *
+ * This uses the same fixed-point weights as cv::cvtColor() with
+ * cv::COLOR_BGR2GRAY, so the result is exactly the same. It's for code which
+ * converts pixels as it goes, rather than in a separate pass over the image.
+ */
+inline uint8_t
+bgrToGrey(uint8_t blue, uint8_t green, uint8_t red)
+{
+    constexpr int Shift = 14;
+    constexpr int BlueWeight = 1868, GreenWeight = 9617, RedWeight = 4899;
+    return static_cast<uint8_t>((blue * BlueWeight + green * GreenWeight + red * RedWeight +
+                                 (1 << (Shift - 1))) >> Shift);
+}
+} // ImgProc
+} // BoBRobotics
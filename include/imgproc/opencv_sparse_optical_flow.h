@@ -0,0 +1,105 @@
+#pragma once
+
+// Third-party includes
+#include "third_party/units.h"
+
+// OpenCV includes
+#include <opencv2/core.hpp>
+
+// Standard C++ includes
+#include <vector>
+
+namespace BoBRobotics {
+namespace ImgProc {
+//----------------------------------------------------------------------------
+// OpenCVSparseOpticalFlow
+//----------------------------------------------------------------------------
+/*!
+ * \brief Sparse optical flow, using pyramidal Lucas-Kanade at a fixed set of
+ *        points
+ *
+ * A much cheaper alternative to OpenCVOpticalFlow's dense Farneback flow, for
+ * when flow is only needed at some points (e.g. on a grid or where an insect
+ * eye's ommatidia would sample). Each frame's image pyramid is kept and used
+ * as the previous frame's for the next one, and all buffers are reused, so
+ * nothing is allocated per frame once the first two frames are in.
+ */
+class OpenCVSparseOpticalFlow
+{
+    using degree_t = units::angle::degree_t;
+
+public:
+    //! Estimated motion of a panoramic camera between two frames
+    struct EgoMotion
+    {
+        //! Rotation, positive if the scene moved rightwards in the image
+        degree_t rotation;
+
+        /*!
+         * \brief Horizontal flow due to forwards translation, in pixels per
+         *        frame at the sides of the panorama
+         *
+         * Only proportional to speed (for a given distance to the scene).
+         */
+        float translation;
+    };
+
+    OpenCVSparseOpticalFlow();
+
+    //! Compute flow at points on an evenly spaced grid of gridSize points
+    OpenCVSparseOpticalFlow(const cv::Size &inputRes, const cv::Size &gridSize,
+                            const cv::Size &winSize = { 9, 9 }, int maxLevel = 2);
+
+    //! Compute flow at the given points
+    OpenCVSparseOpticalFlow(const cv::Size &inputRes, std::vector<cv::Point2f> points,
+                            const cv::Size &winSize = { 9, 9 }, int maxLevel = 2);
+
+    //------------------------------------------------------------------------
+    // Public API
+    //------------------------------------------------------------------------
+    void create(const cv::Size &inputRes, const cv::Size &gridSize,
+                const cv::Size &winSize = { 9, 9 }, int maxLevel = 2);
+    void create(const cv::Size &inputRes, std::vector<cv::Point2f> points,
+                const cv::Size &winSize = { 9, 9 }, int maxLevel = 2);
+
+    //! Returns false for the first frame, as there is nothing to compute flow against
+    bool calculate(const cv::Mat &input);
+
+    void render(cv::Mat &outputImage, int scale) const;
+
+    //! The points flow is computed at
+    const std::vector<cv::Point2f> &getPoints() const;
+
+    //! Flow vector for each point
+    const std::vector<cv::Point2f> &getFlow() const;
+
+    //! Whether the flow for each point could be found
+    const std::vector<uchar> &getStatus() const;
+
+    /*!
+     * \brief Estimate rotation and forwards translation from the horizontal
+     *        flow, for panoramic images
+     *
+     * Assumes that the centre of the image is straight ahead and that the
+     * image covers 360 degrees. Rotation gives the same flow everywhere,
+     * whereas forwards translation gives flow proportional to the sine of
+     * the azimuth, so the two are separated with a least-squares fit.
+     */
+    EgoMotion estimateEgoMotion() const;
+
+private:
+    //------------------------------------------------------------------------
+    // Members
+    //------------------------------------------------------------------------
+    cv::Size m_InputRes;
+    cv::Size m_WinSize;
+    int m_MaxLevel;
+    unsigned int m_Frame;
+
+    std::vector<cv::Mat> m_Pyramids[2];
+    std::vector<cv::Point2f> m_Points, m_NextPoints, m_Flow;
+    std::vector<uchar> m_Status;
+    std::vector<float> m_Error;
+}; // OpenCVSparseOpticalFlow
+}  // ImgProc
+}  // BoBRobotics
@@ -1,18 +1,23 @@
 #pragma once
 
 // Standard C++ includes
+#include <memory>
 #include <string>
+#include <vector>
 
 // OpenCV includes
 #include <opencv2/core.hpp>
 
 // Third-party includes
+#include "third_party/path.h"
 #include "third_party/units.h"
 
 //----------------------------------------------------------------------------
 // BoBRobotics::ImgProc::OpenCVUnwrap360
 //----------------------------------------------------------------------------
 namespace BoBRobotics {
+class MemoryMappedFile;
+
 namespace ImgProc {
 using namespace units::literals;
 
@@ -52,6 +57,35 @@ public:
 
     void unwrap(const cv::Mat &input, cv::Mat &output) const;
 
+    //! Unwrap input and convert it to greyscale in a single pass
+    void unwrapGreyscale(const cv::Mat &input, cv::Mat &output) const;
+
+    /**!
+     * \brief Unwrap input, resize to size and apply colourConversion (e.g.
+     *        cv::COLOR_BGR2GRAY) in a single pass
+     *
+     * The result is the same as calling unwrap(), cv::cvtColor() and
+     * cv::resize() with cv::INTER_NEAREST in turn. An empty size means the
+     * unwrapped resolution and a colourConversion of -1 means no conversion.
+     * 8-bit images with one, three or four channels and conversions to
+     * greyscale are done in one pass; anything else falls back on doing each
+     * step separately.
+     */
+    void unwrapTo(const cv::Mat &input, cv::Mat &output,
+                  const cv::Size &size, int colourConversion = -1) const;
+
+    /**!
+     * \brief Get the offset (in pixels) into the camera image of each
+     *        unwrapped pixel's source, or -1 if it has none
+     *
+     * A CV_32SC1 matrix of the unwrapped resolution, for other code which
+     * wants to unwrap images as it produces them.
+     */
+    const cv::Mat &getUnwrapLUT() const;
+
+    //! The resolution of the camera images which getUnwrapLUT() indexes into
+    const cv::Size &getCameraResolution() const;
+
     //! Serialise this object.
     void write(cv::FileStorage &fs) const;
 
@@ -62,6 +96,19 @@ public:
      */
     void read(const cv::FileNode &node);
 
+    /**!
+     * \brief Set a directory in which to cache unwrap maps, so they needn't be
+     *        regenerated each time an unwrapper is created
+     *
+     * Cached maps are memory mapped, so loading them is almost free. Files are
+     * keyed by the resolutions and the parameters saved by write(). Pass an
+     * empty path to disable the cache. The default is $BOB_UNWRAP_MAP_CACHE_PATH
+     * if set, otherwise disabled. Set this before creating any unwrappers.
+     */
+    static void setMapCacheDirectory(filesystem::path directory);
+
+    static const filesystem::path &getMapCacheDirectory();
+
     // Public members
     cv::Point m_CentrePixel;
     int m_InnerPixel = 0, m_OuterPixel = 0;
@@ -74,10 +121,23 @@ private:
     //------------------------------------------------------------------------
     cv::Size m_CameraResolution;
     cv::Size m_UnwrappedResolution;
-    cv::Mat m_UnwrapMapX;
-    cv::Mat m_UnwrapMapY;
+
+    // Nearest source pixel for each unwrapped pixel, in cv::remap's fixed-point format
+    cv::Mat m_UnwrapMap;
+
+    // The same, as offsets in pixels into the source image (-1 if outside it)
+    cv::Mat m_UnwrapLUT;
+
+    // The index of each unwrapped column, for unwrapTo() when it isn't resizing
+    std::vector<int> m_UnwrappedColumns;
+
+    // If the maps were loaded from the cache, they point into this file
+    std::shared_ptr<MemoryMappedFile> m_MapFile;
 
     void createMaps();
+    std::string getMapCacheKey() const;
+    bool loadMaps(const filesystem::path &filePath, const std::string &key);
+    void saveMaps(const filesystem::path &filePath, const std::string &key) const;
 }; // OpenCVUnwrap360
 
 void
@@ -5,6 +5,7 @@
 #include "common/path.h"
 #include "common/pose.h"
 #include "common/string.h"
+#include "navigation/packed_image_database.h"
 
 // Third-party includes
 #include "plog/Log.h"
@@ -22,19 +23,35 @@
 
 // Standard C++ includes
 #include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <iterator>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace BoBRobotics {
+namespace ImgProc {
+class OpenCVUnwrap360;
+}
+
 namespace Navigation {
 using namespace units::literals;
 
+class ImageDatabaseIndex;
+
 //------------------------------------------------------------------------
 // BoBRobotics::Navigation::Range
 //------------------------------------------------------------------------
@@ -82,31 +99,106 @@ class ImageDatabase
     using hertz_t = units::frequency::hertz_t;
 
 public:
-    //! The metadata for an entry in an ImageDatabase
+    /*!
+     * \brief File names and extra field values for all the entries in a
+     *        database, stored column by column
+     *
+     * Each distinct string is only stored once, so that e.g. an extra field
+     * which only takes a few values costs an index per entry.
+     */
+    struct EntryStrings
+    {
+        //! Folder containing image files
+        filesystem::path directory;
+
+        //! Set for databases loaded from a single .bobdb file
+        std::shared_ptr<const PackedImageDatabase> packedDatabase;
+
+        //! Index of each entry's file name (empty for video-type databases)
+        std::vector<uint32_t> fileNames;
+
+        std::vector<std::string> extraFieldNames;
+
+        //! One column of string indices per extra field
+        std::vector<std::vector<uint32_t>> extraFields;
+
+        //! Store a string, if it isn't stored already, returning its index
+        uint32_t intern(const std::string &str);
+
+        const std::string &get(uint32_t index) const { return *m_Strings[index]; }
+
+        //! Get the column index of an extra field or -1 if not present
+        int findExtraField(const std::string &name) const;
+
+    private:
+        // Map nodes don't move, so we can keep pointers to the keys
+        std::unordered_map<std::string, uint32_t> m_Index;
+        std::vector<const std::string *> m_Strings;
+    };
+
+    /*!
+     * \brief The metadata for an entry in an ImageDatabase
+     *
+     * Entries are small and trivially copyable: strings are kept in the
+     * ImageDatabase's EntryStrings, so an Entry must not outlive its database.
+     */
     struct Entry
     {
         Vector3<millimeter_t> position = Vector3<millimeter_t>::nan();
         degree_t heading{ NAN };
-        filesystem::path path;
         std::array<size_t, 3> gridPosition; //! For grid-type databases, indicates the x,y,z grid position
-        std::unordered_map<std::string, std::string> extraFields;
+
+        //! Where this entry's strings are stored
+        const EntryStrings *strings = nullptr;
+        size_t index = 0;
 
         cv::Mat load(bool greyscale = true) const;
+
+        //! Get the path of this entry's image file (empty for video-type databases)
+        filesystem::path getPath() const;
+
         bool hasExtraField(const std::string &name) const;
         const std::string &getExtraField(const std::string &name) const;
     };
 
+    //! Writes a frame to a file (or to a video, ignoring the path)
+    using WriteFunc = std::function<void(const filesystem::path &, const cv::Mat &)>;
+
     class FrameWriter {
     public:
         virtual std::string getCurrentFilenameRoot() const = 0;
-        virtual void writeFrame(const cv::Mat &frame, Entry &entry) = 0;
+
+        //! Write a frame, returning the name of the new file, if any
+        virtual std::string writeFrame(const cv::Mat &frame) = 0;
+
+        /**!
+         * \brief Check whether the next frame can be written
+         *
+         * Recorders skip frames when this is false, which only happens with
+         * writers which drop frames rather than blocking when busy.
+         */
+        virtual bool canWriteFrame() { return true; }
+
+        //! Wait until all frames have been written
+        virtual void flush() {}
     };
 
     class ImageFileWriter
       : public FrameWriter {
     public:
+        //! writeFrameTo() can be called from several threads at once
+        static constexpr bool IsThreadSafe = true;
+
         ImageFileWriter(const ImageDatabase &, std::string imageFormat);
-        void writeFrame(const cv::Mat &frame, Entry &entry) override;
+        std::string writeFrame(const cv::Mat &frame) override;
+
+        //! Get the path that the next frame would be written to
+        filesystem::path getNextFilePath() const;
+
+        static void writeFrameTo(const filesystem::path &path, const cv::Mat &frame);
+
+        //! Get a function for writing frames which doesn't refer to this object
+        WriteFunc getWriteFunc() const { return &writeFrameTo; }
 
     private:
         const std::string m_ImageFormat;
@@ -115,16 +207,143 @@ public:
     class VideoFileWriter
       : public FrameWriter {
     public:
+        //! Frames have to be written one at a time and in order
+        static constexpr bool IsThreadSafe = false;
+
         VideoFileWriter(const ImageDatabase &,
                         const std::pair<const std::string &, const std::string &> &format);
-        void writeFrame(const cv::Mat &frame, Entry &entry) override;
+        std::string writeFrame(const cv::Mat &frame) override;
         const std::string &getVideoFileName() const;
 
+        //! Frames are all written to the video file, so this is empty
+        filesystem::path getNextFilePath() const { return {}; }
+
+        //! Get a function for writing frames, which shares this object's video file
+        WriteFunc getWriteFunc() const;
+
     private:
-        cv::VideoWriter m_Writer;
+        std::shared_ptr<cv::VideoWriter> m_Writer;
         const std::string m_FileName;
     };
 
+    //! Options for AsyncFrameWriter
+    struct AsyncWriterOptions
+    {
+        //! Number of threads encoding frames (always one for video files)
+        size_t numThreads = 2;
+
+        //! Maximum number of frames waiting to be encoded
+        size_t maxQueueLength = 16;
+
+        //! If the queue is full, drop new frames instead of waiting
+        bool dropWhenFull = false;
+    };
+
+    struct AsyncWriterStatistics
+    {
+        size_t framesQueued = 0;
+        size_t framesWritten = 0;
+        size_t framesDropped = 0;
+        size_t maxQueueLength = 0;
+
+        //! Total time spent waiting for room in a full queue
+        std::chrono::nanoseconds timeBlocked{ 0 };
+    };
+
+    /**!
+     * \brief A queue of frames being written by a pool of worker threads
+     *
+     * Frames are copied into recycled buffers, so after the first few frames
+     * no memory is allocated. Errors on worker threads are rethrown on the
+     * next call to push() or finish().
+     */
+    class AsyncFrameQueue
+    {
+    public:
+        AsyncFrameQueue(WriteFunc write, const AsyncWriterOptions &options);
+        ~AsyncFrameQueue();
+
+        //! Check whether there is room to push a frame, counting it as dropped if not
+        bool canPush();
+
+        //! Copy frame into the queue, blocking if the queue is full
+        void push(filesystem::path path, const cv::Mat &frame);
+
+        //! Wait for queued frames to be written and stop worker threads
+        void finish();
+
+        AsyncWriterStatistics getStatistics() const;
+
+    private:
+        struct Job
+        {
+            filesystem::path path;
+            cv::Mat frame;
+        };
+
+        const WriteFunc m_Write;
+        const AsyncWriterOptions m_Options;
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_QueueNotEmpty, m_QueueNotFull;
+        std::deque<Job> m_Queue;
+        std::vector<cv::Mat> m_FreeBuffers;
+        std::vector<std::thread> m_Threads;
+        AsyncWriterStatistics m_Statistics;
+        std::exception_ptr m_Error;
+        bool m_Stopping = false;
+
+        void runWorker();
+        void stop();
+        void rethrowError();
+    };
+
+    /**!
+     * \brief Wraps ImageFileWriter or VideoFileWriter so that frames are
+     *        encoded on background threads
+     *
+     * The file name for each frame is still chosen on the recording thread,
+     * so entries are saved in the order they were recorded. Recorder::save()
+     * waits for all frames to be written.
+     */
+    template<class FrameWriterType>
+    class AsyncFrameWriter
+      : public FrameWriterType {
+    public:
+        template<class Format>
+        AsyncFrameWriter(const ImageDatabase &database,
+                         const std::pair<Format, AsyncWriterOptions> &format)
+          : FrameWriterType(database, format.first)
+          , m_Queue(std::make_shared<AsyncFrameQueue>(this->getWriteFunc(),
+                                                      getOptions(format.second)))
+        {}
+
+        std::string writeFrame(const cv::Mat &frame) override
+        {
+            auto path = this->getNextFilePath();
+            std::string fileName = path.empty() ? "" : path.filename();
+            m_Queue->push(std::move(path), frame);
+            return fileName;
+        }
+
+        bool canWriteFrame() override { return m_Queue->canPush(); }
+
+        void flush() override { m_Queue->finish(); }
+
+        AsyncWriterStatistics getStatistics() const { return m_Queue->getStatistics(); }
+
+    private:
+        // Shared so that recorders can be returned by value
+        std::shared_ptr<AsyncFrameQueue> m_Queue;
+
+        static AsyncWriterOptions getOptions(AsyncWriterOptions options)
+        {
+            if (!FrameWriterType::IsThreadSafe) {
+                options.numThreads = 1;
+            }
+            return options;
+        }
+    };
+
     //! Base class for GridRecorder and RouteRecorder
     template<class FrameWriterType>
     class Recorder
@@ -134,7 +353,12 @@ public:
         ~Recorder()
         {
             if (m_Recording) {
-                save();
+                // We can't throw from a destructor
+                try {
+                    save();
+                } catch (std::exception &e) {
+                    LOG_ERROR << "Could not save image database: " << e.what();
+                }
             }
         }
 
@@ -147,6 +371,9 @@ public:
         //! Save new metadata
         void save()
         {
+            // Make sure all the frames have actually been written
+            this->flush();
+
             // Write metadata to file
             {
                 m_YAML << "}";
@@ -158,7 +385,8 @@ public:
                 ofs << m_YAML.releaseAndGetString();
             }
 
-            m_ImageDatabase.addNewEntries(m_NewEntries, m_ExtraFieldNames);
+            m_ImageDatabase.addNewEntries(m_NewEntries, m_NewFileNames,
+                                          m_NewExtraFieldValues, m_ExtraFieldNames);
             m_Recording = false;
         }
 
@@ -170,6 +398,10 @@ public:
         ImageDatabase &m_ImageDatabase;
         bool m_Recording;
         std::vector<Entry> m_NewEntries;
+        std::vector<std::string> m_NewFileNames;
+
+        // Values for extra fields, entry by entry
+        std::vector<std::string> m_NewExtraFieldValues;
 
     protected:
         cv::FileStorage m_YAML;
@@ -185,6 +417,9 @@ public:
           , m_Recording(true)
           , m_YAML(".yml", cv::FileStorage::WRITE | cv::FileStorage::MEMORY)
         {
+            // Packed databases are read-only
+            BOB_ASSERT(!imageDatabase.isPacked());
+
             // Set this property of the ImageDatabase
             imageDatabase.m_IsRoute = isRoute;
 
@@ -226,15 +461,18 @@ public:
             BOB_ASSERT(numExtraFields == m_ExtraFieldNames.size());
             BOB_ASSERT(m_Recording);
 
+            // Asynchronous writers may drop frames when they're busy
+            if (!this->canWriteFrame()) {
+                return;
+            }
+
             Entry newEntry{
                 position,
                 heading,
-                "",
-                gridPosition,
-                {}
+                gridPosition
             };
-            this->writeFrame(image, newEntry);
-            m_NewEntries.emplace_back(std::move(newEntry));
+            m_NewFileNames.emplace_back(this->writeFrame(image));
+            m_NewEntries.emplace_back(newEntry);
 
             setExtraFields(std::forward<Ts>(extraFieldValues)...);
         }
@@ -247,8 +485,8 @@ public:
         template<class... Ts>
         void setExtraFields(std::string value, Ts&&... otherValues)
         {
-            const auto &key = *(m_ExtraFieldNames.cend() - 1 - sizeof...(otherValues));
-            m_NewEntries.back().extraFields.emplace(key, std::move(value));
+            // Values are given in the same order as m_ExtraFieldNames
+            m_NewExtraFieldValues.emplace_back(std::move(value));
             setExtraFields(std::forward<Ts>(otherValues)...);
         }
 
@@ -367,6 +605,117 @@ public:
         }
     };
 
+    /**!
+     * \brief Streams images from an ImageDatabase in order, decoding them on
+     *        background threads
+     *
+     * No more than readAhead frames are held in memory at once, counting ones
+     * the caller hasn't released yet, so databases too big to load with
+     * loadImages() can still be processed, with decoding overlapping whatever
+     * the caller does with the frames. Get one with ImageDatabase::stream().
+     * It must not outlive its database.
+     */
+    class ImageStream
+    {
+        struct State;
+
+    public:
+        //! A decoded frame, whose buffer is reused once it is released
+        class Frame
+        {
+        public:
+            Frame() = default;
+            Frame(Frame &&) = default;
+            Frame &operator=(Frame &&other);
+            ~Frame();
+
+            //! Index of the frame, counting in steps of frameSkip as for forEachImage()
+            size_t getIndex() const;
+
+            //! The image, which is only valid until the frame is released
+            const cv::Mat &getImage() const;
+
+            //! Give the frame's buffer back to the stream
+            void release();
+
+            explicit operator bool() const { return static_cast<bool>(m_State); }
+
+        private:
+            std::shared_ptr<State> m_State;
+            size_t m_Index = 0;
+
+            Frame(std::shared_ptr<State> state, size_t index);
+            friend class ImageStream;
+        };
+
+        /**!
+         * \brief Input iterator over the frames of a stream
+         *
+         * Each frame is released when the iterator is advanced, unless it has
+         * been moved out of the iterator.
+         */
+        class iterator
+        {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = Frame;
+            using difference_type = std::ptrdiff_t;
+            using pointer = Frame *;
+            using reference = Frame &;
+
+            iterator() = default;
+
+            explicit iterator(ImageStream &stream)
+              : m_Stream(&stream)
+              , m_Frame(stream.next())
+              , m_End(!m_Frame)
+            {}
+
+            Frame &operator*() { return m_Frame; }
+            Frame *operator->() { return &m_Frame; }
+
+            iterator &operator++()
+            {
+                m_Frame.release();
+                m_Frame = m_Stream->next();
+                m_End = !m_Frame;
+                return *this;
+            }
+
+            bool operator==(const iterator &other) const { return m_End == other.m_End; }
+            bool operator!=(const iterator &other) const { return m_End != other.m_End; }
+
+        private:
+            ImageStream *m_Stream = nullptr;
+            Frame m_Frame;
+            bool m_End = true;
+        };
+
+        ImageStream(const ImageDatabase &database, const cv::Size &size,
+                    size_t frameSkip, bool greyscale, size_t readAhead);
+        ImageStream(ImageStream &&) = default;
+        ~ImageStream();
+
+        /**!
+         * \brief Get the next frame, waiting for it to be decoded
+         *
+         * Returns an empty Frame at the end of the stream. Throws if all the
+         * buffers are held by unreleased frames, as none could be decoded.
+         */
+        Frame next();
+
+        //! Total number of frames in the stream
+        size_t size() const;
+
+        iterator begin() { return iterator{ *this }; }
+        iterator end() { return {}; }
+
+    private:
+        std::shared_ptr<State> m_State;
+        std::vector<std::thread> m_Threads;
+        size_t m_NextIndex = 0;
+    };
+
     ImageDatabase();
     ImageDatabase(const char *databasePath, bool overwrite = false);
     ImageDatabase(const std::string &databasePath, bool overwrite = false);
@@ -405,6 +754,16 @@ public:
     void loadImages(std::vector<cv::Mat> &images, const cv::Size &size = {},
                     size_t frameSkip = 1, bool greyscale = true) const;
 
+    /**!
+     * \brief Stream images from this database in order, decoding up to
+     *        readAhead frames in advance on background threads
+     *
+     * Unlike loadImages(), memory use is bounded by readAhead, however big the
+     * database is.
+     */
+    ImageStream stream(const cv::Size &size = {}, size_t frameSkip = 1,
+                       bool greyscale = true, size_t readAhead = 16) const;
+
     //! Access the metadata for this database via OpenCV's persistence API
     cv::FileNode getMetadata() const;
 
@@ -425,6 +784,15 @@ public:
     RouteRecorder<ImageFileWriter> getRouteRecorder(std::string imageFormat = "png",
                                                     std::vector<std::string> extraFieldNames = {});
 
+    /**!
+     * \brief Start recording a route, encoding images on background threads
+     *        so that recording doesn't block
+     */
+    RouteRecorder<AsyncFrameWriter<ImageFileWriter>>
+    getAsyncRouteRecorder(const AsyncWriterOptions &options,
+                          std::string imageFormat = "png",
+                          std::vector<std::string> extraFieldNames = {});
+
     /**!
      * \brief Start recording a route, saving images into video file using
      *        default AVI/MJPEG format.
@@ -448,6 +816,25 @@ public:
     //! Check if this database has any saved metadata (yet)
     bool hasMetadata() const;
 
+    //! Check if this database was loaded from a single packed (.bobdb) file
+    bool isPacked() const;
+
+    //! Get the names of user-defined fields, in the order they are saved
+    const std::vector<std::string> &getExtraFieldNames() const;
+
+    //! Get the paths of all the files this database was loaded from
+    std::vector<filesystem::path> getSourceFiles() const;
+
+    /**!
+     * \brief Get a spatial index of the entries, for finding the ones nearest
+     *        to a given position
+     *
+     * The index is built the first time it is needed and saved alongside the
+     * database for next time. Adding entries to the database means a new index
+     * is built, but the one returned stays valid for as long as it's held.
+     */
+    std::shared_ptr<const ImageDatabaseIndex> getIndex() const;
+
     template<class Func>
     void forEachImage(const Func &func, size_t frameSkip = 1,
                       bool greyscale = true) const
@@ -470,44 +857,105 @@ public:
             return;
         }
 
-        // ...otherwise we have a video file
-        cv::VideoCapture cap{ m_VideoFilePath.str() };
-        BOB_ASSERT(cap.isOpened());
+        /*
+         * ...otherwise we have a video file, which we split into chunks
+         * starting at keyframes and decode in parallel. Each chunk gets its
+         * own cv::VideoCapture, which only seeks once.
+         */
+        const auto chunks = getVideoChunks(frameSkip);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, chunks.size() - 1, 1),
+                          [&](const auto &r) {
+            cv::VideoCapture cap;
+            cv::Mat img;
+            for (size_t c = r.begin(); c != r.end(); ++c) {
+                openVideoAt(cap, chunks[c] * frameSkip);
+                for (size_t i = chunks[c]; i < chunks[c + 1]; i++) {
+                    BOB_ASSERT(cap.read(img));
+
+                    if (greyscale) {
+                        cv::cvtColor(img, img, cv::COLOR_BGR2GRAY);
+                    }
+
+                    func(i, img);
+
+                    // Seeking is much slower than skipping frames within a chunk
+                    for (size_t j = 1; j < frameSkip && cap.grab(); j++)
+                        ;
+                }
+            }
+        });
+    }
 
-        cv::Mat img;
-        for (size_t i = 0; i < m_Entries.size() / frameSkip; i++) {
-            BOB_ASSERT(cap.read(img));
+    /**!
+     *  \brief Get the indices of the keyframes in a video-type database's
+     *         video file
+     *
+     * The table is built the first time it is needed, which means reading
+     * through the whole file, and saved next to the video file for next time.
+     */
+    std::shared_ptr<const std::vector<size_t>> getVideoKeyframes() const;
 
-            if (greyscale) {
-                cv::cvtColor(img, img, cv::COLOR_BGR2GRAY);
-            }
+    //! Check if this database's frames are stored in a video file
+    bool hasVideoFile() const;
 
-            func(i, img);
+    //! Open a video-type database's video file, ready to read the given frame
+    void openVideoAt(cv::VideoCapture &cap, size_t frame) const;
 
-            /*
-             * It is possible to explicitly jump to a given frame with OpenCV,
-             * but that turns out to be reeeeeeeaaaally slow.
-             */
-            for (size_t j = 1; j < frameSkip && cap.grab(); j++)
-                ;
-        }
-    }
+    //! Thread settings for unwrap()
+    struct PipelineOptions
+    {
+        //! Number of threads to use (zero for one per core)
+        size_t numThreads = 0;
+
+        //! Maximum number of frames being processed at once (zero for four per thread)
+        size_t maxFramesInFlight = 0;
+    };
 
     /**!
      *  \brief Unwrap all the panoramic images in this database into a new
      *         folder, creating a new database.
+     *
+     * Frames are decoded, unwrapped and saved in a pipeline, so that all of
+     * these stages run at the same time, even for video files.
      */
     void unwrap(const filesystem::path &destination,
                 const cv::Size &unwrapRes,
                 size_t frameSkip = 1,
                 bool greyscale = false) const;
 
+    //! Unwrap images into a new database, with custom thread settings
+    void unwrap(const filesystem::path &destination,
+                const cv::Size &unwrapRes,
+                size_t frameSkip,
+                bool greyscale,
+                const PipelineOptions &options) const;
+
+    /**!
+     *  \brief Pack this database into a single .bobdb file
+     *
+     * With FrameFormat::Encoded, image files are copied into the packed file
+     * unchanged and frames from video files are saved as PNGs.
+     */
+    void pack(const filesystem::path &filePath,
+              PackedImageDatabase::FrameFormat frameFormat = PackedImageDatabase::FrameFormat::Encoded) const;
+
+    /**!
+     *  \brief Save this database as a folder of image files, e.g. to convert
+     *         a packed or video-type database into an ordinary one
+     */
+    void unpack(const filesystem::path &destination,
+                const std::string &imageFormat = "png",
+                bool greyscale = false) const;
+
     //! Return true if fn1 should be sorted before fn2
     static bool fileNameCompare(const std::string &fn1, const std::string &fn2);
 
 private:
     filesystem::path m_Path, m_VideoFilePath;
     std::vector<Entry> m_Entries;
+    std::shared_ptr<EntryStrings> m_EntryStrings;
+    mutable std::shared_ptr<const std::vector<size_t>> m_VideoKeyframes;
+    mutable std::shared_ptr<const ImageDatabaseIndex> m_Index;
     std::unique_ptr<cv::FileStorage> m_MetadataYAML;
     cv::Size m_Resolution;
     std::tm m_CreationTime;
@@ -521,13 +969,34 @@ private:
                   bool overwrite);
 
     void generateUnwrapCSV(const filesystem::path &destination, size_t frameSkip) const;
+    std::string getMetadataText(bool skipVideoFile) const;
     void loadMetadata();
+    void parseMetadata(const std::string &yaml);
     bool loadCSV();
+    void loadPacked();
     bool readDirectoryEntries();
     void writeImage(const std::string &filename, const cv::Mat &image) const;
 
-    void addNewEntries(std::vector<Entry> &newEntries,
+    void addNewEntries(const std::vector<Entry> &newEntries,
+                       const std::vector<std::string> &newFileNames,
+                       const std::vector<std::string> &newExtraFieldValues,
                        const std::vector<std::string> &extraFieldNames);
+    void resizeEntries(size_t size);
+
+    filesystem::path getVideoKeyframesPath() const;
+    filesystem::path getIndexPath() const;
+    std::vector<size_t> loadVideoKeyframes() const;
+    bool findVideoKeyframes(std::vector<size_t> &keyframes) const;
+    std::vector<size_t> getVideoChunks(size_t frameSkip) const;
+    void unwrapImages(const filesystem::path &destination,
+                      const ImgProc::OpenCVUnwrap360 &unwrapper,
+                      size_t frameSkip, bool greyscale,
+                      const PipelineOptions &options) const;
+    void writeEntriesCSV(const filesystem::path &path,
+                         const std::vector<std::string> &fileNames) const;
 }; // ImageDatabase
+
+static_assert(std::is_trivially_copyable<ImageDatabase::Entry>::value,
+              "ImageDatabase::Entry should be trivially copyable");
 } // Navigation
 } // BoB robotics
@@ -0,0 +1,96 @@
+#pragma once
+
+// BoB robotics includes
+#include "imgproc/opencv_unwrap_360.h"
+#include "navigation/image_database.h"
+
+// Third-party includes
+#include "third_party/path.h"
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+
+// Standard C includes
+#include <cstdint>
+
+// Standard C++ includes
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Navigation {
+//------------------------------------------------------------------------
+// BoBRobotics::Navigation::ImageDatabaseCache
+//------------------------------------------------------------------------
+/*!
+ * \brief An on-disk cache of images derived from ImageDatabases (resized,
+ *        greyscale, unwrapped etc.)
+ *
+ * The first time a given set of images is requested it is generated from the
+ * database as usual and saved as a raw PackedImageDatabase file. Later
+ * requests are served from the memory-mapped file, skipping decoding and
+ * processing altogether.
+ *
+ * Files are named after a hash of everything which affects their contents:
+ * the database, the parameters used and the size and modification time of
+ * the database's files. Changing any of these means a new file is generated;
+ * old files are eventually removed when the cache grows too big, least
+ * recently used first. Temporary files left behind by processes which died
+ * while saving an entry are removed once they are an hour old.
+ */
+class ImageDatabaseCache
+{
+public:
+    static constexpr uint64_t DefaultMaxSize = 4ULL << 30; // 4 GiB
+
+    ImageDatabaseCache(filesystem::path directory = getDefaultDirectory(),
+                       uint64_t maxSize = DefaultMaxSize);
+
+    //! Like ImageDatabase::loadImages(), but cached
+    std::vector<cv::Mat> loadImages(const ImageDatabase &database,
+                                    const cv::Size &size = {},
+                                    size_t frameSkip = 1,
+                                    bool greyscale = true);
+
+    //! Load images from database, unwrapped with unwrapper, caching the result
+    std::vector<cv::Mat> loadUnwrapped(const ImageDatabase &database,
+                                       const ImgProc::OpenCVUnwrap360 &unwrapper,
+                                       size_t frameSkip = 1,
+                                       bool greyscale = true);
+
+    const filesystem::path &getDirectory() const;
+
+    //! Total size of the files in the cache (including any temporary files), in bytes
+    uint64_t getSize() const;
+
+    //! Remove all files from the cache, except temporary files which may still be being written
+    void clear();
+
+    /**!
+     * \brief Get the default cache directory
+     *
+     * This is $BOB_IMAGE_CACHE_PATH if set, otherwise a bob_robotics folder in
+     * the user's cache directory.
+     */
+    static filesystem::path getDefaultDirectory();
+
+private:
+    using DeriveFunc = std::function<void(const cv::Mat &, cv::Mat &)>;
+
+    const filesystem::path m_Directory;
+    const uint64_t m_MaxSize;
+
+    std::vector<cv::Mat> load(const ImageDatabase &database,
+                              const std::string &parameters,
+                              size_t frameSkip, bool greyscale,
+                              const DeriveFunc &derive);
+    bool tryLoad(const filesystem::path &filePath, const std::string &key,
+                 bool greyscale, std::vector<cv::Mat> &images) const;
+    void save(const filesystem::path &filePath, const std::string &key,
+              const ImageDatabase &database, size_t frameSkip,
+              const std::vector<cv::Mat> &images) const;
+    void evict(const filesystem::path &keep) const;
+}; // ImageDatabaseCache
+} // Navigation
+} // BoBRobotics
@@ -0,0 +1,99 @@
+#pragma once
+
+// BoB robotics includes
+#include "common/pose.h"
+#include "navigation/image_database.h"
+
+// Third-party includes
+#include "third_party/path.h"
+#include "third_party/units.h"
+
+// Standard C includes
+#include <cstdint>
+
+// Standard C++ includes
+#include <array>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Navigation {
+//------------------------------------------------------------------------
+// BoBRobotics::Navigation::ImageDatabaseIndex
+//------------------------------------------------------------------------
+/*!
+ * \brief A k-d tree over the positions of the entries in an ImageDatabase,
+ *        for finding entries near a given point in O(log N) time
+ *
+ * Entries without a position (e.g. routes recorded without GPS) are left out.
+ * If the z coordinate of a query point is NaN, only x and y are used, so 2D
+ * queries work for any database.
+ *
+ * Usually you'd get one of these with ImageDatabase::getIndex(), which caches
+ * the tree next to the database.
+ */
+class ImageDatabaseIndex
+{
+    using degree_t = units::angle::degree_t;
+    using millimeter_t = units::length::millimeter_t;
+
+public:
+    explicit ImageDatabaseIndex(const std::vector<ImageDatabase::Entry> &entries);
+
+    //! Number of entries in the index
+    size_t size() const;
+
+    /**!
+     * \brief Get the indices of the k entries nearest to position, nearest
+     *        first
+     */
+    std::vector<size_t> nearest(const Vector3<millimeter_t> &position, size_t k = 1) const;
+
+    /**!
+     * \brief Get the indices of the k entries nearest to position, whose
+     *        headings are within maxHeadingDifference of heading
+     */
+    std::vector<size_t> nearest(const Vector3<millimeter_t> &position, size_t k,
+                                degree_t heading, degree_t maxHeadingDifference) const;
+
+    //! Get the indices of all entries within radius of position, nearest first
+    std::vector<size_t> withinRadius(const Vector3<millimeter_t> &position,
+                                     millimeter_t radius) const;
+
+    //! Save the tree, so it needn't be rebuilt next time
+    void save(const filesystem::path &filePath) const;
+
+    /**!
+     * \brief Load a tree saved with save(), if it matches these entries
+     *
+     * Returns nullptr if the file doesn't exist or is for different entries.
+     */
+    static std::unique_ptr<ImageDatabaseIndex> load(const filesystem::path &filePath,
+                                                    const std::vector<ImageDatabase::Entry> &entries);
+
+private:
+    struct Point
+    {
+        std::array<double, 3> position; // In mm
+        double heading;                 // In degrees
+        size_t index;                   // Into the database's entries
+        uint8_t splitAxis;              // For the node centred on this point
+    };
+
+    struct Query;
+
+    // Points in tree order: each node is the median of its range
+    std::vector<Point> m_Points;
+    uint64_t m_Hash;
+
+    ImageDatabaseIndex(std::vector<Point> points, uint64_t hash);
+    void build(size_t begin, size_t end);
+    void search(size_t begin, size_t end, Query &query) const;
+
+    static std::vector<Point> getPoints(const std::vector<ImageDatabase::Entry> &entries,
+                                        uint64_t &hash);
+    static const char *getMagic() { return "BoBIndex"; }
+}; // ImageDatabaseIndex
+} // Navigation
+} // BoBRobotics
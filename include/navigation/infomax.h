@@ -2,11 +2,13 @@
 
 // BoB robotics includes
 #include "common/macros.h"
+#include "common/memory_mapped_file.h"
 #include "imgproc/mask.h"
 #include "navigation/insilico_rotater.h"
 
 // Third-party includes
 #include "plog/Log.h"
+#include "third_party/path.h"
 #include "third_party/units.h"
 
 // Eigen
@@ -17,11 +19,16 @@
 
 // Standard C includes
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 
 // Standard C++ includes
 #include <algorithm>
 #include <exception>
+#include <fstream>
+#include <memory>
 #include <random>
+#include <stdexcept>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -32,6 +39,42 @@ class WeightsBlewUpError
   : std::exception
 {};
 
+//------------------------------------------------------------------------
+// BoBRobotics::Navigation::InfoMaxFileHeader
+//------------------------------------------------------------------------
+/*!
+ * \brief Header at the start of a file written by InfoMax::serialise()
+ *
+ * The weight matrix follows at payloadOffset, which is always a multiple of
+ * InfoMaxFileHeader::PayloadAlignment, stored in Eigen's (column-major) order.
+ */
+struct InfoMaxFileHeader
+{
+    static constexpr uint32_t CurrentVersion = 1;
+    static constexpr uint32_t ByteOrderMark = 0x01020304;
+    static constexpr uint64_t PayloadAlignment = 64;
+
+    //! Set in flags if seed holds the seed used to generate the initial weights
+    static constexpr uint32_t FlagHasSeed = 1 << 0;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t dataType;      //!< Size in bytes of each weight
+    uint32_t flags;
+    int32_t unwrapWidth, unwrapHeight;
+    int64_t rows, cols;
+    double learningRate;
+    uint64_t seed;
+    uint64_t numSnapshots;  //!< Number of images the network had been trained on
+    uint64_t payloadOffset;
+    uint64_t payloadSize;
+
+    //! The eight bytes every serialised InfoMax file starts with
+    static const char *getMagic() { return "BoBInfoM"; }
+}; // InfoMaxFileHeader
+static_assert(sizeof(InfoMaxFileHeader) == 88, "InfoMaxFileHeader must not be padded");
+
 //------------------------------------------------------------------------
 // BoBRobotics::Navigation::InfoMax
 //------------------------------------------------------------------------
@@ -52,12 +95,17 @@ public:
         BOB_ASSERT(initialWeights.cols() == unwrapRes.width * unwrapRes.height);
     }
 
-    InfoMax(const cv::Size &unwrapRes, FloatType learningRate = 0.0001)
+    InfoMax(const cv::Size &unwrapRes, FloatType learningRate = 0.0001,
+            unsigned seed = std::random_device()())
       : InfoMax(unwrapRes,
                 generateInitialWeights(unwrapRes.width * unwrapRes.height,
-                                       unwrapRes.width * unwrapRes.height),
+                                       unwrapRes.width * unwrapRes.height,
+                                       seed),
                 learningRate)
-    {}
+    {
+        m_Seed = seed;
+        m_HasSeed = true;
+    }
 
     //------------------------------------------------------------------------
     // Public API
@@ -66,24 +114,109 @@ public:
     {
         calculateUY(image);
         trainUY();
+        m_SnapshotCount++;
     }
 
     float test(const cv::Mat &image, const ImgProc::Mask& = ImgProc::Mask{}) const
     {
-        const auto decs = m_Weights * getFloatVector(image);
+        const auto decs = getWeights() * getFloatVector(image);
         return decs.array().abs().sum();
     }
 
     //! Generates new random weights
     void clearMemory()
     {
-        m_Weights = generateInitialWeights(m_Weights.cols(), m_Weights.rows());
+        const auto weights = getWeights();
+        m_Seed = std::random_device()();
+        m_HasSeed = true;
+        m_Weights = generateInitialWeights(weights.cols(), weights.rows(), m_Seed);
+        m_SnapshotCount = 0;
+        unmapWeights();
+    }
+
+    /*!
+     * \brief Get the weight matrix
+     *
+     * If the network was loaded with deserialise(), this is a view onto the
+     * memory-mapped file.
+     */
+    Eigen::Map<const MatrixType> getWeights() const
+    {
+        if (m_MappedWeights) {
+            return { m_MappedWeights, m_MappedRows, m_MappedCols };
+        } else {
+            return { m_Weights.data(), m_Weights.rows(), m_Weights.cols() };
+        }
+    }
+
+    //! Get the number of images the network has been trained on
+    size_t getNumSnapshots() const { return m_SnapshotCount; }
+
+    FloatType getLearningRate() const { return m_LearningRate; }
+
+    //! Check whether the weights are a read-only view onto a serialised file
+    bool isMemoryMapped() const { return m_MappedWeights != nullptr; }
+
+    /*!
+     * \brief Write the network to a self-describing binary file
+     *
+     * The file can be loaded again with deserialise(), which will map it
+     * into memory rather than reading it.
+     */
+    void serialise(const filesystem::path &filePath) const
+    {
+        const auto weights = getWeights();
+
+        InfoMaxFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::copy_n(InfoMaxFileHeader::getMagic(), sizeof(header.magic), header.magic);
+        header.version = InfoMaxFileHeader::CurrentVersion;
+        header.byteOrderMark = InfoMaxFileHeader::ByteOrderMark;
+        header.dataType = sizeof(FloatType);
+        header.flags = 0;
+        if (m_HasSeed) {
+            header.flags |= InfoMaxFileHeader::FlagHasSeed;
+        }
+        header.unwrapWidth = m_UnwrapRes.width;
+        header.unwrapHeight = m_UnwrapRes.height;
+        header.rows = weights.rows();
+        header.cols = weights.cols();
+        header.learningRate = m_LearningRate;
+        header.seed = m_Seed;
+        header.numSnapshots = m_SnapshotCount;
+        header.payloadOffset = alignPayload(sizeof(header));
+        header.payloadSize = sizeof(FloatType) * weights.size();
+
+        std::ofstream ofs;
+        ofs.exceptions(std::ios::badbit | std::ios::failbit);
+        ofs.open(filePath.str(), std::ios::out | std::ios::binary);
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        // Pad so that the weights start on an aligned boundary
+        const char padding[InfoMaxFileHeader::PayloadAlignment]{};
+        ofs.write(padding, header.payloadOffset - sizeof(header));
+        ofs.write(reinterpret_cast<const char *>(weights.data()), header.payloadSize);
     }
 
+    /*!
+     * \brief Load a network written by serialise()
+     *
+     * The file is mapped into memory and the weights are used in place, so
+     * this takes the same time regardless of the size of the network. The
+     * weights are only copied if the network is trained further.
+     */
+    static InfoMax deserialise(const filesystem::path &filePath)
+    {
+        return InfoMax{ std::make_shared<const MemoryMappedFile>(filePath) };
+    }
 
-    const MatrixType &getWeights() const
+    //! Check whether the file at filePath was written by serialise()
+    static bool isSerialisedFile(const filesystem::path &filePath)
     {
-        return m_Weights;
+        std::ifstream ifs(filePath.str(), std::ios::in | std::ios::binary);
+        char magic[sizeof(InfoMaxFileHeader::magic)];
+        return ifs.read(magic, sizeof(magic)) &&
+               std::equal(std::begin(magic), std::end(magic), InfoMaxFileHeader::getMagic());
     }
 
     static MatrixType generateInitialWeights(const int numInputs,
@@ -112,11 +245,33 @@ public:
     //! Get the resolution of images
     const cv::Size &getUnwrapResolution() const { return m_UnwrapRes; }
 
+protected:
+    explicit InfoMax(std::shared_ptr<const MemoryMappedFile> file)
+      : m_UnwrapRes(readHeader(*file).unwrapWidth, readHeader(*file).unwrapHeight)
+      , m_MappedFile(std::move(file))
+    {
+        const auto &header = readHeader(*m_MappedFile);
+        m_LearningRate = static_cast<FloatType>(header.learningRate);
+        m_SnapshotCount = static_cast<size_t>(header.numSnapshots);
+        m_Seed = static_cast<unsigned>(header.seed);
+        m_HasSeed = header.flags & InfoMaxFileHeader::FlagHasSeed;
+        m_MappedRows = static_cast<Eigen::Index>(header.rows);
+        m_MappedCols = static_cast<Eigen::Index>(header.cols);
+        m_MappedWeights = m_MappedFile->at<FloatType>(header.payloadOffset,
+                                                      static_cast<size_t>(header.rows * header.cols));
+    }
+
 #ifndef EXPOSE_INFOMAX_INTERNALS
     private:
 #endif
     void trainUY()
     {
+        // Copy-on-write: we can't modify weights in a read-only mapping
+        if (m_MappedWeights) {
+            m_Weights = getWeights();
+            unmapWeights();
+        }
+
         // weights = weights + lrate/N * (eye(H)-(y+u)*u') * weights;
         const auto id = MatrixType::Identity(m_Weights.rows(), m_Weights.rows());
         const auto sumYU = (m_Y.array() + m_U.array()).matrix();
@@ -147,7 +302,7 @@ public:
         BOB_ASSERT(image.rows == unwrapRes.height);
 
         // Convert image to vector of floats
-        m_U = m_Weights * getFloatVector(image);
+        m_U = getWeights() * getFloatVector(image);
         m_Y = tanh(m_U.array());
     }
 
@@ -161,9 +316,51 @@ private:
     const cv::Size m_UnwrapRes;
     size_t m_SnapshotCount = 0;
     FloatType m_LearningRate;
+    unsigned m_Seed = 0;
+    bool m_HasSeed = false;
     MatrixType m_Weights;
     VectorType m_U, m_Y;
 
+    // Weights used in place from a file loaded with deserialise()
+    std::shared_ptr<const MemoryMappedFile> m_MappedFile;
+    const FloatType *m_MappedWeights = nullptr;
+    Eigen::Index m_MappedRows = 0, m_MappedCols = 0;
+
+    void unmapWeights()
+    {
+        m_MappedWeights = nullptr;
+        m_MappedFile.reset();
+    }
+
+    static constexpr uint64_t alignPayload(uint64_t offset)
+    {
+        constexpr auto align = InfoMaxFileHeader::PayloadAlignment;
+        return ((offset + align - 1) / align) * align;
+    }
+
+    static const InfoMaxFileHeader &readHeader(const MemoryMappedFile &file)
+    {
+        const auto &header = *file.at<InfoMaxFileHeader>(0);
+        if (!std::equal(std::begin(header.magic), std::end(header.magic), InfoMaxFileHeader::getMagic())) {
+            throw std::runtime_error(file.getPath().str() + " is not a serialised InfoMax network");
+        }
+        if (header.version != InfoMaxFileHeader::CurrentVersion) {
+            throw std::runtime_error("Unsupported InfoMax file version: " + std::to_string(header.version));
+        }
+        if (header.byteOrderMark != InfoMaxFileHeader::ByteOrderMark) {
+            throw std::runtime_error(file.getPath().str() + " was written on a machine with different endianness");
+        }
+        if (header.dataType != sizeof(FloatType)) {
+            throw std::runtime_error("InfoMax weights in " + file.getPath().str() + " are " +
+                                     std::to_string(8 * header.dataType) + "-bit, but " +
+                                     std::to_string(8 * sizeof(FloatType)) + "-bit were requested");
+        }
+        BOB_ASSERT(header.cols == header.unwrapWidth * header.unwrapHeight);
+        BOB_ASSERT(header.payloadOffset % InfoMaxFileHeader::PayloadAlignment == 0);
+        BOB_ASSERT(header.payloadSize == sizeof(FloatType) * header.rows * header.cols);
+        return header;
+    }
+
     static auto getFloatVector(const cv::Mat &image)
     {
         Eigen::Map<Eigen::Matrix<uint8_t, Eigen::Dynamic, 1>> map(image.data, image.cols * image.rows);
@@ -192,10 +389,17 @@ public:
     :   InfoMax<FloatType>(unwrapRes, initialWeights, learningRate)
     {}
 
-    InfoMaxRotater(const cv::Size &unwrapRes, FloatType learningRate = 0.0001)
-    :   InfoMax<FloatType>(unwrapRes, learningRate)
+    InfoMaxRotater(const cv::Size &unwrapRes, FloatType learningRate = 0.0001,
+                   unsigned seed = std::random_device()())
+    :   InfoMax<FloatType>(unwrapRes, learningRate, seed)
     {}
 
+    //! Load a network written by InfoMax::serialise()
+    static InfoMaxRotater deserialise(const filesystem::path &filePath)
+    {
+        return InfoMaxRotater{ std::make_shared<const MemoryMappedFile>(filePath) };
+    }
+
     //------------------------------------------------------------------------
     // Public API
     //------------------------------------------------------------------------
@@ -244,6 +448,11 @@ public:
         return getHeading(image, ImgProc::Mask{}, std::forward<Ts>(args)...);
     }
 
+protected:
+    explicit InfoMaxRotater(std::shared_ptr<const MemoryMappedFile> file)
+    :   InfoMax<FloatType>(std::move(file))
+    {}
+
 private:
     //------------------------------------------------------------------------
     // Private API
@@ -0,0 +1,179 @@
+#pragma once
+
+// BoB robotics includes
+#include "common/memory_mapped_file.h"
+
+// Third-party includes
+#include "third_party/path.h"
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+
+// Standard C includes
+#include <cstdint>
+
+// Standard C++ includes
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Navigation {
+//------------------------------------------------------------------------
+// BoBRobotics::Navigation::PackedImageDatabase
+//------------------------------------------------------------------------
+/*!
+ * \brief Reads and writes image databases packed into a single .bobdb file
+ *
+ * A packed database holds the same information as a directory-type
+ * ImageDatabase (the metadata YAML, the entries CSV and the images) in one
+ * memory-mapped file:
+ *
+ *  - a fixed-size Header
+ *  - the frames, each starting on a FrameAlignment-byte boundary
+ *  - a fixed-width EntryRecord for each entry
+ *  - a numEntries x numExtraFields table of StringRefs for extra field values
+ *  - a StringRef for each extra field name
+ *  - a string table holding all strings (file names, metadata, field values)
+ *
+ * Frames are either raw pixel data, all with the same size and type, or
+ * encoded images (e.g. the original JPEG/PNG files) which are decoded on load.
+ *
+ * Usually you don't need to use this class directly: open a .bobdb file
+ * with ImageDatabase and create one with ImageDatabase::pack().
+ */
+class PackedImageDatabase
+{
+public:
+    static constexpr const char *Extension = "bobdb";
+    static constexpr uint32_t CurrentVersion = 1;
+    static constexpr uint32_t ByteOrderMark = 0x01020304;
+    static constexpr uint64_t FrameAlignment = 64;
+
+    //! How frames are stored in the file
+    enum class FrameFormat : uint32_t
+    {
+        Raw = 0,    //!< Uncompressed pixels
+        Encoded = 1 //!< Compressed image files, as accepted by cv::imdecode()
+    };
+
+    //! A string in the string table
+    struct StringRef
+    {
+        uint32_t offset, length;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        FrameFormat frameFormat;
+        uint32_t isRoute;
+        int32_t width, height;
+        int32_t type;           //!< OpenCV type of raw frames
+        uint32_t numExtraFields;
+        uint64_t numEntries;
+        uint64_t entriesOffset;
+        uint64_t extraFieldsOffset;
+        uint64_t extraFieldNamesOffset;
+        uint64_t stringsOffset;
+        uint64_t stringsSize;
+        StringRef metadata;     //!< Contents of database_metadata.yaml
+
+        static const char *getMagic() { return "BoBImgDB"; }
+    };
+    static_assert(sizeof(Header) == 96, "PackedImageDatabase::Header must not be padded");
+
+    struct EntryRecord
+    {
+        double position[3];     //!< In mm
+        double heading;         //!< In degrees
+        uint64_t gridPosition[3];
+        uint64_t frameOffset, frameSize;
+        StringRef fileName;
+    };
+    static_assert(sizeof(EntryRecord) == 80, "PackedImageDatabase::EntryRecord must not be padded");
+
+    //------------------------------------------------------------------------
+    // BoBRobotics::Navigation::PackedImageDatabase::Writer
+    //------------------------------------------------------------------------
+    /*!
+     * \brief Writes a .bobdb file frame by frame
+     *
+     * The file is only valid once close() has been called. If the Writer is
+     * destroyed before then (e.g. because an exception was thrown), the
+     * partly written file is deleted.
+     */
+    class Writer
+    {
+    public:
+        Writer(const filesystem::path &filePath, FrameFormat frameFormat,
+               bool isRoute, std::vector<std::string> extraFieldNames,
+               const std::string &metadata);
+        ~Writer();
+
+        //! Add a frame stored in the format given to the constructor
+        void addFrame(const cv::Mat &frame, EntryRecord entry,
+                      const std::string &fileName,
+                      const std::vector<std::string> &extraFieldValues);
+
+        //! Add an already-encoded image file, as-is (FrameFormat::Encoded only)
+        void addEncodedFrame(const std::vector<uchar> &data, EntryRecord entry,
+                             const std::string &fileName,
+                             const std::vector<std::string> &extraFieldValues);
+
+        //! Write entry tables and finish the file
+        void close();
+
+    private:
+        const filesystem::path m_FilePath;
+        std::ofstream m_Stream;
+        Header m_Header;
+        std::vector<EntryRecord> m_Entries;
+        std::vector<StringRef> m_ExtraFields;
+        std::vector<std::string> m_ExtraFieldNames;
+        std::string m_Strings;
+        std::vector<uchar> m_EncodeBuffer;
+        uint64_t m_Offset;
+        bool m_Open = true;
+
+        StringRef addString(const std::string &str);
+        void writeAligned(const void *data, size_t size);
+        void addEntry(EntryRecord &entry, uint64_t frameOffset, uint64_t frameSize,
+                      const std::string &fileName,
+                      const std::vector<std::string> &extraFieldValues);
+    }; // Writer
+
+    explicit PackedImageDatabase(const filesystem::path &filePath);
+
+    //! Number of entries in the database
+    size_t size() const { return static_cast<size_t>(m_Header->numEntries); }
+
+    const filesystem::path &getPath() const { return m_File.getPath(); }
+    const Header &getHeader() const { return *m_Header; }
+    const EntryRecord &getEntry(size_t index) const;
+    std::string getFileName(size_t index) const;
+    std::string getExtraField(size_t index, size_t field) const;
+    std::vector<std::string> getExtraFieldNames() const;
+    std::string getMetadata() const;
+
+    /*!
+     * \brief Decode one frame
+     *
+     * The returned cv::Mat always owns its own data and never refers to the
+     * mapped file.
+     */
+    cv::Mat loadFrame(size_t index, bool greyscale = true) const;
+
+    //! Check whether the file at filePath is a packed database
+    static bool isPackedFile(const filesystem::path &filePath);
+
+private:
+    MemoryMappedFile m_File;
+    const Header *m_Header;
+
+    std::string getString(const StringRef &ref) const;
+}; // PackedImageDatabase
+} // Navigation
+} // BoBRobotics
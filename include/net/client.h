@@ -24,9 +24,14 @@ class Client
   : public Connection
 {
 public:
-    //! Create client and connect to host over TCP
+    /*!
+     * \brief Create client and connect to host over TCP
+     *
+     * @param binary Whether to switch to the binary protocol, if the server supports it
+     */
     Client(const std::string &host = getDefaultIP(),
-           uint16_t port = DefaultListenPort);
+           uint16_t port = DefaultListenPort,
+           bool binary = false);
 
     const std::string &getIP() const;
     static std::string getDefaultIP();
@@ -4,12 +4,18 @@
 #include "common/threadable.h"
 #include "socket.h"
 
+// Standard C includes
+#include <cstdint>
+#include <cstring>
+
 // Standard C++ includes
+#include <atomic>
 #include <functional>
 #include <map>
 #include <mutex>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace BoBRobotics {
@@ -17,16 +23,68 @@ namespace Net {
 
 class Connection; // forward declaration
 
+//! Types of message sent with the binary protocol
+enum MessageType : uint8_t
+{
+    //! A text command, which is passed to a CommandHandler
+    CommandMessage = 0,
+
+    //! Data read with Connection::read()
+    DataMessage,
+
+    //! Tank steering command (see Robots::Tank)
+    TankMessage,
+
+    //! Types from here on are free for other uses
+    FirstUserMessage = 64
+};
+
+//! A message received with the binary protocol
+struct Message
+{
+    uint8_t type;
+
+    //! Payload, which points into the receive buffer and so is only valid during the MessageHandler call
+    const uint8_t *data;
+    size_t size;
+
+    //! Copy the payload out as a plain-old-data type
+    template<class T>
+    T get() const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Payload must be a POD type");
+        if (size != sizeof(T)) {
+            throw BadCommandError();
+        }
+
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+};
+
 //! A callback function to handle incoming commands over the network
 using CommandHandler = std::function<void(Connection &, const Command &)>;
 
+//! A callback function to handle incoming messages sent with the binary protocol
+using MessageHandler = std::function<void(Connection &, const Message &)>;
+
 //! A callback function which is notified when a connection is made
 using ConnectedHandler = std::function<void(Connection &)>;
 
 //----------------------------------------------------------------------------
 // BoBRobotics::Net::Connection
 //----------------------------------------------------------------------------
-//! An abstract class representing a network connection, inherited by Server and Client classes
+/*!
+ * \brief An abstract class representing a network connection, inherited by Server and Client classes
+ *
+ * Connections start off with a line-based text protocol. If one end wants to
+ * (see requestBinaryProtocol()) and the other end offers it in its HEY command,
+ * they switch to a binary protocol, where each message is a four-byte length,
+ * a one-byte MessageType and then a payload. Messages can then be handled
+ * without allocating memory for them. Text commands and data sent with
+ * SocketWriter::send() are wrapped in messages, so CommandHandlers keep working.
+ */
 class Connection : public Threadable
 {
 public:
@@ -37,13 +95,26 @@ public:
         SocketWriter(Connection &connection);
         ~SocketWriter();
 
-        //! Send data via the Socket
-        template<typename... Args>
-        void send(Args &&... args)
+        //! Send data via the Socket, which is read at the other end with Connection::read()
+        void send(const void *buffer, size_t length);
+
+        //! Send text commands, each terminated with a newline
+        void send(const std::string &msg);
+
+        //! Send a message with the binary protocol
+        void sendMessage(uint8_t type, const void *data, size_t size);
+
+        //! Send a plain-old-data type as a message with the binary protocol
+        template<class T>
+        void sendMessage(uint8_t type, const T &payload)
         {
-            m_Connection.m_Socket.send(std::forward<Args>(args)...);
+            static_assert(std::is_trivially_copyable<T>::value, "Payload must be a POD type");
+            sendMessage(type, &payload, sizeof(T));
         }
 
+        //! Whether the binary protocol is being used
+        bool isBinary() const;
+
     private:
         Connection &m_Connection;
     };
@@ -51,6 +122,15 @@ public:
     static constexpr size_t DefaultBufferSize = 1024 * 8; //! Default buffer size, in bytes
     static constexpr int DefaultListenPort = 2000;        //! Default listening port
 
+    /*!
+     * \brief Largest message, other than a DataMessage, which can be sent or received
+     *
+     * The length comes from the other end, so anything bigger is rejected
+     * rather than buffered. Large payloads should be sent as data, which
+     * read() copies straight into the caller's buffer.
+     */
+    static constexpr size_t MaxMessageSize = 1024 * 1024;
+
     template<typename... Ts>
     Connection(Ts&&... args)
       : m_Buffer(DefaultBufferSize)
@@ -69,12 +149,29 @@ public:
      */
     void setCommandHandler(const std::string &commandName, const CommandHandler &handler);
 
+    //! Add a handler for a type of message sent with the binary protocol; set to nullptr to ignore them
+    void setMessageHandler(uint8_t type, const MessageHandler &handler);
+
+    /*!
+     * \brief Switch to the binary protocol if the other end offers it
+     *
+     * This must be called before the other end's HEY command is read.
+     */
+    void requestBinaryProtocol();
+
+    //! Whether the binary protocol is being used for sending
+    bool isBinary() const;
+
     //! Read a specified number of bytes into a buffer
     void read(void *buffer, size_t length);
 
     //! Return a transaction object for writing to this Connection's Socket
     SocketWriter getSocketWriter();
 
+    //! The IP address of the other end of the connection
+    std::string getPeerAddress() const;
+
+    //! Read and handle the next command, returning its name (or an empty string for other binary messages)
     std::string readNextCommand();
 
 protected:
@@ -82,13 +179,42 @@ protected:
     virtual void runInternal() override;
 
 private:
+    // Size of each message's length and type
+    static constexpr size_t MessageHeaderSize = sizeof(uint32_t) + sizeof(uint8_t);
+
     std::map<std::string, CommandHandler> m_CommandHandlers;
+    std::map<uint8_t, MessageHandler> m_MessageHandlers;
     std::vector<char> m_Buffer;
+    std::vector<uint8_t> m_SendBuffer;
     Socket m_Socket;
     std::mutex m_SendMutex, m_CommandHandlersMutex;
     size_t m_BufferStart = 0, m_BufferBytes = 0;
 
+    // State of the binary protocol; m_SendBinary is only changed with m_SendMutex held
+    bool m_WantBinary = false, m_ReceiveBinary = false;
+    std::atomic<bool> m_SendBinary{ false };
+    size_t m_DataBytesLeft = 0;
+
+    // Read and handle a command or message, returning false if the connection was closed
+    bool readAndParse(std::string &commandName);
+
     bool parseCommand(Command &command);
+    void parseMessage(const Message &message);
+
+    // Start sending with the binary protocol and tell the other end
+    void sendBinaryRequest();
+
+    //! Read a binary message; its payload stays in m_Buffer until the next read
+    void readMessage(Message &message);
+
+    //! Read the length and type of a binary message
+    uint8_t readMessageHeader(size_t &size);
+
+    //! Read until there are at least nbytes in m_Buffer, all after m_BufferStart
+    void fillBuffer(size_t nbytes);
+
+    //! Read bytes, using any in m_Buffer first
+    void readBytes(char *buffer, size_t length);
 
     //! Read a plaintext command, splitting it into separate words
     Command readCommand();
@@ -0,0 +1,102 @@
+#pragma once
+
+// BoB robotics includes
+#include "udp_socket.h"
+
+// Standard C includes
+#include <cstdint>
+
+// Standard C++ includes
+#include <vector>
+
+namespace BoBRobotics {
+namespace Net {
+//! Largest UDP payload which fits in a standard Ethernet frame (1500 bytes, less IP and UDP headers)
+constexpr size_t DefaultMaxDatagramSize = 1472;
+
+//! Largest frame a FrameReassembler accepts by default (more than an uncompressed 4K BGR image)
+constexpr size_t DefaultMaxFrameSize = 32 * 1024 * 1024;
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Net::FrameFragmenter
+//----------------------------------------------------------------------------
+/*!
+ * \brief Splits frames (or any other messages) into datagrams small enough to
+ *        send without IP fragmentation
+ *
+ * Each datagram has a small header giving the frame's ID and size and where
+ * the fragment goes, so that a FrameReassembler can put frames back together
+ * whatever order the datagrams arrive in.
+ */
+class FrameFragmenter
+{
+public:
+    FrameFragmenter(DatagramSender &sender, size_t maxDatagramSize = DefaultMaxDatagramSize);
+
+    //! Send a frame as one or more datagrams
+    void send(const void *data, size_t size);
+
+private:
+    DatagramSender &m_Sender;
+    const size_t m_MaxPayloadSize;
+    uint32_t m_NextFrameID = 1;
+    std::vector<uint8_t> m_Datagram;
+}; // FrameFragmenter
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Net::FrameReassembler
+//----------------------------------------------------------------------------
+/*!
+ * \brief Puts frames sent by a FrameFragmenter back together
+ *
+ * Up to windowSize frames can be in progress at once, so datagrams from
+ * neighbouring frames may arrive in any order. Frames are only passed on in
+ * order: once a frame is complete, any older ones are abandoned, as are the
+ * oldest ones when the window is full. Nothing waits for lost datagrams to be
+ * resent.
+ *
+ * Frame sizes come from the network, so frames larger than maxFrameSize are
+ * ignored rather than allocated.
+ */
+class FrameReassembler
+{
+public:
+    FrameReassembler(size_t windowSize = 4, size_t maxFrameSize = DefaultMaxFrameSize);
+
+    /*!
+     * \brief Add a datagram received from a FrameFragmenter
+     *
+     * Malformed, duplicate and out-of-date datagrams are ignored, as are ones
+     * which don't fit together with the rest of their frame's fragments.
+     *
+     * @return Whether this completed a frame, which getFrame() then gives
+     */
+    bool addDatagram(const void *data, size_t size);
+
+    //! The last frame completed
+    const std::vector<uint8_t> &getFrame() const;
+
+    //! Number of frames abandoned so far or never seen at all (frame IDs start at 1)
+    size_t getNumDroppedFrames() const;
+
+private:
+    struct PartialFrame
+    {
+        bool inUse = false;
+        uint32_t id = 0;
+        size_t stride = 0;
+        std::vector<uint8_t> data;
+        std::vector<bool> received;
+        size_t numReceived = 0;
+    };
+
+    std::vector<PartialFrame> m_Window;
+    const size_t m_MaxFrameSize;
+    std::vector<uint8_t> m_Frame;
+    uint32_t m_LastFrameID = 0;
+    size_t m_NumDroppedFrames = 0;
+
+    PartialFrame *getPartialFrame(uint32_t id, uint32_t frameSize, uint16_t count, size_t stride);
+}; // FrameReassembler
+} // Net
+} // BoBRobotics
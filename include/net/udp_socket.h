@@ -0,0 +1,101 @@
+#pragma once
+
+// BoB robotics includes
+#include "socket.h"
+
+// Standard C includes
+#include <cstdint>
+
+// Standard C++ includes
+#include <random>
+#include <string>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Net {
+//----------------------------------------------------------------------------
+// BoBRobotics::Net::DatagramSender
+//----------------------------------------------------------------------------
+//! Something datagrams can be sent through, e.g. a UDPSocket
+class DatagramSender
+{
+public:
+    virtual ~DatagramSender();
+
+    virtual void send(const void *data, size_t length) = 0;
+}; // DatagramSender
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Net::UDPSocket
+//----------------------------------------------------------------------------
+//! A UDP socket, bound to a local port and optionally connected to a remote one
+class UDPSocket
+  : public DatagramSender
+{
+public:
+    //! Bind to port on all interfaces (0 picks a free port)
+    explicit UDPSocket(uint16_t port = 0);
+
+    //! Send datagrams to this address from now on
+    void connect(const std::string &address, uint16_t port);
+
+    //! The local port this socket is bound to
+    uint16_t getPort() const;
+
+    //! Send a datagram to the connected address
+    virtual void send(const void *data, size_t length) override;
+
+    /*!
+     * \brief Wait up to timeoutMs (-1 for no limit) for a datagram
+     *
+     * @return The datagram's size, or zero if none came in time
+     */
+    size_t receive(void *buffer, size_t length, int timeoutMs = -1);
+
+    //! As receive(), also giving the IPv4 address the datagram came from
+    size_t receive(void *buffer, size_t length, std::string &fromAddress, int timeoutMs = -1);
+
+private:
+    Socket m_Socket;
+
+    //! Wait up to timeoutMs (-1 for no limit) for the socket to become readable
+    bool waitForDatagram(int timeoutMs);
+}; // UDPSocket
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Net::LossyDatagramSender
+//----------------------------------------------------------------------------
+/*!
+ * \brief Simulates an unreliable network, for testing
+ *
+ * Randomly drops datagrams and swaps the order of neighbouring ones before
+ * passing them on to another DatagramSender.
+ */
+class LossyDatagramSender
+  : public DatagramSender
+{
+public:
+    LossyDatagramSender(DatagramSender &sender,
+                        double lossProbability,
+                        double reorderProbability = 0.0,
+                        unsigned int seed = 0);
+
+    virtual void send(const void *data, size_t length) override;
+
+    //! Send on any datagram being held back to reorder it
+    void flush();
+
+    //! Number of datagrams dropped so far
+    size_t getNumDropped() const;
+
+private:
+    DatagramSender &m_Sender;
+    const double m_LossProbability, m_ReorderProbability;
+    std::mt19937 m_RNG;
+    std::uniform_real_distribution<double> m_Distribution{ 0.0, 1.0 };
+    std::vector<uint8_t> m_HeldBack;
+    bool m_IsHoldingBack = false;
+    size_t m_NumDropped = 0;
+}; // LossyDatagramSender
+} // Net
+} // BoBRobotics
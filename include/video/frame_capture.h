@@ -0,0 +1,120 @@
+#pragma once
+
+// BoB robotics includes
+#include "input.h"
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+// Standard C includes
+#include <cstdint>
+
+// Standard C++ includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Video {
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::CapturedFrame
+//----------------------------------------------------------------------------
+//! A frame read by a FrameCapture, along with when it was read
+struct CapturedFrame
+{
+    cv::Mat image;
+
+    //! When the frame was read from the Input (on a monotonic clock)
+    std::chrono::steady_clock::time_point timestamp;
+
+    //! Frames are numbered from 1 in the order they were read; gaps mean frames were dropped
+    uint64_t sequence = 0;
+};
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::FrameCapture
+//----------------------------------------------------------------------------
+/*!
+ * \brief Reads frames from a Video::Input on a background thread, so that
+ *        consumers don't have to poll it
+ *
+ * Frames are read into a fixed pool of buffers. Consumers get a reference-
+ * counted pointer to a buffer, rather than a copy, and can either take the
+ * latest frame or block until a new one arrives. A buffer is only reused once
+ * every consumer has released it. If all the buffers are in use, frames are
+ * read and dropped, so that the consumers always get recent ones.
+ */
+class FrameCapture
+{
+public:
+    using FramePtr = std::shared_ptr<const CapturedFrame>;
+
+    /*!
+     * \brief Start reading frames from input
+     *
+     * @param numBuffers Size of the buffer pool; must be at least two, so one
+     *                   frame can be read while another is in use
+     * @param greyscale Whether to read frames with Input::readGreyscaleFrame()
+     */
+    FrameCapture(Input &input, size_t numBuffers = 4, bool greyscale = false);
+    ~FrameCapture();
+
+    //! Get the most recent frame, or nullptr if there isn't one yet
+    FramePtr getLatestFrame() const;
+
+    /*!
+     * \brief Wait for a frame newer than lastSequence (0 for any frame)
+     *
+     * @return The newest frame, or nullptr if capturing has stopped, e.g.
+     *         because the Input threw an exception
+     */
+    FramePtr waitForFrame(uint64_t lastSequence = 0) const;
+
+    //! As above, but give up after timeout, returning nullptr
+    template<class Rep, class Period>
+    FramePtr waitForFrame(uint64_t lastSequence,
+                          const std::chrono::duration<Rep, Period> &timeout) const
+    {
+        std::unique_lock<std::mutex> lock{ m_Mutex };
+        m_FrameReady.wait_for(lock, timeout, [&]() { return isNewerOrStopped(lastSequence); });
+        return (m_Latest && m_Latest->sequence > lastSequence) ? m_Latest : nullptr;
+    }
+
+    //! Wait for the frame after previous (or any frame if previous is nullptr)
+    FramePtr waitForNextFrame(const FramePtr &previous) const;
+
+    //! Whether the capture thread is still reading frames
+    bool isRunning() const;
+
+    //! Number of frames dropped because every buffer was in use
+    size_t getNumDroppedFrames() const;
+
+    //! Stop reading frames; consumers can still use the frames they have
+    void stop();
+
+private:
+    Input &m_Input;
+    const bool m_Greyscale;
+
+    // Every buffer in the pool; ones only referenced here are free
+    std::vector<std::shared_ptr<CapturedFrame>> m_Buffers;
+    std::shared_ptr<CapturedFrame> m_Latest;
+    uint64_t m_Sequence = 0;
+    std::atomic<size_t> m_NumDroppedFrames{ 0 };
+
+    mutable std::mutex m_Mutex;
+    mutable std::condition_variable m_FrameReady;
+    std::atomic<bool> m_DoRun{ true };
+    bool m_IsRunning = true;
+    std::thread m_Thread;
+
+    bool isNewerOrStopped(uint64_t lastSequence) const;
+    std::shared_ptr<CapturedFrame> getFreeBuffer();
+    void runCapture();
+}; // FrameCapture
+} // Video
+} // BoBRobotics
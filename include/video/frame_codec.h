@@ -0,0 +1,141 @@
+#pragma once
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+
+// Standard C++ includes
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Video {
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::FrameCodec
+//----------------------------------------------------------------------------
+/*!
+ * \brief Converts frames to and from bytes, for sending over the network
+ *
+ * Codecs are named by a short string (as used in IMG commands) optionally
+ * followed by a colon and a parameter, e.g. "jpeg:80". Codecs may keep state
+ * between frames, so each stream needs its own encoder and decoder and frames
+ * must be decoded in the order they were encoded.
+ */
+class FrameCodec
+{
+public:
+    virtual ~FrameCodec();
+
+    //! The codec's name, without parameters
+    virtual std::string getName() const = 0;
+
+    //! Encode frame into buffer, replacing its contents
+    virtual void encode(const cv::Mat &frame, std::vector<uchar> &buffer) = 0;
+
+    //! Decode size bytes of data into frame, reallocating it if needed
+    virtual void decode(const uchar *data, size_t size, cv::Mat &frame) = 0;
+
+    /*!
+     * \brief Create a codec from a specification, e.g. "png" or "jpeg:80"
+     *
+     * Throws std::invalid_argument for unknown codecs.
+     */
+    static std::unique_ptr<FrameCodec> create(const std::string &spec);
+
+    //! Get the name from a specification
+    static std::string getName(const std::string &spec);
+
+    //! Names of all the available codecs, most general-purpose first
+    static const std::vector<std::string> &getNames();
+}; // FrameCodec
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::JPEGCodec
+//----------------------------------------------------------------------------
+//! Lossy compression with cv::imencode(); the parameter is the quality (0-100)
+class JPEGCodec
+  : public FrameCodec
+{
+public:
+    JPEGCodec(int quality = 95);
+
+    virtual std::string getName() const override;
+    virtual void encode(const cv::Mat &frame, std::vector<uchar> &buffer) override;
+    virtual void decode(const uchar *data, size_t size, cv::Mat &frame) override;
+
+private:
+    const std::vector<int> m_Params;
+}; // JPEGCodec
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::PNGCodec
+//----------------------------------------------------------------------------
+//! Lossless compression with cv::imencode(); the parameter is the compression level (0-9)
+class PNGCodec
+  : public FrameCodec
+{
+public:
+    PNGCodec(int compressionLevel = 1);
+
+    virtual std::string getName() const override;
+    virtual void encode(const cv::Mat &frame, std::vector<uchar> &buffer) override;
+    virtual void decode(const uchar *data, size_t size, cv::Mat &frame) override;
+
+private:
+    const std::vector<int> m_Params;
+}; // PNGCodec
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::RawCodec
+//----------------------------------------------------------------------------
+/*!
+ * \brief Uncompressed pixels, with a header giving the size and type
+ *
+ * The cheapest option for small images, e.g. unwrapped greyscale ones.
+ * Assumes both ends have the same byte order.
+ */
+class RawCodec
+  : public FrameCodec
+{
+public:
+    virtual std::string getName() const override;
+    virtual void encode(const cv::Mat &frame, std::vector<uchar> &buffer) override;
+    virtual void decode(const uchar *data, size_t size, cv::Mat &frame) override;
+}; // RawCodec
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::DeltaCodec
+//----------------------------------------------------------------------------
+/*!
+ * \brief Lossless; sends each frame as its difference from the previous one,
+ *        with runs of unchanged bytes compressed
+ *
+ * Good for static scenes and cameras. A complete frame is sent first, when the
+ * size or type changes and, if the parameter is non-zero, every that many
+ * frames.
+ */
+class DeltaCodec
+  : public FrameCodec
+{
+public:
+    /*!
+     * \brief Largest frame decode() accepts, in bytes
+     *
+     * Runs of unchanged bytes take up almost no space, so a tiny key frame
+     * could otherwise make the decoder allocate gigabytes.
+     */
+    static constexpr size_t MaxFrameSize = 64 << 20;
+
+    DeltaCodec(int keyFrameInterval = 0);
+
+    virtual std::string getName() const override;
+    virtual void encode(const cv::Mat &frame, std::vector<uchar> &buffer) override;
+    virtual void decode(const uchar *data, size_t size, cv::Mat &frame) override;
+
+private:
+    const int m_KeyFrameInterval;
+    int m_FramesSinceKeyFrame = 0;
+    cv::Mat m_Previous;
+}; // DeltaCodec
+} // Video
+} // BoBRobotics
@@ -3,10 +3,17 @@
 // BoB robotics includes
 #include "common/semaphore.h"
 #include "net/connection.h"
+#include "net/frame_fragments.h"
+#include "net/udp_socket.h"
+#include "frame_capture.h"
+#include "frame_codec.h"
 #include "input.h"
 
 // Standard C++ includes
 #include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -16,7 +23,19 @@ namespace Video {
 //----------------------------------------------------------------------------
 // BoBRobotics::Video::NetSink
 //----------------------------------------------------------------------------
-//! Object for sending video frames synchronously or asynchronously over network
+/*!
+ * \brief Object for sending video frames synchronously or asynchronously over network
+ *
+ * Frames are encoded and sent on separate background threads, so that
+ * capturing, encoding and sending can overlap. If the network can't keep up,
+ * stale frames are dropped before encoding, rather than queued, so the
+ * receiver always gets recent frames.
+ *
+ * The codec is agreed with the receiver when it sends IMG START: if it lists
+ * the codecs it can decode, the one given here is used if it's among them,
+ * otherwise the receiver's first choice. Receivers which don't list any get
+ * JPEG. Receivers can also ask for frames to be sent over UDP (see NetSource).
+ */
 class NetSink
 {
 public:
@@ -25,8 +44,11 @@ public:
      *
      * @param connection The connection over which to transmit images
      * @param input The Input source for images
+     * @param codec The preferred codec (see FrameCodec::create())
+     * @param greyscale Whether to send greyscale frames
      */
-    NetSink(Net::Connection &connection, Input &input);
+    NetSink(Net::Connection &connection, Input &input, const std::string &codec = "jpeg",
+            bool greyscale = false);
 
     /*!
      * \brief Create a NetSink for synchronous operation
@@ -34,44 +56,87 @@ public:
      * @param connections The connection over which to transmit images
      * @param frameSize The size of the frames output by the video source
      * @param cameraName The name of the camera (see Input::getCameraName())
+     * @param codec The preferred codec (see FrameCodec::create())
      */
     NetSink(Net::Connection &connection,
             const cv::Size &frameSize,
-            const std::string &cameraName);
+            const std::string &cameraName,
+            const std::string &codec = "jpeg");
 
     virtual ~NetSink();
 
     //----------------------------------------------------------------------------
     // Public API
     //----------------------------------------------------------------------------
-    //! Send a frame over the network (when operating in synchronous mode)
+    /*!
+     * \brief Send a frame over the network (when operating in synchronous mode)
+     *
+     * Blocks until the receiver has connected. The frame is copied and sent in
+     * the background; if the previous frame hasn't been encoded yet, it is
+     * replaced by this one.
+     */
     void sendFrame(const cv::Mat &frame);
 
+    //! The name of the codec agreed with the receiver (blocks until it connects)
+    std::string getCodecName() const;
+
+    //! Number of frames dropped because newer ones arrived before they could be sent
+    size_t getNumDroppedFrames() const;
+
 private:
     //----------------------------------------------------------------------------
     // Private methods
     //----------------------------------------------------------------------------
-    void sendFrameInternal(const cv::Mat &frame);
+    std::string chooseCodec(const Net::Command &command) const;
 
     void onCommandReceived(const Net::Command &command);
 
+    // Check whether a START has already been handled (and so this command should be ignored)
+    bool isStreaming(const Net::Command &command) const;
+
     void onCommandReceivedAsync(const Net::Command &command);
 
     void onCommandReceivedSync(const Net::Command &command);
 
-    void runAsync();
+    // Wait for the next frame to encode; false if we're stopping
+    bool getNextFrame(cv::Mat &frame, FrameCapture::FramePtr &captured);
+
+    void runEncode();
+
+    void runSend();
+
+    void stop();
 
     //----------------------------------------------------------------------------
     // Members
     //----------------------------------------------------------------------------
     Net::Connection &m_Connection;
-    Semaphore m_AckSemaphore;
+    mutable Semaphore m_AckSemaphore;
     const std::string m_Name;
-    std::vector<uchar> m_Buffer;
-    std::thread m_Thread;
+    const std::string m_CodecSpec;
+    std::unique_ptr<FrameCodec> m_Codec;
     const cv::Size m_FrameSize;
     Input *m_Input;
+    const bool m_Greyscale;
+    std::unique_ptr<FrameCapture> m_Capture;
+
+    // For sending frames over UDP, if the receiver asks
+    std::unique_ptr<Net::UDPSocket> m_UDPSocket;
+    std::unique_ptr<Net::FrameFragmenter> m_Fragmenter;
+
+    // Frame waiting to be encoded (synchronous mode)
+    cv::Mat m_PendingFrame;
+    bool m_HasPendingFrame = false;
+
+    // Frame waiting to be sent
+    std::vector<uchar> m_EncodedFrame;
+    bool m_HasEncodedFrame = false;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+    std::atomic<size_t> m_NumDroppedFrames{ 0 };
     std::atomic<bool> m_DoRun{ true };
+    std::thread m_EncodeThread, m_SendThread;
 };
 } // Video
 } // BoBRobotics
@@ -3,12 +3,20 @@
 // BoB robotics includes
 #include "common/semaphore.h"
 #include "net/connection.h"
+#include "net/udp_socket.h"
+#include "frame_codec.h"
 #include "input.h"
 
+// Standard C includes
+#include <cstdint>
+
 // Standard C++ includes
+#include <array>
 #include <atomic>
-#include <mutex>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace BoBRobotics {
@@ -16,16 +24,40 @@ namespace Video {
 //----------------------------------------------------------------------------
 // BoBRobotics::Video::NetSource
 //----------------------------------------------------------------------------
-//! Object for receiving video transmitted over the network by a NetSink
+/*!
+ * \brief Object for receiving video transmitted over the network by a NetSink
+ *
+ * Frames are decoded on the network thread into one of three buffers and
+ * handed over to the reader by swapping buffer indices, so neither the
+ * decoding nor reading blocks the other. readFrame() gives a reference to the
+ * decoded frame's data rather than a copy; frames should only be read from
+ * one thread.
+ *
+ * Frames can optionally come over UDP instead of the TCP connection (which
+ * still carries the handshake), so that a lost packet only costs the frame
+ * it was part of, rather than holding up every frame after it.
+ */
 class NetSource : public Input
 {
 public:
+    //! When a frame got here, for measuring latency
+    struct FrameTimestamps
+    {
+        //! When all of the frame's data had been received
+        std::chrono::steady_clock::time_point received;
+
+        //! When the frame had been decoded
+        std::chrono::steady_clock::time_point decoded;
+    };
+
     /*!
      * \brief Create an object to read video transmitted over the network
      *
      * @param node The network connection from which to read images
+     * @param useUDP Ask the NetSink to send frames over UDP (older ones will
+     *               still use TCP)
      */
-    NetSource(Net::Connection &connection);
+    NetSource(Net::Connection &connection, bool useUDP = false);
 
     virtual ~NetSource() override;
 
@@ -37,18 +69,45 @@ public:
 
     virtual bool readFrame(cv::Mat &frame) override;
 
+    virtual bool readGreyscaleFrame(cv::Mat &frame) override;
+
+    //! As readFrame(), also giving when the frame was received and decoded
+    bool readFrame(cv::Mat &frame, FrameTimestamps &timestamps);
+
+    //! Number of frames lost over UDP (always zero over TCP)
+    size_t getNumDroppedFrames() const;
+
 private:
-    cv::Mat m_Frame;
+    struct DecodedFrame
+    {
+        cv::Mat image;
+        FrameTimestamps timestamps;
+    };
+
+    // The buffer being decoded into, the latest decoded one and the one being read
+    std::array<DecodedFrame, 3> m_Frames;
+    uint8_t m_BackIndex = 0;
+    std::atomic<uint8_t> m_MiddleIndex{ 1 };
+    uint8_t m_FrontIndex = 2;
+
     mutable Semaphore m_ParamsSemaphore;
     std::vector<uchar> m_Buffer;
+    std::unique_ptr<FrameCodec> m_Codec;
     std::string m_CameraName = DefaultCameraName;
     Net::Connection &m_Connection;
     cv::Size m_CameraResolution;
-    std::mutex m_FrameMutex;
-    std::atomic<bool> m_NewFrame{ false };
+    std::atomic<bool> m_HasParams{ false };
+
+    std::string m_PeerAddress;
+    std::unique_ptr<Net::UDPSocket> m_UDPSocket;
+    std::thread m_UDPThread;
+    std::atomic<bool> m_DoRun{ true };
+    std::atomic<size_t> m_NumDroppedFrames{ 0 };
 
     void onCommandReceived(Net::Connection &connection,
                            const Net::Command &command);
+    void decodeFrame(const uchar *data, size_t size);
+    void runUDP();
 }; // NetSource
 } // Video
 } // BoBRobotics
@@ -0,0 +1,343 @@
+#pragma once
+
+// BoB robotics includes
+#include "common/spsc_queue.h"
+#include "imgproc/mask.h"
+#include "imgproc/opencv_unwrap_360.h"
+#include "input.h"
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+// Standard C includes
+#include <cstdint>
+
+// Standard C++ includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Video {
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::PipelineStage
+//----------------------------------------------------------------------------
+//! One step of processing in a Pipeline
+class PipelineStage
+{
+public:
+    virtual ~PipelineStage();
+
+    //! Short name, used for reporting statistics
+    virtual std::string getName() const = 0;
+
+    /*!
+     * \brief Process image, leaving the result in image
+     *
+     * Stages which can't work in place should write into buffer and swap it
+     * with image. Each stage gets its own buffer, which is reused from frame
+     * to frame, so as long as the stage's output has the same size and type
+     * each time, no new memory is allocated.
+     */
+    virtual void process(cv::Mat &image, cv::Mat &buffer) = 0;
+
+    //! Size of the images this stage outputs, given the size of its input
+    virtual cv::Size getOutputSize(const cv::Size &inputSize) const;
+
+    //! Whether this stage unwraps panoramic images
+    virtual bool isUnwrapping() const;
+}; // PipelineStage
+
+//! Unwraps panoramic images with an ImgProc::OpenCVUnwrap360
+class UnwrapStage : public PipelineStage
+{
+public:
+    UnwrapStage(ImgProc::OpenCVUnwrap360 unwrapper);
+
+    virtual std::string getName() const override;
+    virtual void process(cv::Mat &image, cv::Mat &buffer) override;
+    virtual cv::Size getOutputSize(const cv::Size &inputSize) const override;
+    virtual bool isUnwrapping() const override;
+
+private:
+    const ImgProc::OpenCVUnwrap360 m_Unwrapper;
+}; // UnwrapStage
+
+//! Converts images with cv::cvtColor (e.g. with cv::COLOR_BGR2GRAY)
+class ColourConversionStage : public PipelineStage
+{
+public:
+    ColourConversionStage(int code);
+
+    virtual std::string getName() const override;
+    virtual void process(cv::Mat &image, cv::Mat &buffer) override;
+
+private:
+    const int m_Code;
+}; // ColourConversionStage
+
+//! Crops images to a rectangle
+class CropStage : public PipelineStage
+{
+public:
+    CropStage(const cv::Rect &rect);
+
+    virtual std::string getName() const override;
+    virtual void process(cv::Mat &image, cv::Mat &buffer) override;
+    virtual cv::Size getOutputSize(const cv::Size &inputSize) const override;
+
+private:
+    const cv::Rect m_Rect;
+}; // CropStage
+
+//! Resizes images with cv::resize
+class ResizeStage : public PipelineStage
+{
+public:
+    ResizeStage(const cv::Size &size, int interpolation = cv::INTER_LINEAR);
+
+    virtual std::string getName() const override;
+    virtual void process(cv::Mat &image, cv::Mat &buffer) override;
+    virtual cv::Size getOutputSize(const cv::Size &inputSize) const override;
+
+private:
+    const cv::Size m_Size;
+    const int m_Interpolation;
+}; // ResizeStage
+
+//! Equalises the histograms of greyscale images with cv::equalizeHist
+class HistogramEqualisationStage : public PipelineStage
+{
+public:
+    virtual std::string getName() const override;
+    virtual void process(cv::Mat &image, cv::Mat &buffer) override;
+}; // HistogramEqualisationStage
+
+//! Zeroes masked-out pixels with an ImgProc::Mask
+class MaskStage : public PipelineStage
+{
+public:
+    MaskStage(ImgProc::Mask mask);
+
+    virtual std::string getName() const override;
+    virtual void process(cv::Mat &image, cv::Mat &buffer) override;
+
+private:
+    const ImgProc::Mask m_Mask;
+}; // MaskStage
+
+//! Runs any function on images, which may modify them in place
+class CallbackStage : public PipelineStage
+{
+public:
+    using Callback = std::function<void(cv::Mat &)>;
+
+    CallbackStage(std::string name, Callback callback);
+
+    virtual std::string getName() const override;
+    virtual void process(cv::Mat &image, cv::Mat &buffer) override;
+
+private:
+    const std::string m_Name;
+    const Callback m_Callback;
+}; // CallbackStage
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::Pipeline
+//----------------------------------------------------------------------------
+/*!
+ * \brief Processes frames from a Video::Input through a series of stages, each
+ *        running on its own thread
+ *
+ * While one stage works on a frame, the one before it can be working on the
+ * next, so frames come out at the rate of the slowest stage, rather than
+ * having to wait for every stage in turn. Frames are passed between stages
+ * through small SPSCQueues and their buffers are recycled, so nothing is
+ * allocated once the pipeline is running. If a stage falls behind, the ones
+ * before it wait for it. The Input waits too, so that every frame of e.g. a
+ * recording is processed, unless setDropFrames() is used.
+ *
+ * Only the newest processed frame is kept for the reader: if it isn't read
+ * before the next one is ready, it is dropped. As a Pipeline is itself a
+ * Video::Input, it can be used wherever one is, e.g. by a NetSink.
+ *
+ * Inputs have no way of saying that they have run out of frames, so the
+ * pipeline carries on asking for more until it is stopped. When processing
+ * e.g. a recording, the caller must call stop() once it has had every frame.
+ *
+ * \code
+ * Video::Pipeline pipeline{ camera };
+ * pipeline.add<Video::UnwrapStage>(camera.createUnwrapper({ 180, 50 }))
+ *         .add<Video::ColourConversionStage>(cv::COLOR_BGR2GRAY)
+ *         .add("navigate", [&](cv::Mat &image) { pm.test(image); });
+ * pipeline.start();
+ * \endcode
+ */
+class Pipeline : public Input
+{
+public:
+    using Duration = std::chrono::steady_clock::duration;
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    //! How long a stage (or the whole pipeline) is taking
+    struct Statistics
+    {
+        std::string name;
+
+        //! Frames processed since the pipeline started
+        size_t numFrames;
+
+        //! Time spent on each frame
+        Duration meanLatency, maxLatency;
+
+        //! Frames per second since the pipeline started
+        double throughput;
+    };
+
+    /*!
+     * \brief Create a pipeline for processing frames from input
+     *
+     * @param greyscale Whether to read frames with Input::readGreyscaleFrame()
+     * @param queueCapacity How many frames can wait between each pair of stages
+     */
+    Pipeline(Input &input, bool greyscale = false, size_t queueCapacity = 1);
+    virtual ~Pipeline() override;
+
+    //------------------------------------------------------------------------
+    // Video::Input virtuals
+    //------------------------------------------------------------------------
+    virtual std::string getCameraName() const override;
+    virtual units::frequency::hertz_t getFrameRate() const override;
+    virtual cv::Size getOutputSize() const override;
+    virtual bool needsUnwrapping() const override;
+
+    //! Take the newest processed frame, if it hasn't been read already
+    virtual bool readFrame(cv::Mat &outFrame) override;
+    virtual bool readGreyscaleFrame(cv::Mat &outFrame) override;
+
+    //------------------------------------------------------------------------
+    // Public API
+    //------------------------------------------------------------------------
+    //! Add a stage; stages can only be added before the pipeline is started
+    Pipeline &add(std::unique_ptr<PipelineStage> stage);
+
+    //! Construct and add a stage
+    template<class StageType, class... Ts>
+    Pipeline &add(Ts &&... args)
+    {
+        return add(std::make_unique<StageType>(std::forward<Ts>(args)...));
+    }
+
+    //! Add a CallbackStage
+    Pipeline &add(std::string name, CallbackStage::Callback callback);
+
+    /*!
+     * \brief Whether to drop frames from the Input when the first stage isn't
+     *        ready for them, rather than waiting
+     *
+     * This keeps frames from a live camera from going stale in the queues when
+     * the pipeline can't keep up. It must be set before the pipeline is started.
+     */
+    void setDropFrames(bool dropFrames);
+
+    //! Start processing frames
+    void start();
+
+    //! Stop processing frames and wait for the threads to finish
+    void stop();
+
+    /*!
+     * \brief Take the newest processed frame, if it hasn't been read already
+     *
+     * @param sequence Frames are numbered from 1 in the order they were read
+     *                 from the Input
+     * @param captureTime When the frame was read from the Input
+     */
+    bool readFrame(cv::Mat &outFrame, uint64_t &sequence, TimePoint &captureTime);
+
+    /*!
+     * \brief Wait for a frame which hasn't been read already
+     *
+     * Returns false if the pipeline has been stopped and there are no frames
+     * left. This doesn't happen on its own when the Input runs out of frames:
+     * another thread has to call stop().
+     */
+    bool waitForFrame(cv::Mat &outFrame);
+
+    //! Statistics for reading from the Input, then each stage, then the pipeline as a whole
+    std::vector<Statistics> getStatistics() const;
+
+    /*!
+     * \brief Number of frames dropped, either by the Input (see setDropFrames())
+     *        or because a newer processed frame replaced them before they were read
+     */
+    size_t getNumDroppedFrames() const;
+
+private:
+    struct Frame
+    {
+        /*
+         * The image read from the Input, then each stage's buffer. Keeping
+         * them separate means each buffer keeps the same size and type from
+         * frame to frame.
+         */
+        std::vector<cv::Mat> images;
+
+        // Which of images holds the frame, as processed so far
+        size_t current = 0;
+        uint64_t sequence = 0;
+        TimePoint captureTime;
+    };
+
+    // Updated only by the thread running the stage
+    struct Counters
+    {
+        std::atomic<uint64_t> numFrames{ 0 };
+        std::atomic<int64_t> totalTime{ 0 }, maxTime{ 0 };
+
+        void add(Duration time);
+    };
+
+    Input &m_Input;
+    const bool m_Greyscale;
+    const size_t m_QueueCapacity;
+    bool m_DropFrames = false;
+    std::atomic<size_t> m_NumInputDroppedFrames{ 0 };
+    std::vector<std::unique_ptr<PipelineStage>> m_Stages;
+
+    // Queue i feeds stage i; free frames go back to the thread reading the Input
+    std::vector<std::unique_ptr<Frame>> m_Frames;
+    std::vector<std::unique_ptr<SPSCQueue<Frame *>>> m_Queues;
+    std::unique_ptr<SPSCQueue<Frame *>> m_FreeFrames;
+
+    // Input, then each stage, then end-to-end
+    std::unique_ptr<Counters[]> m_Counters;
+    TimePoint m_StartTime;
+
+    // The newest processed frame, waiting to be read
+    mutable std::mutex m_OutputMutex;
+    std::condition_variable m_OutputReady;
+    cv::Mat m_Output;
+    uint64_t m_OutputSequence = 0;
+    TimePoint m_OutputCaptureTime;
+    bool m_HasOutput = false;
+    size_t m_NumDroppedFrames = 0;
+    std::exception_ptr m_Error;
+
+    std::atomic<bool> m_DoRun{ false };
+    std::vector<std::thread> m_Threads;
+
+    void output(Frame &frame);
+    void runInput();
+    void runStage(size_t index);
+    void setError(std::exception_ptr error);
+}; // Pipeline
+} // Video
+} // BoBRobotics
@@ -0,0 +1,175 @@
+#pragma once
+
+// BoB robotics includes
+#include "video/frame_codec.h"
+#include "video/input.h"
+
+// Third-party includes
+#include "third_party/path.h"
+#include "third_party/units.h"
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+// Standard C++ includes
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Video {
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::CaptureLogWriter
+//----------------------------------------------------------------------------
+/*!
+ * \brief Saves timestamped frames from a camera into a single file, which a
+ *        ReplayInput can play back
+ *
+ * Each frame is encoded with a FrameCodec ("png" by default, as it's
+ * lossless). As frames are looked up by index when replaying, codecs which
+ * depend on earlier frames (i.e. "delta") can't be used.
+ */
+class CaptureLogWriter
+{
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    CaptureLogWriter(const filesystem::path &path,
+                     const std::string &codec = "png",
+                     const std::string &cameraName = Input::DefaultCameraName);
+
+    //! Add a frame, recorded at the given time after the start of the log
+    void write(const cv::Mat &frame, Duration timestamp);
+
+    //! Add a frame, timestamped with the time since the first frame was written
+    void write(const cv::Mat &frame);
+
+    static constexpr const char *Extension = "boblog";
+
+private:
+    std::ofstream m_Stream;
+    std::unique_ptr<FrameCodec> m_Codec;
+    std::vector<uchar> m_Buffer;
+    std::chrono::steady_clock::time_point m_StartTime;
+    bool m_Started = false;
+}; // CaptureLogWriter
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::ReplayInput
+//----------------------------------------------------------------------------
+/*!
+ * \brief Plays back a recording as if it were a live camera
+ *
+ * Recordings can be ImageDatabases (made up of image files, video files or
+ * packed into a .bobdb file) or capture logs saved with a CaptureLogWriter.
+ *
+ * readFrame() waits until the time each frame was recorded at, relative to
+ * the first frame read, so code under test sees the same frame rate as it
+ * would from the real camera. The speed can be scaled, or set to
+ * AsFastAsPossible for benchmarking. For ImageDatabases, times are taken from
+ * a "Timestamp [ms]" field if there is one, or otherwise from the frame rate.
+ * Frames are never skipped: if the caller falls behind, it gets frames
+ * straight away until it catches up.
+ *
+ * An index of where every frame is stored is built when the recording is
+ * opened, so seeking to any frame is cheap. Frames are decoded ahead of time
+ * on a background thread, with up to readAhead waiting to be read.
+ */
+class ReplayInput : public Input
+{
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    //! Pass as speed to deliver frames as soon as they're decoded
+    static constexpr double AsFastAsPossible = 0.0;
+
+    explicit ReplayInput(const filesystem::path &path, double speed = 1.0,
+                         size_t readAhead = 8);
+    virtual ~ReplayInput() override;
+
+    //------------------------------------------------------------------------
+    // Video::Input virtuals
+    //------------------------------------------------------------------------
+    virtual std::string getCameraName() const override;
+    virtual units::frequency::hertz_t getFrameRate() const override;
+    virtual cv::Size getOutputSize() const override;
+    virtual bool needsUnwrapping() const override;
+    virtual void setOutputSize(const cv::Size &outSize) override;
+
+    //! Get the next frame, waiting until it's due (returns false at the end of the recording)
+    virtual bool readFrame(cv::Mat &outFrame) override;
+    virtual bool readGreyscaleFrame(cv::Mat &outFrame) override;
+
+    //------------------------------------------------------------------------
+    // Public API
+    //------------------------------------------------------------------------
+    //! Also get the index of the frame read and the time it was recorded at
+    bool readFrame(cv::Mat &outFrame, size_t &index, Duration &timestamp);
+
+    //! Continue playback from the given frame
+    void seek(size_t frame);
+
+    //! Continue playback from the first frame recorded at or after timestamp
+    void seekTime(Duration timestamp);
+
+    //! Set how many times faster than real time to play back (or AsFastAsPossible)
+    void setSpeed(double speed);
+
+    double getSpeed() const;
+
+    //! Index of the next frame to be read
+    size_t getPosition() const;
+
+    //! Time at which a frame was recorded, relative to the start of the recording
+    Duration getTimestamp(size_t frame) const;
+
+    //! Whether all of the frames have been read
+    bool isFinished() const;
+
+    //! Total number of frames in the recording
+    size_t size() const;
+
+private:
+    class Source;
+    class DatabaseSource;
+    class LogSource;
+
+    struct DecodedFrame
+    {
+        size_t index;
+        cv::Mat image;
+    };
+
+    std::unique_ptr<Source> m_Source;
+    const size_t m_ReadAhead;
+    cv::Size m_OutputSize;
+    double m_Speed;
+
+    // Shared with the decoding thread
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_QueueChanged;
+    std::deque<DecodedFrame> m_Queue;
+    size_t m_NextToDecode = 0, m_NextToRead = 0;
+    unsigned int m_SeekCount = 0;
+    std::exception_ptr m_Error;
+    bool m_Stopping = false;
+
+    // When playback (re)started, on the wall clock and in the recording
+    bool m_Anchored = false;
+    std::chrono::steady_clock::time_point m_AnchorTime;
+    Duration m_AnchorTimestamp{ 0 };
+
+    std::thread m_DecodeThread;
+
+    bool readFrame(cv::Mat &outFrame, size_t &index, Duration &timestamp, bool greyscale);
+    void runDecode();
+}; // ReplayInput
+} // Video
+} // BoBRobotics
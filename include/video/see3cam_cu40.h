@@ -3,7 +3,9 @@
 
 // BoB robotics includes
 #include "common/macros.h"
+#include "imgproc/opencv_unwrap_360.h"
 #include "input.h"
+#include "see3cam_cu40_demosaic.h"
 #include "v4l_camera.h"
 
 // OpenCV includes
@@ -62,6 +64,15 @@ public:
     void captureSuperPixelWBU30(cv::Mat &output);
     void captureSuperPixelGreyscale(cv::Mat &output);
 
+    /*
+     * The capture functions above can also give outputs a whole-number
+     * fraction of the super-pixel size. These give unwrapped images directly,
+     * with the same white balance as readFrame(); unwrapper must be for the
+     * super-pixel size.
+     */
+    void captureSuperPixelUnwrapped(const ImgProc::OpenCVUnwrap360 &unwrapper, cv::Mat &output);
+    void captureSuperPixelGreyscaleUnwrapped(const ImgProc::OpenCVUnwrap360 &unwrapper, cv::Mat &output);
+
     // Calculates entropy, either from whole frame or within subset specified by
     // mask
     // **NOTE** this uses full 10-bit sensor range for calculation
@@ -91,59 +102,10 @@ public:
     static cv::Mat createBubblescopeMask(const cv::Size &camRes);
 
 private:
-    //------------------------------------------------------------------------
-    // PixelScale
-    //------------------------------------------------------------------------
-    // Converts 10-bit intensity values to 8-bit by dividing by 4
-    class PixelScale
-    {
-    public:
-        static uint8_t getR(uint16_t r, uint16_t, uint16_t);
-        static uint8_t getG(uint16_t, uint16_t g, uint16_t);
-        static uint8_t getB(uint16_t, uint16_t, uint16_t b);
-
-    private:
-        static uint8_t getScaled(uint16_t v);
-    };
-
-    //------------------------------------------------------------------------
-    // PixelClamp
-    //------------------------------------------------------------------------
-    // Converts 10-bit intensity values to 8-bit by clamping at 255
-    // **NOTE** this is dubious but a)Is what the qtcam example does and b)Can
-    // LOOK nicer than PixelScale
-    class PixelClamp
-    {
-    public:
-        static uint8_t getR(uint16_t r, uint16_t, uint16_t);
-        static uint8_t getG(uint16_t, uint16_t g, uint16_t);
-        static uint8_t getB(uint16_t, uint16_t, uint16_t b);
-
-    private:
-        static uint8_t getClamped(uint16_t v);
-    };
-
-    //------------------------------------------------------------------------
-    // WhiteBalanceCoolWhite
-    //------------------------------------------------------------------------
-    class WhiteBalanceCoolWhite
-    {
-    public:
-        static uint8_t getR(uint16_t r, uint16_t, uint16_t);
-        static uint8_t getG(uint16_t, uint16_t g, uint16_t);
-        static uint8_t getB(uint16_t, uint16_t, uint16_t b);
-    };
-
-    //------------------------------------------------------------------------
-    // WhiteBalanceU30
-    //------------------------------------------------------------------------
-    class WhiteBalanceU30
-    {
-    public:
-        static uint8_t getR(uint16_t r, uint16_t, uint16_t);
-        static uint8_t getG(uint16_t, uint16_t g, uint16_t);
-        static uint8_t getB(uint16_t, uint16_t, uint16_t b);
-    };
+    using PixelScale = See3CAM_CU40Demosaic::PixelScale;
+    using PixelClamp = See3CAM_CU40Demosaic::PixelClamp;
+    using WhiteBalanceCoolWhite = See3CAM_CU40Demosaic::WhiteBalanceCoolWhite;
+    using WhiteBalanceU30 = See3CAM_CU40Demosaic::WhiteBalanceU30;
 
     //------------------------------------------------------------------------
     // Private API
@@ -151,46 +113,15 @@ private:
     template<typename T>
     void captureSuperPixel(cv::Mat &output)
     {
-        // Check that output size is suitable for super-pixel output i.e. a
-        // quarter input size
-        const unsigned int inputWidth = getWidth();
-        const unsigned int inputHeight = getHeight();
-        BOB_ASSERT(output.cols == (int) inputWidth / 2);
-        BOB_ASSERT(output.rows == (int) inputHeight / 2);
-        BOB_ASSERT(output.type() == CV_8UC3);
-
-        // Read data and size (in bytes) from camera
-        // **NOTE** these pointers are only valid within one frame
-        void *data = nullptr;
-        uint32_t sizeBytes = Video4LinuxCamera::capture(data);
-
-        // Check frame size is correct
-        BOB_ASSERT(sizeBytes == (inputWidth * inputHeight * sizeof(uint16_t)));
-        const uint16_t *bayerData = reinterpret_cast<uint16_t *>(data);
-
-        // Loop through bayer pixels
-        for (unsigned int y = 0; y < inputHeight; y += 2) {
-            // Get pointers to start of both rows of Bayer data and output
-            // RGB data
-            const uint16_t *inBG16Start = &bayerData[y * inputWidth];
-            const uint16_t *inR16Start =
-                    &bayerData[((y + 1) * inputWidth) + 1];
-            uint8_t *outRGBStart = output.ptr(y / 2);
-            for (unsigned int x = 0; x < inputWidth; x += 2) {
-                // Read Bayer pixels
-                const uint16_t b = *(inBG16Start++);
-                const uint16_t g = *(inBG16Start++);
-                const uint16_t r = *inR16Start;
-                inR16Start += 2;
-
-                // Write back to BGR
-                *(outRGBStart++) = T::getB(r, g, b);
-                *(outRGBStart++) = T::getG(r, g, b);
-                *(outRGBStart++) = T::getR(r, g, b);
-            }
-        }
+        See3CAM_CU40Demosaic::superPixel<T>(captureBayer(), getBayerSize(), output);
     }
 
+    cv::Size getBayerSize() const;
+
+    // Read a frame of raw sensor data
+    // **NOTE** this is only valid until the next frame is captured
+    const uint16_t *captureBayer();
+
     //------------------------------------------------------------------------
     // Members
     //------------------------------------------------------------------------
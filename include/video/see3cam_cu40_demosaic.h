@@ -0,0 +1,150 @@
+#pragma once
+
+// OpenCV includes
+#include <opencv2/core.hpp>
+
+// Standard C includes
+#include <cstdint>
+
+namespace BoBRobotics {
+namespace Video {
+//------------------------------------------------------------------------
+// BoBRobotics::Video::See3CAM_CU40Demosaic
+//------------------------------------------------------------------------
+/*!
+ * \brief Converts the See3CAM_CU40's 16-bit RGB-IR Bayer data to 8-bit
+ *        "super-pixel" images, half the resolution of the sensor
+ *
+ * Each 2x2 block of the sensor (B G / IR R) gives one output pixel. Whole
+ * rows are processed at once with NEON or SSE2 where available, split
+ * between threads by cv::parallel_for_. The results are bit-for-bit the same
+ * as the scalar versions (the *Scalar functions), which are kept for
+ * reference and testing.
+ *
+ * Outputs can also be a whole-number fraction of the super-pixel resolution
+ * (sampled as cv::resize() with cv::INTER_NEAREST would) or looked up via an
+ * unwrapping table, so frames can be downscaled or unwrapped without a
+ * full-size intermediate image.
+ */
+namespace See3CAM_CU40Demosaic {
+//------------------------------------------------------------------------
+// PixelScale
+//------------------------------------------------------------------------
+// Converts 10-bit intensity values to 8-bit by dividing by 4
+class PixelScale
+{
+public:
+    static uint8_t getR(uint16_t r, uint16_t, uint16_t);
+    static uint8_t getG(uint16_t, uint16_t g, uint16_t);
+    static uint8_t getB(uint16_t, uint16_t, uint16_t b);
+
+private:
+    static uint8_t getScaled(uint16_t v);
+};
+
+//------------------------------------------------------------------------
+// PixelClamp
+//------------------------------------------------------------------------
+// Converts 10-bit intensity values to 8-bit by clamping at 255
+// **NOTE** this is dubious but a)Is what the qtcam example does and b)Can
+// LOOK nicer than PixelScale
+class PixelClamp
+{
+public:
+    static uint8_t getR(uint16_t r, uint16_t, uint16_t);
+    static uint8_t getG(uint16_t, uint16_t g, uint16_t);
+    static uint8_t getB(uint16_t, uint16_t, uint16_t b);
+
+private:
+    static uint8_t getClamped(uint16_t v);
+};
+
+//------------------------------------------------------------------------
+// WhiteBalanceCoolWhite
+//------------------------------------------------------------------------
+class WhiteBalanceCoolWhite
+{
+public:
+    static uint8_t getR(uint16_t r, uint16_t, uint16_t);
+    static uint8_t getG(uint16_t, uint16_t g, uint16_t);
+    static uint8_t getB(uint16_t, uint16_t, uint16_t b);
+};
+
+//------------------------------------------------------------------------
+// WhiteBalanceU30
+//------------------------------------------------------------------------
+class WhiteBalanceU30
+{
+public:
+    static uint8_t getR(uint16_t r, uint16_t, uint16_t);
+    static uint8_t getG(uint16_t, uint16_t g, uint16_t);
+    static uint8_t getB(uint16_t, uint16_t, uint16_t b);
+};
+
+/*!
+ * \brief Convert a frame to colour (CV_8UC3) with transform T
+ *
+ * T is one of the classes above. output must already be allocated, with a
+ * size of the super-pixel size divided by a whole number.
+ */
+template<typename T>
+void
+superPixel(const uint16_t *bayerData, const cv::Size &bayerSize, cv::Mat &output);
+
+//! Convert a frame to greyscale (CV_8UC1); output is as for superPixel()
+void
+superPixelGreyscale(const uint16_t *bayerData, const cv::Size &bayerSize, cv::Mat &output);
+
+/*!
+ * \brief Convert a frame to colour, taking output pixels from the
+ *        super-pixels given by lut (see ImgProc::OpenCVUnwrap360::getUnwrapLUT())
+ *
+ * output is allocated with the size of lut.
+ */
+template<typename T>
+void
+superPixelLUT(const uint16_t *bayerData, const cv::Size &bayerSize,
+              const cv::Mat &lut, cv::Mat &output);
+
+//! As superPixelLUT(), in greyscale
+void
+superPixelGreyscaleLUT(const uint16_t *bayerData, const cv::Size &bayerSize,
+                       const cv::Mat &lut, cv::Mat &output);
+
+//! The original, pixel-by-pixel version of superPixel() (at full super-pixel size)
+template<typename T>
+void
+superPixelScalar(const uint16_t *bayerData, const cv::Size &bayerSize, cv::Mat &output)
+{
+    const unsigned int inputWidth = bayerSize.width;
+    const unsigned int inputHeight = bayerSize.height;
+
+    // Loop through bayer pixels
+    for (unsigned int y = 0; y < inputHeight; y += 2) {
+        // Get pointers to start of both rows of Bayer data and output
+        // RGB data
+        const uint16_t *inBG16Start = &bayerData[y * inputWidth];
+        const uint16_t *inR16Start =
+                &bayerData[((y + 1) * inputWidth) + 1];
+        uint8_t *outRGBStart = output.ptr(y / 2);
+        for (unsigned int x = 0; x < inputWidth; x += 2) {
+            // Read Bayer pixels
+            const uint16_t b = *(inBG16Start++);
+            const uint16_t g = *(inBG16Start++);
+            const uint16_t r = *inR16Start;
+            inR16Start += 2;
+
+            // Write back to BGR
+            *(outRGBStart++) = T::getB(r, g, b);
+            *(outRGBStart++) = T::getG(r, g, b);
+            *(outRGBStart++) = T::getR(r, g, b);
+        }
+    }
+}
+
+//! The original, pixel-by-pixel version of superPixelGreyscale() (at full super-pixel size)
+void
+superPixelGreyscaleScalar(const uint16_t *bayerData, const cv::Size &bayerSize, cv::Mat &output);
+} // See3CAM_CU40Demosaic
+} // Video
+} // BoBRobotics
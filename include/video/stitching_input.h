@@ -0,0 +1,135 @@
+#pragma once
+
+// BoB robotics includes
+#include "input.h"
+
+// Third-party includes
+#include "third_party/units.h"
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+// Standard C++ includes
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Video {
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::FisheyeCalibration
+//----------------------------------------------------------------------------
+/*!
+ * \brief Calibration for one fisheye camera on a multi-camera rig
+ *
+ * Uses the equidistant lens model, i.e. a point's distance from the centre of
+ * the image is proportional to its angle from the optical axis. Orientations
+ * are relative to the rig, whose x axis points forwards and z axis up.
+ */
+struct FisheyeCalibration
+{
+    using degree_t = units::angle::degree_t;
+
+    //! The resolution this calibration is for
+    cv::Size resolution;
+
+    //! The pixel where the optical axis meets the image
+    cv::Point2d centre;
+
+    //! Distance from the centre of the image per radian from the optical axis
+    double pixelsPerRadian = 0.0;
+
+    //! The widest angle from the optical axis which the lens can see
+    degree_t maxAngle{ 90.0 };
+
+    //! Direction of the optical axis (yaw and pitch) and rotation about it (roll)
+    degree_t yaw{ 0.0 }, pitch{ 0.0 }, roll{ 0.0 };
+
+    void write(cv::FileStorage &fs) const;
+    void read(const cv::FileNode &node);
+}; // FisheyeCalibration
+
+void
+write(cv::FileStorage &fs, const std::string &, const FisheyeCalibration &calibration);
+
+void
+read(const cv::FileNode &node, FisheyeCalibration &calibration,
+     const FisheyeCalibration &defaultValue = FisheyeCalibration());
+
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::StitchingInput
+//----------------------------------------------------------------------------
+/*!
+ * \brief Stitches frames from several fisheye cameras into a single
+ *        equirectangular panorama
+ *
+ * A lookup table giving the camera and source pixel for every output pixel is
+ * built up front, so stitching a frame is a single parallel pass over the
+ * output. Where cameras overlap, each output pixel comes from the camera which
+ * sees it closest to the centre of its image, where fisheye lenses are
+ * sharpest.
+ *
+ * A panorama is only produced when every camera has a new frame and the
+ * frames arrived within maxSkew of each other; otherwise the oldest frame is
+ * dropped. As the output is already a panorama, this can be used anywhere
+ * a Video::Input can.
+ */
+class StitchingInput : public Input
+{
+    using degree_t = units::angle::degree_t;
+    using millisecond_t = units::time::millisecond_t;
+
+public:
+    /*!
+     * \brief Stitch frames from cameras into panoramas of size outputSize
+     *
+     * @param minElevation The elevation at the bottom of the panorama
+     * @param maxElevation The elevation at the top of the panorama
+     * @param maxSkew The greatest time between frames which are stitched together
+     */
+    StitchingInput(std::vector<std::unique_ptr<Input>> cameras,
+                   std::vector<FisheyeCalibration> calibrations,
+                   const cv::Size &outputSize,
+                   degree_t minElevation = degree_t{ -90.0 },
+                   degree_t maxElevation = degree_t{ 90.0 },
+                   millisecond_t maxSkew = millisecond_t{ 20.0 });
+
+    //------------------------------------------------------------------------
+    // Video::Input virtuals
+    //------------------------------------------------------------------------
+    virtual std::string getCameraName() const override;
+    virtual units::frequency::hertz_t getFrameRate() const override;
+    virtual cv::Size getOutputSize() const override;
+    virtual bool needsUnwrapping() const override;
+    virtual void setOutputSize(const cv::Size &outputSize) override;
+    virtual bool readFrame(cv::Mat &outFrame) override;
+    virtual bool readGreyscaleFrame(cv::Mat &outFrame) override;
+
+    //! Number of frames dropped because the other cameras' frames were too far apart
+    size_t getNumDroppedFrames() const;
+
+private:
+    struct Camera
+    {
+        std::unique_ptr<Input> input;
+        FisheyeCalibration calibration;
+        cv::Mat frame;
+        std::chrono::steady_clock::time_point arrivalTime;
+        bool isNew = false;
+    };
+
+    std::vector<Camera> m_Cameras;
+    cv::Size m_OutputSize;
+    const degree_t m_MinElevation, m_MaxElevation;
+    const millisecond_t m_MaxSkew;
+    size_t m_NumDroppedFrames = 0;
+
+    // Camera index and pixel offset for each output pixel (camera is -1 if none sees it)
+    cv::Mat m_LUT;
+
+    void createLUT();
+    bool readFrames();
+}; // StitchingInput
+} // Video
+} // BoBRobotics
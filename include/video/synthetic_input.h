@@ -0,0 +1,131 @@
+#pragma once
+
+// BoB robotics includes
+#include "common/pose.h"
+#include "input.h"
+
+// Third-party includes
+#include "third_party/units.h"
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+// Standard C includes
+#include <cstdint>
+
+// Standard C++ includes
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace BoBRobotics {
+namespace Video {
+//----------------------------------------------------------------------------
+// BoBRobotics::Video::SyntheticInput
+//----------------------------------------------------------------------------
+/*!
+ * \brief Renders panoramic views of a procedurally generated world, for
+ *        testing and profiling without a camera or OpenGL
+ *
+ * The world is a flat plain scattered with cylindrical landmarks of varying
+ * sizes and colours, in front of a range of distant hills. An agent moves
+ * along a scripted trajectory (by default, round a circle) and each frame is
+ * the view from its pose at the next time step, so nearby landmarks shift
+ * against the skyline as it moves. The same seed always gives the same world
+ * and frames.
+ *
+ * Frames are equirectangular panoramas with square pixels, centred on the
+ * horizon, or, if wrapped is set, the same view as a catadioptric camera with
+ * the parameters in synthetic.yaml would see it, so that ImgProc::OpenCVUnwrap360
+ * gets exercised too.
+ *
+ * Time advances by one frame period per frame read. By default, frames are
+ * produced as fast as they can be rendered; setRealTime() paces them at the
+ * frame rate instead.
+ */
+class SyntheticInput : public Input
+{
+    using degree_t = units::angle::degree_t;
+    using hertz_t = units::frequency::hertz_t;
+    using meter_t = units::length::meter_t;
+    using second_t = units::time::second_t;
+
+public:
+    using Pose = Pose2<meter_t, degree_t>;
+
+    //! Gives the agent's pose at a given time
+    using Trajectory = std::function<Pose(second_t)>;
+
+    SyntheticInput(const cv::Size &size,
+                   hertz_t frameRate = hertz_t{ 30 },
+                   bool wrapped = false,
+                   uint32_t seed = 0);
+
+    //------------------------------------------------------------------------
+    // Video::Input virtuals
+    //------------------------------------------------------------------------
+    virtual std::string getCameraName() const override;
+    virtual hertz_t getFrameRate() const override;
+    virtual cv::Size getOutputSize() const override;
+    virtual bool needsUnwrapping() const override;
+    virtual void setOutputSize(const cv::Size &outSize) override;
+    virtual bool readFrame(cv::Mat &outFrame) override;
+    virtual bool readGreyscaleFrame(cv::Mat &outFrame) override;
+
+    //------------------------------------------------------------------------
+    // Public API
+    //------------------------------------------------------------------------
+    //! Replace the agent's trajectory, starting again from time zero
+    void setTrajectory(Trajectory trajectory);
+
+    //! Whether to wait for each frame to be due, rather than rendering them as fast as possible
+    void setRealTime(bool realTime);
+
+    //! The agent's pose in the last frame read
+    const Pose &getPose() const;
+
+    //! The time of the last frame read, from the start of the trajectory
+    second_t getTime() const;
+
+    //! Render the view from any pose, as an unwrapped panorama
+    void renderPanorama(const Pose &pose, cv::Mat &outFrame, bool greyscale = false) const;
+
+    //! Trajectory going anticlockwise round a circle about the origin
+    static Trajectory circle(meter_t radius = meter_t{ 10 },
+                             units::velocity::meters_per_second_t speed = units::velocity::meters_per_second_t{ 1 });
+
+    static constexpr const char *CameraName = "synthetic";
+
+private:
+    struct Landmark
+    {
+        meter_t x, y, radius, height;
+        cv::Vec3b colour;
+    };
+
+    cv::Size m_Size, m_PanoramaSize;
+    const hertz_t m_FrameRate;
+    const bool m_Wrapped;
+    std::vector<Landmark> m_Landmarks;
+
+    // Elevation of the hills at each degree of azimuth
+    std::vector<degree_t> m_Hills;
+
+    // Offset into the panorama of each pixel of a wrapped frame, or -1 if outside the mirror
+    std::vector<int32_t> m_WrapLUT;
+
+    Trajectory m_Trajectory;
+    bool m_RealTime = false;
+    size_t m_FrameCount = 0;
+    Pose m_Pose;
+    std::chrono::steady_clock::time_point m_StartTime;
+    cv::Mat m_Panorama;
+
+    bool readFrame(cv::Mat &outFrame, bool greyscale);
+    void createWrapLUT();
+    template<typename PixelType>
+    void render(const Pose &pose, cv::Mat &panorama) const;
+}; // SyntheticInput
+} // Video
+} // BoBRobotics
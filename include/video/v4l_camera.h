@@ -2,22 +2,81 @@
 #ifdef __linux__
 
 // Standard C++ includes
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 // Standard C includes
 #include <cstdint>
 
+// POSIX includes
+#include <sys/types.h>
+
 // Video4Linux includes
 #include <linux/videodev2.h>
 
 namespace BoBRobotics {
 namespace Video {
+//------------------------------------------------------------------------
+// BoBRobotics::Video::Video4LinuxDevice
+//------------------------------------------------------------------------
+/*!
+ * \brief The system calls Video4LinuxCamera makes on a device
+ *
+ * These mirror the POSIX functions of the same names (including returning -1
+ * and setting errno on failure), so that the camera can be tested against a
+ * fake device.
+ */
+class Video4LinuxDevice
+{
+public:
+    virtual ~Video4LinuxDevice();
+
+    virtual int ioctl(unsigned long request, void *arg) = 0;
+    virtual void *mmap(size_t length, off_t offset) = 0;
+    virtual int munmap(void *address, size_t length) = 0;
+
+    //! Wait up to timeoutMs (-1 for no limit) for a frame to be ready; 0 means timed out
+    virtual int poll(int timeoutMs) = 0;
+}; // Video4LinuxDevice
+
+//------------------------------------------------------------------------
+// BoBRobotics::Video::Video4LinuxFileDevice
+//------------------------------------------------------------------------
+//! A real Video4Linux device file, e.g. /dev/video0
+class Video4LinuxFileDevice
+  : public Video4LinuxDevice
+{
+public:
+    //! Takes ownership of the open file descriptor fd
+    explicit Video4LinuxFileDevice(int fd);
+    virtual ~Video4LinuxFileDevice() override;
+
+    virtual int ioctl(unsigned long request, void *arg) override;
+    virtual void *mmap(size_t length, off_t offset) override;
+    virtual int munmap(void *address, size_t length) override;
+    virtual int poll(int timeoutMs) override;
+
+private:
+    const int m_FD;
+}; // Video4LinuxFileDevice
+
 //------------------------------------------------------------------------
 // BoBRobotics::Video::Video4LinuxCamera
 //------------------------------------------------------------------------
-//! An interface for the low-level Video4Linux API
+/*!
+ * \brief An interface for the low-level Video4Linux API
+ *
+ * The driver is given a queue of numBuffers memory-mapped buffers to fill.
+ * Captured frames are handed out as Frame objects, which own their buffer
+ * until they are destroyed, whereupon it goes back on the driver's queue. So
+ * long as some buffers are queued, holding on to frames for a while (e.g.
+ * for processing on another thread) doesn't make the driver drop frames.
+ */
 class Video4LinuxCamera
 {
 public:
@@ -28,11 +87,56 @@ public:
         Error(const std::string &msg);
     };
 
+    //------------------------------------------------------------------------
+    // BoBRobotics::Video::Video4LinuxCamera::Frame
+    //------------------------------------------------------------------------
+    /*!
+     * \brief A captured frame, whose buffer is requeued when it is destroyed
+     *
+     * Frames can be released on any thread, but must be released before the
+     * camera is destroyed.
+     */
+    class Frame
+    {
+    public:
+        Frame() = default;
+        Frame(Frame &&other) noexcept;
+        Frame &operator=(Frame &&other) noexcept;
+        ~Frame();
+
+        //! Whether this holds a frame (capture can time out)
+        explicit operator bool() const;
+
+        //! Give the buffer back to the driver now
+        void release();
+
+        const void *getData() const;
+
+        //! Number of bytes of data in the frame
+        uint32_t getSize() const;
+
+        //! Sequence number assigned by the driver; gaps mean frames were dropped
+        uint32_t getSequence() const;
+
+        //! The driver's timestamp for the frame (usually on the CLOCK_MONOTONIC clock)
+        std::chrono::microseconds getTimestamp() const;
+
+    private:
+        friend class Video4LinuxCamera;
+
+        Video4LinuxCamera *m_Camera = nullptr;
+        v4l2_buffer m_BufferInfo{};
+        const void *m_Data = nullptr;
+
+        Frame(Video4LinuxCamera &camera, const v4l2_buffer &bufferInfo, const void *data);
+    }; // Frame
+
     Video4LinuxCamera();
     Video4LinuxCamera(const std::string &device,
                       unsigned int width,
                       unsigned int height,
-                      uint32_t pixelFormat);
+                      uint32_t pixelFormat,
+                      unsigned int numBuffers = 4);
     ~Video4LinuxCamera();
 
     //------------------------------------------------------------------------
@@ -41,26 +145,73 @@ public:
     void open(const std::string &device,
               unsigned int width,
               unsigned int height,
-              uint32_t pixelFormat);
+              uint32_t pixelFormat,
+              unsigned int numBuffers = 4);
+
+    //! Use an already-open device, e.g. a fake one for testing
+    void open(std::unique_ptr<Video4LinuxDevice> device,
+              unsigned int width,
+              unsigned int height,
+              uint32_t pixelFormat,
+              unsigned int numBuffers = 4);
+
     void enumerateControls(const std::function<void(const v4l2_queryctrl &)> &processControl);
     void queryControl(uint32_t id, v4l2_queryctrl &queryControl);
+
+    /*!
+     * \brief Wait up to timeoutMs (-1 for no limit) for the next frame
+     *
+     * Returns an empty Frame on timeout, or if poll() wakes up spuriously
+     * without a frame being ready. Throws if every buffer is held by
+     * a Frame, as none could ever be filled.
+     */
+    Frame captureFrame(int timeoutMs = -1);
+
+    /*!
+     * \brief Wait for the next frame, giving a pointer to its data
+     *
+     * The data is only valid until the next call to capture().
+     *
+     * @return The number of bytes of data in the frame
+     */
     uint32_t capture(void *&buffer);
+
+    //! Throw away any frames which have already been captured
+    void flush();
+
     int32_t getControlValue(uint32_t id) const;
     void setControlValue(uint32_t id, int32_t value);
 
+    //! Number of buffers the driver gave us
+    unsigned int getNumBuffers() const;
+
+    //! Number of frames the driver dropped, going by gaps in sequence numbers
+    uint64_t getNumDroppedFrames() const;
+
 private:
     //------------------------------------------------------------------------
     // Members
     //------------------------------------------------------------------------
-    // File handle to camera
-    int m_Camera;
+    // Camera device
+    std::unique_ptr<Video4LinuxDevice> m_Device;
+
+    // Buffers and their corresponding information structures
+    std::vector<void *> m_Buffers;
+    std::vector<v4l2_buffer> m_BufferInfo;
+
+    // Number of buffers currently queued with the driver
+    std::atomic<unsigned int> m_NumQueued{ 0 };
+
+    // For spotting dropped frames
+    bool m_HasSequence = false;
+    uint32_t m_LastSequence = 0;
+    uint64_t m_NumDroppedFrames = 0;
 
-    // Index of current frame - used to select correct buffer
-    unsigned int m_Frame;
+    // The frame whose data capture() last passed out
+    Frame m_CaptureFrame;
 
-    // Two buffers and their corresponding information structures
-    void *m_Buffer[2];
-    v4l2_buffer m_BufferInfo[2];
+    void close();
+    void enqueue(const v4l2_buffer &bufferInfo);
 }; // Video4LinuxCamera
 } // Video
 } // BoBRobotics
@@ -205,8 +205,8 @@ void InfoMax::train(const cv::Mat &snapshot, const ImgProc::Mask &mask)
 //-----------------------------------------------------------------------
 void InfoMax::saveWeights(const filesystem::path &filename) const
 {
-    // Write weights to disk
-    writeMatrix(filename, getInfoMax().getWeights());
+    // Write network to disk
+    getInfoMax().serialise(filename);
 }
 //-----------------------------------------------------------------------
 InfoMax::InfoMaxType InfoMax::createInfoMax(const Config &config, const cv::Size &inputSize)
@@ -215,6 +215,13 @@ InfoMax::InfoMaxType InfoMax::createInfoMax(const Config &config, const cv::Size
     if(weightPath.exists()) {
         LOGI << "\tLoading weights from " << weightPath;
 
+        if(InfoMaxType::isSerialisedFile(weightPath)) {
+            auto infoMax = InfoMaxType::deserialise(weightPath);
+            BOB_ASSERT(infoMax.getUnwrapResolution() == inputSize);
+            return infoMax;
+        }
+
+        // Fall back to loading bare weight matrices saved by older versions
         const auto weights = readMatrix<InfoMaxWeightMatrixType::Scalar>(weightPath);
         return InfoMaxType(inputSize, weights);
     }
@@ -0,0 +1,45 @@
+// BoB robotics includes
+#include "common/hash.h"
+
+// Standard C++ includes
+#include <iomanip>
+#include <sstream>
+
+namespace BoBRobotics {
+FNV1aHash &
+FNV1aHash::add(const void *data, size_t size)
+{
+    const auto bytes = reinterpret_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+        m_Hash ^= bytes[i];
+        m_Hash *= 0x100000001b3ULL;
+    }
+    return *this;
+}
+
+FNV1aHash &
+FNV1aHash::add(const std::string &str)
+{
+    return add(str.data(), str.size());
+}
+
+uint64_t
+FNV1aHash::get() const
+{
+    return m_Hash;
+}
+
+uint64_t
+hashString(const std::string &str)
+{
+    return FNV1aHash{}.add(str).get();
+}
+
+std::string
+toHexString(uint64_t value)
+{
+    std::ostringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return ss.str();
+}
+} // BoBRobotics
@@ -0,0 +1,109 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "common/memory_mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Standard C++ includes
+#include <stdexcept>
+#include <string>
+
+namespace BoBRobotics {
+MemoryMappedFile::MemoryMappedFile(const filesystem::path &filePath)
+  : m_Path(filePath)
+{
+#ifdef _WIN32
+    m_FileHandle = CreateFileW(filePath.wstr().c_str(), GENERIC_READ, FILE_SHARE_READ,
+                               nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_FileHandle == INVALID_HANDLE_VALUE) {
+        m_FileHandle = nullptr;
+        throw std::runtime_error("Could not open " + filePath.str());
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_FileHandle, &size)) {
+        CloseHandle(m_FileHandle);
+        throw std::runtime_error("Could not get size of " + filePath.str());
+    }
+    m_Size = static_cast<size_t>(size.QuadPart);
+
+    // Windows refuses to map empty files, so leave m_Data as null
+    if (m_Size == 0) {
+        return;
+    }
+
+    m_MappingHandle = CreateFileMappingW(m_FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_MappingHandle) {
+        CloseHandle(m_FileHandle);
+        throw std::runtime_error("Could not map " + filePath.str());
+    }
+    m_Data = static_cast<const uint8_t *>(MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!m_Data) {
+        CloseHandle(m_MappingHandle);
+        CloseHandle(m_FileHandle);
+        throw std::runtime_error("Could not map " + filePath.str());
+    }
+#else
+    const int fd = ::open(filePath.str().c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + filePath.str());
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not get size of " + filePath.str());
+    }
+    m_Size = static_cast<size_t>(st.st_size);
+
+    // mmap() fails for zero-length mappings, so leave m_Data as null
+    if (m_Size > 0) {
+        void *data = mmap(nullptr, m_Size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Could not map " + filePath.str());
+        }
+        m_Data = static_cast<const uint8_t *>(data);
+    }
+
+    // The mapping stays valid after the file descriptor is closed
+    ::close(fd);
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+#ifdef _WIN32
+    if (m_Data) {
+        UnmapViewOfFile(m_Data);
+    }
+    if (m_MappingHandle) {
+        CloseHandle(m_MappingHandle);
+    }
+    if (m_FileHandle) {
+        CloseHandle(m_FileHandle);
+    }
+#else
+    if (m_Data) {
+        munmap(const_cast<uint8_t *>(m_Data), m_Size);
+    }
+#endif
+}
+
+void
+MemoryMappedFile::checkRange(size_t offset, size_t length) const
+{
+    if (offset > m_Size || length > m_Size - offset) {
+        throw std::runtime_error("Read past end of " + m_Path.str() + " (offset: " +
+                                 std::to_string(offset) + ", length: " +
+                                 std::to_string(length) + ")");
+    }
+}
+} // BoBRobotics
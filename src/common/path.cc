@@ -1,4 +1,5 @@
 // BoB robotics includes
+#include "common/hash.h"
 #include "common/macros.h"
 #include "common/path.h"
 
@@ -13,10 +14,12 @@
 #endif
 
 // Standard C includes
+#include <cstdio>
 #include <cstdlib>
 
 // Standard C++ includes
 #include <iomanip>
+#include <random>
 #include <sstream>
 #include <stdexcept>
 
@@ -104,5 +107,26 @@ getNewPath(const filesystem::path &rootPath, const std::string &extension)
     const auto currentTime = localtime(&timer);
     return getNewPath(*currentTime, rootPath, extension);
 }
+
+void
+writeFileAtomically(const filesystem::path &filePath,
+                    const std::function<void(const filesystem::path &tempPath)> &writeFile)
+{
+    std::random_device rd;
+    const uint64_t suffix = (static_cast<uint64_t>(rd()) << 32) | rd();
+    const auto tempPath = filePath.parent_path() /
+                          (filePath.filename() + "." + toHexString(suffix) + "." + TempFileExtension);
+    try {
+        writeFile(tempPath);
+    } catch (...) {
+        tempPath.remove_file();
+        throw;
+    }
+
+    if (std::rename(tempPath.str().c_str(), filePath.str().c_str()) != 0) {
+        tempPath.remove_file();
+        throw std::runtime_error("Could not rename " + tempPath.str() + " to " + filePath.str());
+    }
+}
 } // Path
 } // BoBRobotics
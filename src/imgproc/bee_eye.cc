@@ -3,16 +3,131 @@
 
 // Standard C includes
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Standard C++ includes
+#include <limits>
 
 namespace BoBRobotics {
 namespace ImgProc {
 namespace BeeEye {
+namespace {
+// Copy pixels of a fixed size so the compiler can inline the copies
+template<size_t PixelSize>
+void
+gatherRow(const uint8_t *input, const int32_t *lut, int width, uint8_t *output)
+{
+    for (int j = 0; j < width; j++, output += PixelSize) {
+        if (lut[j] < 0) {
+            std::memset(output, 0, PixelSize);
+        } else {
+            std::memcpy(output, input + PixelSize * lut[j], PixelSize);
+        }
+    }
+}
+
+void
+gatherRow(const uint8_t *input, const int32_t *lut, int width, uint8_t *output,
+          size_t pixelSize)
+{
+    for (int j = 0; j < width; j++, output += pixelSize) {
+        if (lut[j] < 0) {
+            std::memset(output, 0, pixelSize);
+        } else {
+            std::memcpy(output, input + pixelSize * lut[j], pixelSize);
+        }
+    }
+}
+} // anonymous namespace
 
 //! Takes an input image and transforms it with the Giger bee-eye transform
 void Map::getEyeView(const cv::Mat &in, cv::Mat &out)
 {
-    remap(in, out, m_MapX, m_MapY, cv::INTER_NEAREST);
-    out.setTo(cv::Scalar{ 0, 0, 0 }, m_Mask);
+    if (in.size() != m_InputSize) {
+        createLUT(in.size());
+    }
+
+    // The lookup table gives offsets into a continuous image
+    const cv::Mat input = in.isContinuous() ? in : in.clone();
+    out.create(m_LUT.size(), input.type());
+    cv::parallel_for_(cv::Range(0, m_LUT.rows), [&](const cv::Range &rows) {
+        gather(input, out, rows);
+    });
+}
+
+void Map::getEyeViews(const std::vector<cv::Mat> &in, std::vector<cv::Mat> &out)
+{
+    // Make sure the lookup table is ready before we start on the images
+    for (const auto &image : in) {
+        BOB_ASSERT(image.size() == in[0].size());
+    }
+    if (!in.empty() && in[0].size() != m_InputSize) {
+        createLUT(in[0].size());
+    }
+
+    // The lookup table gives offsets into continuous images
+    std::vector<cv::Mat> inputs(in.size());
+    out.resize(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        inputs[i] = in[i].isContinuous() ? in[i] : in[i].clone();
+        out[i].create(m_LUT.size(), in[i].type());
+    }
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(in.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            gather(inputs[i], out[i], cv::Range(0, m_LUT.rows));
+        }
+    });
+}
+
+cv::Size Map::getEyeSize() const
+{
+    return m_Coordinates.size();
+}
+
+void Map::createLUT(const cv::Size &inputSize)
+{
+    BOB_ASSERT(static_cast<int64_t>(inputSize.width) * inputSize.height <= std::numeric_limits<int32_t>::max());
+
+    m_InputSize = inputSize;
+    m_LUT.create(m_Coordinates.size(), CV_32SC1);
+    for (int i = 0; i < m_Coordinates.rows; i++) {
+        const auto coordinatesRow = m_Coordinates.ptr<cv::Vec2i>(i);
+        auto lutRow = m_LUT.ptr<int32_t>(i);
+        for (int j = 0; j < m_Coordinates.cols; j++) {
+            // Pixels outside the input are black, as with cv::remap()
+            const int x = coordinatesRow[j][0], y = coordinatesRow[j][1];
+            if (x < 0 || x >= inputSize.width || y < 0 || y >= inputSize.height) {
+                lutRow[j] = -1;
+            } else {
+                lutRow[j] = y * inputSize.width + x;
+            }
+        }
+    }
+}
+
+void Map::gather(const cv::Mat &input, cv::Mat &out, const cv::Range &rows) const
+{
+    BOB_ASSERT(input.isContinuous());
+    const size_t pixelSize = input.elemSize();
+    for (int i = rows.start; i < rows.end; i++) {
+        const auto lutRow = m_LUT.ptr<int32_t>(i);
+        const auto outRow = out.ptr<uint8_t>(i);
+        switch (pixelSize) {
+        case 1:
+            gatherRow<1>(input.ptr<uint8_t>(), lutRow, m_LUT.cols, outRow);
+            break;
+        case 3:
+            gatherRow<3>(input.ptr<uint8_t>(), lutRow, m_LUT.cols, outRow);
+            break;
+        case 4:
+            gatherRow<4>(input.ptr<uint8_t>(), lutRow, m_LUT.cols, outRow);
+            break;
+        default:
+            gatherRow(input.ptr<uint8_t>(), lutRow, m_LUT.cols, outRow, pixelSize);
+        }
+    }
 }
 
 } // BeeEye
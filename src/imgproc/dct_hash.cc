@@ -0,0 +1,384 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "imgproc/dct_hash.h"
+
+// Standard C includes
+#include <cmath>
+
+// Standard C++ includes
+#include <limits>
+#include <memory>
+#include <queue>
+
+namespace BoBRobotics {
+namespace ImgProc {
+namespace DCTHash {
+namespace {
+/*
+ * computeHash() compares the first 64 coefficients of the DCT's top row with
+ * the median of the low 8x8 frequencies, so those are all we need.
+ */
+constexpr int BlockSize = 8;
+constexpr int NumBits = 64;
+
+class PartialDCT
+{
+public:
+    PartialDCT(const cv::Size &size)
+      : m_Size(size)
+      , m_RowCosines(BlockSize * size.height)
+      , m_ColumnCosines(NumBits * size.width)
+    {
+        // Use the same (orthonormal) scaling as cv::dct
+        for (int u = 0; u < BlockSize; u++) {
+            const double scale = std::sqrt((u == 0 ? 1.0 : 2.0) / size.height);
+            for (int y = 0; y < size.height; y++) {
+                m_RowCosines[u * size.height + y] = scale * std::cos(CV_PI * (2 * y + 1) * u / (2.0 * size.height));
+            }
+        }
+        for (int v = 0; v < NumBits; v++) {
+            const double scale = std::sqrt((v == 0 ? 1.0 : 2.0) / size.width);
+            for (int x = 0; x < size.width; x++) {
+                m_ColumnCosines[v * size.width + x] = scale * std::cos(CV_PI * (2 * x + 1) * v / (2.0 * size.width));
+            }
+        }
+    }
+
+    // We can only skip the full DCT if the top row has enough coefficients for every bit
+    static bool canUse(const cv::Size &size)
+    {
+        return size.width >= NumBits && size.height >= BlockSize;
+    }
+
+    const cv::Size &getSize() const { return m_Size; }
+
+    /*
+     * Do the vertical part of the DCT for the first BlockSize frequencies,
+     * giving a BlockSize x width matrix. This is the bulk of the work.
+     */
+    void transformColumns(const cv::Mat &image, std::vector<double> &columns) const
+    {
+        BOB_ASSERT(image.size() == m_Size);
+        columns.assign(BlockSize * m_Size.width, 0.0);
+        for (int y = 0; y < m_Size.height; y++) {
+            if (image.depth() == CV_8U) {
+                addRow(image.ptr<uint8_t>(y), y, columns);
+            } else {
+                addRow(image.ptr<float>(y), y, columns);
+            }
+        }
+    }
+
+    //! Get the hash from the output of transformColumns(), rolled left by shift pixels
+    std::bitset<64> getHash(const std::vector<double> &columns, int shift) const
+    {
+        std::array<float, BlockSize * BlockSize> block;
+        for (int u = 0; u < BlockSize; u++) {
+            for (int v = 0; v < BlockSize; v++) {
+                block[u * BlockSize + v] = getCoefficient(columns, u, v, shift);
+            }
+        }
+
+        std::array<float, 33> sorted;
+        std::partial_sort_copy(block.begin(), block.end(), sorted.begin(), sorted.end());
+        const float median = (sorted[31] + sorted[32]) / 2;
+
+        std::bitset<64> binary;
+        for (int v = 0; v < NumBits; v++) {
+            const float coefficient = (v < BlockSize) ? block[v] : getCoefficient(columns, 0, v, shift);
+            if (coefficient > median) {
+                binary.set(v, 1);
+            }
+        }
+        return binary;
+    }
+
+private:
+    const cv::Size m_Size;
+    std::vector<double> m_RowCosines, m_ColumnCosines;
+
+    template<class T>
+    void addRow(const T *row, int y, std::vector<double> &columns) const
+    {
+        for (int u = 0; u < BlockSize; u++) {
+            const double weight = m_RowCosines[u * m_Size.height + y];
+            double *out = &columns[u * m_Size.width];
+            for (int x = 0; x < m_Size.width; x++) {
+                out[x] += weight * row[x];
+            }
+        }
+    }
+
+    float getCoefficient(const std::vector<double> &columns, int u, int v, int shift) const
+    {
+        // Rolling the image left by shift means column x comes from column x + shift
+        const double *in = &columns[u * m_Size.width];
+        const double *cosines = &m_ColumnCosines[v * m_Size.width];
+        const int split = m_Size.width - shift;
+        double sum = 0.0;
+        for (int x = 0; x < split; x++) {
+            sum += in[x + shift] * cosines[x];
+        }
+        for (int x = split; x < m_Size.width; x++) {
+            sum += in[x - split] * cosines[x];
+        }
+        return static_cast<float>(sum);
+    }
+};
+
+// For images too small to skip the full DCT
+cv::Mat
+toFloat(const cv::Mat &image)
+{
+    if (image.type() == CV_32FC1) {
+        return image;
+    }
+
+    cv::Mat converted;
+    image.convertTo(converted, CV_32FC1);
+    return converted;
+}
+
+cv::Mat
+rollLeft(const cv::Mat &image, int pixelsLeft)
+{
+    if (pixelsLeft == 0) {
+        return image;
+    }
+
+    cv::Mat rolled;
+    cv::hconcat(image.colRange(pixelsLeft, image.cols), image.colRange(0, pixelsLeft), rolled);
+    return rolled;
+}
+
+int
+getRotationShift(const cv::Mat &image, size_t rotation, size_t numRotations)
+{
+    return static_cast<int>(rotation * static_cast<size_t>(image.cols) / numRotations);
+}
+} // anonymous namespace
+
+std::vector<std::bitset<64>>
+computeHashes(const std::vector<cv::Mat> &images)
+{
+    std::vector<std::bitset<64>> hashes(images.size());
+    if (images.empty()) {
+        return hashes;
+    }
+
+    // Usually all the images are the same size, so they can share the cosine tables
+    std::shared_ptr<const PartialDCT> sharedDCT;
+    if (PartialDCT::canUse(images[0].size())) {
+        sharedDCT = std::make_shared<const PartialDCT>(images[0].size());
+    }
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(images.size())), [&](const cv::Range &range) {
+        std::vector<double> columns;
+        auto dct = sharedDCT;
+        for (int i = range.start; i < range.end; i++) {
+            const auto &image = images[i];
+            BOB_ASSERT(image.channels() == 1);
+            if (!PartialDCT::canUse(image.size())) {
+                hashes[i] = computeHash(toFloat(image));
+                continue;
+            }
+            if (!dct || dct->getSize() != image.size()) {
+                dct = std::make_shared<const PartialDCT>(image.size());
+            }
+
+            if (image.depth() == CV_8U || image.depth() == CV_32F) {
+                dct->transformColumns(image, columns);
+            } else {
+                dct->transformColumns(toFloat(image), columns);
+            }
+            hashes[i] = dct->getHash(columns, 0);
+        }
+    });
+
+    return hashes;
+}
+
+std::vector<std::bitset<64>>
+computeRotatedHashes(const cv::Mat &image, size_t numRotations)
+{
+    BOB_ASSERT(image.channels() == 1);
+    BOB_ASSERT(numRotations > 0 && numRotations <= static_cast<size_t>(image.cols));
+
+    std::vector<std::bitset<64>> hashes(numRotations);
+    if (!PartialDCT::canUse(image.size())) {
+        const auto floatImage = toFloat(image);
+        for (size_t i = 0; i < numRotations; i++) {
+            hashes[i] = computeHash(rollLeft(floatImage, getRotationShift(image, i, numRotations)));
+        }
+        return hashes;
+    }
+
+    // Rolling the image doesn't affect the vertical part of the DCT, so we only do it once
+    const PartialDCT dct{ image.size() };
+    std::vector<double> columns;
+    if (image.depth() == CV_8U || image.depth() == CV_32F) {
+        dct.transformColumns(image, columns);
+    } else {
+        dct.transformColumns(toFloat(image), columns);
+    }
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(numRotations)), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            hashes[i] = dct.getHash(columns, getRotationShift(image, i, numRotations));
+        }
+    });
+
+    return hashes;
+}
+
+std::pair<int, size_t>
+rotatedDistance(const std::vector<std::bitset<64>> &rotatedHashes,
+                const std::bitset<64> &hash)
+{
+    BOB_ASSERT(!rotatedHashes.empty());
+
+    std::pair<int, size_t> best{ std::numeric_limits<int>::max(), 0 };
+    for (size_t i = 0; i < rotatedHashes.size(); i++) {
+        const int d = distance(rotatedHashes[i], hash);
+        if (d < best.first) {
+            best = { d, i };
+        }
+    }
+    return best;
+}
+
+constexpr int HashIndex::NumTables;
+constexpr int HashIndex::SubstringBits;
+
+HashIndex::HashIndex(const std::vector<std::bitset<64>> &hashes)
+{
+    BOB_ASSERT(hashes.size() <= std::numeric_limits<uint32_t>::max());
+
+    m_Hashes.reserve(hashes.size());
+    for (const auto &hash : hashes) {
+        m_Hashes.push_back(hash.to_ullong());
+    }
+
+    // Counting sort the hashes by each substring
+    for (int table = 0; table < NumTables; table++) {
+        auto &offsets = m_Offsets[table];
+        offsets.assign((1 << SubstringBits) + 1, 0);
+        for (const auto hash : m_Hashes) {
+            offsets[getSubstring(hash, table) + 1]++;
+        }
+        for (size_t i = 1; i < offsets.size(); i++) {
+            offsets[i] += offsets[i - 1];
+        }
+
+        auto &indices = m_Indices[table];
+        indices.resize(m_Hashes.size());
+        auto next = offsets;
+        for (size_t i = 0; i < m_Hashes.size(); i++) {
+            indices[next[getSubstring(m_Hashes[i], table)]++] = static_cast<uint32_t>(i);
+        }
+    }
+}
+
+size_t
+HashIndex::size() const
+{
+    return m_Hashes.size();
+}
+
+std::vector<std::pair<size_t, int>>
+HashIndex::nearest(const std::bitset<64> &query, size_t k) const
+{
+    BOB_ASSERT(k > 0);
+    const uint64_t queryValue = query.to_ullong();
+
+    // A max-heap of (distance, index), so the worst result is on top
+    std::priority_queue<std::pair<int, size_t>> best;
+    for (int s = 0; s <= SubstringBits; s++) {
+        searchSubstringDistance(queryValue, s, [&](size_t index, int d) {
+            if (best.size() < k) {
+                best.emplace(d, index);
+            } else if (std::make_pair(d, index) < best.top()) {
+                best.pop();
+                best.emplace(d, index);
+            }
+        });
+
+        // By now we've seen every hash closer than NumTables * (s + 1)
+        if (best.size() == k && best.top().first < NumTables * (s + 1)) {
+            break;
+        }
+    }
+
+    std::vector<std::pair<size_t, int>> results(best.size());
+    for (auto it = results.rbegin(); it != results.rend(); ++it) {
+        *it = { best.top().second, best.top().first };
+        best.pop();
+    }
+    return results;
+}
+
+std::vector<std::pair<size_t, int>>
+HashIndex::withinDistance(const std::bitset<64> &query, int maxDistance) const
+{
+    BOB_ASSERT(maxDistance >= 0);
+    const uint64_t queryValue = query.to_ullong();
+
+    std::vector<std::pair<size_t, int>> results;
+    for (int s = 0; s <= std::min(maxDistance / NumTables, SubstringBits); s++) {
+        searchSubstringDistance(queryValue, s, [&](size_t index, int d) {
+            if (d <= maxDistance) {
+                results.emplace_back(index, d);
+            }
+        });
+    }
+
+    std::sort(results.begin(), results.end(), [](const auto &a, const auto &b) {
+        return std::make_pair(a.second, a.first) < std::make_pair(b.second, b.first);
+    });
+    return results;
+}
+
+/*
+ * Call func(index, distance) for every hash whose nearest substring to the
+ * query's is exactly substringDistance away. Calling this for increasing
+ * distances visits each hash once.
+ */
+template<class Func>
+void
+HashIndex::searchSubstringDistance(uint64_t query, int substringDistance, const Func &func) const
+{
+    constexpr uint32_t NumSubstrings = 1U << SubstringBits;
+    for (int table = 0; table < NumTables; table++) {
+        const auto &offsets = m_Offsets[table];
+        const auto &indices = m_Indices[table];
+        const uint16_t querySubstring = getSubstring(query, table);
+
+        // Go through all the masks with substringDistance bits set (Gosper's hack)
+        for (uint32_t mask = (1U << substringDistance) - 1; mask < NumSubstrings;) {
+            const uint16_t substring = querySubstring ^ static_cast<uint16_t>(mask);
+            for (uint32_t i = offsets[substring]; i < offsets[substring + 1]; i++) {
+                const uint64_t hash = m_Hashes[indices[i]];
+
+                // Skip hashes which are found at a smaller distance or in an earlier table
+                bool isFirst = true;
+                for (int other = 0; other < NumTables && isFirst; other++) {
+                    const int d = static_cast<int>(std::bitset<SubstringBits>(getSubstring(hash ^ query, other)).count());
+                    isFirst = (other < table) ? (d > substringDistance) : (d >= substringDistance);
+                }
+                if (isFirst) {
+                    func(indices[i], static_cast<int>(std::bitset<64>(hash ^ query).count()));
+                }
+            }
+
+            if (mask == 0) {
+                break;
+            }
+            const uint32_t lowest = mask & -mask;
+            const uint32_t ripple = mask + lowest;
+            mask = (((ripple ^ mask) >> 2) / lowest) | ripple;
+        }
+    }
+}
+} // DCTHash
+} // ImgProc
+} // BoBRobotics
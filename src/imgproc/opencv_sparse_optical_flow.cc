@@ -0,0 +1,191 @@
+// BoB robotics includes
+#include "imgproc/opencv_sparse_optical_flow.h"
+#include "common/macros.h"
+
+// Standard C includes
+#include <cmath>
+
+// Standard C++ includes
+#include <utility>
+
+// OpenCV includes
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+namespace BoBRobotics {
+namespace ImgProc {
+//----------------------------------------------------------------------------
+// OpenCVSparseOpticalFlow
+//----------------------------------------------------------------------------
+
+OpenCVSparseOpticalFlow::OpenCVSparseOpticalFlow()
+  : m_MaxLevel(0)
+  , m_Frame(0)
+{
+}
+
+OpenCVSparseOpticalFlow::OpenCVSparseOpticalFlow(const cv::Size &inputRes, const cv::Size &gridSize,
+                                                 const cv::Size &winSize, int maxLevel)
+  : OpenCVSparseOpticalFlow()
+{
+    create(inputRes, gridSize, winSize, maxLevel);
+}
+
+OpenCVSparseOpticalFlow::OpenCVSparseOpticalFlow(const cv::Size &inputRes, std::vector<cv::Point2f> points,
+                                                 const cv::Size &winSize, int maxLevel)
+  : OpenCVSparseOpticalFlow()
+{
+    create(inputRes, std::move(points), winSize, maxLevel);
+}
+
+//------------------------------------------------------------------------
+// Public API
+//------------------------------------------------------------------------
+void
+OpenCVSparseOpticalFlow::create(const cv::Size &inputRes, const cv::Size &gridSize,
+                                const cv::Size &winSize, int maxLevel)
+{
+    BOB_ASSERT(gridSize.width > 0 && gridSize.height > 0);
+
+    // Put points in the middle of each cell of the grid
+    std::vector<cv::Point2f> points;
+    points.reserve(gridSize.area());
+    for (int y = 0; y < gridSize.height; y++) {
+        for (int x = 0; x < gridSize.width; x++) {
+            points.emplace_back((x + 0.5f) * inputRes.width / gridSize.width,
+                                (y + 0.5f) * inputRes.height / gridSize.height);
+        }
+    }
+    create(inputRes, std::move(points), winSize, maxLevel);
+}
+
+void
+OpenCVSparseOpticalFlow::create(const cv::Size &inputRes, std::vector<cv::Point2f> points,
+                                const cv::Size &winSize, int maxLevel)
+{
+    BOB_ASSERT(!points.empty());
+    BOB_ASSERT(maxLevel >= 0);
+
+    m_InputRes = inputRes;
+    m_WinSize = winSize;
+    m_MaxLevel = maxLevel;
+    m_Frame = 0;
+    m_Points = std::move(points);
+
+    // Allocate outputs up front so that OpenCV can reuse them
+    m_NextPoints.resize(m_Points.size());
+    m_Flow.assign(m_Points.size(), cv::Point2f{ 0.0f, 0.0f });
+    m_Status.assign(m_Points.size(), 0);
+    m_Error.resize(m_Points.size());
+}
+
+bool
+OpenCVSparseOpticalFlow::calculate(const cv::Mat &input)
+{
+    BOB_ASSERT(input.cols == m_InputRes.width);
+    BOB_ASSERT(input.rows == m_InputRes.height);
+    BOB_ASSERT(input.type() == CV_8UC1);
+
+    // Build this frame's pyramid over the oldest one; we mustn't keep references to input
+    const unsigned int currentFrame = m_Frame % 2;
+    cv::buildOpticalFlowPyramid(input, m_Pyramids[currentFrame], m_WinSize, m_MaxLevel,
+                                /*withDerivatives=*/true, cv::BORDER_REFLECT_101,
+                                cv::BORDER_CONSTANT, /*tryReuseInputImage=*/false);
+
+    // If this isn't the first frame
+    if (m_Frame > 0) {
+        // Track points from the previous frame's pyramid into this one
+        const unsigned int prevFrame = (m_Frame - 1) % 2;
+        cv::calcOpticalFlowPyrLK(m_Pyramids[prevFrame], m_Pyramids[currentFrame],
+                                 m_Points, m_NextPoints, m_Status, m_Error,
+                                 m_WinSize, m_MaxLevel);
+        for (size_t i = 0; i < m_Points.size(); i++) {
+            m_Flow[i] = m_Status[i] ? (m_NextPoints[i] - m_Points[i]) : cv::Point2f{ 0.0f, 0.0f };
+        }
+
+        // Increment frame count
+        m_Frame++;
+        return true;
+    } else {
+        // Increment frame count
+        m_Frame++;
+
+        return false;
+    }
+}
+
+void
+OpenCVSparseOpticalFlow::render(cv::Mat &outputImage, int scale) const
+{
+    BOB_ASSERT(outputImage.cols == m_InputRes.width * scale);
+    BOB_ASSERT(outputImage.rows == m_InputRes.height * scale);
+
+    // Clear image
+    outputImage.setTo(cv::Scalar::all(0));
+
+    // Draw line showing direction of optical flow at each point
+    for (size_t i = 0; i < m_Points.size(); i++) {
+        if (!m_Status[i]) {
+            continue;
+        }
+
+        const cv::Point start(m_Points[i] * (float) scale);
+        const cv::Point end((m_Points[i] + m_Flow[i]) * (float) scale);
+        cv::line(outputImage, start, end, CV_RGB(0xFF, 0xFF, 0xFF));
+    }
+}
+
+const std::vector<cv::Point2f> &
+OpenCVSparseOpticalFlow::getPoints() const
+{
+    return m_Points;
+}
+
+const std::vector<cv::Point2f> &
+OpenCVSparseOpticalFlow::getFlow() const
+{
+    return m_Flow;
+}
+
+const std::vector<uchar> &
+OpenCVSparseOpticalFlow::getStatus() const
+{
+    return m_Status;
+}
+
+OpenCVSparseOpticalFlow::EgoMotion
+OpenCVSparseOpticalFlow::estimateEgoMotion() const
+{
+    // Fit flowX = rotation + translation * sin(azimuth) by least squares
+    double n = 0.0, sumSin = 0.0, sumSin2 = 0.0, sumFlow = 0.0, sumFlowSin = 0.0;
+    for (size_t i = 0; i < m_Points.size(); i++) {
+        if (!m_Status[i]) {
+            continue;
+        }
+
+        const double azimuth = 2.0 * CV_PI * m_Points[i].x / m_InputRes.width - CV_PI;
+        const double sinAzimuth = std::sin(azimuth);
+        n++;
+        sumSin += sinAzimuth;
+        sumSin2 += sinAzimuth * sinAzimuth;
+        sumFlow += m_Flow[i].x;
+        sumFlowSin += m_Flow[i].x * sinAzimuth;
+    }
+
+    if (n == 0.0) {
+        return { degree_t{ 0.0 }, 0.0f };
+    }
+
+    // If the points don't cover enough azimuths to separate the two, assume it's all rotation
+    double rotation = sumFlow / n, translation = 0.0;
+    const double det = n * sumSin2 - sumSin * sumSin;
+    if (std::abs(det) > 1e-6 * n * n) {
+        rotation = (sumSin2 * sumFlow - sumSin * sumFlowSin) / det;
+        translation = (n * sumFlowSin - sumSin * sumFlow) / det;
+    }
+
+    return { degree_t{ rotation * 360.0 / m_InputRes.width }, static_cast<float>(translation) };
+}
+
+} // ImgProc
+} // BoBRobotics
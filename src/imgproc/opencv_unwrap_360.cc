@@ -1,10 +1,20 @@
 // BoB robotics includes
+#include "common/hash.h"
 #include "common/path.h"
 #include "common/macros.h"
+#include "common/memory_mapped_file.h"
 #include "plog/Log.h"
+#include "imgproc/grey.h"
 #include "imgproc/opencv_unwrap_360.h"
 
+// Standard C includes
+#include <cstdint>
+#include <cstdlib>
+
 // Standard C++ includes
+#include <algorithm>
+#include <fstream>
+#include <numeric>
 #include <stdexcept>
 #include <vector>
 
@@ -23,6 +33,109 @@ namespace ImgProc {
 using namespace units::literals;
 using namespace units::angle;
 
+namespace {
+template<size_t PixelSize>
+void
+gatherRow(const uint8_t *input, const int32_t *lut, const int *columns,
+          uint8_t *output, int width)
+{
+    for (int j = 0; j < width; j++, output += PixelSize) {
+        const int32_t offset = lut[columns[j]];
+        if (offset < 0) {
+            std::fill_n(output, PixelSize, 0);
+        } else {
+            std::copy_n(input + offset * PixelSize, PixelSize, output);
+        }
+    }
+}
+
+template<size_t Channels, size_t BlueIndex>
+void
+gatherGreyRow(const uint8_t *input, const int32_t *lut, const int *columns,
+              uint8_t *output, int width)
+{
+    for (int j = 0; j < width; j++) {
+        const int32_t offset = lut[columns[j]];
+        if (offset < 0) {
+            output[j] = 0;
+        } else {
+            const uint8_t *pixel = input + offset * Channels;
+            output[j] = bgrToGrey(pixel[BlueIndex], pixel[1], pixel[2 - BlueIndex]);
+        }
+    }
+}
+
+using GatherRowFunc = void (*)(const uint8_t *, const int32_t *, const int *, uint8_t *, int);
+
+// Returns nullptr if we can't do this in one pass
+GatherRowFunc
+getGatherRowFunc(int type, int colourConversion, int &outputType)
+{
+    if (CV_MAT_DEPTH(type) != CV_8U) {
+        return nullptr;
+    }
+
+    const int channels = CV_MAT_CN(type);
+    outputType = CV_8UC1;
+    switch (colourConversion) {
+    case -1:
+        outputType = type;
+        switch (channels) {
+        case 1:
+            return gatherRow<1>;
+        case 3:
+            return gatherRow<3>;
+        case 4:
+            return gatherRow<4>;
+        default:
+            return nullptr;
+        }
+    case cv::COLOR_BGR2GRAY:
+        return (channels == 3) ? gatherGreyRow<3, 0> : nullptr;
+    case cv::COLOR_RGB2GRAY:
+        return (channels == 3) ? gatherGreyRow<3, 2> : nullptr;
+    case cv::COLOR_BGRA2GRAY:
+        return (channels == 4) ? gatherGreyRow<4, 0> : nullptr;
+    case cv::COLOR_RGBA2GRAY:
+        return (channels == 4) ? gatherGreyRow<4, 2> : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+// Cache files start with this, then the length of the key, then the key itself
+constexpr char MapCacheMagic[8]{ 'B', 'o', 'B', 'U', 'n', 'w', 'r', 'p' };
+constexpr size_t MapCacheAlignment = 16;
+
+size_t
+alignMapCacheOffset(size_t offset)
+{
+    return (offset + MapCacheAlignment - 1) / MapCacheAlignment * MapCacheAlignment;
+}
+
+filesystem::path &
+getMapCacheDirectoryRef()
+{
+    static filesystem::path directory = []() {
+        const char *path = std::getenv("BOB_UNWRAP_MAP_CACHE_PATH");
+        return path ? filesystem::path{ path } : filesystem::path{};
+    }();
+    return directory;
+}
+
+// Which source index cv::resize picks for each destination index with cv::INTER_NEAREST
+std::vector<int>
+getNearestIndices(int sourceSize, int destinationSize)
+{
+    const double scale = 1.0 / ((double) destinationSize / (double) sourceSize);
+    std::vector<int> indices(destinationSize);
+    for (int i = 0; i < destinationSize; i++) {
+        indices[i] = std::min(cvFloor(i * scale), sourceSize - 1);
+    }
+    return indices;
+}
+} // anonymous namespace
+
 OpenCVUnwrap360::OpenCVUnwrap360()
 {}
 
@@ -105,37 +218,142 @@ OpenCVUnwrap360::create(const cv::Size &cameraResolution,
 void
 OpenCVUnwrap360::updateMaps()
 {
-    // Build unwrap maps
+    // Maps loaded from the cache are read only, so we need new ones
+    if (m_MapFile) {
+        m_MapFile.reset();
+        m_UnwrapMap = cv::Mat(m_UnwrappedResolution, CV_16SC2);
+        m_UnwrapLUT = cv::Mat(m_UnwrappedResolution, CV_32SC1);
+    }
+
+    // The radius only depends on the row...
+    std::vector<float> radii(m_UnwrappedResolution.height);
     for (int i = 0; i < m_UnwrappedResolution.height; i++) {
-        for (int j = 0; j < m_UnwrappedResolution.width; j++) {
-            // Get i as a fraction of unwrapped height, flipping if desired
-            const float iFrac =
-                    m_Flip ? 1.0f - ((float) i /
-                                     (float) m_UnwrappedResolution.height)
-                           : ((float) i /
-                              (float) m_UnwrappedResolution.height);
-
-            // Convert i and j to polar
-            const float r =
-                    iFrac * (m_OuterPixel - m_InnerPixel) + m_InnerPixel;
-            const degree_t th =
-                    (((double) j / (double) m_UnwrappedResolution.width) *
-                     360.0_deg) +
-                    m_OffsetAngle;
-
-            // Remap onto sphere
-            const float x = m_CentrePixel.x - r * units::math::sin(th);
-            const float y = m_CentrePixel.y + r * units::math::cos(th);
-            m_UnwrapMapX.at<float>(i, j) = x;
-            m_UnwrapMapY.at<float>(i, j) = y;
-        }
+        // Get i as a fraction of unwrapped height, flipping if desired
+        const float iFrac =
+                m_Flip ? 1.0f - ((float) i /
+                                 (float) m_UnwrappedResolution.height)
+                       : ((float) i /
+                          (float) m_UnwrappedResolution.height);
+        radii[i] = iFrac * (m_OuterPixel - m_InnerPixel) + m_InnerPixel;
     }
+
+    // ...and the angle only on the column, so we only need sin and cos once per column
+    std::vector<double> sines(m_UnwrappedResolution.width), cosines(m_UnwrappedResolution.width);
+    for (int j = 0; j < m_UnwrappedResolution.width; j++) {
+        const degree_t th =
+                (((double) j / (double) m_UnwrappedResolution.width) *
+                 360.0_deg) +
+                m_OffsetAngle;
+        sines[j] = units::math::sin(th);
+        cosines[j] = units::math::cos(th);
+    }
+
+    // Build unwrap maps
+    cv::parallel_for_(cv::Range(0, m_UnwrappedResolution.height), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            auto mapRow = m_UnwrapMap.ptr<cv::Vec2s>(i);
+            auto lutRow = m_UnwrapLUT.ptr<int32_t>(i);
+            for (int j = 0; j < m_UnwrappedResolution.width; j++) {
+                // Remap onto sphere
+                const float x = m_CentrePixel.x - radii[i] * sines[j];
+                const float y = m_CentrePixel.y + radii[i] * cosines[j];
+
+                // Round to the nearest pixel, as cv::remap does
+                const cv::Vec2s pixel{ cv::saturate_cast<short>(x), cv::saturate_cast<short>(y) };
+                mapRow[j] = pixel;
+
+                const bool inside = pixel[0] >= 0 && pixel[0] < m_CameraResolution.width &&
+                                    pixel[1] >= 0 && pixel[1] < m_CameraResolution.height;
+                lutRow[j] = inside ? pixel[1] * m_CameraResolution.width + pixel[0] : -1;
+            }
+        }
+    });
 }
 
 void
 OpenCVUnwrap360::unwrap(const cv::Mat &input, cv::Mat &output) const
 {
-    cv::remap(input, output, m_UnwrapMapX, m_UnwrapMapY, cv::INTER_NEAREST);
+    cv::remap(input, output, m_UnwrapMap, cv::noArray(), cv::INTER_NEAREST);
+}
+
+void
+OpenCVUnwrap360::unwrapGreyscale(const cv::Mat &input, cv::Mat &output) const
+{
+    switch (input.channels()) {
+    case 1:
+        unwrap(input, output);
+        break;
+    case 3:
+        unwrapTo(input, output, {}, cv::COLOR_BGR2GRAY);
+        break;
+    case 4:
+        unwrapTo(input, output, {}, cv::COLOR_BGRA2GRAY);
+        break;
+    default:
+        throw std::runtime_error("Cannot convert image with " +
+                                 std::to_string(input.channels()) +
+                                 " channels to greyscale");
+    }
+}
+
+void
+OpenCVUnwrap360::unwrapTo(const cv::Mat &input, cv::Mat &output,
+                          const cv::Size &size, int colourConversion) const
+{
+    BOB_ASSERT(input.size() == m_CameraResolution);
+    BOB_ASSERT(&input != &output);
+    const cv::Size outputSize = (size == cv::Size{}) ? m_UnwrappedResolution : size;
+
+    int outputType;
+    const auto gatherRowFunc = getGatherRowFunc(input.type(), colourConversion, outputType);
+    if (!gatherRowFunc || !input.isContinuous()) {
+        cv::Mat unwrapped;
+        unwrap(input, unwrapped);
+        if (colourConversion != -1) {
+            cv::cvtColor(unwrapped, unwrapped, colourConversion);
+        }
+        if (outputSize == m_UnwrappedResolution) {
+            output = unwrapped;
+        } else {
+            cv::resize(unwrapped, output, outputSize, 0.0, 0.0, cv::INTER_NEAREST);
+        }
+        return;
+    }
+
+    /*
+     * Look up each output pixel's source pixel directly, so the image is only
+     * read and written once, however many steps there are.
+     */
+    output.create(outputSize, outputType);
+
+    // At the unwrapped resolution, every row and column maps onto itself
+    const bool resizing = outputSize != m_UnwrappedResolution;
+    std::vector<int> rows, columns;
+    if (resizing) {
+        rows = getNearestIndices(m_UnwrappedResolution.height, outputSize.height);
+        columns = getNearestIndices(m_UnwrappedResolution.width, outputSize.width);
+    }
+    const int *columnIndices = resizing ? columns.data() : m_UnwrappedColumns.data();
+
+    cv::parallel_for_(cv::Range(0, outputSize.height), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            const int row = resizing ? rows[i] : i;
+            gatherRowFunc(input.ptr<uint8_t>(), m_UnwrapLUT.ptr<int32_t>(row),
+                          columnIndices, output.ptr<uint8_t>(i), outputSize.width);
+        }
+    });
+}
+
+const cv::Mat &
+OpenCVUnwrap360::getUnwrapLUT() const
+{
+    return m_UnwrapLUT;
+}
+
+const cv::Size &
+OpenCVUnwrap360::getCameraResolution() const
+{
+    return m_CameraResolution;
 }
 
 void
@@ -195,12 +413,130 @@ OpenCVUnwrap360::read(const cv::FileNode &node)
            flip);
 }
 
+void
+OpenCVUnwrap360::setMapCacheDirectory(filesystem::path directory)
+{
+    getMapCacheDirectoryRef() = std::move(directory);
+}
+
+const filesystem::path &
+OpenCVUnwrap360::getMapCacheDirectory()
+{
+    return getMapCacheDirectoryRef();
+}
+
 void
 OpenCVUnwrap360::createMaps()
 {
-    m_UnwrapMapX.create(m_UnwrappedResolution, CV_32FC1);
-    m_UnwrapMapY.create(m_UnwrappedResolution, CV_32FC1);
+    m_UnwrappedColumns.resize(m_UnwrappedResolution.width);
+    std::iota(m_UnwrappedColumns.begin(), m_UnwrappedColumns.end(), 0);
+
+    const auto &cacheDirectory = getMapCacheDirectory();
+    if (cacheDirectory.empty()) {
+        m_MapFile.reset();
+        m_UnwrapMap = cv::Mat(m_UnwrappedResolution, CV_16SC2);
+        m_UnwrapLUT = cv::Mat(m_UnwrappedResolution, CV_32SC1);
+        updateMaps();
+        return;
+    }
+
+    const auto key = getMapCacheKey();
+    const auto filePath = cacheDirectory / (toHexString(hashString(key)) + ".unwrapmap");
+    if (loadMaps(filePath, key)) {
+        LOG_DEBUG << "Loaded unwrap maps from " << filePath;
+        return;
+    }
+
+    m_MapFile.reset();
+    m_UnwrapMap = cv::Mat(m_UnwrappedResolution, CV_16SC2);
+    m_UnwrapLUT = cv::Mat(m_UnwrappedResolution, CV_32SC1);
     updateMaps();
+    saveMaps(filePath, key);
+}
+
+std::string
+OpenCVUnwrap360::getMapCacheKey() const
+{
+    // The saved parameters are relative, so we need the resolutions too
+    cv::FileStorage fs(".yml", cv::FileStorage::WRITE | cv::FileStorage::MEMORY);
+    fs << "cameraResolution" << m_CameraResolution;
+    fs << "unwrappedResolution" << m_UnwrappedResolution;
+    fs << "unwrapper" << *this;
+    return fs.releaseAndGetString();
+}
+
+bool
+OpenCVUnwrap360::loadMaps(const filesystem::path &filePath, const std::string &key)
+{
+    if (!filePath.exists()) {
+        return false;
+    }
+
+    try {
+        auto file = std::make_shared<MemoryMappedFile>(filePath);
+        const auto magic = file->at<char>(0, sizeof(MapCacheMagic));
+        if (!std::equal(std::begin(MapCacheMagic), std::end(MapCacheMagic), magic)) {
+            LOG_WARNING << filePath << " is not an unwrap map file";
+            return false;
+        }
+
+        // Guard against hash collisions
+        const uint64_t keyLength = *file->at<uint64_t>(sizeof(MapCacheMagic));
+        const size_t keyOffset = sizeof(MapCacheMagic) + sizeof(keyLength);
+        if (std::string(file->at<char>(keyOffset, keyLength), keyLength) != key) {
+            LOG_WARNING << filePath << " holds maps for different parameters";
+            return false;
+        }
+
+        // cv::Mat won't take a const pointer, but we never write through it
+        const size_t mapSize = m_UnwrappedResolution.area() * sizeof(int32_t);
+        const auto maps = const_cast<uint8_t *>(file->at(alignMapCacheOffset(keyOffset + keyLength),
+                                                         2 * mapSize));
+        m_UnwrapMap = cv::Mat(m_UnwrappedResolution, CV_16SC2, maps);
+        m_UnwrapLUT = cv::Mat(m_UnwrappedResolution, CV_32SC1, maps + mapSize);
+        m_MapFile = std::move(file);
+        return true;
+    } catch (std::exception &e) {
+        // e.g. a truncated file
+        LOG_WARNING << "Could not read " << filePath << ": " << e.what();
+        return false;
+    }
+}
+
+void
+OpenCVUnwrap360::saveMaps(const filesystem::path &filePath, const std::string &key) const
+{
+    try {
+        const auto directory = filePath.parent_path();
+        if (!directory.exists() && !filesystem::create_directory(directory)) {
+            throw std::runtime_error("Could not create directory " + directory.str());
+        }
+
+        // Other processes may be building the same maps at the same time
+        Path::writeFileAtomically(filePath, [&](const filesystem::path &tempPath) {
+            std::ofstream ofs;
+            ofs.exceptions(std::ios::badbit | std::ios::failbit);
+            ofs.open(tempPath.str(), std::ios::out | std::ios::binary);
+
+            const uint64_t keyLength = key.size();
+            ofs.write(MapCacheMagic, sizeof(MapCacheMagic));
+            ofs.write(reinterpret_cast<const char *>(&keyLength), sizeof(keyLength));
+            ofs.write(key.data(), key.size());
+
+            const size_t keyEnd = sizeof(MapCacheMagic) + sizeof(keyLength) + key.size();
+            const std::string padding(alignMapCacheOffset(keyEnd) - keyEnd, '\0');
+            ofs.write(padding.data(), padding.size());
+
+            // We created the maps, so they're continuous
+            const size_t mapSize = m_UnwrappedResolution.area() * sizeof(int32_t);
+            ofs.write(reinterpret_cast<const char *>(m_UnwrapMap.data), mapSize);
+            ofs.write(reinterpret_cast<const char *>(m_UnwrapLUT.data), mapSize);
+        });
+    } catch (std::exception &e) {
+        LOG_WARNING << "Could not save unwrap maps to " << filePath << ": " << e.what();
+        return;
+    }
+    LOG_DEBUG << "Saved unwrap maps to " << filePath;
 }
 
 void
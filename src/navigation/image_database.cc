@@ -1,22 +1,38 @@
 // BoB robotics includes
 #include "common/macros.h"
+#include "common/memory_mapped_file.h"
 #include "common/string.h"
 #include "imgproc/opencv_unwrap_360.h"
 #include "navigation/image_database.h"
+#include "navigation/image_database_index.h"
 
 // Third-party includes
 #include "plog/Log.h"
 #include "third_party/tinydir.h"
 
 // TBB
+#include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+// oneTBB moved and renamed parts of the pipeline API
+#if TBB_VERSION_MAJOR >= 2021
+#include <tbb/parallel_pipeline.h>
+using FilterMode = tbb::filter_mode;
+#else
+#include <tbb/pipeline.h>
+using FilterMode = tbb::filter;
+#endif
 
 // Standard C includes
+#include <cctype>
+#include <cstdlib>
 #include <ctime>
 
 // Standard C++ includes
 #include <algorithm>
 #include <fstream>
+#include <memory>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
@@ -30,6 +46,16 @@ namespace Navigation {
 
 constexpr const char *ImageDatabase::MetadataFilename;
 constexpr const char *ImageDatabase::EntriesFilename;
+constexpr bool ImageDatabase::ImageFileWriter::IsThreadSafe;
+constexpr bool ImageDatabase::VideoFileWriter::IsThreadSafe;
+
+namespace {
+/*
+ * Don't make video chunks shorter than this (in output frames), because
+ * each one needs its own cv::VideoCapture and a seek.
+ */
+constexpr size_t MinVideoChunkSize = 32;
+}
 
 size_t
 Range::size() const
@@ -37,9 +63,31 @@ Range::size() const
     return (separation == 0_mm) ? 1 : (1 + ((end - begin) / separation).to<size_t>());
 }
 
+uint32_t
+ImageDatabase::EntryStrings::intern(const std::string &str)
+{
+    const auto result = m_Index.emplace(str, static_cast<uint32_t>(m_Strings.size()));
+    if (result.second) {
+        m_Strings.push_back(&result.first->first);
+    }
+    return result.first->second;
+}
+
+int
+ImageDatabase::EntryStrings::findExtraField(const std::string &name) const
+{
+    const auto pos = std::find(extraFieldNames.cbegin(), extraFieldNames.cend(), name);
+    return (pos == extraFieldNames.cend()) ? -1 : static_cast<int>(std::distance(extraFieldNames.cbegin(), pos));
+}
+
 cv::Mat
 ImageDatabase::Entry::load(bool greyscale) const
 {
+    if (strings && strings->packedDatabase) {
+        return strings->packedDatabase->loadFrame(index, greyscale);
+    }
+
+    const auto path = getPath();
     auto img = cv::imread(path.str(), greyscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
     if (img.empty()) {
         throw std::runtime_error("Could not load image file at " + path.str());
@@ -47,20 +95,31 @@ ImageDatabase::Entry::load(bool greyscale) const
     return img;
 }
 
+filesystem::path
+ImageDatabase::Entry::getPath() const
+{
+    if (!strings || index >= strings->fileNames.size()) {
+        return {};
+    }
+
+    // Packed video-type databases have empty file names
+    const auto &fileName = strings->get(strings->fileNames[index]);
+    return fileName.empty() ? filesystem::path{} : strings->directory / fileName;
+}
+
 bool
 ImageDatabase::Entry::hasExtraField(const std::string &name) const
 {
-    return extraFields.find(name) != extraFields.cend();
+    return strings && strings->findExtraField(name) != -1;
 }
 
 const std::string &
 ImageDatabase::Entry::getExtraField(const std::string &name) const
 {
-    const auto pos = extraFields.find(name);
-    BOB_ASSERT(pos != extraFields.cend());
-
-    // This is needed because operator[] is non-const for std::unordered_map
-    return pos->second;
+    BOB_ASSERT(strings);
+    const int field = strings->findExtraField(name);
+    BOB_ASSERT(field != -1);
+    return strings->get(strings->extraFields[field][index]);
 }
 
 ImageDatabase::ImageFileWriter::ImageFileWriter(const ImageDatabase &,
@@ -68,30 +127,43 @@ ImageDatabase::ImageFileWriter::ImageFileWriter(const ImageDatabase &,
   : m_ImageFormat{ std::move(imageFormat) }
 {}
 
+std::string
+ImageDatabase::ImageFileWriter::writeFrame(const cv::Mat &frame)
+{
+    const auto path = getNextFilePath();
+    writeFrameTo(path, frame);
+    return path.filename();
+}
+
+filesystem::path
+ImageDatabase::ImageFileWriter::getNextFilePath() const
+{
+    return getCurrentFilenameRoot() + "." + m_ImageFormat;
+}
+
 void
-ImageDatabase::ImageFileWriter::writeFrame(const cv::Mat &frame, Entry &entry)
+ImageDatabase::ImageFileWriter::writeFrameTo(const filesystem::path &path,
+                                             const cv::Mat &frame)
 {
-    filesystem::path path = getCurrentFilenameRoot() + "." + m_ImageFormat;
     BOB_ASSERT(!path.exists()); // Don't overwrite data by default!
     BOB_ASSERT(cv::imwrite(path.str(), frame));
-
-    entry.path = std::move(path);
 }
 
 ImageDatabase::VideoFileWriter::VideoFileWriter(const ImageDatabase &database,
                                                 const std::pair<const std::string &, const std::string &> &format)
-  : m_FileName{ database.getName() + "." + format.first }
+  : m_Writer{ std::make_shared<cv::VideoWriter>() }
+  , m_FileName{ database.getName() + "." + format.first }
 {
     const auto path = database.getPath() / m_FileName;
     BOB_ASSERT(!path.exists()); // Don't overwrite by mistake
 
     const auto &fourcc = format.second;
     BOB_ASSERT(fourcc.size() == 4);
-    m_Writer.open(path.str(),
-                  cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]),
-                  database.getFrameRate().value(),
-                  database.getResolution());
-    BOB_ASSERT(m_Writer.isOpened());
+    m_Writer->open(path.str(),
+                   cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]),
+                   database.getFrameRate().value(),
+                   database.getResolution());
+    BOB_ASSERT(m_Writer->isOpened());
 }
 
 const std::string &
@@ -100,10 +172,410 @@ ImageDatabase::VideoFileWriter::getVideoFileName() const
     return m_FileName;
 }
 
+std::string
+ImageDatabase::VideoFileWriter::writeFrame(const cv::Mat &frame)
+{
+    m_Writer->write(frame);
+    return {};
+}
+
+ImageDatabase::WriteFunc
+ImageDatabase::VideoFileWriter::getWriteFunc() const
+{
+    const auto writer = m_Writer;
+    return [writer](const filesystem::path &, const cv::Mat &frame) {
+        writer->write(frame);
+    };
+}
+
+ImageDatabase::AsyncFrameQueue::AsyncFrameQueue(WriteFunc write,
+                                                const AsyncWriterOptions &options)
+  : m_Write(std::move(write))
+  , m_Options(options)
+{
+    BOB_ASSERT(m_Options.numThreads > 0);
+    BOB_ASSERT(m_Options.maxQueueLength > 0);
+
+    for (size_t i = 0; i < m_Options.numThreads; i++) {
+        m_Threads.emplace_back(&AsyncFrameQueue::runWorker, this);
+    }
+}
+
+ImageDatabase::AsyncFrameQueue::~AsyncFrameQueue()
+{
+    stop();
+
+    std::lock_guard<std::mutex> guard{ m_Mutex };
+    if (m_Error) {
+        try {
+            std::rethrow_exception(m_Error);
+        } catch (std::exception &e) {
+            LOG_ERROR << "Error writing frame: " << e.what();
+        }
+    }
+}
+
+bool
+ImageDatabase::AsyncFrameQueue::canPush()
+{
+    // Only the recording thread adds frames, so there'll still be room in push()
+    std::lock_guard<std::mutex> guard{ m_Mutex };
+    if (!m_Options.dropWhenFull || m_Queue.size() < m_Options.maxQueueLength) {
+        return true;
+    }
+
+    m_Statistics.framesDropped++;
+    return false;
+}
+
+void
+ImageDatabase::AsyncFrameQueue::push(filesystem::path path, const cv::Mat &frame)
+{
+    cv::Mat buffer;
+    {
+        std::unique_lock<std::mutex> lock{ m_Mutex };
+        BOB_ASSERT(!m_Stopping);
+        rethrowError();
+
+        if (m_Queue.size() >= m_Options.maxQueueLength) {
+            const auto startTime = std::chrono::steady_clock::now();
+            m_QueueNotFull.wait(lock, [this]() {
+                return m_Queue.size() < m_Options.maxQueueLength || m_Error;
+            });
+            m_Statistics.timeBlocked += std::chrono::steady_clock::now() - startTime;
+            rethrowError();
+        }
+
+        if (!m_FreeBuffers.empty()) {
+            buffer = std::move(m_FreeBuffers.back());
+            m_FreeBuffers.pop_back();
+        }
+    }
+
+    // The caller can reuse frame as soon as we return, so we need a copy
+    frame.copyTo(buffer);
+
+    {
+        std::lock_guard<std::mutex> guard{ m_Mutex };
+        m_Queue.push_back({ std::move(path), std::move(buffer) });
+        m_Statistics.framesQueued++;
+        m_Statistics.maxQueueLength = std::max(m_Statistics.maxQueueLength, m_Queue.size());
+    }
+    m_QueueNotEmpty.notify_one();
+}
+
+void
+ImageDatabase::AsyncFrameQueue::finish()
+{
+    stop();
+
+    std::lock_guard<std::mutex> guard{ m_Mutex };
+    LOG_INFO << "Wrote " << m_Statistics.framesWritten << " frames ("
+             << m_Statistics.framesDropped << " dropped, blocked for "
+             << std::chrono::duration<double>(m_Statistics.timeBlocked).count() << "s)";
+    rethrowError();
+}
+
+ImageDatabase::AsyncWriterStatistics
+ImageDatabase::AsyncFrameQueue::getStatistics() const
+{
+    std::lock_guard<std::mutex> guard{ m_Mutex };
+    return m_Statistics;
+}
+
+void
+ImageDatabase::AsyncFrameQueue::runWorker()
+{
+    std::unique_lock<std::mutex> lock{ m_Mutex };
+    while (true) {
+        m_QueueNotEmpty.wait(lock, [this]() { return m_Stopping || !m_Queue.empty(); });
+
+        // When stopping, we keep going until the queue is empty
+        if (m_Queue.empty()) {
+            return;
+        }
+
+        Job job = std::move(m_Queue.front());
+        m_Queue.pop_front();
+        lock.unlock();
+        m_QueueNotFull.notify_one();
+
+        std::exception_ptr error;
+        try {
+            m_Write(job.path, job.frame);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        if (error) {
+            if (!m_Error) {
+                m_Error = error;
+            }
+            m_QueueNotFull.notify_all();
+        } else {
+            m_Statistics.framesWritten++;
+        }
+        m_FreeBuffers.emplace_back(std::move(job.frame));
+    }
+}
+
+void
+ImageDatabase::AsyncFrameQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard{ m_Mutex };
+        m_Stopping = true;
+    }
+    m_QueueNotEmpty.notify_all();
+
+    for (auto &thread : m_Threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+// **NOTE** m_Mutex must be held
+void
+ImageDatabase::AsyncFrameQueue::rethrowError()
+{
+    if (m_Error) {
+        std::rethrow_exception(m_Error);
+    }
+}
+
+struct ImageDatabase::ImageStream::State
+{
+    enum class SlotState
+    {
+        Free,
+        Decoding,
+        Ready,
+        InUse
+    };
+
+    struct Slot
+    {
+        cv::Mat image;
+        SlotState state = SlotState::Free;
+    };
+
+    const ImageDatabase &database;
+    const cv::Size size;
+    const size_t frameSkip;
+    const bool greyscale;
+    const size_t numFrames;
+
+    std::mutex mutex;
+    std::condition_variable slotFree, frameReady;
+
+    /*
+     * Frame i always uses slot i % slots.size(), so frames are decoded into
+     * the buffers in turn and a frame can only be decoded once the one
+     * slots.size() before it has been released.
+     */
+    std::vector<Slot> slots;
+    size_t nextToDecode = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+
+    State(const ImageDatabase &database, const cv::Size &size, size_t frameSkip,
+          bool greyscale, size_t readAhead)
+      : database(database)
+      , size(size)
+      , frameSkip(frameSkip)
+      , greyscale(greyscale)
+      , numFrames(database.size() / frameSkip)
+      , slots(readAhead)
+    {}
+
+    Slot &getSlot(size_t index)
+    {
+        return slots[index % slots.size()];
+    }
+
+    void runWorker()
+    {
+        try {
+            const bool isVideo = !database.m_VideoFilePath.empty();
+            cv::VideoCapture cap;
+            if (isVideo) {
+                BOB_ASSERT(cap.open(database.m_VideoFilePath.str()));
+            }
+
+            cv::Mat image;
+            std::unique_lock<std::mutex> lock{ mutex };
+            while (true) {
+                slotFree.wait(lock, [this]() {
+                    return stopping || nextToDecode == numFrames ||
+                           getSlot(nextToDecode).state == SlotState::Free;
+                });
+                if (stopping || nextToDecode == numFrames) {
+                    return;
+                }
+
+                const size_t index = nextToDecode++;
+                auto &slot = getSlot(index);
+                slot.state = SlotState::Decoding;
+                lock.unlock();
+                slotFree.notify_one();
+
+                // Video files only ever have one worker, so frames are read in order
+                if (isVideo) {
+                    BOB_ASSERT(cap.read(image));
+                    if (greyscale) {
+                        cv::cvtColor(image, image, cv::COLOR_BGR2GRAY);
+                    }
+                    for (size_t j = 1; j < frameSkip && cap.grab(); j++)
+                        ;
+                } else {
+                    image = database.m_Entries[index * frameSkip].load(greyscale);
+                }
+
+                // Write into the slot's existing buffer
+                if (size == cv::Size{}) {
+                    image.copyTo(slot.image);
+                } else {
+                    cv::resize(image, slot.image, size);
+                }
+
+                lock.lock();
+                slot.state = SlotState::Ready;
+                frameReady.notify_all();
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> guard{ mutex };
+            if (!error) {
+                error = std::current_exception();
+            }
+            stopping = true;
+            frameReady.notify_all();
+            slotFree.notify_all();
+        }
+    }
+};
+
+ImageDatabase::ImageStream::Frame::Frame(std::shared_ptr<State> state, size_t index)
+  : m_State(std::move(state))
+  , m_Index(index)
+{}
+
+ImageDatabase::ImageStream::Frame &
+ImageDatabase::ImageStream::Frame::operator=(Frame &&other)
+{
+    if (this != &other) {
+        release();
+        m_State = std::move(other.m_State);
+        m_Index = other.m_Index;
+    }
+    return *this;
+}
+
+ImageDatabase::ImageStream::Frame::~Frame()
+{
+    release();
+}
+
+size_t
+ImageDatabase::ImageStream::Frame::getIndex() const
+{
+    BOB_ASSERT(m_State);
+    return m_Index;
+}
+
+const cv::Mat &
+ImageDatabase::ImageStream::Frame::getImage() const
+{
+    // Workers don't touch a slot while it's in use, so we don't need the lock
+    BOB_ASSERT(m_State);
+    return m_State->getSlot(m_Index).image;
+}
+
 void
-ImageDatabase::VideoFileWriter::writeFrame(const cv::Mat &frame, Entry &)
+ImageDatabase::ImageStream::Frame::release()
+{
+    if (!m_State) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard{ m_State->mutex };
+        m_State->getSlot(m_Index).state = State::SlotState::Free;
+    }
+    m_State->slotFree.notify_all();
+    m_State.reset();
+}
+
+ImageDatabase::ImageStream::ImageStream(const ImageDatabase &database,
+                                        const cv::Size &size, size_t frameSkip,
+                                        bool greyscale, size_t readAhead)
+{
+    BOB_ASSERT(frameSkip > 0);
+    BOB_ASSERT(readAhead > 0);
+
+    m_State = std::make_shared<State>(database, size, frameSkip, greyscale, readAhead);
+
+    // Video frames have to be decoded in order, so they get one thread
+    size_t numThreads = 1;
+    if (database.m_VideoFilePath.empty()) {
+        const size_t numCores = std::max(1U, std::thread::hardware_concurrency());
+        numThreads = std::min(readAhead, numCores);
+    }
+    for (size_t i = 0; i < numThreads; i++) {
+        m_Threads.emplace_back(&State::runWorker, m_State.get());
+    }
+}
+
+ImageDatabase::ImageStream::~ImageStream()
+{
+    // Nothing to do if we've been moved from
+    if (!m_State) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard{ m_State->mutex };
+        m_State->stopping = true;
+    }
+    m_State->slotFree.notify_all();
+
+    for (auto &thread : m_Threads) {
+        thread.join();
+    }
+}
+
+ImageDatabase::ImageStream::Frame
+ImageDatabase::ImageStream::next()
+{
+    auto &state = *m_State;
+    std::unique_lock<std::mutex> lock{ state.mutex };
+    if (m_NextIndex == state.numFrames) {
+        return {};
+    }
+
+    // If the slot still holds an older frame, we'd wait forever
+    auto &slot = state.getSlot(m_NextIndex);
+    if (slot.state == State::SlotState::InUse) {
+        throw std::runtime_error("All of the stream's buffers are in use; "
+                                 "frames must be released before getting new ones");
+    }
+
+    state.frameReady.wait(lock, [&]() {
+        return slot.state == State::SlotState::Ready || state.error;
+    });
+    if (slot.state != State::SlotState::Ready) {
+        std::rethrow_exception(state.error);
+    }
+
+    slot.state = State::SlotState::InUse;
+    return { m_State, m_NextIndex++ };
+}
+
+size_t
+ImageDatabase::ImageStream::size() const
 {
-    m_Writer.write(frame);
+    return m_State->numFrames;
 }
 
 ImageDatabase::GridRecorder::GridRecorder(ImageDatabase &imageDatabase,
@@ -240,6 +712,7 @@ ImageDatabase::ImageDatabase(const std::tm *creationTime,
                              filesystem::path databasePath,
                              bool overwrite)
   : m_Path{ std::move(databasePath) }
+  , m_EntryStrings{ std::make_shared<EntryStrings>() }
   , m_CreationTime{}
 {
     m_CreationTime.tm_isdst = -1;
@@ -263,13 +736,19 @@ ImageDatabase::ImageDatabase(const std::tm *creationTime,
             c = ::tolower(c);
         }
 
+        // Single-file packed database
+        if (ext == PackedImageDatabase::Extension) {
+            loadPacked();
+            return;
+        }
+
         m_VideoFilePath = m_Path;
         m_Path = m_Path.parent_path();
 
         // Populate m_Entries with empty entries
         cv::VideoCapture cap{ m_VideoFilePath.str() };
         BOB_ASSERT(cap.isOpened());
-        m_Entries.resize(static_cast<size_t>(cap.get(cv::CAP_PROP_FRAME_COUNT)));
+        resizeEntries(static_cast<size_t>(cap.get(cv::CAP_PROP_FRAME_COUNT)));
     } else if (m_Path.exists()) {
         BOB_ASSERT(m_Path.is_directory());
     }
@@ -295,30 +774,96 @@ ImageDatabase::ImageDatabase(const std::tm *creationTime,
             // Populate m_Entries with empty entries
             cv::VideoCapture cap{ m_VideoFilePath.str() };
             BOB_ASSERT(cap.isOpened());
-            m_Entries.resize(static_cast<size_t>(cap.get(cv::CAP_PROP_FRAME_COUNT)));
+            resizeEntries(static_cast<size_t>(cap.get(cv::CAP_PROP_FRAME_COUNT)));
+        }
+    }
+}
+
+namespace {
+// A field in the CSV file, pointing into the mapped file
+struct FieldSpan
+{
+    const char *begin, *end;
+};
+
+FieldSpan
+trimSpan(const char *begin, const char *end)
+{
+    while (begin < end && std::isspace(static_cast<unsigned char>(*begin))) {
+        begin++;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(end[-1]))) {
+        end--;
+    }
+    return { begin, end };
+}
+
+/*
+ * strtod() and friends need null-terminated strings, so copy fields into a
+ * buffer on the stack first. This avoids allocating a std::string per field,
+ * as std::stod() would.
+ */
+template<class T, class Parse>
+T parseNumber(const FieldSpan &field, Parse parse)
+{
+    char buffer[64];
+    const auto length = static_cast<size_t>(field.end - field.begin);
+    if (length > 0 && length < sizeof(buffer)) {
+        std::copy(field.begin, field.end, buffer);
+        buffer[length] = '\0';
+
+        char *parsedEnd;
+        const T value = parse(buffer, &parsedEnd);
+        if (parsedEnd != buffer) {
+            return value;
         }
     }
+
+    throw std::invalid_argument("Could not parse number in CSV file: \"" +
+                                std::string(field.begin, field.end) + "\"");
+}
+
+double
+parseDouble(const FieldSpan &field)
+{
+    return parseNumber<double>(field, [](const char *str, char **end) {
+        return std::strtod(str, end);
+    });
 }
 
+size_t
+parseSize(const FieldSpan &field)
+{
+    return parseNumber<size_t>(field, [](const char *str, char **end) {
+        return static_cast<size_t>(std::strtoull(str, end, 10));
+    });
+}
+} // anonymous namespace
+
 bool
 ImageDatabase::loadCSV()
 {
     const auto entriesPath = m_Path / EntriesFilename;
-    std::ifstream entriesFile(entriesPath.str());
-    if (entriesFile.fail()) {
+    if (!entriesPath.exists()) {
         return false;
     }
-    entriesFile.exceptions(std::ios::badbit);
 
-    std::string line;
-    if (!std::getline(entriesFile, line)) {
+    /*
+     * Map the file into memory rather than reading it line by line, so that
+     * we can parse the lines in parallel without copying them.
+     */
+    const MemoryMappedFile file{ entriesPath };
+    if (file.size() == 0) {
         // ...then it's an empty file
         return false;
     }
+    const char *const fileBegin = reinterpret_cast<const char *>(file.data());
+    const char *const fileEnd = fileBegin + file.size();
 
     // Read field names, using comma as separator and trimming whitespace
+    const char *headerEnd = std::find(fileBegin, fileEnd, '\n');
     std::vector<std::string> fields;
-    strSplit(line, ',', fields);
+    strSplit(std::string{ fileBegin, headerEnd }, ',', fields);
     std::for_each(fields.begin(), fields.end(), strTrim);
     const size_t numFields = fields.size();
 
@@ -329,20 +874,25 @@ ImageDatabase::loadCSV()
 
     /*
      * Go through field names, figuring out which are standard ones and which
-     * are extra, user-defined ones
+     * are extra, user-defined ones. Columns holding default fields are
+     * numbered 0-7 in columnFields; extra fields are numbered from 8 up.
      */
     std::array<int, defaultFieldNames.size()> fieldNameIdx;
     std::fill(fieldNameIdx.begin(), fieldNameIdx.end(), -1);
-    std::unordered_map<size_t, std::string> extraFieldNames;
+    std::vector<size_t> columnFields(numFields);
+    auto &strings = *m_EntryStrings;
     for (size_t i = 0; i < fields.size(); i++) {
         const auto def = std::find(defaultFieldNames.begin(), defaultFieldNames.end(), fields[i]);
         if (def != defaultFieldNames.end()) {
             // If it's a default one, save the column number for later parsing
             fieldNameIdx[std::distance(defaultFieldNames.begin(), def)] = i;
+            columnFields[i] = std::distance(defaultFieldNames.begin(), def);
         } else {
-            extraFieldNames.emplace(i, std::move(fields[i]));
+            columnFields[i] = defaultFieldNames.size() + strings.extraFieldNames.size();
+            strings.extraFieldNames.emplace_back(std::move(fields[i]));
         }
     }
+    const size_t numExtraFields = strings.extraFieldNames.size();
 
     // Sanity check the file: we need the first four columns
     const auto validIdx = [](int idx) {
@@ -366,57 +916,144 @@ ImageDatabase::loadCSV()
         BOB_ASSERT(std::all_of(fieldNameIdx.cbegin() + 5, fieldNameIdx.cend(), validIdx));
     }
 
-    // Read data line by line
-    while (std::getline(entriesFile, line)) {
-        // Ignore empty lines
-        strTrim(line);
-        if (line.empty()) {
-            continue;
+    // Find the non-empty lines; this is cheap compared to parsing them
+    std::vector<FieldSpan> lines;
+    for (const char *lineBegin = headerEnd; lineBegin < fileEnd;) {
+        lineBegin++; // Skip newline
+        const char *lineEnd = std::find(lineBegin, fileEnd, '\n');
+        const auto line = trimSpan(lineBegin, lineEnd);
+        if (line.begin != line.end) {
+            lines.push_back(line);
         }
+        lineBegin = lineEnd;
+    }
 
-        // Use comma as delimiter
-        strSplit(line, ',', fields);
-        BOB_ASSERT(fields.size() == numFields);
-        std::for_each(fields.begin(), fields.end(), strTrim);
-
-        // Get values for any user-defined fields
-        std::unordered_map<std::string, std::string> extraFields;
-        for (size_t i = 0; i < fields.size(); i++) {
-            const auto pos = extraFieldNames.find(i);
-            if (pos != extraFieldNames.cend()) {
-                extraFields.emplace(pos->second, std::move(fields[i]));
+    // File names and extra fields are interned afterwards, on one thread
+    const size_t numStringFields = numExtraFields + 1;
+    std::vector<FieldSpan> stringFields(lines.size() * numStringFields);
+
+    const size_t firstEntry = m_Entries.size();
+    m_Entries.resize(firstEntry + lines.size());
+    const bool isRoute = m_IsRoute;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, lines.size()),
+                      [&](const auto &r) {
+        std::array<FieldSpan, defaultFieldNames.size()> defaultFields;
+        for (size_t i = r.begin(); i != r.end(); ++i) {
+            // Use comma as delimiter
+            const char *fieldBegin = lines[i].begin;
+            size_t column = 0;
+            for (;; column++) {
+                const char *fieldEnd = std::find(fieldBegin, lines[i].end, ',');
+                if (column < numFields) {
+                    const auto field = trimSpan(fieldBegin, fieldEnd);
+                    const size_t fieldIdx = columnFields[column];
+                    if (fieldIdx < defaultFieldNames.size()) {
+                        defaultFields[fieldIdx] = field;
+                    } else {
+                        stringFields[i * numStringFields + 1 + fieldIdx - defaultFieldNames.size()] = field;
+                    }
+                }
+                if (fieldEnd == lines[i].end) {
+                    break;
+                }
+                fieldBegin = fieldEnd + 1;
+            }
+            BOB_ASSERT(column + 1 == numFields);
+
+            auto &entry = m_Entries[firstEntry + i];
+            entry.position = { millimeter_t(parseDouble(defaultFields[0])),
+                               millimeter_t(parseDouble(defaultFields[1])),
+                               millimeter_t(parseDouble(defaultFields[2])) };
+            entry.heading = degree_t(parseDouble(defaultFields[3]));
+
+            // Get grid position for grid databases
+            entry.gridPosition = { 0, 0, 0 };
+            if (!isRoute) {
+                for (size_t j = 0; j < 3; j++) {
+                    entry.gridPosition[j] = parseSize(defaultFields[5 + j]);
+                }
             }
-        }
 
-        // Get the value for a given default field
-        const auto getDefaultField = [&fields, &fieldNameIdx](size_t i) {
-            return fields[fieldNameIdx[i]];
-        };
+            if (validIdx(fieldNameIdx[4])) {
+                stringFields[i * numStringFields] = defaultFields[4];
+            }
 
-        // Get grid position for grid databases
-        std::array<size_t, 3> gridPosition{0, 0, 0};
-        if (!m_IsRoute) {
-            gridPosition[0] = static_cast<size_t>(std::stoul(getDefaultField(5)));
-            gridPosition[1] = static_cast<size_t>(std::stoul(getDefaultField(6)));
-            gridPosition[2] = static_cast<size_t>(std::stoul(getDefaultField(7)));
+            entry.strings = m_EntryStrings.get();
+            entry.index = firstEntry + i;
         }
+    });
 
-        // Save details to vector
-        Entry entry{
-            { millimeter_t(std::stod(getDefaultField(0))),
-              millimeter_t(std::stod(getDefaultField(1))),
-              millimeter_t(std::stod(getDefaultField(2))) },
-            degree_t(std::stod(getDefaultField(3))),
-            m_VideoFilePath.empty() ? m_Path / getDefaultField(4) : filesystem::path{},
-            gridPosition,
-            std::move(extraFields)
-        };
-        m_Entries.emplace_back(std::move(entry));
+    // Store strings column by column
+    std::string scratch;
+    const auto intern = [&](const FieldSpan &field) {
+        scratch.assign(field.begin, field.end);
+        return strings.intern(scratch);
+    };
+    if (m_VideoFilePath.empty()) {
+        strings.directory = m_Path;
+        strings.fileNames.reserve(m_Entries.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            strings.fileNames.push_back(intern(stringFields[i * numStringFields]));
+        }
+    }
+    strings.extraFields.resize(numExtraFields);
+    for (size_t j = 0; j < numExtraFields; j++) {
+        auto &column = strings.extraFields[j];
+        column.resize(firstEntry, strings.intern(""));
+        column.reserve(m_Entries.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            column.push_back(intern(stringFields[i * numStringFields + 1 + j]));
+        }
     }
 
     return true;
 }
 
+void
+ImageDatabase::loadPacked()
+{
+    auto &strings = *m_EntryStrings;
+    strings.packedDatabase = std::make_shared<const PackedImageDatabase>(m_Path);
+    const auto &packed = *strings.packedDatabase;
+    const auto &header = packed.getHeader();
+
+    // Paths of entries are relative to the folder containing the file
+    m_Path = m_Path.parent_path();
+    strings.directory = m_Path;
+
+    const auto metadata = packed.getMetadata();
+    if (!metadata.empty()) {
+        parseMetadata(metadata);
+    }
+    m_IsRoute = header.isRoute;
+    if (m_Resolution.empty()) {
+        m_Resolution = { header.width, header.height };
+    }
+
+    strings.extraFieldNames = packed.getExtraFieldNames();
+    strings.extraFields.resize(strings.extraFieldNames.size());
+    strings.fileNames.reserve(packed.size());
+    m_Entries.resize(packed.size());
+    for (size_t i = 0; i < packed.size(); i++) {
+        const auto &record = packed.getEntry(i);
+        auto &entry = m_Entries[i];
+        entry.position = { millimeter_t(record.position[0]),
+                           millimeter_t(record.position[1]),
+                           millimeter_t(record.position[2]) };
+        entry.heading = degree_t(record.heading);
+        for (size_t j = 0; j < 3; j++) {
+            entry.gridPosition[j] = static_cast<size_t>(record.gridPosition[j]);
+        }
+        entry.strings = m_EntryStrings.get();
+        entry.index = i;
+
+        strings.fileNames.push_back(strings.intern(packed.getFileName(i)));
+        for (size_t j = 0; j < strings.extraFields.size(); j++) {
+            strings.extraFields[j].push_back(strings.intern(packed.getExtraField(i, j)));
+        }
+    }
+}
+
 bool
 ImageDatabase::readDirectoryEntries()
 {
@@ -425,6 +1062,7 @@ ImageDatabase::readDirectoryEntries()
     }
 
     // For reading contents of directory
+    std::vector<std::string> fileNames;
     tinydir_dir dir{};
     BOB_ASSERT(tinydir_open(&dir, m_Path.str().c_str()) == 0);
     for (; dir.has_next; BOB_ASSERT(tinydir_next(&dir) == 0)) {
@@ -444,17 +1082,20 @@ ImageDatabase::readDirectoryEntries()
         }
         if (ext == "jpg" || ext == "jpeg" || ext == "png") {
             // Save details to vector
-            m_Entries.emplace_back();
-            m_Entries.back().path = std::move(fileName);
+            fileNames.emplace_back(fileName.filename());
         }
     }
     tinydir_close(&dir);
 
     // Try to sort by number in file name and fall back on alphabetic comparison
-    const auto byName = [](const auto &e1, const auto &e2) {
-        return ImageDatabase::fileNameCompare(e1.path.filename(), e2.path.filename());
-    };
-    std::sort(m_Entries.begin(), m_Entries.end(), byName);
+    std::sort(fileNames.begin(), fileNames.end(), ImageDatabase::fileNameCompare);
+
+    auto &strings = *m_EntryStrings;
+    strings.directory = m_Path;
+    for (const auto &fileName : fileNames) {
+        strings.fileNames.push_back(strings.intern(fileName));
+    }
+    resizeEntries(fileNames.size());
 
     return !m_Entries.empty();
 }
@@ -487,6 +1128,17 @@ ImageDatabase::getRouteRecorder(std::string imageFormat,
     };
 }
 
+ImageDatabase::RouteRecorder<ImageDatabase::AsyncFrameWriter<ImageDatabase::ImageFileWriter>>
+ImageDatabase::getAsyncRouteRecorder(const AsyncWriterOptions &options,
+                                     std::string imageFormat,
+                                     std::vector<std::string> extraFieldNames)
+{
+    return ImageDatabase::RouteRecorder<AsyncFrameWriter<ImageFileWriter>>{
+        *this, std::make_pair(std::move(imageFormat), options),
+        std::move(extraFieldNames)
+    };
+}
+
 ImageDatabase::RouteRecorder<ImageDatabase::VideoFileWriter>
 ImageDatabase::getRouteVideoRecorder(const cv::Size &resolution,
                                      units::frequency::hertz_t fps,
@@ -608,6 +1260,13 @@ ImageDatabase::loadImages(std::vector<cv::Mat> &images, const cv::Size &size,
     }
 }
 
+ImageDatabase::ImageStream
+ImageDatabase::stream(const cv::Size &size, size_t frameSkip, bool greyscale,
+                      size_t readAhead) const
+{
+    return { *this, size, frameSkip, greyscale, readAhead };
+}
+
 units::frequency::hertz_t
 ImageDatabase::getFrameRate() const
 {
@@ -645,6 +1304,46 @@ ImageDatabase::hasMetadata() const
     return static_cast<bool>(m_MetadataYAML);
 }
 
+//! Check if this database was loaded from a single packed (.bobdb) file
+bool
+ImageDatabase::isPacked() const
+{
+    return static_cast<bool>(m_EntryStrings->packedDatabase);
+}
+
+//! Get the names of user-defined fields, in the order they are saved
+const std::vector<std::string> &
+ImageDatabase::getExtraFieldNames() const
+{
+    return m_EntryStrings->extraFieldNames;
+}
+
+std::vector<filesystem::path>
+ImageDatabase::getSourceFiles() const
+{
+    std::vector<filesystem::path> files;
+    if (isPacked()) {
+        files.push_back(m_EntryStrings->packedDatabase->getPath());
+        return files;
+    }
+
+    for (const auto fileName : { MetadataFilename, EntriesFilename }) {
+        const auto path = m_Path / fileName;
+        if (path.exists()) {
+            files.push_back(path);
+        }
+    }
+    if (!m_VideoFilePath.empty()) {
+        files.push_back(m_VideoFilePath);
+    } else {
+        for (const auto &entry : m_Entries) {
+            files.push_back(entry.getPath());
+        }
+    }
+
+    return files;
+}
+
 void
 ImageDatabase::generateUnwrapCSV(const filesystem::path &destination,
                                  size_t frameSkip) const
@@ -700,6 +1399,14 @@ void
 ImageDatabase::unwrap(const filesystem::path &destination,
                       const cv::Size &unwrapRes, size_t frameSkip,
                       bool greyscale) const
+{
+    unwrap(destination, unwrapRes, frameSkip, greyscale, PipelineOptions{});
+}
+
+void
+ImageDatabase::unwrap(const filesystem::path &destination,
+                      const cv::Size &unwrapRes, size_t frameSkip,
+                      bool greyscale, const PipelineOptions &options) const
 {
     // Check that the database doesn't already exist
     BOB_ASSERT(!(destination / EntriesFilename).exists());
@@ -786,23 +1493,194 @@ ImageDatabase::unwrap(const filesystem::path &destination,
     }
 
     // Finally, unwrap all images and save to new folder
-    forEachImage([&](size_t i, const cv::Mat &image) {
-        /*
-         * *If* forEachImage runs in parallel, then each thread will need its own
-         * copy of these scratch variables.
-         */
-        static thread_local cv::Mat unwrapped;
-        static thread_local std::string outPath;
+    unwrapImages(destination, unwrapper, frameSkip, greyscale, options);
+}
+
+void
+ImageDatabase::unwrapImages(const filesystem::path &destination,
+                            const ImgProc::OpenCVUnwrap360 &unwrapper,
+                            size_t frameSkip, bool greyscale,
+                            const PipelineOptions &options) const
+{
+    struct Frame
+    {
+        size_t index;
+        cv::Mat image, unwrapped;
+    };
+
+    tbb::task_arena arena{ options.numThreads ? static_cast<int>(options.numThreads)
+                                              : tbb::task_arena::automatic };
+    const size_t maxFrames = options.maxFramesInFlight ? options.maxFramesInFlight
+                                                       : 4 * static_cast<size_t>(arena.max_concurrency());
+
+    /*
+     * There is one Frame for each token in the pipeline, so there is always a
+     * free one when a new frame is started. Reusing them means we aren't
+     * constantly reallocating image buffers.
+     */
+    std::vector<Frame> frames(maxFrames);
+    tbb::concurrent_queue<Frame *> freeFrames;
+    for (auto &frame : frames) {
+        freeFrames.push(&frame);
+    }
+
+    const bool isVideo = !m_VideoFilePath.empty();
+    cv::VideoCapture cap;
+    if (isVideo) {
+        BOB_ASSERT(cap.open(m_VideoFilePath.str()));
+    }
+
+    // Serial stage: video frames can only be decoded in order
+    const size_t numImages = m_Entries.size() / frameSkip;
+    size_t nextIndex = 0;
+    const auto decode = [&](tbb::flow_control &control) -> Frame * {
+        if (nextIndex == numImages) {
+            control.stop();
+            return nullptr;
+        }
+
+        Frame *frame;
+        BOB_ASSERT(freeFrames.try_pop(frame));
+        frame->index = nextIndex++;
+        if (isVideo) {
+            BOB_ASSERT(cap.read(frame->image));
+            for (size_t j = 1; j < frameSkip && cap.grab(); j++)
+                ;
+        }
+        return frame;
+    };
+
+    // Parallel stage: decode image files, convert to greyscale and unwrap
+    const auto unwrapFrame = [&](Frame *frame) {
+        if (!isVideo) {
+            frame->image = m_Entries[frame->index * frameSkip].load(greyscale);
+            unwrapper.unwrap(frame->image, frame->unwrapped);
+        } else if (greyscale) {
+            unwrapper.unwrapGreyscale(frame->image, frame->unwrapped);
+        } else {
+            unwrapper.unwrap(frame->image, frame->unwrapped);
+        }
+        return frame;
+    };
+
+    // Parallel stage: encode and write to disk
+    const auto encode = [&](Frame *frame) {
+        const auto path = m_Entries[frame->index * frameSkip].getPath();
+        const std::string fileName = path.empty() ? "image" + std::to_string(frame->index) + ".jpg"
+                                                  : path.filename();
+        BOB_ASSERT(cv::imwrite((destination / fileName).str(), frame->unwrapped));
+        freeFrames.push(frame);
+    };
+
+    arena.execute([&]() {
+        tbb::parallel_pipeline(maxFrames,
+                               tbb::make_filter<void, Frame *>(FilterMode::serial_in_order, decode) &
+                               tbb::make_filter<Frame *, Frame *>(FilterMode::parallel, unwrapFrame) &
+                               tbb::make_filter<Frame *, void>(FilterMode::parallel, encode));
+    });
+}
+
+void
+ImageDatabase::pack(const filesystem::path &filePath,
+                    PackedImageDatabase::FrameFormat frameFormat) const
+{
+    using FrameFormat = PackedImageDatabase::FrameFormat;
+
+    BOB_ASSERT(!filePath.exists()); // Don't overwrite by mistake
+    LOG_INFO << "Packing " << m_Entries.size() << " entries into " << filePath;
+
+    const auto &strings = *m_EntryStrings;
+    const auto &extraFieldNames = strings.extraFieldNames;
+    PackedImageDatabase::Writer writer{ filePath, frameFormat, m_IsRoute,
+                                        extraFieldNames, getMetadataText(true) };
+
+    // Video files have to be read sequentially
+    cv::VideoCapture cap;
+    if (!m_VideoFilePath.empty()) {
+        BOB_ASSERT(cap.open(m_VideoFilePath.str()));
+    }
 
-        unwrapper.unwrap(image, unwrapped);
-        if (m_Entries[i].path.empty()) {
-            outPath = "image" + std::to_string(i) + ".jpg";
+    cv::Mat frame;
+    std::vector<uchar> fileData;
+    std::vector<std::string> extraFieldValues(extraFieldNames.size());
+    for (size_t i = 0; i < m_Entries.size(); i++) {
+        const auto &entry = m_Entries[i];
+
+        PackedImageDatabase::EntryRecord record{};
+        for (size_t j = 0; j < 3; j++) {
+            record.position[j] = entry.position[j].value();
+            record.gridPosition[j] = entry.gridPosition[j];
+        }
+        record.heading = entry.heading.value();
+
+        for (size_t j = 0; j < extraFieldNames.size(); j++) {
+            extraFieldValues[j] = strings.get(strings.extraFields[j][i]);
+        }
+
+        const auto path = entry.getPath();
+        const std::string fileName = path.empty() ? "" : path.filename();
+        if (cap.isOpened()) {
+            BOB_ASSERT(cap.read(frame));
+        } else if (isPacked()) {
+            frame = entry.load(false);
+        } else if (frameFormat == FrameFormat::Encoded) {
+            // Copy compressed image files as they are, without re-encoding
+            std::ifstream ifs;
+            ifs.exceptions(std::ios::badbit | std::ios::failbit);
+            ifs.open(path.str(), std::ios::in | std::ios::binary);
+            ifs.seekg(0, std::ios::end);
+            fileData.resize(static_cast<size_t>(ifs.tellg()));
+            ifs.seekg(0);
+            ifs.read(reinterpret_cast<char *>(fileData.data()), fileData.size());
+
+            writer.addEncodedFrame(fileData, record, fileName, extraFieldValues);
+            continue;
         } else {
-            outPath = m_Entries[i * frameSkip].path.filename();
+            frame = cv::imread(path.str(), cv::IMREAD_UNCHANGED);
+            if (frame.empty()) {
+                throw std::runtime_error("Could not load image file at " + path.str());
+            }
         }
 
-        BOB_ASSERT(cv::imwrite((destination / outPath).str(), unwrapped));
-    }, frameSkip, greyscale);
+        writer.addFrame(frame, record, fileName, extraFieldValues);
+    }
+
+    writer.close();
+}
+
+void
+ImageDatabase::unpack(const filesystem::path &destination,
+                      const std::string &imageFormat, bool greyscale) const
+{
+    // Check that the database doesn't already exist
+    BOB_ASSERT(!(destination / EntriesFilename).exists());
+    filesystem::create_directory(destination);
+
+    if (hasMetadata()) {
+        std::ofstream ofs;
+        ofs.exceptions(std::ios::badbit | std::ios::failbit);
+        ofs.open((destination / MetadataFilename).str());
+        ofs << getMetadataText(true);
+    }
+
+    // Keep the old file names, if there were any
+    std::vector<std::string> fileNames(m_Entries.size());
+    for (size_t i = 0; i < m_Entries.size(); i++) {
+        const auto path = m_Entries[i].getPath();
+        if (path.empty()) {
+            std::ostringstream ss;
+            ss << "image" << std::setw(5) << std::setfill('0') << i << "." << imageFormat;
+            fileNames[i] = ss.str();
+        } else {
+            fileNames[i] = path.filename();
+        }
+    }
+
+    forEachImage([&](size_t i, const cv::Mat &image) {
+        BOB_ASSERT(cv::imwrite((destination / fileNames[i]).str(), image));
+    }, 1, greyscale);
+
+    writeEntriesCSV(destination / EntriesFilename, fileNames);
 }
 
 bool
@@ -827,6 +1705,31 @@ ImageDatabase::fileNameCompare(const std::string &fn1, const std::string &fn2)
     return fn1 < fn2;
 }
 
+std::string
+ImageDatabase::getMetadataText(bool skipVideoFile) const
+{
+    if (m_EntryStrings->packedDatabase) {
+        return m_EntryStrings->packedDatabase->getMetadata();
+    }
+
+    const auto metadataPath = m_Path / MetadataFilename;
+    if (!metadataPath.exists()) {
+        return {};
+    }
+
+    std::ifstream ifs{ metadataPath.str() };
+    ifs.exceptions(std::ios::badbit);
+    std::ostringstream ss;
+    std::string line;
+    const std::regex regex{ "^\\s*videoFile:.*" };
+    while (std::getline(ifs, line)) {
+        if (!skipVideoFile || !std::regex_match(line, regex)) {
+            ss << line << "\n";
+        }
+    }
+    return ss.str();
+}
+
 void
 ImageDatabase::loadMetadata()
 {
@@ -841,97 +1744,371 @@ ImageDatabase::loadMetadata()
         ifs.exceptions(std::ios::badbit | std::ios::failbit);
 
         std::stringstream ss;
-        ss << "%YAML:1.0\n"
-           << ifs.rdbuf();
-
-        // Parse metadata file
-        m_MetadataYAML = std::make_unique<cv::FileStorage>(ss.str(), cv::FileStorage::READ | cv::FileStorage::MEMORY);
-
-        // What type of database is it?
-        std::string dbtype;
-        const auto metadata = getMetadata();
-        metadata["type"] >> dbtype;
-        if (dbtype == "route") {
-            m_IsRoute = true;
-        } else if (dbtype == "grid") {
-            m_IsRoute = false;
-        } else {
-            throw std::runtime_error("Invalid database type \"" + dbtype + "\"");
-        }
+        ss << ifs.rdbuf();
+        parseMetadata(ss.str());
+    }
+}
 
-        // Check whether images are panoramic or not
-        metadata["needsUnwrapping"] >> m_NeedsUnwrapping;
+void
+ImageDatabase::parseMetadata(const std::string &yaml)
+{
+    // Parse metadata file
+    m_MetadataYAML = std::make_unique<cv::FileStorage>("%YAML:1.0\n" + yaml, cv::FileStorage::READ | cv::FileStorage::MEMORY);
+
+    // What type of database is it?
+    std::string dbtype;
+    const auto metadata = getMetadata();
+    metadata["type"] >> dbtype;
+    if (dbtype == "route") {
+        m_IsRoute = true;
+    } else if (dbtype == "grid") {
+        m_IsRoute = false;
+    } else {
+        throw std::runtime_error("Invalid database type \"" + dbtype + "\"");
+    }
 
-        // Get image resolution
-        std::vector<int> size(2);
-        metadata["camera"]["resolution"] >> size;
-        m_Resolution = { size[0], size[1] };
+    // Check whether images are panoramic or not
+    metadata["needsUnwrapping"] >> m_NeedsUnwrapping;
 
-        // These will only be set if database was recorded as a video file
-        std::string videoFileName;
-        metadata["videoFile"] >> videoFileName;
-        if (!videoFileName.empty()) {
-            m_VideoFilePath = m_Path / videoFileName;
-        }
+    // Get image resolution
+    std::vector<int> size(2);
+    metadata["camera"]["resolution"] >> size;
+    m_Resolution = { size[0], size[1] };
 
-        double fps = 0;
-        metadata["frameRate"] >> fps;
-        m_FrameRate = hertz_t{ fps };
+    // These will only be set if database was recorded as a video file
+    std::string videoFileName;
+    metadata["videoFile"] >> videoFileName;
+    if (!videoFileName.empty()) {
+        m_VideoFilePath = m_Path / videoFileName;
+    }
 
-        std::string time;
-        metadata["time"] >> time;
-        if (!time.empty()) {
-            std::istringstream ss{ time };
-            ss >> std::get_time(&m_CreationTime, "%Y-%m-%d %H:%M:%S");
-        }
+    double fps = 0;
+    metadata["frameRate"] >> fps;
+    m_FrameRate = hertz_t{ fps };
+
+    std::string time;
+    metadata["time"] >> time;
+    if (!time.empty()) {
+        std::istringstream ss{ time };
+        ss >> std::get_time(&m_CreationTime, "%Y-%m-%d %H:%M:%S");
     }
 }
 
 void
-ImageDatabase::addNewEntries(std::vector<ImageDatabase::Entry> &newEntries,
+ImageDatabase::addNewEntries(const std::vector<ImageDatabase::Entry> &newEntries,
+                             const std::vector<std::string> &newFileNames,
+                             const std::vector<std::string> &newExtraFieldValues,
                              const std::vector<std::string> &extraFieldNames)
 {
     if (newEntries.empty()) {
         LOG_WARNING << "No new entries added, nothing will be written";
         return;
     }
+    BOB_ASSERT(newFileNames.size() == newEntries.size());
+    BOB_ASSERT(newExtraFieldValues.size() == newEntries.size() * extraFieldNames.size());
 
     // Reload metadata, in case it's changed
     loadMetadata();
 
-    const std::string path = (m_Path / EntriesFilename).str();
-    LOG_INFO << "Writing entries to " << path << "...";
+    /*
+     * Rebuild the extra field columns for the recorder's fields, keeping
+     * values of existing entries where the fields match.
+     */
+    auto &strings = *m_EntryStrings;
+    const size_t oldSize = m_Entries.size();
+    std::vector<std::vector<uint32_t>> extraFields(extraFieldNames.size());
+    for (size_t j = 0; j < extraFieldNames.size(); j++) {
+        auto &column = extraFields[j];
+        const int oldField = strings.findExtraField(extraFieldNames[j]);
+        if (oldField == -1) {
+            column.resize(oldSize, strings.intern(""));
+        } else {
+            column = std::move(strings.extraFields[oldField]);
+        }
+
+        column.reserve(oldSize + newEntries.size());
+        for (size_t i = 0; i < newEntries.size(); i++) {
+            column.push_back(strings.intern(newExtraFieldValues[i * extraFieldNames.size() + j]));
+        }
+    }
+    strings.extraFields = std::move(extraFields);
+    strings.extraFieldNames = extraFieldNames;
 
-    // Move new entries into this object's vector
-    m_Entries.reserve(m_Entries.size() + newEntries.size());
-    for (auto &&e : newEntries) {
-        m_Entries.emplace_back(std::move(e));
+    // Add new entries to this object's vector
+    if (m_VideoFilePath.empty()) {
+        strings.directory = m_Path;
+        for (const auto &fileName : newFileNames) {
+            strings.fileNames.push_back(strings.intern(fileName));
+        }
+    }
+    m_Entries.insert(m_Entries.end(), newEntries.cbegin(), newEntries.cend());
+    std::atomic_store(&m_Index, std::shared_ptr<const ImageDatabaseIndex>{});
+    for (size_t i = oldSize; i < m_Entries.size(); i++) {
+        m_Entries[i].strings = m_EntryStrings.get();
+        m_Entries[i].index = i;
     }
 
     // Write image entries info to CSV file
+    std::vector<std::string> fileNames;
+    if (m_VideoFilePath.empty()) {
+        fileNames.reserve(m_Entries.size());
+        for (const auto index : strings.fileNames) {
+            fileNames.push_back(strings.get(index));
+        }
+    }
+    writeEntriesCSV(m_Path / EntriesFilename, fileNames);
+}
+
+std::shared_ptr<const std::vector<size_t>>
+ImageDatabase::getVideoKeyframes() const
+{
+    BOB_ASSERT(!m_VideoFilePath.empty());
+
+    auto keyframes = std::atomic_load(&m_VideoKeyframes);
+    if (!keyframes) {
+        /*
+         * If another thread got there first then use its table instead, so
+         * that the table never changes once it's been returned.
+         */
+        decltype(keyframes) expected;
+        keyframes = std::make_shared<const std::vector<size_t>>(loadVideoKeyframes());
+        if (!std::atomic_compare_exchange_strong(&m_VideoKeyframes, &expected, keyframes)) {
+            keyframes = expected;
+        }
+    }
+    return keyframes;
+}
+
+std::shared_ptr<const ImageDatabaseIndex>
+ImageDatabase::getIndex() const
+{
+    auto index = std::atomic_load(&m_Index);
+    if (!index) {
+        const auto indexPath = getIndexPath();
+        std::shared_ptr<const ImageDatabaseIndex> newIndex = ImageDatabaseIndex::load(indexPath, m_Entries);
+        if (!newIndex) {
+            newIndex = std::make_shared<const ImageDatabaseIndex>(m_Entries);
+            try {
+                newIndex->save(indexPath);
+            } catch (std::exception &e) {
+                // e.g. read-only media
+                LOG_WARNING << "Could not save index to " << indexPath << ": " << e.what();
+            }
+        }
+
+        // As with keyframes, the first index to be stored is the one we use
+        decltype(index) expected;
+        if (std::atomic_compare_exchange_strong(&m_Index, &expected, newIndex)) {
+            index = std::move(newIndex);
+        } else {
+            index = std::move(expected);
+        }
+    }
+    return index;
+}
+
+filesystem::path
+ImageDatabase::getIndexPath() const
+{
+    if (isPacked()) {
+        const auto &packedPath = m_EntryStrings->packedDatabase->getPath();
+        return packedPath.parent_path() / (packedPath.filename() + ".index");
+    }
+    if (!m_VideoFilePath.empty()) {
+        return m_Path / (m_VideoFilePath.filename() + ".index");
+    }
+    return m_Path / "database_index.bin";
+}
+
+filesystem::path
+ImageDatabase::getVideoKeyframesPath() const
+{
+    return m_Path / (m_VideoFilePath.filename() + ".keyframes");
+}
+
+std::vector<size_t>
+ImageDatabase::loadVideoKeyframes() const
+{
+    /*
+     * The cache file holds the size of the video file, so we can tell if it's
+     * been replaced, followed by the keyframe indices.
+     */
+    const auto cachePath = getVideoKeyframesPath();
+    const size_t videoSize = m_VideoFilePath.file_size();
+    std::vector<size_t> keyframes;
+    if (cachePath.exists()) {
+        std::ifstream ifs{ cachePath.str() };
+        size_t cachedSize;
+        if (ifs >> cachedSize && cachedSize == videoSize) {
+            size_t keyframe;
+            while (ifs >> keyframe) {
+                keyframes.push_back(keyframe);
+            }
+            if (!keyframes.empty()) {
+                return keyframes;
+            }
+        }
+
+        LOG_WARNING << cachePath << " is out of date; rebuilding";
+        keyframes.clear();
+    }
+
+    LOG_INFO << "Finding keyframes in " << m_VideoFilePath << "...";
+    if (!findVideoKeyframes(keyframes)) {
+        /*
+         * We can't tell where the keyframes are, so just use evenly spaced
+         * frames. Seeking to these is still accurate, because OpenCV decodes
+         * forward from the previous keyframe, but slower. We don't cache
+         * these, in case a later version of OpenCV can do better.
+         */
+        LOG_WARNING << "Could not read keyframes from " << m_VideoFilePath
+                    << "; decoding will be slower";
+        keyframes.clear();
+        for (size_t i = 0; i < m_Entries.size(); i += MinVideoChunkSize) {
+            keyframes.push_back(i);
+        }
+        return keyframes;
+    }
+
+    // Not being able to write the cache (e.g. read-only media) isn't an error
+    std::ofstream ofs{ cachePath.str() };
+    if (ofs) {
+        ofs << videoSize << "\n";
+        for (const size_t keyframe : keyframes) {
+            ofs << keyframe << "\n";
+        }
+    }
+    if (!ofs) {
+        LOG_WARNING << "Could not write " << cachePath;
+    }
+
+    return keyframes;
+}
+
+bool
+ImageDatabase::findVideoKeyframes(std::vector<size_t> &keyframes) const
+{
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 7)
+    // Read the raw packets from the file, which skips decoding the frames
+    cv::VideoCapture cap{ m_VideoFilePath.str(), cv::CAP_FFMPEG, { cv::CAP_PROP_FORMAT, -1 } };
+    if (!cap.isOpened()) {
+        return false;
+    }
+
+    for (size_t i = 0; cap.grab(); i++) {
+        if (cap.get(cv::CAP_PROP_LRF_HAS_KEY_FRAME) != 0.0) {
+            keyframes.push_back(i);
+        }
+    }
+
+    // The first frame is always a keyframe, so something's gone wrong
+    return !keyframes.empty() && keyframes[0] == 0;
+#else
+    // Older OpenCVs don't tell us which frames are keyframes
+    return false;
+#endif
+}
+
+std::vector<size_t>
+ImageDatabase::getVideoChunks(size_t frameSkip) const
+{
+    const size_t numImages = m_Entries.size() / frameSkip;
+
+    // Aim for a few chunks per thread, so the load is balanced
+    const size_t numThreads = static_cast<size_t>(tbb::this_task_arena::max_concurrency());
+    const size_t minChunkSize = std::max(MinVideoChunkSize, numImages / (4 * numThreads));
+
+    /*
+     * Chunks start at the first image at or after a keyframe, so with
+     * frameSkip > 1 we may decode a few frames past the keyframe first.
+     */
+    std::vector<size_t> chunks{ 0 };
+    for (const size_t keyframe : *getVideoKeyframes()) {
+        const size_t start = (keyframe + frameSkip - 1) / frameSkip;
+        if (start + minChunkSize > numImages) {
+            break;
+        }
+        if (start - chunks.back() >= minChunkSize) {
+            chunks.push_back(start);
+        }
+    }
+    chunks.push_back(numImages);
+
+    return chunks;
+}
+
+bool
+ImageDatabase::hasVideoFile() const
+{
+    return !m_VideoFilePath.empty();
+}
+
+void
+ImageDatabase::openVideoAt(cv::VideoCapture &cap, size_t frame) const
+{
+    BOB_ASSERT(cap.open(m_VideoFilePath.str()));
+    if (frame == 0) {
+        return;
+    }
+
+    // If the backend can't seek accurately, fall back on reading from the start
+    if (!cap.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frame)) ||
+            static_cast<size_t>(cap.get(cv::CAP_PROP_POS_FRAMES)) != frame) {
+        LOG_WARNING << "Could not seek to frame " << frame << " of " << m_VideoFilePath;
+        BOB_ASSERT(cap.open(m_VideoFilePath.str()));
+        for (size_t i = 0; i < frame; i++) {
+            BOB_ASSERT(cap.grab());
+        }
+    }
+}
+
+void
+ImageDatabase::resizeEntries(size_t size)
+{
+    const size_t oldSize = m_Entries.size();
+    m_Entries.resize(size);
+    for (size_t i = oldSize; i < size; i++) {
+        m_Entries[i].strings = m_EntryStrings.get();
+        m_Entries[i].index = i;
+    }
+}
+
+void
+ImageDatabase::writeEntriesCSV(const filesystem::path &path,
+                               const std::vector<std::string> &fileNames) const
+{
+    LOG_INFO << "Writing entries to " << path << "...";
+
+    // File names aren't written for video-type databases
+    const bool includeFileNames = !fileNames.empty();
+    BOB_ASSERT(!includeFileNames || fileNames.size() == m_Entries.size());
+
+    const auto &strings = *m_EntryStrings;
     std::ofstream os;
     os.exceptions(std::ios::badbit | std::ios::failbit);
-    os.open(path);
+    os.open(path.str());
     os << "X [mm], Y [mm], Z [mm], Heading [degrees]";
-    if (m_VideoFilePath.empty()) {
+    if (includeFileNames) {
         os << ", Filename";
     }
     if (!m_IsRoute) {
         os << ", Grid X, Grid Y, Grid Z";
     }
-    for (const auto &name : extraFieldNames) {
+    for (const auto &name : strings.extraFieldNames) {
         os << ", " << name;
     }
     os << "\n";
 
-    for (auto &e : m_Entries) {
+    for (size_t i = 0; i < m_Entries.size(); i++) {
+        const auto &e = m_Entries[i];
+
         // These fields are always written...
         os << e.position[0]() << ", " << e.position[1]() << ", "
            << e.position[2]() << ", " << e.heading();
 
         // ...this is only written if we're not saving as a video
-        if (m_VideoFilePath.empty()) {
-            os << ", " << e.path.filename();
+        if (includeFileNames) {
+            os << ", " << fileNames[i];
         }
 
         // ...and these are only written if it's a grid database
@@ -941,8 +2118,8 @@ ImageDatabase::addNewEntries(std::vector<ImageDatabase::Entry> &newEntries,
         }
 
         // Write any extra user-specified field values
-        for (const auto &name : extraFieldNames) {
-            os << ", " << e.extraFields[name];
+        for (const auto &column : strings.extraFields) {
+            os << ", " << strings.get(column[i]);
         }
 
         os << "\n";
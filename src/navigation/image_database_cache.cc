@@ -0,0 +1,346 @@
+// BoB robotics includes
+#include "common/hash.h"
+#include "common/macros.h"
+#include "common/path.h"
+#include "navigation/image_database_cache.h"
+#include "navigation/packed_image_database.h"
+
+// Third-party includes
+#include "plog/Log.h"
+#include "third_party/tinydir.h"
+
+// TBB
+#include <tbb/parallel_for.h>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+// Standard C includes
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+// Standard C++ includes
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace BoBRobotics {
+namespace Navigation {
+namespace {
+// Create a directory and any missing parent directories
+void
+createDirectories(const filesystem::path &path)
+{
+    if (path.exists()) {
+        return;
+    }
+
+    const auto parent = path.parent_path();
+    if (!parent.empty()) {
+        createDirectories(parent);
+    }
+    BOB_ASSERT(filesystem::create_directory(path));
+}
+
+/*
+ * Temporary files which haven't been written to for this long (in seconds)
+ * were left by a process which crashed or was killed while saving
+ */
+constexpr time_t StaleTempFileAge = 60 * 60;
+
+struct CacheFile
+{
+    filesystem::path path;
+    uint64_t size;
+    time_t lastUsed;
+    bool isTemporary;
+
+    bool isStale() const
+    {
+        return isTemporary && std::time(nullptr) - lastUsed > StaleTempFileAge;
+    }
+};
+
+// List entries, along with any temporary files, which also take up space
+
+std::vector<CacheFile>
+listCacheFiles(const filesystem::path &directory)
+{
+    std::vector<CacheFile> files;
+    tinydir_dir dir{};
+    if (tinydir_open(&dir, directory.str().c_str()) != 0) {
+        return files;
+    }
+    for (; dir.has_next; BOB_ASSERT(tinydir_next(&dir) == 0)) {
+        tinydir_file file;
+        if (tinydir_readfile(&dir, &file)) {
+            tinydir_close(&dir);
+            throw std::runtime_error("Could not read from directory");
+        }
+
+        const filesystem::path path = file.path;
+        const bool isTemporary = path.extension() == Path::TempFileExtension;
+        struct stat st;
+        if (!file.is_dir && (isTemporary || path.extension() == PackedImageDatabase::Extension) &&
+                stat(path.str().c_str(), &st) == 0) {
+            files.push_back({ path, static_cast<uint64_t>(st.st_size), st.st_mtime, isTemporary });
+        }
+    }
+    tinydir_close(&dir);
+
+    return files;
+}
+} // anonymous namespace
+
+constexpr uint64_t ImageDatabaseCache::DefaultMaxSize;
+
+ImageDatabaseCache::ImageDatabaseCache(filesystem::path directory, uint64_t maxSize)
+  : m_Directory(std::move(directory))
+  , m_MaxSize(maxSize)
+{
+    createDirectories(m_Directory);
+}
+
+std::vector<cv::Mat>
+ImageDatabaseCache::loadImages(const ImageDatabase &database, const cv::Size &size,
+                               size_t frameSkip, bool greyscale)
+{
+    std::ostringstream ss;
+    ss << "size: " << size.width << "x" << size.height;
+    return load(database, ss.str(), frameSkip, greyscale,
+                [size](const cv::Mat &image, cv::Mat &out) {
+                    if (size == cv::Size{}) {
+                        image.copyTo(out);
+                    } else {
+                        cv::resize(image, out, size);
+                    }
+                });
+}
+
+std::vector<cv::Mat>
+ImageDatabaseCache::loadUnwrapped(const ImageDatabase &database,
+                                  const ImgProc::OpenCVUnwrap360 &unwrapper,
+                                  size_t frameSkip, bool greyscale)
+{
+    // The unwrapper's saved parameters are relative, so we need the resolutions too
+    cv::FileStorage fs(".yml", cv::FileStorage::WRITE | cv::FileStorage::MEMORY);
+    fs << "cameraResolution" << unwrapper.getCameraResolution();
+    fs << "unwrappedResolution" << unwrapper.getUnwrapLUT().size();
+    fs << "unwrapper" << unwrapper;
+    return load(database, fs.releaseAndGetString(), frameSkip, greyscale,
+                [&unwrapper](const cv::Mat &image, cv::Mat &out) {
+                    unwrapper.unwrap(image, out);
+                });
+}
+
+const filesystem::path &
+ImageDatabaseCache::getDirectory() const
+{
+    return m_Directory;
+}
+
+uint64_t
+ImageDatabaseCache::getSize() const
+{
+    uint64_t size = 0;
+    for (const auto &file : listCacheFiles(m_Directory)) {
+        size += file.size;
+    }
+    return size;
+}
+
+void
+ImageDatabaseCache::clear()
+{
+    // Other processes may still be writing to recent temporary files
+    for (const auto &file : listCacheFiles(m_Directory)) {
+        if (!file.isTemporary || file.isStale()) {
+            file.path.remove_file();
+        }
+    }
+}
+
+filesystem::path
+ImageDatabaseCache::getDefaultDirectory()
+{
+    if (const char *path = std::getenv("BOB_IMAGE_CACHE_PATH")) {
+        return filesystem::path{ path };
+    }
+
+#ifdef _WIN32
+    const char *cacheRoot = std::getenv("LOCALAPPDATA");
+    BOB_ASSERT(cacheRoot);
+    return filesystem::path{ cacheRoot } / "bob_robotics" / "image_cache";
+#else
+    if (const char *cacheRoot = std::getenv("XDG_CACHE_HOME")) {
+        return filesystem::path{ cacheRoot } / "bob_robotics" / "image_cache";
+    }
+    const char *home = std::getenv("HOME");
+    BOB_ASSERT(home);
+    return filesystem::path{ home } / ".cache" / "bob_robotics" / "image_cache";
+#endif
+}
+
+std::vector<cv::Mat>
+ImageDatabaseCache::load(const ImageDatabase &database, const std::string &parameters,
+                         size_t frameSkip, bool greyscale, const DeriveFunc &derive)
+{
+    BOB_ASSERT(frameSkip > 0);
+
+    /*
+     * If any of the database's files change (as judged by size and
+     * modification time) then we'll get a different key.
+     */
+    std::ostringstream sources;
+    for (const auto &path : database.getSourceFiles()) {
+        struct stat st;
+        if (stat(path.str().c_str(), &st) != 0) {
+            throw std::runtime_error("Could not stat " + path.str());
+        }
+        sources << path.str() << " " << st.st_size << " " << st.st_mtime << "\n";
+    }
+
+    std::ostringstream ss;
+    ss << "database: " << database.getPath().make_absolute().str() << "\n"
+       << "sources: " << toHexString(hashString(sources.str())) << "\n"
+       << "frameSkip: " << frameSkip << "\n"
+       << "greyscale: " << greyscale << "\n"
+       << parameters;
+    const auto key = ss.str();
+    const auto filePath = m_Directory / (toHexString(hashString(key)) + "." + PackedImageDatabase::Extension);
+
+    std::vector<cv::Mat> images;
+    if (tryLoad(filePath, key, greyscale, images)) {
+        LOG_DEBUG << "Loaded " << images.size() << " images from " << filePath;
+        return images;
+    }
+
+    images.resize(database.size() / frameSkip);
+    database.forEachImage([&](size_t i, const cv::Mat &image) {
+        derive(image, images[i]);
+    }, frameSkip, greyscale);
+
+    save(filePath, key, database, frameSkip, images);
+    return images;
+}
+
+bool
+ImageDatabaseCache::tryLoad(const filesystem::path &filePath, const std::string &key,
+                            bool greyscale, std::vector<cv::Mat> &images) const
+{
+    if (!filePath.exists()) {
+        return false;
+    }
+
+    try {
+        const PackedImageDatabase packed{ filePath };
+
+        // Guard against hash collisions
+        if (packed.getMetadata() != key) {
+            LOG_WARNING << filePath << " holds images for a different key";
+            return false;
+        }
+
+        images.resize(packed.size());
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, images.size()),
+                          [&](const auto &r) {
+                              for (size_t i = r.begin(); i != r.end(); ++i) {
+                                  images[i] = packed.loadFrame(i, greyscale);
+                              }
+                          });
+    } catch (std::exception &e) {
+        // e.g. a partly written file left by a crash
+        LOG_WARNING << "Could not read " << filePath << ": " << e.what();
+        images.clear();
+        return false;
+    }
+
+    // Mark the file as recently used
+    utime(filePath.str().c_str(), nullptr);
+
+    return true;
+}
+
+void
+ImageDatabaseCache::save(const filesystem::path &filePath, const std::string &key,
+                         const ImageDatabase &database, size_t frameSkip,
+                         const std::vector<cv::Mat> &images) const
+{
+    if (images.empty()) {
+        return;
+    }
+
+    const uint64_t size = images.size() * images[0].total() * images[0].elemSize();
+    if (size > m_MaxSize) {
+        LOG_WARNING << "Images are bigger than the maximum cache size; not caching";
+        return;
+    }
+
+    // Another process may be filling the same entry at the same time
+    try {
+        Path::writeFileAtomically(filePath, [&](const filesystem::path &tempPath) {
+            PackedImageDatabase::Writer writer{ tempPath, PackedImageDatabase::FrameFormat::Raw,
+                                                database.isRoute(), {}, key };
+            for (size_t i = 0; i < images.size(); i++) {
+                const auto &entry = database[i * frameSkip];
+
+                PackedImageDatabase::EntryRecord record{};
+                for (size_t j = 0; j < 3; j++) {
+                    record.position[j] = entry.position[j].value();
+                    record.gridPosition[j] = entry.gridPosition[j];
+                }
+                record.heading = entry.heading.value();
+                writer.addFrame(images[i], record, "", {});
+            }
+            writer.close();
+        });
+    } catch (std::exception &e) {
+        LOG_WARNING << "Could not save " << filePath << ": " << e.what();
+        return;
+    }
+    LOG_INFO << "Saved " << images.size() << " images to " << filePath;
+
+    evict(filePath);
+}
+
+void
+ImageDatabaseCache::evict(const filesystem::path &keep) const
+{
+    auto files = listCacheFiles(m_Directory);
+    uint64_t totalSize = 0;
+    for (const auto &file : files) {
+        if (file.isStale()) {
+            LOG_DEBUG << "Removing stale temporary file " << file.path << " from cache";
+            if (file.path.remove_file()) {
+                continue;
+            }
+        }
+        totalSize += file.size;
+    }
+
+    // Remove least recently used files first
+    std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) {
+        return a.lastUsed < b.lastUsed;
+    });
+    for (const auto &file : files) {
+        if (totalSize <= m_MaxSize) {
+            break;
+        }
+        if (file.isTemporary || file.path.filename() == keep.filename()) {
+            continue;
+        }
+
+        LOG_DEBUG << "Removing " << file.path << " from cache";
+        if (file.path.remove_file()) {
+            totalSize -= file.size;
+        }
+    }
+}
+} // Navigation
+} // BoBRobotics
@@ -0,0 +1,300 @@
+// BoB robotics includes
+#include "common/circstat.h"
+#include "common/hash.h"
+#include "common/macros.h"
+#include "navigation/image_database_index.h"
+
+// Standard C includes
+#include <cmath>
+#include <cstring>
+
+// Standard C++ includes
+#include <algorithm>
+#include <fstream>
+#include <utility>
+
+namespace BoBRobotics {
+namespace Navigation {
+
+struct ImageDatabaseIndex::Query
+{
+    std::array<double, 3> position;
+    bool useZ;
+    size_t k;
+
+    // Squared distance beyond which points can be ignored
+    double maxDistance2;
+
+    bool filterHeading = false;
+    degree_t heading, maxHeadingDifference;
+
+    // A max-heap of squared distances and indices
+    std::vector<std::pair<double, size_t>> results;
+
+    Query(const Vector3<millimeter_t> &pos, size_t maxResults, double maxDistance)
+      : position{ pos[0].value(), pos[1].value(), pos[2].value() }
+      , useZ(!std::isnan(pos[2].value()))
+      , k(maxResults)
+      , maxDistance2(maxDistance * maxDistance)
+    {
+        BOB_ASSERT(!std::isnan(position[0]) && !std::isnan(position[1]));
+    }
+
+    double distance2(const Point &point) const
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < (useZ ? 3 : 2); i++) {
+            const double diff = point.position[i] - position[i];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    void consider(const Point &point)
+    {
+        const double d2 = distance2(point);
+        if (d2 > maxDistance2) {
+            return;
+        }
+        if (filterHeading &&
+                !(units::math::abs(circularDistance(degree_t{ point.heading }, heading)) <= maxHeadingDifference)) {
+            return;
+        }
+
+        results.emplace_back(d2, point.index);
+        std::push_heap(results.begin(), results.end());
+        if (results.size() > k) {
+            std::pop_heap(results.begin(), results.end());
+            results.pop_back();
+        }
+
+        // Once we have k results, we only need to look for closer ones
+        if (results.size() == k) {
+            maxDistance2 = results.front().first;
+        }
+    }
+
+    std::vector<size_t> getIndices()
+    {
+        std::sort_heap(results.begin(), results.end());
+        std::vector<size_t> indices;
+        indices.reserve(results.size());
+        for (const auto &result : results) {
+            indices.push_back(result.second);
+        }
+        return indices;
+    }
+};
+
+ImageDatabaseIndex::ImageDatabaseIndex(const std::vector<ImageDatabase::Entry> &entries)
+{
+    m_Points = getPoints(entries, m_Hash);
+    build(0, m_Points.size());
+}
+
+ImageDatabaseIndex::ImageDatabaseIndex(std::vector<Point> points, uint64_t hash)
+  : m_Points(std::move(points))
+  , m_Hash(hash)
+{}
+
+size_t
+ImageDatabaseIndex::size() const
+{
+    return m_Points.size();
+}
+
+std::vector<size_t>
+ImageDatabaseIndex::nearest(const Vector3<millimeter_t> &position, size_t k) const
+{
+    BOB_ASSERT(k > 0);
+    Query query{ position, k, std::numeric_limits<double>::infinity() };
+    search(0, m_Points.size(), query);
+    return query.getIndices();
+}
+
+std::vector<size_t>
+ImageDatabaseIndex::nearest(const Vector3<millimeter_t> &position, size_t k,
+                            degree_t heading, degree_t maxHeadingDifference) const
+{
+    BOB_ASSERT(k > 0);
+    Query query{ position, k, std::numeric_limits<double>::infinity() };
+    query.filterHeading = true;
+    query.heading = heading;
+    query.maxHeadingDifference = maxHeadingDifference;
+    search(0, m_Points.size(), query);
+    return query.getIndices();
+}
+
+std::vector<size_t>
+ImageDatabaseIndex::withinRadius(const Vector3<millimeter_t> &position,
+                                 millimeter_t radius) const
+{
+    Query query{ position, std::numeric_limits<size_t>::max(), radius.value() };
+    search(0, m_Points.size(), query);
+    return query.getIndices();
+}
+
+void
+ImageDatabaseIndex::save(const filesystem::path &filePath) const
+{
+    std::ofstream ofs;
+    ofs.exceptions(std::ios::badbit | std::ios::failbit);
+    ofs.open(filePath.str(), std::ios::out | std::ios::binary);
+
+    // Only the order of the points and the split axes are needed
+    const uint64_t count = m_Points.size();
+    ofs.write(getMagic(), std::strlen(getMagic()));
+    ofs.write(reinterpret_cast<const char *>(&m_Hash), sizeof(m_Hash));
+    ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const auto &point : m_Points) {
+        const uint64_t index = point.index;
+        ofs.write(reinterpret_cast<const char *>(&index), sizeof(index));
+        ofs.write(reinterpret_cast<const char *>(&point.splitAxis), sizeof(point.splitAxis));
+    }
+}
+
+std::unique_ptr<ImageDatabaseIndex>
+ImageDatabaseIndex::load(const filesystem::path &filePath,
+                         const std::vector<ImageDatabase::Entry> &entries)
+{
+    std::ifstream ifs(filePath.str(), std::ios::in | std::ios::binary);
+    if (!ifs) {
+        return nullptr;
+    }
+
+    char magic[8];
+    uint64_t fileHash, count;
+    ifs.read(magic, sizeof(magic));
+    ifs.read(reinterpret_cast<char *>(&fileHash), sizeof(fileHash));
+    ifs.read(reinterpret_cast<char *>(&count), sizeof(count));
+    if (!ifs || !std::equal(std::begin(magic), std::end(magic), getMagic())) {
+        return nullptr;
+    }
+
+    // The positions of the entries have to match the ones the tree was built for
+    uint64_t hash;
+    auto points = getPoints(entries, hash);
+    if (hash != fileHash || count != points.size()) {
+        return nullptr;
+    }
+
+    std::vector<Point> ordered;
+    ordered.reserve(points.size());
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t index;
+        uint8_t splitAxis;
+        ifs.read(reinterpret_cast<char *>(&index), sizeof(index));
+        ifs.read(reinterpret_cast<char *>(&splitAxis), sizeof(splitAxis));
+        if (!ifs || index >= entries.size() || splitAxis > 2) {
+            return nullptr;
+        }
+
+        const auto &entry = entries[index];
+        ordered.push_back({ { entry.position[0].value(), entry.position[1].value(),
+                              std::isnan(entry.position[2].value()) ? 0.0 : entry.position[2].value() },
+                            entry.heading.value(), static_cast<size_t>(index), splitAxis });
+    }
+
+    return std::unique_ptr<ImageDatabaseIndex>(new ImageDatabaseIndex(std::move(ordered), hash));
+}
+
+void
+ImageDatabaseIndex::build(size_t begin, size_t end)
+{
+    if (end - begin < 2) {
+        if (begin != end) {
+            m_Points[begin].splitAxis = 0;
+        }
+        return;
+    }
+
+    // Split along the axis in which the points are most spread out
+    std::array<double, 3> min, max;
+    min.fill(std::numeric_limits<double>::infinity());
+    max.fill(-std::numeric_limits<double>::infinity());
+    for (size_t i = begin; i < end; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            min[j] = std::min(min[j], m_Points[i].position[j]);
+            max[j] = std::max(max[j], m_Points[i].position[j]);
+        }
+    }
+    uint8_t axis = 0;
+    for (uint8_t j = 1; j < 3; j++) {
+        if (max[j] - min[j] > max[axis] - min[axis]) {
+            axis = j;
+        }
+    }
+
+    const size_t mid = begin + (end - begin) / 2;
+    std::nth_element(m_Points.begin() + begin, m_Points.begin() + mid, m_Points.begin() + end,
+                     [axis](const Point &a, const Point &b) {
+                         return a.position[axis] < b.position[axis];
+                     });
+    m_Points[mid].splitAxis = axis;
+
+    build(begin, mid);
+    build(mid + 1, end);
+}
+
+void
+ImageDatabaseIndex::search(size_t begin, size_t end, Query &query) const
+{
+    if (begin == end) {
+        return;
+    }
+
+    const size_t mid = begin + (end - begin) / 2;
+    const auto &point = m_Points[mid];
+    query.consider(point);
+
+    // For 2D queries, we can't rule out either side of a split in z
+    const auto axis = point.splitAxis;
+    if (axis == 2 && !query.useZ) {
+        search(begin, mid, query);
+        search(mid + 1, end, query);
+        return;
+    }
+
+    // Search the side containing the query point first, as that's likely closer
+    const double diff = query.position[axis] - point.position[axis];
+    const auto near = (diff < 0) ? std::make_pair(begin, mid) : std::make_pair(mid + 1, end);
+    const auto far = (diff < 0) ? std::make_pair(mid + 1, end) : std::make_pair(begin, mid);
+    search(near.first, near.second, query);
+    if (diff * diff <= query.maxDistance2) {
+        search(far.first, far.second, query);
+    }
+}
+
+std::vector<ImageDatabaseIndex::Point>
+ImageDatabaseIndex::getPoints(const std::vector<ImageDatabase::Entry> &entries,
+                              uint64_t &hash)
+{
+    // Hash positions, so we can tell if a saved tree is out of date
+    FNV1aHash hasher;
+    const auto addToHash = [&hasher](double value) {
+        hasher.add(&value, sizeof(value));
+    };
+
+    std::vector<Point> points;
+    points.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto &position = entries[i].position;
+        if (std::isnan(position[0].value()) || std::isnan(position[1].value())) {
+            continue;
+        }
+
+        // Routes don't always have a z coordinate
+        const double z = std::isnan(position[2].value()) ? 0.0 : position[2].value();
+        points.push_back({ { position[0].value(), position[1].value(), z },
+                           entries[i].heading.value(), i, 0 });
+        addToHash(static_cast<double>(i));
+        for (const double value : points.back().position) {
+            addToHash(value);
+        }
+    }
+
+    hash = hasher.get();
+    return points;
+}
+} // Navigation
+} // BoBRobotics
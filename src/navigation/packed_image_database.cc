@@ -0,0 +1,304 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "navigation/packed_image_database.h"
+#include "plog/Log.h"
+
+// Standard C includes
+#include <cstdio>
+#include <cstring>
+
+// Standard C++ includes
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace BoBRobotics {
+namespace Navigation {
+
+constexpr const char *PackedImageDatabase::Extension;
+constexpr uint32_t PackedImageDatabase::CurrentVersion;
+constexpr uint32_t PackedImageDatabase::ByteOrderMark;
+constexpr uint64_t PackedImageDatabase::FrameAlignment;
+
+PackedImageDatabase::Writer::Writer(const filesystem::path &filePath,
+                                    FrameFormat frameFormat, bool isRoute,
+                                    std::vector<std::string> extraFieldNames,
+                                    const std::string &metadata)
+  : m_FilePath(filePath)
+  , m_ExtraFieldNames(std::move(extraFieldNames))
+{
+    std::memset(&m_Header, 0, sizeof(m_Header));
+    std::copy_n(Header::getMagic(), sizeof(m_Header.magic), m_Header.magic);
+    m_Header.version = CurrentVersion;
+    m_Header.byteOrderMark = ByteOrderMark;
+    m_Header.frameFormat = frameFormat;
+    m_Header.isRoute = isRoute;
+    m_Header.numExtraFields = static_cast<uint32_t>(m_ExtraFieldNames.size());
+    m_Header.metadata = addString(metadata);
+
+    m_Stream.exceptions(std::ios::badbit | std::ios::failbit);
+    m_Stream.open(filePath.str(), std::ios::out | std::ios::binary);
+
+    // Write a placeholder header, which we fill in when we're finished
+    m_Offset = 0;
+    writeAligned(&m_Header, sizeof(m_Header));
+}
+
+PackedImageDatabase::Writer::~Writer()
+{
+    if (!m_Open) {
+        return;
+    }
+
+    // Don't leave a half-written file which looks like a valid one
+    LOG_WARNING << "Packed database " << m_FilePath << " was not finished; removing it";
+    m_Stream.exceptions(std::ios::goodbit);
+    m_Stream.close();
+    std::remove(m_FilePath.str().c_str());
+}
+
+void
+PackedImageDatabase::Writer::addFrame(const cv::Mat &frame, EntryRecord entry,
+                                      const std::string &fileName,
+                                      const std::vector<std::string> &extraFieldValues)
+{
+    BOB_ASSERT(m_Open);
+    BOB_ASSERT(!frame.empty());
+
+    // All frames need the same resolution, so that raw frames can be decoded
+    if (m_Entries.empty()) {
+        m_Header.width = frame.cols;
+        m_Header.height = frame.rows;
+        m_Header.type = frame.type();
+    } else {
+        BOB_ASSERT(frame.cols == m_Header.width && frame.rows == m_Header.height);
+    }
+
+    if (m_Header.frameFormat == FrameFormat::Encoded) {
+        BOB_ASSERT(cv::imencode(".png", frame, m_EncodeBuffer));
+        addEncodedFrame(m_EncodeBuffer, entry, fileName, extraFieldValues);
+        return;
+    }
+
+    BOB_ASSERT(frame.type() == m_Header.type);
+    const uint64_t frameOffset = m_Offset;
+    const size_t rowSize = frame.cols * frame.elemSize();
+    if (frame.isContinuous()) {
+        m_Stream.write(reinterpret_cast<const char *>(frame.data), rowSize * frame.rows);
+    } else {
+        for (int y = 0; y < frame.rows; y++) {
+            m_Stream.write(reinterpret_cast<const char *>(frame.ptr(y)), rowSize);
+        }
+    }
+    m_Offset += rowSize * frame.rows;
+    writeAligned(nullptr, 0);
+
+    addEntry(entry, frameOffset, rowSize * frame.rows, fileName, extraFieldValues);
+}
+
+void
+PackedImageDatabase::Writer::addEncodedFrame(const std::vector<uchar> &data,
+                                             EntryRecord entry,
+                                             const std::string &fileName,
+                                             const std::vector<std::string> &extraFieldValues)
+{
+    BOB_ASSERT(m_Open);
+    BOB_ASSERT(m_Header.frameFormat == FrameFormat::Encoded);
+
+    const uint64_t frameOffset = m_Offset;
+    writeAligned(data.data(), data.size());
+    addEntry(entry, frameOffset, data.size(), fileName, extraFieldValues);
+}
+
+void
+PackedImageDatabase::Writer::close()
+{
+    BOB_ASSERT(m_Open);
+
+    m_Header.numEntries = m_Entries.size();
+    m_Header.entriesOffset = m_Offset;
+    writeAligned(m_Entries.data(), m_Entries.size() * sizeof(EntryRecord));
+
+    m_Header.extraFieldsOffset = m_Offset;
+    writeAligned(m_ExtraFields.data(), m_ExtraFields.size() * sizeof(StringRef));
+
+    std::vector<StringRef> names;
+    names.reserve(m_ExtraFieldNames.size());
+    for (const auto &name : m_ExtraFieldNames) {
+        names.push_back(addString(name));
+    }
+    m_Header.extraFieldNamesOffset = m_Offset;
+    writeAligned(names.data(), names.size() * sizeof(StringRef));
+
+    m_Header.stringsOffset = m_Offset;
+    m_Header.stringsSize = m_Strings.size();
+    writeAligned(m_Strings.data(), m_Strings.size());
+
+    // Now we know where everything is, we can write the real header
+    m_Stream.seekp(0);
+    m_Stream.write(reinterpret_cast<const char *>(&m_Header), sizeof(m_Header));
+    m_Stream.close();
+    m_Open = false;
+}
+
+PackedImageDatabase::StringRef
+PackedImageDatabase::Writer::addString(const std::string &str)
+{
+    BOB_ASSERT(m_Strings.size() + str.size() <= std::numeric_limits<uint32_t>::max());
+
+    const StringRef ref{ static_cast<uint32_t>(m_Strings.size()),
+                         static_cast<uint32_t>(str.size()) };
+    m_Strings += str;
+    return ref;
+}
+
+void
+PackedImageDatabase::Writer::writeAligned(const void *data, size_t size)
+{
+    if (size > 0) {
+        m_Stream.write(static_cast<const char *>(data), size);
+        m_Offset += size;
+    }
+
+    // Pad with zeros up to the next boundary
+    static const char padding[FrameAlignment]{};
+    const size_t remainder = m_Offset % FrameAlignment;
+    if (remainder > 0) {
+        m_Stream.write(padding, FrameAlignment - remainder);
+        m_Offset += FrameAlignment - remainder;
+    }
+}
+
+void
+PackedImageDatabase::Writer::addEntry(EntryRecord &entry, uint64_t frameOffset,
+                                      uint64_t frameSize, const std::string &fileName,
+                                      const std::vector<std::string> &extraFieldValues)
+{
+    BOB_ASSERT(extraFieldValues.size() == m_ExtraFieldNames.size());
+
+    entry.frameOffset = frameOffset;
+    entry.frameSize = frameSize;
+    entry.fileName = addString(fileName);
+    m_Entries.push_back(entry);
+
+    for (const auto &value : extraFieldValues) {
+        m_ExtraFields.push_back(addString(value));
+    }
+}
+
+PackedImageDatabase::PackedImageDatabase(const filesystem::path &filePath)
+  : m_File(filePath)
+  , m_Header(m_File.at<Header>(0))
+{
+    if (!std::equal(std::begin(m_Header->magic), std::end(m_Header->magic), Header::getMagic())) {
+        throw std::runtime_error(filePath.str() + " is not a packed image database");
+    }
+    if (m_Header->version != CurrentVersion) {
+        throw std::runtime_error("Unsupported packed image database version: " +
+                                 std::to_string(m_Header->version));
+    }
+    if (m_Header->byteOrderMark != ByteOrderMark) {
+        throw std::runtime_error(filePath.str() + " was written on a machine with different endianness");
+    }
+
+    // Check the tables are all within the file
+    m_File.at<EntryRecord>(m_Header->entriesOffset, size());
+    m_File.at<StringRef>(m_Header->extraFieldsOffset, size() * m_Header->numExtraFields);
+    m_File.at<StringRef>(m_Header->extraFieldNamesOffset, m_Header->numExtraFields);
+    m_File.at<char>(m_Header->stringsOffset, m_Header->stringsSize);
+}
+
+const PackedImageDatabase::EntryRecord &
+PackedImageDatabase::getEntry(size_t index) const
+{
+    BOB_ASSERT(index < size());
+    return m_File.at<EntryRecord>(m_Header->entriesOffset, size())[index];
+}
+
+std::string
+PackedImageDatabase::getFileName(size_t index) const
+{
+    return getString(getEntry(index).fileName);
+}
+
+std::string
+PackedImageDatabase::getExtraField(size_t index, size_t field) const
+{
+    BOB_ASSERT(index < size() && field < m_Header->numExtraFields);
+    const auto refs = m_File.at<StringRef>(m_Header->extraFieldsOffset,
+                                           size() * m_Header->numExtraFields);
+    return getString(refs[index * m_Header->numExtraFields + field]);
+}
+
+std::vector<std::string>
+PackedImageDatabase::getExtraFieldNames() const
+{
+    const auto refs = m_File.at<StringRef>(m_Header->extraFieldNamesOffset,
+                                           m_Header->numExtraFields);
+    std::vector<std::string> names;
+    names.reserve(m_Header->numExtraFields);
+    for (size_t i = 0; i < m_Header->numExtraFields; i++) {
+        names.push_back(getString(refs[i]));
+    }
+    return names;
+}
+
+std::string
+PackedImageDatabase::getMetadata() const
+{
+    return getString(m_Header->metadata);
+}
+
+cv::Mat
+PackedImageDatabase::loadFrame(size_t index, bool greyscale) const
+{
+    const auto &entry = getEntry(index);
+    const auto data = m_File.at(entry.frameOffset, entry.frameSize);
+
+    // cv::Mat won't take a const pointer, but we never write through it
+    auto mutableData = const_cast<uint8_t *>(data);
+
+    cv::Mat frame;
+    if (m_Header->frameFormat == FrameFormat::Encoded) {
+        const cv::Mat encoded{ 1, static_cast<int>(entry.frameSize), CV_8UC1, mutableData };
+        frame = cv::imdecode(encoded, greyscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+        if (frame.empty()) {
+            throw std::runtime_error("Could not decode frame " + std::to_string(index) +
+                                     " of " + m_File.getPath().str());
+        }
+        return frame;
+    }
+
+    const cv::Mat raw{ m_Header->height, m_Header->width, m_Header->type, mutableData };
+    BOB_ASSERT(raw.total() * raw.elemSize() == entry.frameSize);
+    const int channels = raw.channels();
+    if (greyscale && channels == 3) {
+        cv::cvtColor(raw, frame, cv::COLOR_BGR2GRAY);
+    } else if (greyscale && channels == 4) {
+        cv::cvtColor(raw, frame, cv::COLOR_BGRA2GRAY);
+    } else if (!greyscale && channels == 1) {
+        cv::cvtColor(raw, frame, cv::COLOR_GRAY2BGR);
+    } else {
+        raw.copyTo(frame);
+    }
+    return frame;
+}
+
+bool
+PackedImageDatabase::isPackedFile(const filesystem::path &filePath)
+{
+    std::ifstream ifs(filePath.str(), std::ios::in | std::ios::binary);
+    char magic[sizeof(Header::magic)];
+    return ifs.read(magic, sizeof(magic)) &&
+           std::equal(std::begin(magic), std::end(magic), Header::getMagic());
+}
+
+std::string
+PackedImageDatabase::getString(const StringRef &ref) const
+{
+    BOB_ASSERT(static_cast<uint64_t>(ref.offset) + ref.length <= m_Header->stringsSize);
+    const auto str = m_File.at<char>(m_Header->stringsOffset + ref.offset, ref.length);
+    return { str, ref.length };
+}
+} // Navigation
+} // BoBRobotics
@@ -13,10 +13,15 @@ namespace BoBRobotics {
 namespace Net {
 
 Client::Client(const std::string &host,
-               uint16_t port)
+               uint16_t port,
+               bool binary)
   : Connection(AF_INET, SOCK_STREAM, 0)
   , m_IP(host)
 {
+    if (binary) {
+        requestBinaryProtocol();
+    }
+
     // Create socket address structure
     in_addr addr;
     addr.s_addr = inet_addr(host.c_str());
@@ -1,9 +1,12 @@
 // BoB robotics includes
+#include "common/macros.h"
 #include "plog/Log.h"
 #include "net/connection.h"
 
 // Standard C++ includes
+#include <algorithm>
 #include <iterator>
+#include <limits>
 #include <sstream>
 
 namespace BoBRobotics {
@@ -20,10 +23,70 @@ Connection::SocketWriter::~SocketWriter()
     m_Connection.m_SendMutex.unlock();
 }
 
+void Connection::SocketWriter::send(const void *buffer, size_t length)
+{
+    if (m_Connection.m_SendBinary) {
+        sendMessage(DataMessage, buffer, length);
+    } else {
+        m_Connection.m_Socket.send(buffer, length);
+    }
+}
+
+void Connection::SocketWriter::send(const std::string &msg)
+{
+    if (!m_Connection.m_SendBinary) {
+        m_Connection.m_Socket.send(msg);
+        return;
+    }
+
+    // Send each line as a separate message
+    size_t start = 0;
+    while (start < msg.size()) {
+        size_t end = msg.find('\n', start);
+        if (end == std::string::npos) {
+            end = msg.size();
+        }
+        if (end > start) {
+            sendMessage(CommandMessage, &msg[start], end - start);
+            LOG_VERBOSE << ">>> " << msg.substr(start, end - start);
+        }
+        start = end + 1;
+    }
+}
+
+void Connection::SocketWriter::sendMessage(uint8_t type, const void *data, size_t size)
+{
+    if (!m_Connection.m_SendBinary) {
+        throw std::runtime_error("Messages can only be sent with the binary protocol");
+    }
+    BOB_ASSERT(size <= std::numeric_limits<uint32_t>::max());
+    BOB_ASSERT(type == DataMessage || size <= MaxMessageSize);
+
+    // Small messages are sent with a single call, copying them after the header
+    auto &buffer = m_Connection.m_SendBuffer;
+    const auto length = static_cast<uint32_t>(size);
+    const bool copy = size <= DefaultBufferSize;
+    buffer.resize(MessageHeaderSize + (copy ? size : 0));
+    std::memcpy(&buffer[0], &length, sizeof(length));
+    buffer[sizeof(length)] = type;
+    if (copy) {
+        std::copy_n(reinterpret_cast<const uint8_t *>(data), size, &buffer[MessageHeaderSize]);
+        m_Connection.m_Socket.send(buffer.data(), buffer.size());
+    } else {
+        m_Connection.m_Socket.send(buffer.data(), buffer.size());
+        m_Connection.m_Socket.send(data, size);
+    }
+}
+
+bool Connection::SocketWriter::isBinary() const
+{
+    return m_Connection.m_SendBinary;
+}
+
 Connection::~Connection()
 {
     if (m_Socket.isOpen()) {
-        m_Socket.send("BYE\n");
+        getSocketWriter().send("BYE\n");
         m_Socket.close();
     }
 
@@ -41,10 +104,50 @@ void Connection::setCommandHandler(const std::string &commandName, const Command
     m_CommandHandlers.emplace(commandName, handler);
 }
 
+void Connection::setMessageHandler(uint8_t type, const MessageHandler &handler)
+{
+    std::lock_guard<std::mutex> guard(m_CommandHandlersMutex);
+    m_MessageHandlers[type] = handler;
+}
+
+void Connection::requestBinaryProtocol()
+{
+    m_WantBinary = true;
+}
+
+bool Connection::isBinary() const
+{
+    return m_SendBinary;
+}
+
 void Connection::read(void *buffer, size_t length)
 {
-    // initially, copy over any leftover bytes in m_Buffer
     auto cbuffer = reinterpret_cast<char *>(buffer);
+    if (!m_ReceiveBinary) {
+        readBytes(cbuffer, length);
+        return;
+    }
+
+    // The data may be split across several messages
+    while (length > 0) {
+        if (m_DataBytesLeft == 0) {
+            if (readMessageHeader(m_DataBytesLeft) != DataMessage) {
+                throw BadCommandError();
+            }
+            continue;
+        }
+
+        const size_t nbytes = std::min(length, m_DataBytesLeft);
+        readBytes(cbuffer, nbytes);
+        cbuffer += nbytes;
+        length -= nbytes;
+        m_DataBytesLeft -= nbytes;
+    }
+}
+
+void Connection::readBytes(char *cbuffer, size_t length)
+{
+    // initially, copy over any leftover bytes in m_Buffer
     if (m_BufferBytes > 0) {
         size_t tocopy = std::min(length, m_BufferBytes);
         std::copy_n(&m_Buffer[m_BufferStart], tocopy, cbuffer);
@@ -66,21 +169,63 @@ Connection::SocketWriter Connection::getSocketWriter()
     return SocketWriter(*this);
 }
 
+std::string Connection::getPeerAddress() const
+{
+    sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    if (getpeername(m_Socket.getHandle(), (sockaddr *) &addr, &addrlen)) {
+        throw OS::Net::NetworkError("Could not get peer address");
+    }
+
+    char saddr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, (void *) &addr.sin_addr, saddr, sizeof(saddr));
+    return saddr;
+}
+
 std::string Connection::readNextCommand()
 {
-    Command command = readCommand();
-    parseCommand(command);
-    return command[0];
+    std::string commandName;
+    readAndParse(commandName);
+    return commandName;
 }
 
 Socket &Connection::getSocket() { return m_Socket; }
 
 void Connection::runInternal()
+{
+    std::string commandName;
+    while (readAndParse(commandName) && isRunning())
+        ;
+}
+
+bool Connection::readAndParse(std::string &commandName)
 {
     Command command;
-    do {
+    if (m_ReceiveBinary) {
+        Message message;
+        readMessage(message);
+        if (message.type != CommandMessage) {
+            commandName.clear();
+            parseMessage(message);
+            return true;
+        }
+
+        // Existing handlers are given the command as a list of words
+        const auto text = reinterpret_cast<const char *>(message.data);
+        const std::string line(text, text + message.size);
+        LOG_VERBOSE << "<<< " << line;
+        std::istringstream iss(line);
+        command.assign(std::istream_iterator<std::string>{ iss },
+                       std::istream_iterator<std::string>());
+        if (command.empty()) {
+            throw BadCommandError();
+        }
+    } else {
         command = readCommand();
-    } while (isRunning() && parseCommand(command));
+    }
+
+    commandName = command[0];
+    return parseCommand(command);
 }
 
 bool Connection::parseCommand(Command &command)
@@ -90,6 +235,23 @@ bool Connection::parseCommand(Command &command)
         return false;
     }
     if (command[0] == "HEY") {
+        // The other end lists optional features after HEY
+        if (m_WantBinary) {
+            if (std::find(command.cbegin() + 1, command.cend(), "BIN") != command.cend()) {
+                sendBinaryRequest();
+            } else {
+                LOG_WARNING << "Binary protocol is not supported by other end; using text";
+            }
+        }
+        return true;
+    }
+    if (command[0] == "BIN") {
+        // This is either a request to switch or a reply to ours
+        if (!m_SendBinary) {
+            sendBinaryRequest();
+        }
+        m_ReceiveBinary = true;
+        LOG_DEBUG << "Switched to binary protocol";
         return true;
     }
 
@@ -107,6 +269,80 @@ bool Connection::parseCommand(Command &command)
     }
 }
 
+void Connection::parseMessage(const Message &message)
+{
+    try {
+        std::lock_guard<std::mutex> guard(m_CommandHandlersMutex);
+        MessageHandler &handler = m_MessageHandlers.at(message.type);
+
+        // handler will be nullptr if it has been removed
+        if (handler) {
+            handler(*this, message);
+        }
+    } catch (std::out_of_range &) {
+        throw BadCommandError();
+    }
+}
+
+void Connection::sendBinaryRequest()
+{
+    // Everything sent after this command uses the binary protocol
+    SocketWriter writer(*this);
+    writer.send("BIN\n");
+    m_SendBinary = true;
+}
+
+void Connection::readMessage(Message &message)
+{
+    size_t size;
+    message.type = readMessageHeader(size);
+    if (message.type == DataMessage) {
+        // Data should only be read with read()
+        throw BadCommandError();
+    }
+    if (size > MaxMessageSize) {
+        throw BadCommandError();
+    }
+
+    fillBuffer(size);
+    message.data = reinterpret_cast<const uint8_t *>(&m_Buffer[m_BufferStart]);
+    message.size = size;
+    debitBytes(size);
+}
+
+uint8_t Connection::readMessageHeader(size_t &size)
+{
+    fillBuffer(MessageHeaderSize);
+    uint32_t length;
+    std::memcpy(&length, &m_Buffer[m_BufferStart], sizeof(length));
+    const auto type = static_cast<uint8_t>(m_Buffer[m_BufferStart + sizeof(length)]);
+    debitBytes(MessageHeaderSize);
+
+    size = length;
+    return type;
+}
+
+void Connection::fillBuffer(size_t nbytes)
+{
+    if (m_BufferStart + nbytes > m_Buffer.size()) {
+        // Move what we have to the start, making room for bigger messages if needed
+        std::copy_n(&m_Buffer[m_BufferStart], m_BufferBytes, &m_Buffer[0]);
+        m_BufferStart = 0;
+        if (nbytes > m_Buffer.size()) {
+            m_Buffer.resize(nbytes);
+        }
+    }
+
+    while (m_BufferBytes < nbytes) {
+        const size_t end = m_BufferStart + m_BufferBytes;
+        const size_t nread = m_Socket.read(&m_Buffer[end], m_Buffer.size() - end);
+        if (nread == 0) {
+            throw SocketClosedError();
+        }
+        m_BufferBytes += nread;
+    }
+}
+
 Command Connection::readCommand()
 {
     std::string line = readLine();
@@ -122,7 +358,7 @@ std::string Connection::readLine()
     while (true) {
         if (m_BufferBytes == 0) {
             m_BufferBytes += m_Socket.read(&m_Buffer[m_BufferStart],
-                                            DefaultBufferSize - m_BufferStart);
+                                           m_Buffer.size() - m_BufferStart);
         }
 
         // look for newline char
@@ -151,10 +387,10 @@ std::string Connection::readLine()
 void Connection::debitBytes(const size_t nbytes)
 {
     m_BufferStart += nbytes;
-    if (m_BufferStart == DefaultBufferSize) {
+    m_BufferBytes -= nbytes;
+    if (m_BufferBytes == 0) {
         m_BufferStart = 0;
     }
-    m_BufferBytes -= nbytes;
 }
 
 } // Net
@@ -0,0 +1,198 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "net/frame_fragments.h"
+
+// Standard C includes
+#include <cstring>
+
+// Standard C++ includes
+#include <algorithm>
+#include <limits>
+
+namespace BoBRobotics {
+namespace Net {
+namespace {
+// Sent at the start of each datagram, in network byte order
+struct FragmentHeader
+{
+    uint32_t frameID;
+    uint32_t frameSize;
+    uint32_t offset;
+    uint16_t index;
+    uint16_t count;
+};
+
+// Frame IDs wrap around, so compare them like TCP sequence numbers
+bool
+isNewer(uint32_t id, uint32_t than)
+{
+    return static_cast<int32_t>(id - than) > 0;
+}
+
+/*
+ * Fragments all carry the same amount of data (the stride), except the last,
+ * which may carry less. Work out the stride from one fragment, checking that
+ * the fragment is where it should be and that count fragments cover the frame.
+ */
+bool
+getStride(uint32_t frameSize, uint32_t offset, uint16_t index, uint16_t count,
+          size_t payloadSize, size_t &stride)
+{
+    if (index >= count || offset > frameSize || payloadSize > frameSize - offset) {
+        return false;
+    }
+    if (count == 1) {
+        stride = frameSize;
+        return offset == 0 && payloadSize == frameSize;
+    }
+
+    if (index < count - 1) {
+        stride = payloadSize;
+    } else {
+        if (offset % index != 0 || offset + payloadSize != frameSize) {
+            return false;
+        }
+        stride = offset / index;
+        if (payloadSize == 0 || payloadSize > stride) {
+            return false;
+        }
+    }
+    return stride > 0 && offset == index * stride &&
+           (frameSize + stride - 1) / stride == count;
+}
+} // anonymous namespace
+
+FrameFragmenter::FrameFragmenter(DatagramSender &sender, size_t maxDatagramSize)
+  : m_Sender(sender)
+  , m_MaxPayloadSize(maxDatagramSize - sizeof(FragmentHeader))
+{
+    BOB_ASSERT(maxDatagramSize > sizeof(FragmentHeader));
+    m_Datagram.resize(maxDatagramSize);
+}
+
+void
+FrameFragmenter::send(const void *data, size_t size)
+{
+    const size_t count = std::max<size_t>(1, (size + m_MaxPayloadSize - 1) / m_MaxPayloadSize);
+    BOB_ASSERT(size <= std::numeric_limits<uint32_t>::max());
+    BOB_ASSERT(count <= std::numeric_limits<uint16_t>::max());
+
+    const auto bytes = reinterpret_cast<const uint8_t *>(data);
+    FragmentHeader header;
+    header.frameID = htonl(m_NextFrameID++);
+    header.frameSize = htonl(static_cast<uint32_t>(size));
+    header.count = htons(static_cast<uint16_t>(count));
+    for (size_t i = 0; i < count; i++) {
+        const size_t offset = i * m_MaxPayloadSize;
+        const size_t payloadSize = std::min(m_MaxPayloadSize, size - offset);
+        header.offset = htonl(static_cast<uint32_t>(offset));
+        header.index = htons(static_cast<uint16_t>(i));
+
+        std::memcpy(m_Datagram.data(), &header, sizeof(header));
+        std::copy_n(bytes + offset, payloadSize, m_Datagram.data() + sizeof(header));
+        m_Sender.send(m_Datagram.data(), sizeof(header) + payloadSize);
+    }
+}
+
+FrameReassembler::FrameReassembler(size_t windowSize, size_t maxFrameSize)
+  : m_Window(windowSize)
+  , m_MaxFrameSize(maxFrameSize)
+{
+    BOB_ASSERT(windowSize > 0);
+}
+
+bool
+FrameReassembler::addDatagram(const void *data, size_t size)
+{
+    FragmentHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    const uint32_t id = ntohl(header.frameID);
+    const uint32_t frameSize = ntohl(header.frameSize);
+    const uint32_t offset = ntohl(header.offset);
+    const uint16_t index = ntohs(header.index);
+    const uint16_t count = ntohs(header.count);
+    const size_t payloadSize = size - sizeof(header);
+    size_t stride;
+    if (frameSize > m_MaxFrameSize ||
+        !getStride(frameSize, offset, index, count, payloadSize, stride)) {
+        return false;
+    }
+
+    // We've already moved on from this frame
+    if (!isNewer(id, m_LastFrameID)) {
+        return false;
+    }
+
+    PartialFrame *frame = getPartialFrame(id, frameSize, count, stride);
+    if (!frame || frame->received[index]) {
+        return false;
+    }
+
+    const auto payload = reinterpret_cast<const uint8_t *>(data) + sizeof(header);
+    std::copy_n(payload, payloadSize, frame->data.begin() + offset);
+    frame->received[index] = true;
+    if (++frame->numReceived < count) {
+        return false;
+    }
+
+    // Frame is complete: anything before it, we've missed
+    m_NumDroppedFrames += id - m_LastFrameID - 1;
+    m_LastFrameID = id;
+    std::swap(m_Frame, frame->data);
+    for (auto &partial : m_Window) {
+        if (partial.inUse && !isNewer(partial.id, id)) {
+            partial.inUse = false;
+        }
+    }
+    return true;
+}
+
+const std::vector<uint8_t> &
+FrameReassembler::getFrame() const
+{
+    return m_Frame;
+}
+
+size_t
+FrameReassembler::getNumDroppedFrames() const
+{
+    return m_NumDroppedFrames;
+}
+
+FrameReassembler::PartialFrame *
+FrameReassembler::getPartialFrame(uint32_t id, uint32_t frameSize, uint16_t count, size_t stride)
+{
+    PartialFrame *oldest = nullptr;
+    for (auto &partial : m_Window) {
+        if (!partial.inUse) {
+            if (!oldest || oldest->inUse) {
+                oldest = &partial;
+            }
+        } else if (partial.id == id) {
+            // Ignore datagrams which disagree with the rest of the frame
+            return (partial.data.size() == frameSize && partial.received.size() == count &&
+                    partial.stride == stride) ? &partial : nullptr;
+        } else if (!oldest || (oldest->inUse && isNewer(oldest->id, partial.id))) {
+            oldest = &partial;
+        }
+    }
+
+    // If the window is full, abandon the oldest frame, unless this one is older
+    if (oldest->inUse && isNewer(oldest->id, id)) {
+        return nullptr;
+    }
+
+    // Reuse the slot's memory
+    oldest->inUse = true;
+    oldest->id = id;
+    oldest->stride = stride;
+    oldest->data.resize(frameSize);
+    oldest->received.assign(count, false);
+    oldest->numReceived = 0;
+    return oldest;
+}
+} // Net
+} // BoBRobotics
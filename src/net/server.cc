@@ -44,7 +44,9 @@ Server::waitForConnection() const
     // Wait for incoming TCP connection
     LOG_INFO << "Waiting for incoming connection...";
     Socket socket(accept(m_ListenSocket.getHandle(), (sockaddr *) &addr, &addrlen));
-    socket.send("HEY\n");
+
+    // Let the client know it can switch to the binary protocol
+    socket.send("HEY BIN\n");
 
     // Convert IP to string
     char saddr[INET_ADDRSTRLEN];
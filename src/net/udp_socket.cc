@@ -0,0 +1,190 @@
+// BoB robotics includes
+#include "net/udp_socket.h"
+
+// Standard C includes
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+// POSIX includes
+#include <sys/select.h>
+#endif
+
+namespace BoBRobotics {
+namespace Net {
+
+DatagramSender::~DatagramSender()
+{}
+
+UDPSocket::UDPSocket(uint16_t port)
+  : m_Socket(AF_INET, SOCK_DGRAM, 0)
+{
+    // Frames come in bursts of datagrams, so make sure there's room for them
+    const int bufferSize = 4 * 1024 * 1024;
+    setsockopt(m_Socket.getHandle(), SOL_SOCKET, SO_RCVBUF,
+               reinterpret_cast<const char *>(&bufferSize), sizeof(bufferSize));
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(m_Socket.getHandle(), reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+        throw OS::Net::NetworkError("Could not bind UDP socket to port " + std::to_string(port));
+    }
+}
+
+void
+UDPSocket::connect(const std::string &address, uint16_t port)
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        throw OS::Net::NetworkError("Invalid address: " + address);
+    }
+    if (::connect(m_Socket.getHandle(), reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+        throw OS::Net::NetworkError("Could not connect UDP socket to " + address);
+    }
+}
+
+uint16_t
+UDPSocket::getPort() const
+{
+    sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    if (getsockname(m_Socket.getHandle(), reinterpret_cast<sockaddr *>(&addr), &addrlen)) {
+        throw OS::Net::NetworkError("Could not get UDP socket's port");
+    }
+    return ntohs(addr.sin_port);
+}
+
+void
+UDPSocket::send(const void *data, size_t length)
+{
+    const auto ret = ::send(m_Socket.getHandle(),
+                            reinterpret_cast<sendbuff_t>(data),
+                            static_cast<bufflen_t>(length),
+                            OS::Net::sendFlags);
+
+    // If nothing is listening yet, the datagram is lost, which is fine
+#ifdef _WIN32
+    constexpr int refusedError = WSAECONNRESET;
+#else
+    constexpr int refusedError = ECONNREFUSED;
+#endif
+    if (ret == -1 && OS::Net::lastError() != refusedError) {
+        throw OS::Net::NetworkError("Could not send UDP datagram");
+    }
+}
+
+size_t
+UDPSocket::receive(void *buffer, size_t length, int timeoutMs)
+{
+    if (!waitForDatagram(timeoutMs)) {
+        return 0;
+    }
+
+    return m_Socket.read(buffer, length);
+}
+
+size_t
+UDPSocket::receive(void *buffer, size_t length, std::string &fromAddress, int timeoutMs)
+{
+    if (!waitForDatagram(timeoutMs)) {
+        return 0;
+    }
+
+    sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    const auto nbytes = recvfrom(m_Socket.getHandle(),
+                                 reinterpret_cast<readbuff_t>(buffer),
+                                 static_cast<bufflen_t>(length),
+                                 0,
+                                 reinterpret_cast<sockaddr *>(&addr),
+                                 &addrlen);
+    if (nbytes == -1) {
+        throw OS::Net::NetworkError("Could not read from UDP socket");
+    }
+
+    char saddr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, saddr, sizeof(saddr));
+    fromAddress = saddr;
+    return static_cast<size_t>(nbytes);
+}
+
+bool
+UDPSocket::waitForDatagram(int timeoutMs)
+{
+    if (timeoutMs >= 0) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(m_Socket.getHandle(), &readSet);
+        timeval timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+        const int ret = select(static_cast<int>(m_Socket.getHandle()) + 1, &readSet, nullptr, nullptr, &timeout);
+        if (ret == -1) {
+            throw OS::Net::NetworkError("Error waiting for UDP datagram");
+        }
+        if (ret == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+LossyDatagramSender::LossyDatagramSender(DatagramSender &sender,
+                                         double lossProbability,
+                                         double reorderProbability,
+                                         unsigned int seed)
+  : m_Sender(sender)
+  , m_LossProbability(lossProbability)
+  , m_ReorderProbability(reorderProbability)
+  , m_RNG(seed)
+{}
+
+void
+LossyDatagramSender::send(const void *data, size_t length)
+{
+    if (m_Distribution(m_RNG) < m_LossProbability) {
+        m_NumDropped++;
+        return;
+    }
+
+    // Either send this one before the one we held back...
+    if (m_IsHoldingBack) {
+        m_Sender.send(data, length);
+        flush();
+        return;
+    }
+
+    // ...or hold it back to send after the next one
+    if (m_Distribution(m_RNG) < m_ReorderProbability) {
+        const auto bytes = reinterpret_cast<const uint8_t *>(data);
+        m_HeldBack.assign(bytes, bytes + length);
+        m_IsHoldingBack = true;
+    } else {
+        m_Sender.send(data, length);
+    }
+}
+
+void
+LossyDatagramSender::flush()
+{
+    if (m_IsHoldingBack) {
+        m_IsHoldingBack = false;
+        m_Sender.send(m_HeldBack.data(), m_HeldBack.size());
+    }
+}
+
+size_t
+LossyDatagramSender::getNumDropped() const
+{
+    return m_NumDropped;
+}
+} // Net
+} // BoBRobotics
@@ -9,6 +9,7 @@
 
 // Standard C++ includes
 #include <algorithm>
+#include <array>
 #include <limits>
 #include <sstream>
 #include <string>
@@ -87,6 +88,13 @@ void Tank::readFromNetwork(Net::Connection &connection)
                                         onTankCommandReceived(connection, command);
                                     });
 
+    // With the binary protocol, TNK commands are sent as a pair of floats
+    connection.setMessageHandler(Net::TankMessage,
+                                 [this](Net::Connection &, const Net::Message &message) {
+                                     const auto speeds = message.get<std::array<float, 2>>();
+                                     tank(speeds[0], speeds[1]);
+                                 });
+
     connection.setCommandHandler("TNK_MAX",
                                     [this](Net::Connection &, const Net::Command &command) {
                                         Tank::setMaximumSpeedProportion(stof(command.at(1)));
@@ -101,6 +109,7 @@ void Tank::stopReadingFromNetwork()
     if (m_Connection) {
         // Ignore incoming TNK commands
         m_Connection->setCommandHandler("TNK", nullptr);
+        m_Connection->setMessageHandler(Net::TankMessage, nullptr);
     }
 }
 
@@ -4,6 +4,9 @@
 #include "common/stopwatch.h"
 #include "robots/tank_netsink.h"
 
+// Standard C++ includes
+#include <array>
+
 namespace BoBRobotics {
 namespace Robots {
 
@@ -11,7 +14,9 @@ namespace Robots {
 template class TankNetSinkBase<Net::Connection &>;
 
 BundledTankNetSink::BundledTankNetSink()
-  : TankNetSinkBase<Net::Client>()
+  : TankNetSinkBase<Net::Client>(Net::Client::getDefaultIP(),
+                                 static_cast<uint16_t>(Net::Connection::DefaultListenPort),
+                                 true)
 {
     // Run client on background thread
     getConnection().runInBackground();
@@ -64,8 +69,15 @@ TankNetSinkBase<ConnectionType>::tank(float left, float right)
     netTimer.start();
 
     // send steering command
-    m_Connection.getSocketWriter().send("TNK " + std::to_string(left) + " " +
-                                        std::to_string(right) + "\n");
+    {
+        auto socket = m_Connection.getSocketWriter();
+        if (socket.isBinary()) {
+            socket.sendMessage(Net::TankMessage, std::array<float, 2>{ { left, right } });
+        } else {
+            socket.send("TNK " + std::to_string(left) + " " +
+                        std::to_string(right) + "\n");
+        }
+    }
 
     // print warning if steering command was slow to send
     using namespace std::literals;
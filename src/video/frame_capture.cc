@@ -0,0 +1,142 @@
+// BoB robotics includes
+#include "common/background_exception_catcher.h"
+#include "common/macros.h"
+#include "plog/Log.h"
+#include "video/frame_capture.h"
+
+using namespace std::literals;
+
+namespace BoBRobotics {
+namespace Video {
+
+FrameCapture::FrameCapture(Input &input, size_t numBuffers, bool greyscale)
+  : m_Input(input)
+  , m_Greyscale(greyscale)
+{
+    BOB_ASSERT(numBuffers >= 2);
+    for (size_t i = 0; i < numBuffers; i++) {
+        m_Buffers.emplace_back(std::make_shared<CapturedFrame>());
+    }
+
+    m_Thread = std::thread(&FrameCapture::runCapture, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    stop();
+}
+
+FrameCapture::FramePtr
+FrameCapture::getLatestFrame() const
+{
+    std::lock_guard<std::mutex> guard{ m_Mutex };
+    return m_Latest;
+}
+
+FrameCapture::FramePtr
+FrameCapture::waitForFrame(uint64_t lastSequence) const
+{
+    std::unique_lock<std::mutex> lock{ m_Mutex };
+    m_FrameReady.wait(lock, [&]() { return isNewerOrStopped(lastSequence); });
+    return (m_Latest && m_Latest->sequence > lastSequence) ? m_Latest : nullptr;
+}
+
+FrameCapture::FramePtr
+FrameCapture::waitForNextFrame(const FramePtr &previous) const
+{
+    return waitForFrame(previous ? previous->sequence : 0);
+}
+
+bool
+FrameCapture::isRunning() const
+{
+    std::lock_guard<std::mutex> guard{ m_Mutex };
+    return m_IsRunning;
+}
+
+size_t
+FrameCapture::getNumDroppedFrames() const
+{
+    return m_NumDroppedFrames;
+}
+
+void
+FrameCapture::stop()
+{
+    m_DoRun = false;
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+}
+
+bool
+FrameCapture::isNewerOrStopped(uint64_t lastSequence) const
+{
+    return !m_IsRunning || (m_Latest && m_Latest->sequence > lastSequence);
+}
+
+std::shared_ptr<CapturedFrame>
+FrameCapture::getFreeBuffer()
+{
+    /*
+     * Consumers can only get hold of buffers through m_Latest, with the mutex
+     * held, so if nothing else references a buffer now, nothing will until we
+     * make it the latest one.
+     */
+    std::lock_guard<std::mutex> guard{ m_Mutex };
+    for (auto &buffer : m_Buffers) {
+        if (buffer != m_Latest && buffer.use_count() == 1) {
+            // If someone kept a shallow copy of the image, leave them its data
+            if (buffer->image.u && buffer->image.u->refcount > 1) {
+                buffer->image.release();
+            }
+            return buffer;
+        }
+    }
+    return nullptr;
+}
+
+void
+FrameCapture::runCapture()
+{
+    try {
+        cv::Mat dropped;
+        while (m_DoRun) {
+            // If every buffer is in use, we still need to keep up with the camera
+            const auto buffer = getFreeBuffer();
+            cv::Mat &image = buffer ? buffer->image : dropped;
+            if (!(m_Greyscale ? m_Input.readGreyscaleFrame(image) : m_Input.readFrame(image))) {
+                std::this_thread::sleep_for(1ms);
+                continue;
+            }
+            const auto timestamp = std::chrono::steady_clock::now();
+
+            {
+                std::lock_guard<std::mutex> guard{ m_Mutex };
+                m_Sequence++;
+                if (!buffer) {
+                    m_NumDroppedFrames++;
+                    continue;
+                }
+
+                buffer->timestamp = timestamp;
+                buffer->sequence = m_Sequence;
+                m_Latest = buffer;
+            }
+            m_FrameReady.notify_all();
+        }
+    } catch (...) {
+        LOG_WARNING << "Video::FrameCapture stopped because of an exception";
+        BackgroundExceptionCatcher::set(std::current_exception());
+    }
+
+    // Wake anyone waiting for a frame
+    {
+        std::lock_guard<std::mutex> guard{ m_Mutex };
+        m_IsRunning = false;
+    }
+    m_FrameReady.notify_all();
+}
+
+} // Video
+} // BoBRobotics
@@ -0,0 +1,322 @@
+// BoB robotics includes
+#include "video/frame_codec.h"
+
+// Standard C includes
+#include <cstdint>
+#include <cstring>
+
+// Standard C++ includes
+#include <stdexcept>
+
+namespace BoBRobotics {
+namespace Video {
+namespace {
+// Size and type of raw frames
+struct RawHeader
+{
+    int32_t rows, cols, type;
+};
+
+void
+writeHeader(const cv::Mat &frame, std::vector<uchar> &buffer)
+{
+    const RawHeader header{ frame.rows, frame.cols, frame.type() };
+    const auto start = reinterpret_cast<const uchar *>(&header);
+    buffer.insert(buffer.end(), start, start + sizeof(header));
+}
+
+RawHeader
+readHeader(const uchar *&data, size_t &size)
+{
+    RawHeader header;
+    if (size < sizeof(header)) {
+        throw std::runtime_error("Frame is too short");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    size -= sizeof(header);
+    return header;
+}
+
+size_t
+getNumBytes(const cv::Mat &frame)
+{
+    return frame.total() * frame.elemSize();
+}
+
+/*
+ * Headers come from the network, so check them before allocating anything:
+ * the frame must have a valid size and type and take up at most maxBytes
+ */
+size_t
+getNumBytes(const RawHeader &header, size_t maxBytes)
+{
+    if (header.rows <= 0 || header.cols <= 0 || (header.type & ~CV_MAT_TYPE_MASK) != 0 ||
+            CV_MAT_DEPTH(header.type) > CV_64F) {
+        throw std::runtime_error("Frame has an invalid size or type");
+    }
+
+    const size_t elemSize = CV_ELEM_SIZE(header.type);
+    const size_t numPixels = static_cast<size_t>(header.rows) * static_cast<size_t>(header.cols);
+    if (numPixels > maxBytes / elemSize) {
+        throw std::runtime_error("Frame is too big");
+    }
+    return numPixels * elemSize;
+}
+
+cv::Mat
+makeContinuous(const cv::Mat &frame)
+{
+    return frame.isContinuous() ? frame : frame.clone();
+}
+
+void
+writeVarint(size_t value, std::vector<uchar> &buffer)
+{
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uchar>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uchar>(value));
+}
+
+size_t
+readVarint(const uchar *&data, const uchar *end)
+{
+    size_t value = 0;
+    for (unsigned int shift = 0; shift < 8 * sizeof(size_t); shift += 7) {
+        if (data == end) {
+            break;
+        }
+
+        const uchar byte = *(data++);
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Frame is corrupt");
+}
+} // anonymous namespace
+
+FrameCodec::~FrameCodec()
+{}
+
+std::unique_ptr<FrameCodec>
+FrameCodec::create(const std::string &spec)
+{
+    const std::string name = getName(spec);
+    const size_t colon = spec.find(':');
+    const bool hasParam = colon != std::string::npos;
+    const int param = hasParam ? std::stoi(spec.substr(colon + 1)) : 0;
+
+    if (name == "jpeg") {
+        return hasParam ? std::make_unique<JPEGCodec>(param) : std::make_unique<JPEGCodec>();
+    } else if (name == "png") {
+        return hasParam ? std::make_unique<PNGCodec>(param) : std::make_unique<PNGCodec>();
+    } else if (name == "raw") {
+        return std::make_unique<RawCodec>();
+    } else if (name == "delta") {
+        return std::make_unique<DeltaCodec>(param);
+    } else {
+        throw std::invalid_argument("Unknown frame codec: " + spec);
+    }
+}
+
+std::string
+FrameCodec::getName(const std::string &spec)
+{
+    return spec.substr(0, spec.find(':'));
+}
+
+const std::vector<std::string> &
+FrameCodec::getNames()
+{
+    static const std::vector<std::string> names{ "jpeg", "png", "raw", "delta" };
+    return names;
+}
+
+//----------------------------------------------------------------------------
+// JPEGCodec
+//----------------------------------------------------------------------------
+JPEGCodec::JPEGCodec(int quality)
+  : m_Params{ cv::IMWRITE_JPEG_QUALITY, quality }
+{}
+
+std::string
+JPEGCodec::getName() const
+{
+    return "jpeg";
+}
+
+void
+JPEGCodec::encode(const cv::Mat &frame, std::vector<uchar> &buffer)
+{
+    cv::imencode(".jpg", frame, buffer, m_Params);
+}
+
+void
+JPEGCodec::decode(const uchar *data, size_t size, cv::Mat &frame)
+{
+    cv::imdecode(cv::Mat(1, static_cast<int>(size), CV_8UC1, const_cast<uchar *>(data)),
+                 cv::IMREAD_UNCHANGED, &frame);
+}
+
+//----------------------------------------------------------------------------
+// PNGCodec
+//----------------------------------------------------------------------------
+PNGCodec::PNGCodec(int compressionLevel)
+  : m_Params{ cv::IMWRITE_PNG_COMPRESSION, compressionLevel }
+{}
+
+std::string
+PNGCodec::getName() const
+{
+    return "png";
+}
+
+void
+PNGCodec::encode(const cv::Mat &frame, std::vector<uchar> &buffer)
+{
+    cv::imencode(".png", frame, buffer, m_Params);
+}
+
+void
+PNGCodec::decode(const uchar *data, size_t size, cv::Mat &frame)
+{
+    cv::imdecode(cv::Mat(1, static_cast<int>(size), CV_8UC1, const_cast<uchar *>(data)),
+                 cv::IMREAD_UNCHANGED, &frame);
+}
+
+//----------------------------------------------------------------------------
+// RawCodec
+//----------------------------------------------------------------------------
+std::string
+RawCodec::getName() const
+{
+    return "raw";
+}
+
+void
+RawCodec::encode(const cv::Mat &frame, std::vector<uchar> &buffer)
+{
+    const cv::Mat continuous = makeContinuous(frame);
+    buffer.clear();
+    writeHeader(continuous, buffer);
+    buffer.insert(buffer.end(), continuous.data, continuous.data + getNumBytes(continuous));
+}
+
+void
+RawCodec::decode(const uchar *data, size_t size, cv::Mat &frame)
+{
+    const auto header = readHeader(data, size);
+    const size_t numBytes = getNumBytes(header, size);
+    if (size != numBytes) {
+        throw std::runtime_error("Frame is the wrong size");
+    }
+    frame.create(header.rows, header.cols, header.type);
+    std::memcpy(frame.data, data, numBytes);
+}
+
+//----------------------------------------------------------------------------
+// DeltaCodec
+//----------------------------------------------------------------------------
+constexpr size_t DeltaCodec::MaxFrameSize;
+
+/*
+ * Frames are a byte saying whether this is a key frame, a RawHeader, then
+ * pairs of runs: the number of unchanged bytes followed by the number of
+ * changed bytes and their differences (mod 256) from the previous frame. Run
+ * lengths are varints. Key frames are differences from a black frame.
+ */
+DeltaCodec::DeltaCodec(int keyFrameInterval)
+  : m_KeyFrameInterval(keyFrameInterval)
+{}
+
+std::string
+DeltaCodec::getName() const
+{
+    return "delta";
+}
+
+void
+DeltaCodec::encode(const cv::Mat &frame, std::vector<uchar> &buffer)
+{
+    const cv::Mat continuous = makeContinuous(frame);
+    const bool isKeyFrame = m_Previous.size() != continuous.size() ||
+                            m_Previous.type() != continuous.type() ||
+                            (m_KeyFrameInterval > 0 && m_FramesSinceKeyFrame >= m_KeyFrameInterval);
+    if (isKeyFrame) {
+        m_Previous = cv::Mat::zeros(continuous.size(), continuous.type());
+        m_FramesSinceKeyFrame = 0;
+    }
+    m_FramesSinceKeyFrame++;
+
+    buffer.clear();
+    buffer.push_back(isKeyFrame ? 1 : 0);
+    writeHeader(continuous, buffer);
+
+    const uchar *current = continuous.data;
+    uchar *previous = m_Previous.data;
+    const size_t numBytes = getNumBytes(continuous);
+    size_t i = 0;
+    while (i < numBytes) {
+        // Unchanged bytes
+        const size_t unchangedStart = i;
+        while (i < numBytes && current[i] == previous[i]) {
+            i++;
+        }
+        writeVarint(i - unchangedStart, buffer);
+
+        // Changed bytes, up to the next pair of unchanged ones
+        const size_t changedStart = i;
+        while (i < numBytes &&
+               (current[i] != previous[i] || (i + 1 < numBytes && current[i + 1] != previous[i + 1]))) {
+            i++;
+        }
+        writeVarint(i - changedStart, buffer);
+        for (size_t j = changedStart; j < i; j++) {
+            buffer.push_back(static_cast<uchar>(current[j] - previous[j]));
+            previous[j] = current[j];
+        }
+    }
+}
+
+void
+DeltaCodec::decode(const uchar *data, size_t size, cv::Mat &frame)
+{
+    if (size < 1) {
+        throw std::runtime_error("Frame is too short");
+    }
+    const bool isKeyFrame = *data;
+    data++;
+    size--;
+
+    const auto header = readHeader(data, size);
+    getNumBytes(header, MaxFrameSize);
+    if (isKeyFrame) {
+        m_Previous = cv::Mat::zeros(header.rows, header.cols, header.type);
+    } else if (m_Previous.rows != header.rows || m_Previous.cols != header.cols ||
+               m_Previous.type() != header.type) {
+        throw std::runtime_error("Delta frame doesn't match the previous frame");
+    }
+
+    const uchar *const end = data + size;
+    uchar *previous = m_Previous.data;
+    const size_t numBytes = getNumBytes(m_Previous);
+    size_t i = 0;
+    while (i < numBytes) {
+        i += readVarint(data, end);
+        const size_t numChanged = readVarint(data, end);
+        if (i + numChanged > numBytes || numChanged > static_cast<size_t>(end - data)) {
+            throw std::runtime_error("Frame is corrupt");
+        }
+        for (const size_t changedEnd = i + numChanged; i < changedEnd; i++) {
+            previous[i] += *(data++);
+        }
+    }
+
+    m_Previous.copyTo(frame);
+}
+} // Video
+} // BoBRobotics
@@ -4,6 +4,7 @@
 #include "video/netsink.h"
 
 // Standard C++ includes
+#include <algorithm>
 #include <chrono>
 #include <stdexcept>
 
@@ -12,12 +13,17 @@ using namespace std::literals;
 namespace BoBRobotics {
 namespace Video {
 
-NetSink::NetSink(Net::Connection &connection, Input &input)
+NetSink::NetSink(Net::Connection &connection, Input &input, const std::string &codec, bool greyscale)
     : m_Connection(connection)
     , m_Name(input.getCameraName())
+    , m_CodecSpec(codec)
     , m_FrameSize(input.getOutputSize())
     , m_Input(&input)
+    , m_Greyscale(greyscale)
 {
+    // Check the codec is valid now, rather than when the receiver connects
+    FrameCodec::create(m_CodecSpec);
+
     // handle incoming IMG commands
     m_Connection.setCommandHandler("IMG",
                                     [this](Net::Connection &, const Net::Command &command) {
@@ -25,12 +31,18 @@ NetSink::NetSink(Net::Connection &connection, Input &input)
                                     });
 }
 
-NetSink::NetSink(Net::Connection &connection, const cv::Size &frameSize, const std::string &cameraName)
+NetSink::NetSink(Net::Connection &connection, const cv::Size &frameSize, const std::string &cameraName,
+                 const std::string &codec)
     : m_Connection(connection)
     , m_Name(cameraName)
+    , m_CodecSpec(codec)
     , m_FrameSize(frameSize)
     , m_Input(nullptr)
+    , m_Greyscale(false)
 {
+    // Check the codec is valid now, rather than when the receiver connects
+    FrameCodec::create(m_CodecSpec);
+
     // handle incoming IMG commands
     m_Connection.setCommandHandler("IMG",
                                     [this](Net::Connection &, const Net::Command &command) {
@@ -45,10 +57,14 @@ NetSink::~NetSink()
     // Ignore IMG commands
     m_Connection.setCommandHandler("IMG", nullptr);
 
-    m_DoRun = false;
-    if (m_Thread.joinable()) {
-        m_Thread.join();
+    stop();
+    if (m_EncodeThread.joinable()) {
+        m_EncodeThread.join();
     }
+    if (m_SendThread.joinable()) {
+        m_SendThread.join();
+    }
+    m_Capture.reset();
 
     LOG_DEBUG << "Video::NetSink stopped";
 }
@@ -56,47 +72,125 @@ NetSink::~NetSink()
 //----------------------------------------------------------------------------
 // Public API
 //----------------------------------------------------------------------------
-//! Send a frame over the network (when operating in synchronous mode)
-void NetSink::sendFrame(const cv::Mat &frame)
+void
+NetSink::sendFrame(const cv::Mat &frame)
 {
     // Wait for start acknowledgement
     m_AckSemaphore.waitOnce();
 
-    sendFrameInternal(frame);
+    {
+        std::lock_guard<std::mutex> guard{ m_Mutex };
+        if (m_HasPendingFrame) {
+            m_NumDroppedFrames++;
+        }
+        frame.copyTo(m_PendingFrame);
+        m_HasPendingFrame = true;
+    }
+    m_Changed.notify_all();
 }
 
-void NetSink::sendFrameInternal(const cv::Mat &frame)
+std::string
+NetSink::getCodecName() const
 {
-    cv::imencode(".jpg", frame, m_Buffer);
+    m_AckSemaphore.waitOnce();
+    return m_Codec->getName();
+}
+
+size_t
+NetSink::getNumDroppedFrames() const
+{
+    return m_NumDroppedFrames;
+}
+
+//----------------------------------------------------------------------------
+// Private methods
+//----------------------------------------------------------------------------
+std::string
+NetSink::chooseCodec(const Net::Command &command) const
+{
+    // Older receivers don't tell us which codecs they have, but can decode JPEGs
+    const auto accepted = command.cbegin() + 2;
+    if (accepted == command.cend()) {
+        return "jpeg";
+    }
 
-    auto socket = m_Connection.getSocketWriter();
-    socket.send("IMG FRAME " + std::to_string(m_Buffer.size()) + "\n");
-    socket.send(m_Buffer.data(), m_Buffer.size());
+    if (std::find(accepted, command.cend(), FrameCodec::getName(m_CodecSpec)) != command.cend()) {
+        return m_CodecSpec;
+    }
+
+    const auto &ourNames = FrameCodec::getNames();
+    for (auto it = accepted; it != command.cend(); ++it) {
+        if (std::find(ourNames.cbegin(), ourNames.cend(), *it) != ourNames.cend()) {
+            return *it;
+        }
+    }
+    throw std::runtime_error("Video::NetSink has no codecs in common with receiver");
 }
 
-void NetSink::onCommandReceived(const Net::Command &command)
+void
+NetSink::onCommandReceived(const Net::Command &command)
 {
     if (command[1] != "START") {
         throw Net::BadCommandError();
     }
+    m_Codec = FrameCodec::create(chooseCodec(command));
 
-    // ACK the command and tell client the camera resolution
+    // The receiver may want frames sent to a UDP port
+    for (auto it = command.cbegin() + 2; it != command.cend(); ++it) {
+        if (it->compare(0, 4, "udp:") == 0) {
+            m_UDPSocket = std::make_unique<Net::UDPSocket>();
+            m_UDPSocket->connect(m_Connection.getPeerAddress(),
+                                 static_cast<uint16_t>(std::stoul(it->substr(4))));
+            m_Fragmenter = std::make_unique<Net::FrameFragmenter>(*m_UDPSocket);
+        }
+    }
+
+    // ACK the command and tell client the camera resolution, codec and transport
     m_Connection.getSocketWriter().send("IMG PARAMS " + std::to_string(m_FrameSize.width) + " " +
-                                    std::to_string(m_FrameSize.height) + " " +
-                                    m_Name + "\n");
+                                        std::to_string(m_FrameSize.height) + " " +
+                                        m_Name + " " + m_Codec->getName() +
+                                        (m_Fragmenter ? " udp\n" : "\n"));
+
+    // Start threads to encode and transmit images in background
+    m_EncodeThread = std::thread(&NetSink::runEncode, this);
+    m_SendThread = std::thread(&NetSink::runSend, this);
 }
 
-void NetSink::onCommandReceivedAsync(const Net::Command &command)
+bool
+NetSink::isStreaming(const Net::Command &command) const
 {
+    // Restarting would mean replacing the threads while they're running
+    if (m_EncodeThread.joinable()) {
+        LOG_WARNING << "Video::NetSink is already streaming; ignoring IMG " << command[1];
+        return true;
+    }
+    return false;
+}
+
+void
+NetSink::onCommandReceivedAsync(const Net::Command &command)
+{
+    if (isStreaming(command)) {
+        return;
+    }
+
+    // Start reading frames in the background
+    m_Capture = std::make_unique<FrameCapture>(*m_Input, 4, m_Greyscale);
+
     // Handle command
     onCommandReceived(command);
 
-    // start thread to transmit images in background
-    m_Thread = std::thread(&NetSink::runAsync, this);
+    // Raise semaphore, for getCodecName()
+    m_AckSemaphore.notify();
 }
 
-void NetSink::onCommandReceivedSync(const Net::Command &command)
+void
+NetSink::onCommandReceivedSync(const Net::Command &command)
 {
+    if (isStreaming(command)) {
+        return;
+    }
+
     // Handle command
     onCommandReceived(command);
 
@@ -104,20 +198,112 @@ void NetSink::onCommandReceivedSync(const Net::Command &command)
     m_AckSemaphore.notify();
 }
 
-void NetSink::runAsync()
+bool
+NetSink::getNextFrame(cv::Mat &frame, FrameCapture::FramePtr &captured)
+{
+    // Synchronous mode: take whatever frame was last passed to sendFrame()
+    if (!m_Capture) {
+        std::unique_lock<std::mutex> lock{ m_Mutex };
+        m_Changed.wait(lock, [this]() { return m_HasPendingFrame || !m_DoRun; });
+        if (!m_DoRun) {
+            return false;
+        }
+
+        // Swap so that sendFrame() can reuse the old frame's memory
+        cv::swap(frame, m_PendingFrame);
+        m_HasPendingFrame = false;
+        return true;
+    }
+
+    // Asynchronous mode: take the latest captured frame, skipping older ones
+    // (letting go of the previous one, so FrameCapture can reuse its buffer)
+    const uint64_t lastSequence = captured ? captured->sequence : 0;
+    frame.release();
+    captured.reset();
+    while (m_DoRun) {
+        captured = m_Capture->waitForFrame(lastSequence, 100ms);
+        if (captured) {
+            if (lastSequence > 0) {
+                m_NumDroppedFrames += captured->sequence - lastSequence - 1;
+            }
+            frame = captured->image;
+            return true;
+        }
+        if (!m_Capture->isRunning()) {
+            // The Input has failed, and FrameCapture will have reported why
+            break;
+        }
+    }
+    return false;
+}
+
+void
+NetSink::runEncode()
 {
     try {
         cv::Mat frame;
-        while (m_DoRun) {
-            if (m_Input->readFrame(frame)) {
-                sendFrameInternal(frame);
+        FrameCapture::FramePtr captured;
+        std::vector<uchar> buffer;
+        while (getNextFrame(frame, captured)) {
+            m_Codec->encode(frame, buffer);
+
+            // Wait for the previous frame to be sent
+            {
+                std::unique_lock<std::mutex> lock{ m_Mutex };
+                m_Changed.wait(lock, [this]() { return !m_HasEncodedFrame || !m_DoRun; });
+                if (!m_DoRun) {
+                    break;
+                }
+                std::swap(buffer, m_EncodedFrame);
+                m_HasEncodedFrame = true;
+            }
+            m_Changed.notify_all();
+        }
+    } catch (...) {
+        BackgroundExceptionCatcher::set(std::current_exception());
+    }
+    stop();
+}
+
+void
+NetSink::runSend()
+{
+    try {
+        std::vector<uchar> buffer;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock{ m_Mutex };
+                m_Changed.wait(lock, [this]() { return m_HasEncodedFrame || !m_DoRun; });
+                if (!m_DoRun) {
+                    break;
+                }
+                std::swap(buffer, m_EncodedFrame);
+                m_HasEncodedFrame = false;
+            }
+            m_Changed.notify_all();
+
+            if (m_Fragmenter) {
+                m_Fragmenter->send(buffer.data(), buffer.size());
             } else {
-                std::this_thread::sleep_for(25ms);
+                auto socket = m_Connection.getSocketWriter();
+                socket.send("IMG FRAME " + std::to_string(buffer.size()) + "\n");
+                socket.send(buffer.data(), buffer.size());
             }
         }
     } catch (...) {
         BackgroundExceptionCatcher::set(std::current_exception());
     }
+    stop();
+}
+
+void
+NetSink::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard{ m_Mutex };
+        m_DoRun = false;
+    }
+    m_Changed.notify_all();
 }
 
 } // Video
@@ -1,10 +1,25 @@
 // BoB robotics includes
+#include "common/background_exception_catcher.h"
+#include "net/frame_fragments.h"
 #include "video/netsource.h"
 
+// Third-party includes
+#include "plog/Log.h"
+
+// OpenCV includes
+#include <opencv2/imgproc.hpp>
+
+// Standard C++ includes
+#include <exception>
+
 namespace BoBRobotics {
 namespace Video {
+namespace {
+// Set in NetSource::m_MiddleIndex when it holds a frame which hasn't been read yet
+constexpr uint8_t NewFrameFlag = 0x80;
+} // anonymous namespace
 
-NetSource::NetSource(Net::Connection &connection)
+NetSource::NetSource(Net::Connection &connection, bool useUDP)
   : m_Connection(connection)
 {
     // Handle incoming IMG commands
@@ -12,14 +27,35 @@ NetSource::NetSource(Net::Connection &connection)
         onCommandReceived(connection, command);
     });
 
-    // When connected, send command to start streaming
-    connection.getSocketWriter().send("IMG START\n");
+    // When connected, send command to start streaming, listing the codecs we can decode
+    std::string command = "IMG START";
+    for (const auto &name : FrameCodec::getNames()) {
+        // Every frame must arrive for delta coding to work
+        if (!useUDP || name != "delta") {
+            command += " " + name;
+        }
+    }
+
+    // Tell the sender where to send UDP frames
+    if (useUDP) {
+        // Only accept frames from the machine we're streaming from
+        m_PeerAddress = connection.getPeerAddress();
+        m_UDPSocket = std::make_unique<Net::UDPSocket>();
+        command += " udp:" + std::to_string(m_UDPSocket->getPort());
+        m_UDPThread = std::thread(&NetSource::runUDP, this);
+    }
+    connection.getSocketWriter().send(command + "\n");
 }
 
 NetSource::~NetSource()
 {
     // Ignore IMG commands
     m_Connection.setCommandHandler("IMG", nullptr);
+
+    m_DoRun = false;
+    if (m_UDPThread.joinable()) {
+        m_UDPThread.join();
+    }
 }
 
 std::string
@@ -46,16 +82,51 @@ NetSource::needsUnwrapping() const
 bool
 NetSource::readFrame(cv::Mat &frame)
 {
-    if (!m_NewFrame.exchange(false)) {
-        // The return value indicates whether there is a new frame or not
+    FrameTimestamps timestamps;
+    return readFrame(frame, timestamps);
+}
+
+bool
+NetSource::readGreyscaleFrame(cv::Mat &frame)
+{
+    cv::Mat colour;
+    if (!readFrame(colour)) {
         return false;
+    }
+
+    // The sender may already be sending greyscale frames
+    if (colour.channels() == 1) {
+        frame = colour;
     } else {
-        std::lock_guard<std::mutex> guard(m_FrameMutex);
+        cv::cvtColor(colour, frame, cv::COLOR_BGR2GRAY);
+    }
+    return true;
+}
 
-        // Copy latest frame and return true
-        m_Frame.copyTo(frame);
-        return true;
+bool
+NetSource::readFrame(cv::Mat &frame, FrameTimestamps &timestamps)
+{
+    // The return value indicates whether there is a new frame or not
+    if (!(m_MiddleIndex.load() & NewFrameFlag)) {
+        return false;
     }
+
+    // Swap the latest frame for the one we had
+    m_FrontIndex = m_MiddleIndex.exchange(m_FrontIndex) & ~NewFrameFlag;
+
+    /*
+     * The decoder doesn't write into a buffer whose data is still referenced
+     * elsewhere, so this frame stays valid however long the caller keeps it.
+     */
+    frame = m_Frames[m_FrontIndex].image;
+    timestamps = m_Frames[m_FrontIndex].timestamps;
+    return true;
+}
+
+size_t
+NetSource::getNumDroppedFrames() const
+{
+    return m_NumDroppedFrames;
 }
 
 void
@@ -65,19 +136,71 @@ NetSource::onCommandReceived(Net::Connection &connection, const Net::Command &co
         m_CameraResolution.width = stoi(command[2]);
         m_CameraResolution.height = stoi(command[3]);
         m_CameraName = command[4];
+
+        // Older senders don't say which codec, but always send JPEGs
+        m_Codec = FrameCodec::create(command.size() > 5 ? command[5] : "jpeg");
+        m_HasParams = true;
         m_ParamsSemaphore.notify();
     } else if (command[1] == "FRAME") {
         const auto nbytes = static_cast<size_t>(stoul(command[2]));
         m_Buffer.resize(nbytes);
         connection.read(m_Buffer.data(), nbytes);
 
-        std::lock_guard<std::mutex> guard(m_FrameMutex);
-        cv::imdecode(m_Buffer, cv::IMREAD_UNCHANGED, &m_Frame);
-        m_NewFrame = true;
+        decodeFrame(m_Buffer.data(), nbytes);
     } else {
         throw Net::BadCommandError();
     }
 }
 
+void
+NetSource::decodeFrame(const uchar *data, size_t size)
+{
+    // If a reader still has this buffer's last frame, leave it be
+    auto &decoded = m_Frames[m_BackIndex];
+    if (decoded.image.u && decoded.image.u->refcount > 1) {
+        decoded.image.release();
+    }
+
+    decoded.timestamps.received = std::chrono::steady_clock::now();
+    m_Codec->decode(data, size, decoded.image);
+    decoded.timestamps.decoded = std::chrono::steady_clock::now();
+
+    // Publish the frame, taking the previous latest one (if unread) to decode into
+    m_BackIndex = m_MiddleIndex.exchange(m_BackIndex | NewFrameFlag) & ~NewFrameFlag;
+}
+
+void
+NetSource::runUDP()
+{
+    try {
+        Net::FrameReassembler reassembler;
+        std::vector<uint8_t> datagram(64 * 1024);
+        std::string fromAddress;
+        size_t numUndecodable = 0;
+        while (m_DoRun) {
+            const size_t size = m_UDPSocket->receive(datagram.data(), datagram.size(), fromAddress, 100);
+            if (size == 0 || fromAddress != m_PeerAddress
+                    || !reassembler.addDatagram(datagram.data(), size)) {
+                continue;
+            }
+
+            // We can't decode anything until we know the codec
+            if (m_HasParams) {
+                // A corrupt frame shouldn't stop us receiving later ones
+                const auto &frame = reassembler.getFrame();
+                try {
+                    decodeFrame(frame.data(), frame.size());
+                } catch (std::exception &e) {
+                    LOG_WARNING << "Dropping UDP frame which could not be decoded: " << e.what();
+                    numUndecodable++;
+                }
+            }
+            m_NumDroppedFrames = reassembler.getNumDroppedFrames() + numUndecodable;
+        }
+    } catch (...) {
+        BackgroundExceptionCatcher::set(std::current_exception());
+    }
+}
+
 } // Video
 } // BoBRobotics
@@ -0,0 +1,516 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "video/pipeline.h"
+
+// OpenCV includes
+#include <opencv2/imgproc.hpp>
+
+// Standard C++ includes
+#include <algorithm>
+#include <utility>
+
+using namespace std::literals;
+
+namespace BoBRobotics {
+namespace Video {
+
+PipelineStage::~PipelineStage()
+{}
+
+cv::Size
+PipelineStage::getOutputSize(const cv::Size &inputSize) const
+{
+    return inputSize;
+}
+
+bool
+PipelineStage::isUnwrapping() const
+{
+    return false;
+}
+
+UnwrapStage::UnwrapStage(ImgProc::OpenCVUnwrap360 unwrapper)
+  : m_Unwrapper(std::move(unwrapper))
+{}
+
+std::string
+UnwrapStage::getName() const
+{
+    return "unwrap";
+}
+
+void
+UnwrapStage::process(cv::Mat &image, cv::Mat &buffer)
+{
+    m_Unwrapper.unwrap(image, buffer);
+    std::swap(image, buffer);
+}
+
+cv::Size
+UnwrapStage::getOutputSize(const cv::Size &) const
+{
+    return m_Unwrapper.getUnwrapLUT().size();
+}
+
+bool
+UnwrapStage::isUnwrapping() const
+{
+    return true;
+}
+
+ColourConversionStage::ColourConversionStage(int code)
+  : m_Code(code)
+{}
+
+std::string
+ColourConversionStage::getName() const
+{
+    return "colour conversion";
+}
+
+void
+ColourConversionStage::process(cv::Mat &image, cv::Mat &buffer)
+{
+    cv::cvtColor(image, buffer, m_Code);
+    std::swap(image, buffer);
+}
+
+CropStage::CropStage(const cv::Rect &rect)
+  : m_Rect(rect)
+{}
+
+std::string
+CropStage::getName() const
+{
+    return "crop";
+}
+
+void
+CropStage::process(cv::Mat &image, cv::Mat &buffer)
+{
+    image(m_Rect).copyTo(buffer);
+    std::swap(image, buffer);
+}
+
+cv::Size
+CropStage::getOutputSize(const cv::Size &) const
+{
+    return m_Rect.size();
+}
+
+ResizeStage::ResizeStage(const cv::Size &size, int interpolation)
+  : m_Size(size)
+  , m_Interpolation(interpolation)
+{}
+
+std::string
+ResizeStage::getName() const
+{
+    return "resize";
+}
+
+void
+ResizeStage::process(cv::Mat &image, cv::Mat &buffer)
+{
+    cv::resize(image, buffer, m_Size, 0.0, 0.0, m_Interpolation);
+    std::swap(image, buffer);
+}
+
+cv::Size
+ResizeStage::getOutputSize(const cv::Size &) const
+{
+    return m_Size;
+}
+
+std::string
+HistogramEqualisationStage::getName() const
+{
+    return "histogram equalisation";
+}
+
+void
+HistogramEqualisationStage::process(cv::Mat &image, cv::Mat &buffer)
+{
+    BOB_ASSERT(image.type() == CV_8UC1);
+    cv::equalizeHist(image, buffer);
+    std::swap(image, buffer);
+}
+
+MaskStage::MaskStage(ImgProc::Mask mask)
+  : m_Mask(std::move(mask))
+{}
+
+std::string
+MaskStage::getName() const
+{
+    return "mask";
+}
+
+void
+MaskStage::process(cv::Mat &image, cv::Mat &buffer)
+{
+    if (!m_Mask.empty()) {
+        m_Mask.apply(image, buffer);
+        std::swap(image, buffer);
+    }
+}
+
+CallbackStage::CallbackStage(std::string name, Callback callback)
+  : m_Name(std::move(name))
+  , m_Callback(std::move(callback))
+{}
+
+std::string
+CallbackStage::getName() const
+{
+    return m_Name;
+}
+
+void
+CallbackStage::process(cv::Mat &image, cv::Mat &)
+{
+    m_Callback(image);
+}
+
+void
+Pipeline::Counters::add(Duration time)
+{
+    const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+    numFrames++;
+    totalTime += ns;
+    if (ns > maxTime) {
+        maxTime = ns;
+    }
+}
+
+Pipeline::Pipeline(Input &input, bool greyscale, size_t queueCapacity)
+  : m_Input(input)
+  , m_Greyscale(greyscale)
+  , m_QueueCapacity(queueCapacity)
+{
+    BOB_ASSERT(queueCapacity > 0);
+}
+
+Pipeline::~Pipeline()
+{
+    stop();
+}
+
+std::string
+Pipeline::getCameraName() const
+{
+    return m_Input.getCameraName();
+}
+
+units::frequency::hertz_t
+Pipeline::getFrameRate() const
+{
+    return m_Input.getFrameRate();
+}
+
+cv::Size
+Pipeline::getOutputSize() const
+{
+    cv::Size size = m_Input.getOutputSize();
+    for (const auto &stage : m_Stages) {
+        size = stage->getOutputSize(size);
+    }
+    return size;
+}
+
+bool
+Pipeline::needsUnwrapping() const
+{
+    return m_Input.needsUnwrapping() &&
+           std::none_of(m_Stages.cbegin(), m_Stages.cend(), [](const auto &stage) {
+               return stage->isUnwrapping();
+           });
+}
+
+bool
+Pipeline::readFrame(cv::Mat &outFrame)
+{
+    uint64_t sequence;
+    TimePoint captureTime;
+    return readFrame(outFrame, sequence, captureTime);
+}
+
+bool
+Pipeline::readGreyscaleFrame(cv::Mat &outFrame)
+{
+    if (!readFrame(outFrame)) {
+        return false;
+    }
+
+    // Frames may already be greyscale, depending on the stages
+    if (outFrame.channels() == 3) {
+        cv::cvtColor(outFrame, outFrame, cv::COLOR_BGR2GRAY);
+    }
+    return true;
+}
+
+Pipeline &
+Pipeline::add(std::unique_ptr<PipelineStage> stage)
+{
+    BOB_ASSERT(m_Threads.empty());
+    m_Stages.emplace_back(std::move(stage));
+    return *this;
+}
+
+Pipeline &
+Pipeline::add(std::string name, CallbackStage::Callback callback)
+{
+    return add<CallbackStage>(std::move(name), std::move(callback));
+}
+
+void
+Pipeline::setDropFrames(bool dropFrames)
+{
+    BOB_ASSERT(m_Threads.empty());
+    m_DropFrames = dropFrames;
+}
+
+void
+Pipeline::start()
+{
+    BOB_ASSERT(m_Threads.empty());
+
+    /*
+     * There need to be enough frames for every queue to be full while the
+     * Input and every stage have one each.
+     */
+    const size_t numStages = m_Stages.size();
+    const size_t numFrames = (numStages + 1) * (m_QueueCapacity + 1);
+    m_FreeFrames = std::make_unique<SPSCQueue<Frame *>>(numFrames);
+    m_Frames.clear();
+    for (size_t i = 0; i < numFrames; i++) {
+        m_Frames.emplace_back(std::make_unique<Frame>());
+        Frame *frame = m_Frames.back().get();
+        frame->images.resize(numStages + 1);
+        BOB_ASSERT(m_FreeFrames->tryPush(frame));
+    }
+    m_Queues.clear();
+    for (size_t i = 0; i < numStages; i++) {
+        m_Queues.emplace_back(std::make_unique<SPSCQueue<Frame *>>(m_QueueCapacity));
+    }
+    m_Counters = std::make_unique<Counters[]>(numStages + 2);
+
+    m_DoRun = true;
+    m_StartTime = std::chrono::steady_clock::now();
+    m_Threads.emplace_back(&Pipeline::runInput, this);
+    for (size_t i = 0; i < numStages; i++) {
+        m_Threads.emplace_back(&Pipeline::runStage, this, i);
+    }
+}
+
+void
+Pipeline::stop()
+{
+    m_DoRun = false;
+    if (m_FreeFrames) {
+        m_FreeFrames->close();
+    }
+    for (auto &queue : m_Queues) {
+        queue->close();
+    }
+    for (auto &thread : m_Threads) {
+        thread.join();
+    }
+    m_Threads.clear();
+
+    std::lock_guard<std::mutex> lock{ m_OutputMutex };
+    m_OutputReady.notify_all();
+}
+
+bool
+Pipeline::readFrame(cv::Mat &outFrame, uint64_t &sequence, TimePoint &captureTime)
+{
+    std::lock_guard<std::mutex> lock{ m_OutputMutex };
+    if (m_Error) {
+        std::rethrow_exception(m_Error);
+    }
+    if (!m_HasOutput) {
+        return false;
+    }
+
+    /*
+     * Give the reader's old buffer to the pipeline, unless something else is
+     * still using it. It goes back into the buffer of whichever stage produced
+     * the next frame, so it should already be the right size and type.
+     */
+    std::swap(outFrame, m_Output);
+    if (!m_Output.u || m_Output.u->refcount > 1) {
+        m_Output.release();
+    }
+    m_HasOutput = false;
+    sequence = m_OutputSequence;
+    captureTime = m_OutputCaptureTime;
+    return true;
+}
+
+bool
+Pipeline::waitForFrame(cv::Mat &outFrame)
+{
+    {
+        std::unique_lock<std::mutex> lock{ m_OutputMutex };
+        m_OutputReady.wait(lock, [this]() { return m_HasOutput || m_Error || !m_DoRun; });
+    }
+    return readFrame(outFrame);
+}
+
+std::vector<Pipeline::Statistics>
+Pipeline::getStatistics() const
+{
+    std::vector<Statistics> statistics;
+    if (!m_Counters) {
+        return statistics;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_StartTime;
+    for (size_t i = 0; i < m_Stages.size() + 2; i++) {
+        Statistics stats;
+        if (i == 0) {
+            stats.name = "input";
+        } else if (i <= m_Stages.size()) {
+            stats.name = m_Stages[i - 1]->getName();
+        } else {
+            stats.name = "pipeline";
+        }
+
+        const auto &counters = m_Counters[i];
+        stats.numFrames = counters.numFrames;
+        const int64_t meanTime = stats.numFrames ? counters.totalTime / static_cast<int64_t>(stats.numFrames) : 0;
+        stats.meanLatency = std::chrono::duration_cast<Duration>(std::chrono::nanoseconds{ meanTime });
+        stats.maxLatency = std::chrono::duration_cast<Duration>(std::chrono::nanoseconds{ counters.maxTime.load() });
+        stats.throughput = stats.numFrames / elapsed.count();
+        statistics.push_back(std::move(stats));
+    }
+    return statistics;
+}
+
+size_t
+Pipeline::getNumDroppedFrames() const
+{
+    std::lock_guard<std::mutex> lock{ m_OutputMutex };
+    return m_NumDroppedFrames + m_NumInputDroppedFrames;
+}
+
+void
+Pipeline::output(Frame &frame)
+{
+    m_Counters[m_Stages.size() + 1].add(std::chrono::steady_clock::now() - frame.captureTime);
+
+    // The newest frame wins
+    std::lock_guard<std::mutex> lock{ m_OutputMutex };
+    if (m_HasOutput) {
+        m_NumDroppedFrames++;
+    }
+    std::swap(m_Output, frame.images[frame.current]);
+    m_OutputSequence = frame.sequence;
+    m_OutputCaptureTime = frame.captureTime;
+    m_HasOutput = true;
+    m_OutputReady.notify_all();
+}
+
+void
+Pipeline::runInput()
+{
+    try {
+        Frame *frame = nullptr;
+        uint64_t sequence = 0;
+        while (m_DoRun) {
+            if (!frame && !m_FreeFrames->pop(frame)) {
+                break;
+            }
+
+            const auto startTime = std::chrono::steady_clock::now();
+            bool haveFrame = false;
+            cv::Mat &image = frame->images[0];
+            while (m_DoRun && !haveFrame) {
+                haveFrame = m_Greyscale ? m_Input.readGreyscaleFrame(image)
+                                        : m_Input.readFrame(image);
+                if (!haveFrame) {
+                    std::this_thread::sleep_for(1ms);
+                }
+            }
+            if (!haveFrame) {
+                break;
+            }
+
+            frame->current = 0;
+            frame->captureTime = std::chrono::steady_clock::now();
+            frame->sequence = ++sequence;
+            m_Counters[0].add(frame->captureTime - startTime);
+
+            if (m_Stages.empty()) {
+                output(*frame);
+                BOB_ASSERT(m_FreeFrames->tryPush(frame));
+            } else if (m_DropFrames) {
+                // Read the next frame into the same buffer if there's no room
+                if (!m_Queues[0]->tryPush(frame)) {
+                    m_NumInputDroppedFrames++;
+                    continue;
+                }
+            } else if (!m_Queues[0]->push(frame)) {
+                break;
+            }
+            frame = nullptr;
+        }
+    } catch (...) {
+        setError(std::current_exception());
+    }
+}
+
+void
+Pipeline::runStage(size_t index)
+{
+    try {
+        auto &stage = *m_Stages[index];
+        const bool isLast = index + 1 == m_Stages.size();
+        Frame *frame;
+        while (m_DoRun && m_Queues[index]->pop(frame)) {
+            const auto startTime = std::chrono::steady_clock::now();
+            cv::Mat &image = frame->images[frame->current];
+            cv::Mat &buffer = frame->images[index + 1];
+            const auto data = image.u;
+            stage.process(image, buffer);
+
+            // If the stage swapped in its buffer, swap back so each buffer stays with its stage
+            if (image.u != data) {
+                std::swap(image, buffer);
+                frame->current = index + 1;
+            }
+            m_Counters[index + 1].add(std::chrono::steady_clock::now() - startTime);
+
+            if (isLast) {
+                output(*frame);
+                if (!m_FreeFrames->push(frame)) {
+                    break;
+                }
+            } else if (!m_Queues[index + 1]->push(frame)) {
+                break;
+            }
+        }
+    } catch (...) {
+        setError(std::current_exception());
+    }
+}
+
+void
+Pipeline::setError(std::exception_ptr error)
+{
+    // Stop the other threads, without waiting for them
+    m_DoRun = false;
+    m_FreeFrames->close();
+    for (auto &queue : m_Queues) {
+        queue->close();
+    }
+
+    std::lock_guard<std::mutex> lock{ m_OutputMutex };
+    if (!m_Error) {
+        m_Error = error;
+    }
+    m_OutputReady.notify_all();
+}
+} // Video
+} // BoBRobotics
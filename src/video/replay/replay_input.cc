@@ -0,0 +1,504 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "navigation/image_database.h"
+#include "plog/Log.h"
+#include "video/replay/replay_input.h"
+
+// OpenCV includes
+#include <opencv2/imgproc.hpp>
+
+// Standard C includes
+#include <cstdint>
+#include <cstring>
+
+// Standard C++ includes
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace BoBRobotics {
+namespace Video {
+namespace {
+/*
+ * Capture logs start with this, followed by the names of the codec and the
+ * camera. Each frame is then saved as its timestamp in nanoseconds, its size
+ * and the encoded data.
+ */
+constexpr char LogMagic[8] = { 'B', 'O', 'B', 'C', 'L', 'O', 'G', '1' };
+constexpr const char *TimestampField = "Timestamp [ms]";
+
+void
+writeString(std::ofstream &stream, const std::string &str)
+{
+    const auto length = static_cast<uint32_t>(str.size());
+    stream.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    stream.write(str.data(), length);
+}
+
+std::string
+readString(std::ifstream &stream)
+{
+    uint32_t length;
+    stream.read(reinterpret_cast<char *>(&length), sizeof(length));
+    std::string str(length, '\0');
+    stream.read(&str[0], length);
+    return str;
+}
+
+// Make timestamps relative to the first frame
+void
+zeroTimestamps(std::vector<ReplayInput::Duration> &timestamps)
+{
+    if (!timestamps.empty()) {
+        const auto first = timestamps[0];
+        for (auto &timestamp : timestamps) {
+            timestamp -= first;
+        }
+    }
+}
+} // anonymous namespace
+
+CaptureLogWriter::CaptureLogWriter(const filesystem::path &path,
+                                   const std::string &codec,
+                                   const std::string &cameraName)
+  : m_Stream(path.str(), std::ios::binary)
+  , m_Codec(FrameCodec::create(codec))
+{
+    if (!m_Stream.good()) {
+        throw std::runtime_error("Could not open " + path.str() + " for writing");
+    }
+
+    // Frames have to be decodable on their own to seek
+    BOB_ASSERT(m_Codec->getName() != "delta");
+
+    m_Stream.write(LogMagic, sizeof(LogMagic));
+    writeString(m_Stream, m_Codec->getName());
+    writeString(m_Stream, cameraName);
+}
+
+void
+CaptureLogWriter::write(const cv::Mat &frame, Duration timestamp)
+{
+    m_Codec->encode(frame, m_Buffer);
+
+    const int64_t nanoseconds = timestamp.count();
+    const auto size = static_cast<uint32_t>(m_Buffer.size());
+    m_Stream.write(reinterpret_cast<const char *>(&nanoseconds), sizeof(nanoseconds));
+    m_Stream.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    m_Stream.write(reinterpret_cast<const char *>(m_Buffer.data()), size);
+    if (!m_Stream.good()) {
+        throw std::runtime_error("Error writing to capture log");
+    }
+}
+
+void
+CaptureLogWriter::write(const cv::Mat &frame)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (!m_Started) {
+        m_StartTime = now;
+        m_Started = true;
+    }
+    write(frame, std::chrono::duration_cast<Duration>(now - m_StartTime));
+}
+
+//----------------------------------------------------------------------------
+// ReplayInput::Source
+//----------------------------------------------------------------------------
+// Somewhere frames can be decoded from, in any order
+class ReplayInput::Source
+{
+public:
+    virtual ~Source() = default;
+
+    //! Only called from the decoding thread
+    virtual void decode(size_t index, cv::Mat &image) = 0;
+
+    std::vector<Duration> timestamps;
+    std::string cameraName = DefaultCameraName;
+    bool needsUnwrapping = false;
+    units::frequency::hertz_t frameRate{ 0 };
+    cv::Size resolution;
+};
+
+//----------------------------------------------------------------------------
+// ReplayInput::DatabaseSource
+//----------------------------------------------------------------------------
+class ReplayInput::DatabaseSource
+  : public ReplayInput::Source
+{
+public:
+    DatabaseSource(const filesystem::path &path)
+      : m_Database(path)
+    {
+        if (m_Database.hasMetadata()) {
+            const auto metadata = m_Database.getMetadata();
+            metadata["camera"]["name"] >> cameraName;
+            metadata["needsUnwrapping"] >> needsUnwrapping;
+            resolution = m_Database.getResolution();
+            frameRate = m_Database.getFrameRate();
+        }
+
+        timestamps.reserve(m_Database.size());
+        const auto &fields = m_Database.getExtraFieldNames();
+        if (std::find(fields.cbegin(), fields.cend(), TimestampField) != fields.cend()) {
+            for (const auto &entry : m_Database) {
+                const std::chrono::duration<double, std::milli> ms{ std::stod(entry.getExtraField(TimestampField)) };
+                timestamps.push_back(std::chrono::duration_cast<Duration>(ms));
+            }
+            zeroTimestamps(timestamps);
+        } else {
+            if (frameRate.value() <= 0) {
+                LOG_WARNING << "Database " << path << " has no timestamps or frame rate; "
+                            << "frames will be replayed as fast as possible";
+            }
+            for (size_t i = 0; i < m_Database.size(); i++) {
+                const std::chrono::duration<double> seconds{ frameRate.value() > 0 ? i / frameRate.value() : 0.0 };
+                timestamps.push_back(std::chrono::duration_cast<Duration>(seconds));
+            }
+        }
+    }
+
+    virtual void decode(size_t index, cv::Mat &image) override
+    {
+        if (!m_Database.hasVideoFile()) {
+            image = m_Database[index].load(false);
+            return;
+        }
+
+        // Only seek if we're not already there
+        if (index != m_NextVideoFrame) {
+            m_Database.openVideoAt(m_Capture, index);
+        }
+        BOB_ASSERT(m_Capture.read(image));
+        m_NextVideoFrame = index + 1;
+    }
+
+private:
+    const Navigation::ImageDatabase m_Database;
+    cv::VideoCapture m_Capture;
+    size_t m_NextVideoFrame = std::numeric_limits<size_t>::max();
+};
+
+//----------------------------------------------------------------------------
+// ReplayInput::LogSource
+//----------------------------------------------------------------------------
+class ReplayInput::LogSource
+  : public ReplayInput::Source
+{
+public:
+    LogSource(const filesystem::path &path)
+      : m_Stream(path.str(), std::ios::binary)
+    {
+        char magic[sizeof(LogMagic)];
+        m_Stream.read(magic, sizeof(magic));
+        if (!m_Stream.good() || std::memcmp(magic, LogMagic, sizeof(magic)) != 0) {
+            throw std::runtime_error(path.str() + " is not a capture log");
+        }
+        m_Codec = FrameCodec::create(readString(m_Stream));
+        cameraName = readString(m_Stream);
+        needsUnwrapping = cameraName != DefaultCameraName;
+
+        // Index the frames, skipping over their data
+        const auto headerEnd = m_Stream.tellg();
+        m_Stream.seekg(0, std::ios::end);
+        const auto end = m_Stream.tellg();
+        m_Stream.seekg(headerEnd);
+        int64_t nanoseconds;
+        uint32_t size;
+        while (m_Stream.read(reinterpret_cast<char *>(&nanoseconds), sizeof(nanoseconds)) &&
+               m_Stream.read(reinterpret_cast<char *>(&size), sizeof(size))) {
+            // The last frame may have been cut short if recording was interrupted
+            const auto offset = m_Stream.tellg();
+            if (end - offset < static_cast<std::streamoff>(size)) {
+                LOG_WARNING << "Ignoring incomplete frame at end of " << path;
+                break;
+            }
+
+            timestamps.emplace_back(nanoseconds);
+            m_Frames.push_back({ offset, size });
+            m_Stream.seekg(offset + static_cast<std::streamoff>(size));
+        }
+        zeroTimestamps(timestamps);
+        m_Stream.clear();
+    }
+
+    virtual void decode(size_t index, cv::Mat &image) override
+    {
+        const auto &frame = m_Frames[index];
+        m_Buffer.resize(frame.size);
+        m_Stream.seekg(frame.offset);
+        if (!m_Stream.read(reinterpret_cast<char *>(m_Buffer.data()), frame.size)) {
+            throw std::runtime_error("Could not read frame " + std::to_string(index) + " from capture log");
+        }
+        m_Codec->decode(m_Buffer.data(), m_Buffer.size(), image);
+    }
+
+private:
+    struct FrameLocation
+    {
+        std::streampos offset;
+        uint32_t size;
+    };
+
+    std::ifstream m_Stream;
+    std::unique_ptr<FrameCodec> m_Codec;
+    std::vector<FrameLocation> m_Frames;
+    std::vector<uchar> m_Buffer;
+};
+
+//----------------------------------------------------------------------------
+// ReplayInput
+//----------------------------------------------------------------------------
+ReplayInput::ReplayInput(const filesystem::path &path, double speed, size_t readAhead)
+  : m_ReadAhead(readAhead)
+  , m_Speed(speed)
+{
+    BOB_ASSERT(readAhead > 0);
+    BOB_ASSERT(speed >= 0.0);
+
+    if (path.extension() == CaptureLogWriter::Extension) {
+        m_Source = std::make_unique<LogSource>(path);
+    } else {
+        m_Source = std::make_unique<DatabaseSource>(path);
+    }
+
+    // If the resolution wasn't saved, look at the first frame
+    if (m_Source->resolution.area() == 0 && size() > 0) {
+        cv::Mat image;
+        m_Source->decode(0, image);
+        m_Source->resolution = image.size();
+    }
+    m_OutputSize = m_Source->resolution;
+
+    m_DecodeThread = std::thread{ &ReplayInput::runDecode, this };
+}
+
+ReplayInput::~ReplayInput()
+{
+    {
+        std::lock_guard<std::mutex> lock{ m_Mutex };
+        m_Stopping = true;
+    }
+    m_QueueChanged.notify_all();
+    m_DecodeThread.join();
+}
+
+std::string
+ReplayInput::getCameraName() const
+{
+    return m_Source->cameraName;
+}
+
+units::frequency::hertz_t
+ReplayInput::getFrameRate() const
+{
+    if (m_Source->frameRate.value() > 0) {
+        return m_Source->frameRate;
+    }
+
+    // Otherwise work out the average from the timestamps
+    const auto &timestamps = m_Source->timestamps;
+    if (timestamps.size() < 2 || timestamps.back() <= timestamps.front()) {
+        return units::frequency::hertz_t{ 0 };
+    }
+    const std::chrono::duration<double> duration = timestamps.back() - timestamps.front();
+    return units::frequency::hertz_t{ (timestamps.size() - 1) / duration.count() };
+}
+
+cv::Size
+ReplayInput::getOutputSize() const
+{
+    std::lock_guard<std::mutex> lock{ m_Mutex };
+    return m_OutputSize;
+}
+
+bool
+ReplayInput::needsUnwrapping() const
+{
+    return m_Source->needsUnwrapping;
+}
+
+void
+ReplayInput::setOutputSize(const cv::Size &outSize)
+{
+    std::lock_guard<std::mutex> lock{ m_Mutex };
+    m_OutputSize = outSize;
+}
+
+bool
+ReplayInput::readFrame(cv::Mat &outFrame)
+{
+    size_t index;
+    Duration timestamp;
+    return readFrame(outFrame, index, timestamp, false);
+}
+
+bool
+ReplayInput::readGreyscaleFrame(cv::Mat &outFrame)
+{
+    size_t index;
+    Duration timestamp;
+    return readFrame(outFrame, index, timestamp, true);
+}
+
+bool
+ReplayInput::readFrame(cv::Mat &outFrame, size_t &index, Duration &timestamp)
+{
+    return readFrame(outFrame, index, timestamp, false);
+}
+
+void
+ReplayInput::seek(size_t frame)
+{
+    BOB_ASSERT(frame <= size());
+    {
+        std::lock_guard<std::mutex> lock{ m_Mutex };
+        m_Queue.clear();
+        m_NextToDecode = m_NextToRead = frame;
+        m_SeekCount++;
+        m_Anchored = false;
+    }
+    m_QueueChanged.notify_all();
+}
+
+void
+ReplayInput::seekTime(Duration timestamp)
+{
+    const auto &timestamps = m_Source->timestamps;
+    const auto pos = std::lower_bound(timestamps.cbegin(), timestamps.cend(), timestamp);
+    seek(static_cast<size_t>(pos - timestamps.cbegin()));
+}
+
+void
+ReplayInput::setSpeed(double speed)
+{
+    BOB_ASSERT(speed >= 0.0);
+
+    // Carry on from the next frame at the new speed
+    std::lock_guard<std::mutex> lock{ m_Mutex };
+    m_Speed = speed;
+    m_Anchored = false;
+}
+
+double
+ReplayInput::getSpeed() const
+{
+    std::lock_guard<std::mutex> lock{ m_Mutex };
+    return m_Speed;
+}
+
+size_t
+ReplayInput::getPosition() const
+{
+    std::lock_guard<std::mutex> lock{ m_Mutex };
+    return m_NextToRead;
+}
+
+ReplayInput::Duration
+ReplayInput::getTimestamp(size_t frame) const
+{
+    return m_Source->timestamps.at(frame);
+}
+
+bool
+ReplayInput::isFinished() const
+{
+    return getPosition() >= size();
+}
+
+size_t
+ReplayInput::size() const
+{
+    return m_Source->timestamps.size();
+}
+
+bool
+ReplayInput::readFrame(cv::Mat &outFrame, size_t &index, Duration &timestamp, bool greyscale)
+{
+    std::unique_lock<std::mutex> lock{ m_Mutex };
+    if (m_NextToRead >= size()) {
+        return false;
+    }
+
+    m_QueueChanged.wait(lock, [this]() { return !m_Queue.empty() || m_Error; });
+    if (m_Queue.empty()) {
+        std::rethrow_exception(m_Error);
+    }
+    cv::Mat image = std::move(m_Queue.front().image);
+    index = m_Queue.front().index;
+    m_Queue.pop_front();
+    m_NextToRead = index + 1;
+    m_QueueChanged.notify_all();
+
+    // Frames are due relative to the first one read since playback (re)started
+    timestamp = m_Source->timestamps[index];
+    if (!m_Anchored) {
+        m_Anchored = true;
+        m_AnchorTime = std::chrono::steady_clock::now();
+        m_AnchorTimestamp = timestamp;
+    }
+    const double speed = m_Speed;
+    const auto anchorTime = m_AnchorTime;
+    const auto sinceAnchor = timestamp - m_AnchorTimestamp;
+    const cv::Size outputSize = m_OutputSize;
+    lock.unlock();
+
+    // Convert and resize while we wait
+    if (greyscale && image.channels() == 3) {
+        cv::cvtColor(image, image, cv::COLOR_BGR2GRAY);
+    } else if (!greyscale && image.channels() == 1) {
+        cv::cvtColor(image, image, cv::COLOR_GRAY2BGR);
+    }
+    if (image.size() != outputSize) {
+        cv::resize(image, outFrame, outputSize);
+    } else {
+        outFrame = image;
+    }
+
+    /*
+     * Frames are never skipped, so if the caller falls behind they'll get
+     * frames straight away until it catches up.
+     */
+    if (speed != AsFastAsPossible) {
+        const std::chrono::duration<double, std::nano> wait{ sinceAnchor.count() / speed };
+        std::this_thread::sleep_until(anchorTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait));
+    }
+    return true;
+}
+
+void
+ReplayInput::runDecode()
+{
+    try {
+        std::unique_lock<std::mutex> lock{ m_Mutex };
+        while (true) {
+            m_QueueChanged.wait(lock, [this]() {
+                return m_Stopping || (m_Queue.size() < m_ReadAhead && m_NextToDecode < size());
+            });
+            if (m_Stopping) {
+                return;
+            }
+
+            const size_t index = m_NextToDecode++;
+            const auto seekCount = m_SeekCount;
+            lock.unlock();
+
+            cv::Mat image;
+            m_Source->decode(index, image);
+
+            // If the caller has seeked elsewhere in the meantime, throw the frame away
+            lock.lock();
+            if (seekCount == m_SeekCount) {
+                m_Queue.push_back({ index, std::move(image) });
+                m_QueueChanged.notify_all();
+            }
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock{ m_Mutex };
+        m_Error = std::current_exception();
+        m_QueueChanged.notify_all();
+    }
+}
+} // Video
+} // BoBRobotics
@@ -101,46 +101,25 @@ See3CAM_CU40::captureSuperPixelWBU30(cv::Mat &output)
 void
 See3CAM_CU40::captureSuperPixelGreyscale(cv::Mat &output)
 {
-    // Check that output size is suitable for super-pixel output i.e. a
-    // quarter input size
-    const unsigned int inputWidth = getWidth();
-    const unsigned int inputHeight = getHeight();
-    BOB_ASSERT(output.cols == (int) inputWidth / 2);
-    BOB_ASSERT(output.rows == (int) inputHeight / 2);
-    BOB_ASSERT(output.type() == CV_8UC1);
-
-    // Read data and size (in bytes) from camera
-    // **NOTE** these pointers are only valid within one frame
-    void *data = nullptr;
-    uint32_t sizeBytes = Video4LinuxCamera::capture(data);
-
-    // Check frame size is correct
-    BOB_ASSERT(sizeBytes == (inputWidth * inputHeight * sizeof(uint16_t)));
-    const uint16_t *bayerData = reinterpret_cast<uint16_t *>(data);
-
-    // Loop through bayer pixels
-    for (unsigned int y = 0; y < inputHeight; y += 2) {
-        // Get pointers to start of both rows of Bayer data and output
-        // RGB data
-        const uint16_t *inBG16Start = &bayerData[y * inputWidth];
-        const uint16_t *inR16Start =
-                &bayerData[((y + 1) * inputWidth) + 1];
-        uint8_t *outStart = output.ptr(y / 2);
-        for (unsigned int x = 0; x < inputWidth; x += 2) {
-            // Read Bayer pixels
-            const uint16_t b = *(inBG16Start++);
-            const uint16_t g = *(inBG16Start++);
-            const uint16_t r = *inR16Start;
-            inR16Start += 2;
+    See3CAM_CU40Demosaic::superPixelGreyscale(captureBayer(), getBayerSize(), output);
+}
 
-            // Add channels together and divide by 3 to take average and
-            // 4 to rescale from 10-bit per-channel to 8-bit
-            const uint32_t gray = (b + g + r) / (3 * 4);
+void
+See3CAM_CU40::captureSuperPixelUnwrapped(const ImgProc::OpenCVUnwrap360 &unwrapper,
+                                         cv::Mat &output)
+{
+    BOB_ASSERT(unwrapper.getCameraResolution() == getSuperPixelSize());
+    See3CAM_CU40Demosaic::superPixelLUT<WhiteBalanceU30>(captureBayer(), getBayerSize(),
+                                                         unwrapper.getUnwrapLUT(), output);
+}
 
-            // Write back to BGR
-            *(outStart++) = (uint8_t) gray;
-        }
-    }
+void
+See3CAM_CU40::captureSuperPixelGreyscaleUnwrapped(const ImgProc::OpenCVUnwrap360 &unwrapper,
+                                                  cv::Mat &output)
+{
+    BOB_ASSERT(unwrapper.getCameraResolution() == getSuperPixelSize());
+    See3CAM_CU40Demosaic::superPixelGreyscaleLUT(captureBayer(), getBayerSize(),
+                                                 unwrapper.getUnwrapLUT(), output);
 }
 
 // Calculates entropy, either from whole frame or within subset specified by
@@ -253,11 +232,10 @@ See3CAM_CU40::autoExposure(const cv::Mat &mask, int brightnessExposureConstant)
         // **NOTE** delay  found experimentally
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
-        // Throw away frame so new frame is captured AFTER setting change
-        // **NOTE** this is required because of double-buffering in
+        // Throw away frames so new frame is captured AFTER setting change
+        // **NOTE** this is required because of the buffer queue in
         // Video4LinuxCamera
-        void *data = nullptr;
-        capture(data);
+        flush();
 
         // Calculate image entropy
         const float entropy = calculateImageEntropy(mask);
@@ -381,89 +359,23 @@ See3CAM_CU40::createBubblescopeMask(const cv::Size &camRes)
     return mask;
 }
 
-uint8_t
-See3CAM_CU40::PixelScale::getR(uint16_t r, uint16_t, uint16_t)
-{
-    return getScaled(r);
-}
-uint8_t
-See3CAM_CU40::PixelScale::getG(uint16_t, uint16_t g, uint16_t)
-{
-    return getScaled(g);
-}
-uint8_t
-See3CAM_CU40::PixelScale::getB(uint16_t, uint16_t, uint16_t b)
-{
-    return getScaled(b);
-}
-
-uint8_t
-See3CAM_CU40::PixelScale::getScaled(uint16_t v)
-{
-    return (uint8_t)(v >> 2);
-}
-
-uint8_t
-See3CAM_CU40::PixelClamp::getR(uint16_t r, uint16_t, uint16_t)
-{
-    return getClamped(r);
-}
-uint8_t
-See3CAM_CU40::PixelClamp::getG(uint16_t, uint16_t g, uint16_t)
-{
-    return getClamped(g);
-}
-uint8_t
-See3CAM_CU40::PixelClamp::getB(uint16_t, uint16_t, uint16_t b)
-{
-    return getClamped(b);
-}
-uint8_t
-See3CAM_CU40::PixelClamp::getClamped(uint16_t v)
-{
-    return (uint8_t) std::min<uint16_t>(255, v);
-}
-
-uint8_t
-See3CAM_CU40::WhiteBalanceCoolWhite::getR(uint16_t r, uint16_t, uint16_t)
-{
-    // 0.96 (15729)
-    return (uint8_t)(((uint32_t) r * 15729) >> 16);
-}
-
-uint8_t
-See3CAM_CU40::WhiteBalanceCoolWhite::getG(uint16_t, uint16_t g, uint16_t)
-{
-    return (uint8_t)(g >> 2);
-}
-
-uint8_t
-See3CAM_CU40::WhiteBalanceCoolWhite::getB(uint16_t, uint16_t, uint16_t b)
-{
-    // 1.74 (28508)
-    return (uint8_t) std::min<uint32_t>(((uint32_t) b * 28508) >> 16,
-                                        255);
-}
-
-uint8_t
-See3CAM_CU40::WhiteBalanceU30::getR(uint16_t r, uint16_t, uint16_t)
+cv::Size
+See3CAM_CU40::getBayerSize() const
 {
-    // 0.92 (15073)
-    return (uint8_t)(((uint32_t) r * 15073) >> 16);
+    return { static_cast<int>(getWidth()), static_cast<int>(getHeight()) };
 }
 
-uint8_t
-See3CAM_CU40::WhiteBalanceU30::getG(uint16_t, uint16_t g, uint16_t)
+const uint16_t *
+See3CAM_CU40::captureBayer()
 {
-    return (uint8_t)(g >> 2);
-}
+    // Read data and size (in bytes) from camera
+    // **NOTE** these pointers are only valid within one frame
+    void *data = nullptr;
+    uint32_t sizeBytes = Video4LinuxCamera::capture(data);
 
-uint8_t
-See3CAM_CU40::WhiteBalanceU30::getB(uint16_t, uint16_t, uint16_t b)
-{
-    // 1.53 (25068)
-    return (uint8_t) std::min<uint32_t>(((uint32_t) b * 25068) >> 16,
-                                        255);
+    // Check frame size is correct
+    BOB_ASSERT(sizeBytes == (getWidth() * getHeight() * sizeof(uint16_t)));
+    return reinterpret_cast<uint16_t *>(data);
 }
 
 } // Video
@@ -0,0 +1,492 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "video/see3cam_cu40_demosaic.h"
+
+// Standard C++ includes
+#include <algorithm>
+
+// SIMD intrinsics
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BOB_DEMOSAIC_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BOB_DEMOSAIC_SSE2
+#endif
+
+namespace BoBRobotics {
+namespace Video {
+namespace See3CAM_CU40Demosaic {
+namespace {
+/*
+ * The transforms, as the vectorised code sees them: a channel's output is the
+ * low byte of min(multiplier ? (v * multiplier) >> 16 : v, max). This is
+ * exactly what the scalar transforms compute.
+ */
+struct ChannelOp
+{
+    uint16_t multiplier;
+    uint16_t max;
+};
+
+struct PixelOps
+{
+    ChannelOp b, g, r;
+};
+
+template<typename T>
+PixelOps getOps();
+
+template<>
+PixelOps
+getOps<PixelScale>()
+{
+    // Multiplying by 2^14 and dividing by 2^16 is the same as dividing by 4
+    return { { 16384, 0xFFFF }, { 16384, 0xFFFF }, { 16384, 0xFFFF } };
+}
+
+template<>
+PixelOps
+getOps<PixelClamp>()
+{
+    return { { 0, 255 }, { 0, 255 }, { 0, 255 } };
+}
+
+template<>
+PixelOps
+getOps<WhiteBalanceCoolWhite>()
+{
+    return { { 28508, 255 }, { 16384, 0xFFFF }, { 15729, 0xFFFF } };
+}
+
+template<>
+PixelOps
+getOps<WhiteBalanceU30>()
+{
+    return { { 25068, 255 }, { 16384, 0xFFFF }, { 15073, 0xFFFF } };
+}
+
+uint8_t
+getGrey(uint16_t r, uint16_t g, uint16_t b)
+{
+    // Add channels together and divide by 3 to take average and
+    // 4 to rescale from 10-bit per-channel to 8-bit
+    const uint32_t gray = (b + g + r) / (3 * 4);
+    return (uint8_t) gray;
+}
+
+#if defined(BOB_DEMOSAIC_NEON)
+constexpr unsigned int VectorWidth = 8;
+
+inline uint8x8_t
+apply(uint16x8_t v, const ChannelOp &op)
+{
+    if (op.multiplier) {
+        const uint16x4_t multiplier = vdup_n_u16(op.multiplier);
+        v = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(v), multiplier), 16),
+                         vshrn_n_u32(vmull_u16(vget_high_u16(v), multiplier), 16));
+    }
+    if (op.max != 0xFFFF) {
+        v = vminq_u16(v, vdupq_n_u16(op.max));
+    }
+
+    // Narrowing keeps the low byte, like casting to uint8_t
+    return vmovn_u16(v);
+}
+
+// Process VectorWidth super-pixels
+inline void
+superPixelVector(const uint16_t *bg, const uint16_t *irR, const PixelOps &ops, uint8_t *out)
+{
+    const uint16x8x2_t bgPixels = vld2q_u16(bg);
+    const uint16x8x2_t irRPixels = vld2q_u16(irR);
+
+    uint8x8x3_t bgr;
+    bgr.val[0] = apply(bgPixels.val[0], ops.b);
+    bgr.val[1] = apply(bgPixels.val[1], ops.g);
+    bgr.val[2] = apply(irRPixels.val[1], ops.r);
+    vst3_u8(out, bgr);
+}
+
+inline void
+superPixelGreyscaleVector(const uint16_t *bg, const uint16_t *irR, uint8_t *out)
+{
+    const uint16x8x2_t bgPixels = vld2q_u16(bg);
+    const uint16x8x2_t irRPixels = vld2q_u16(irR);
+    const uint16x8_t b = bgPixels.val[0], g = bgPixels.val[1], r = irRPixels.val[1];
+
+    // (b + g + r) / 4 fits in 16 bits, even though the sum doesn't
+    const uint32x4_t sumLow = vaddw_u16(vaddl_u16(vget_low_u16(b), vget_low_u16(g)), vget_low_u16(r));
+    const uint32x4_t sumHigh = vaddw_u16(vaddl_u16(vget_high_u16(b), vget_high_u16(g)), vget_high_u16(r));
+    const uint16x8_t quarter = vcombine_u16(vshrn_n_u32(sumLow, 2), vshrn_n_u32(sumHigh, 2));
+
+    // Divide by 3 exactly, by multiplying by 2^17 / 3 (rounded up)
+    const uint16x4_t third = vdup_n_u16(0xAAAB);
+    const uint16x8_t grey = vshrq_n_u16(vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(quarter), third), 16),
+                                                     vshrn_n_u32(vmull_u16(vget_high_u16(quarter), third), 16)),
+                                        1);
+    vst1_u8(out, vmovn_u16(grey));
+}
+#elif defined(BOB_DEMOSAIC_SSE2)
+constexpr unsigned int VectorWidth = 8;
+
+// Pack 32-bit values (all < 2^16) into 16 bits; SSE2 can only pack with signed saturation
+inline __m128i
+packUnsigned(__m128i low, __m128i high)
+{
+    const __m128i bias = _mm_set1_epi32(32768);
+    return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(low, bias), _mm_sub_epi32(high, bias)),
+                         _mm_set1_epi16(-32768));
+}
+
+// Split 16 interleaved 16-bit values into the even and odd ones
+inline void
+deinterleave(const uint16_t *in, __m128i &even, __m128i &odd)
+{
+    const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 8));
+    const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+    even = packUnsigned(_mm_and_si128(first, lowMask), _mm_and_si128(second, lowMask));
+    odd = packUnsigned(_mm_srli_epi32(first, 16), _mm_srli_epi32(second, 16));
+}
+
+// Gives 16-bit lanes holding the output bytes
+inline __m128i
+apply(__m128i v, const ChannelOp &op)
+{
+    if (op.multiplier) {
+        v = _mm_mulhi_epu16(v, _mm_set1_epi16(static_cast<short>(op.multiplier)));
+    }
+    if (op.max != 0xFFFF) {
+        // Unsigned minimum, which SSE2 lacks
+        v = _mm_sub_epi16(v, _mm_subs_epu16(v, _mm_set1_epi16(static_cast<short>(op.max))));
+    }
+    return _mm_and_si128(v, _mm_set1_epi16(0xFF));
+}
+
+// Process VectorWidth super-pixels
+inline void
+superPixelVector(const uint16_t *bg, const uint16_t *irR, const PixelOps &ops, uint8_t *out)
+{
+    __m128i b, g, ir, r;
+    deinterleave(bg, b, g);
+    deinterleave(irR, ir, r);
+
+    // SSE2 has no byte shuffles, so interleave the channels as we store them
+    alignas(16) uint8_t channels[3][16];
+    _mm_store_si128(reinterpret_cast<__m128i *>(channels[0]), _mm_packus_epi16(apply(b, ops.b), apply(g, ops.g)));
+    _mm_store_si128(reinterpret_cast<__m128i *>(channels[2]), _mm_packus_epi16(apply(r, ops.r), _mm_setzero_si128()));
+    for (unsigned int i = 0; i < VectorWidth; i++) {
+        *(out++) = channels[0][i];
+        *(out++) = channels[0][i + 8];
+        *(out++) = channels[2][i];
+    }
+}
+
+inline void
+superPixelGreyscaleVector(const uint16_t *bg, const uint16_t *irR, uint8_t *out)
+{
+    __m128i b, g, ir, r;
+    deinterleave(bg, b, g);
+    deinterleave(irR, ir, r);
+
+    // (b + g + r) / 4 fits in 16 bits, even though the sum doesn't
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sumLow = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(b, zero), _mm_unpacklo_epi16(g, zero)),
+                                         _mm_unpacklo_epi16(r, zero));
+    const __m128i sumHigh = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(b, zero), _mm_unpackhi_epi16(g, zero)),
+                                          _mm_unpackhi_epi16(r, zero));
+    const __m128i quarter = packUnsigned(_mm_srli_epi32(sumLow, 2), _mm_srli_epi32(sumHigh, 2));
+
+    // Divide by 3 exactly, by multiplying by 2^17 / 3 (rounded up)
+    const __m128i grey = _mm_srli_epi16(_mm_mulhi_epu16(quarter, _mm_set1_epi16(static_cast<short>(0xAAAB))), 1);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                     _mm_packus_epi16(_mm_and_si128(grey, _mm_set1_epi16(0xFF)), zero));
+}
+#else
+constexpr unsigned int VectorWidth = 0;
+#endif
+
+// Work out how much smaller than the super-pixel image output is
+unsigned int
+getDownscale(const cv::Size &bayerSize, const cv::Mat &output)
+{
+    BOB_ASSERT(bayerSize.width % 2 == 0 && bayerSize.height % 2 == 0);
+    BOB_ASSERT(output.cols > 0 && output.rows > 0);
+
+    const int downscale = bayerSize.width / 2 / output.cols;
+    BOB_ASSERT(output.cols * downscale * 2 == bayerSize.width);
+    BOB_ASSERT(output.rows * downscale * 2 == bayerSize.height);
+    return static_cast<unsigned int>(downscale);
+}
+
+// Convert output row y, taking every downscale'th super-pixel
+template<typename T>
+void
+superPixelRow(const uint16_t *bayerData, const cv::Size &bayerSize, unsigned int downscale,
+              int y, uint8_t *out, unsigned int outputWidth)
+{
+    const unsigned int inputWidth = bayerSize.width;
+    const uint16_t *inBG16 = &bayerData[2 * downscale * y * inputWidth];
+    const uint16_t *inR16 = inBG16 + inputWidth + 1;
+
+    unsigned int x = 0;
+    if (VectorWidth > 0 && downscale == 1) {
+#if defined(BOB_DEMOSAIC_NEON) || defined(BOB_DEMOSAIC_SSE2)
+        const auto ops = getOps<T>();
+        for (; x + VectorWidth <= outputWidth; x += VectorWidth) {
+            superPixelVector(inBG16 + 2 * x, inR16 - 1 + 2 * x, ops, out + 3 * x);
+        }
+#endif
+    }
+
+    // Scalar version for what's left
+    for (; x < outputWidth; x++) {
+        const unsigned int offset = 2 * downscale * x;
+        const uint16_t b = inBG16[offset];
+        const uint16_t g = inBG16[offset + 1];
+        const uint16_t r = inR16[offset];
+
+        // Write back to BGR
+        out[3 * x] = T::getB(r, g, b);
+        out[3 * x + 1] = T::getG(r, g, b);
+        out[3 * x + 2] = T::getR(r, g, b);
+    }
+}
+
+void
+superPixelGreyscaleRow(const uint16_t *bayerData, const cv::Size &bayerSize, unsigned int downscale,
+                       int y, uint8_t *out, unsigned int outputWidth)
+{
+    const unsigned int inputWidth = bayerSize.width;
+    const uint16_t *inBG16 = &bayerData[2 * downscale * y * inputWidth];
+    const uint16_t *inR16 = inBG16 + inputWidth + 1;
+
+    unsigned int x = 0;
+    if (VectorWidth > 0 && downscale == 1) {
+#if defined(BOB_DEMOSAIC_NEON) || defined(BOB_DEMOSAIC_SSE2)
+        for (; x + VectorWidth <= outputWidth; x += VectorWidth) {
+            superPixelGreyscaleVector(inBG16 + 2 * x, inR16 - 1 + 2 * x, out + x);
+        }
+#endif
+    }
+
+    // Scalar version for what's left
+    for (; x < outputWidth; x++) {
+        const unsigned int offset = 2 * downscale * x;
+        out[x] = getGrey(inR16[offset], inBG16[offset + 1], inBG16[offset]);
+    }
+}
+
+// Look up super-pixels for a row of a LUT, calling func(bg, irR, out) for each valid one
+template<typename Func>
+void
+gatherRow(const uint16_t *bayerData, const cv::Size &bayerSize, const int32_t *lut,
+          int outputWidth, uint8_t *out, size_t outputChannels, Func func)
+{
+    const int superPixelWidth = bayerSize.width / 2;
+    const int32_t numSuperPixels = superPixelWidth * (bayerSize.height / 2);
+    for (int x = 0; x < outputWidth; x++, out += outputChannels) {
+        const int32_t offset = lut[x];
+        if (offset < 0 || offset >= numSuperPixels) {
+            std::fill_n(out, outputChannels, 0);
+            continue;
+        }
+
+        const int32_t superPixelY = offset / superPixelWidth;
+        const int32_t superPixelX = offset - superPixelY * superPixelWidth;
+        const uint16_t *inBG16 = &bayerData[2 * (superPixelY * bayerSize.width + superPixelX)];
+        func(inBG16, inBG16 + bayerSize.width, out);
+    }
+}
+} // anonymous namespace
+
+template<typename T>
+void
+superPixel(const uint16_t *bayerData, const cv::Size &bayerSize, cv::Mat &output)
+{
+    BOB_ASSERT(output.type() == CV_8UC3);
+    const unsigned int downscale = getDownscale(bayerSize, output);
+
+    // Split the image into bands of rows for each thread
+    cv::parallel_for_(cv::Range(0, output.rows), [&](const cv::Range &rows) {
+        for (int y = rows.start; y < rows.end; y++) {
+            superPixelRow<T>(bayerData, bayerSize, downscale, y, output.ptr(y), output.cols);
+        }
+    });
+}
+
+void
+superPixelGreyscale(const uint16_t *bayerData, const cv::Size &bayerSize, cv::Mat &output)
+{
+    BOB_ASSERT(output.type() == CV_8UC1);
+    const unsigned int downscale = getDownscale(bayerSize, output);
+
+    // Split the image into bands of rows for each thread
+    cv::parallel_for_(cv::Range(0, output.rows), [&](const cv::Range &rows) {
+        for (int y = rows.start; y < rows.end; y++) {
+            superPixelGreyscaleRow(bayerData, bayerSize, downscale, y, output.ptr(y), output.cols);
+        }
+    });
+}
+
+template<typename T>
+void
+superPixelLUT(const uint16_t *bayerData, const cv::Size &bayerSize,
+              const cv::Mat &lut, cv::Mat &output)
+{
+    BOB_ASSERT(lut.type() == CV_32SC1);
+    output.create(lut.size(), CV_8UC3);
+    cv::parallel_for_(cv::Range(0, output.rows), [&](const cv::Range &rows) {
+        for (int y = rows.start; y < rows.end; y++) {
+            gatherRow(bayerData, bayerSize, lut.ptr<int32_t>(y), output.cols, output.ptr(y), 3,
+                      [](const uint16_t *bg, const uint16_t *irR, uint8_t *out) {
+                          out[0] = T::getB(irR[1], bg[1], bg[0]);
+                          out[1] = T::getG(irR[1], bg[1], bg[0]);
+                          out[2] = T::getR(irR[1], bg[1], bg[0]);
+                      });
+        }
+    });
+}
+
+void
+superPixelGreyscaleLUT(const uint16_t *bayerData, const cv::Size &bayerSize,
+                       const cv::Mat &lut, cv::Mat &output)
+{
+    BOB_ASSERT(lut.type() == CV_32SC1);
+    output.create(lut.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, output.rows), [&](const cv::Range &rows) {
+        for (int y = rows.start; y < rows.end; y++) {
+            gatherRow(bayerData, bayerSize, lut.ptr<int32_t>(y), output.cols, output.ptr(y), 1,
+                      [](const uint16_t *bg, const uint16_t *irR, uint8_t *out) {
+                          *out = getGrey(irR[1], bg[1], bg[0]);
+                      });
+        }
+    });
+}
+
+void
+superPixelGreyscaleScalar(const uint16_t *bayerData, const cv::Size &bayerSize, cv::Mat &output)
+{
+    const unsigned int inputWidth = bayerSize.width;
+    const unsigned int inputHeight = bayerSize.height;
+
+    // Loop through bayer pixels
+    for (unsigned int y = 0; y < inputHeight; y += 2) {
+        // Get pointers to start of both rows of Bayer data and output
+        // RGB data
+        const uint16_t *inBG16Start = &bayerData[y * inputWidth];
+        const uint16_t *inR16Start =
+                &bayerData[((y + 1) * inputWidth) + 1];
+        uint8_t *outStart = output.ptr(y / 2);
+        for (unsigned int x = 0; x < inputWidth; x += 2) {
+            // Read Bayer pixels
+            const uint16_t b = *(inBG16Start++);
+            const uint16_t g = *(inBG16Start++);
+            const uint16_t r = *inR16Start;
+            inR16Start += 2;
+
+            // Write back to BGR
+            *(outStart++) = getGrey(r, g, b);
+        }
+    }
+}
+
+// Instantiate for each transform
+#define BOB_INSTANTIATE_SUPER_PIXEL(T)                                                    \
+    template void superPixel<T>(const uint16_t *, const cv::Size &, cv::Mat &);           \
+    template void superPixelLUT<T>(const uint16_t *, const cv::Size &, const cv::Mat &, \
+                                   cv::Mat &)
+BOB_INSTANTIATE_SUPER_PIXEL(PixelScale);
+BOB_INSTANTIATE_SUPER_PIXEL(PixelClamp);
+BOB_INSTANTIATE_SUPER_PIXEL(WhiteBalanceCoolWhite);
+BOB_INSTANTIATE_SUPER_PIXEL(WhiteBalanceU30);
+#undef BOB_INSTANTIATE_SUPER_PIXEL
+
+uint8_t
+PixelScale::getR(uint16_t r, uint16_t, uint16_t)
+{
+    return getScaled(r);
+}
+uint8_t
+PixelScale::getG(uint16_t, uint16_t g, uint16_t)
+{
+    return getScaled(g);
+}
+uint8_t
+PixelScale::getB(uint16_t, uint16_t, uint16_t b)
+{
+    return getScaled(b);
+}
+
+uint8_t
+PixelScale::getScaled(uint16_t v)
+{
+    return (uint8_t)(v >> 2);
+}
+
+uint8_t
+PixelClamp::getR(uint16_t r, uint16_t, uint16_t)
+{
+    return getClamped(r);
+}
+uint8_t
+PixelClamp::getG(uint16_t, uint16_t g, uint16_t)
+{
+    return getClamped(g);
+}
+uint8_t
+PixelClamp::getB(uint16_t, uint16_t, uint16_t b)
+{
+    return getClamped(b);
+}
+uint8_t
+PixelClamp::getClamped(uint16_t v)
+{
+    return (uint8_t) std::min<uint16_t>(255, v);
+}
+
+uint8_t
+WhiteBalanceCoolWhite::getR(uint16_t r, uint16_t, uint16_t)
+{
+    // 0.96 (15729)
+    return (uint8_t)(((uint32_t) r * 15729) >> 16);
+}
+
+uint8_t
+WhiteBalanceCoolWhite::getG(uint16_t, uint16_t g, uint16_t)
+{
+    return (uint8_t)(g >> 2);
+}
+
+uint8_t
+WhiteBalanceCoolWhite::getB(uint16_t, uint16_t, uint16_t b)
+{
+    // 1.74 (28508)
+    return (uint8_t) std::min<uint32_t>(((uint32_t) b * 28508) >> 16,
+                                        255);
+}
+
+uint8_t
+WhiteBalanceU30::getR(uint16_t r, uint16_t, uint16_t)
+{
+    // 0.92 (15073)
+    return (uint8_t)(((uint32_t) r * 15073) >> 16);
+}
+
+uint8_t
+WhiteBalanceU30::getG(uint16_t, uint16_t g, uint16_t)
+{
+    return (uint8_t)(g >> 2);
+}
+
+uint8_t
+WhiteBalanceU30::getB(uint16_t, uint16_t, uint16_t b)
+{
+    // 1.53 (25068)
+    return (uint8_t) std::min<uint32_t>(((uint32_t) b * 25068) >> 16,
+                                        255);
+}
+} // See3CAM_CU40Demosaic
+} // Video
+} // BoBRobotics
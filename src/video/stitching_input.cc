@@ -0,0 +1,317 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "imgproc/grey.h"
+#include "video/stitching_input.h"
+
+// Standard C includes
+#include <cmath>
+#include <cstdint>
+
+// Standard C++ includes
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace BoBRobotics {
+namespace Video {
+namespace {
+double
+toRadians(units::angle::degree_t angle)
+{
+    return units::angle::radian_t{ angle }.value();
+}
+
+// Rotation from a camera's frame of reference to the rig's
+cv::Matx33d
+getCameraRotation(const FisheyeCalibration &calibration)
+{
+    const double yaw = toRadians(calibration.yaw);
+    const double pitch = toRadians(calibration.pitch);
+    const double roll = toRadians(calibration.roll);
+
+    const cv::Matx33d yawRotation{ std::cos(yaw), -std::sin(yaw), 0.0,
+                                   std::sin(yaw), std::cos(yaw), 0.0,
+                                   0.0, 0.0, 1.0 };
+
+    // Positive pitch tilts the optical axis upwards
+    const cv::Matx33d pitchRotation{ std::cos(pitch), 0.0, -std::sin(pitch),
+                                     0.0, 1.0, 0.0,
+                                     std::sin(pitch), 0.0, std::cos(pitch) };
+    const cv::Matx33d rollRotation{ 1.0, 0.0, 0.0,
+                                    0.0, std::cos(roll), -std::sin(roll),
+                                    0.0, std::sin(roll), std::cos(roll) };
+    return yawRotation * pitchRotation * rollRotation;
+}
+} // anonymous namespace
+
+void
+FisheyeCalibration::write(cv::FileStorage &fs) const
+{
+    fs << "{";
+    fs << "resolution" << resolution;
+    fs << "centre" << centre;
+    fs << "pixelsPerRadian" << pixelsPerRadian;
+    fs << "maxAngleDegrees" << maxAngle.value();
+    fs << "yawDegrees" << yaw.value();
+    fs << "pitchDegrees" << pitch.value();
+    fs << "rollDegrees" << roll.value();
+    fs << "}";
+}
+
+void
+FisheyeCalibration::read(const cv::FileNode &node)
+{
+    node["resolution"] >> resolution;
+    node["centre"] >> centre;
+    pixelsPerRadian = (double) node["pixelsPerRadian"];
+    maxAngle = degree_t{ (double) node["maxAngleDegrees"] };
+    yaw = degree_t{ (double) node["yawDegrees"] };
+    pitch = degree_t{ (double) node["pitchDegrees"] };
+    roll = degree_t{ (double) node["rollDegrees"] };
+
+    BOB_ASSERT(resolution.width > 0 && resolution.height > 0);
+    BOB_ASSERT(pixelsPerRadian > 0.0);
+}
+
+void
+write(cv::FileStorage &fs, const std::string &, const FisheyeCalibration &calibration)
+{
+    calibration.write(fs);
+}
+
+void
+read(const cv::FileNode &node, FisheyeCalibration &calibration,
+     const FisheyeCalibration &defaultValue)
+{
+    if (node.empty()) {
+        calibration = defaultValue;
+    } else {
+        calibration.read(node);
+    }
+}
+
+StitchingInput::StitchingInput(std::vector<std::unique_ptr<Input>> cameras,
+                               std::vector<FisheyeCalibration> calibrations,
+                               const cv::Size &outputSize,
+                               degree_t minElevation, degree_t maxElevation,
+                               millisecond_t maxSkew)
+  : m_OutputSize(outputSize)
+  , m_MinElevation(minElevation)
+  , m_MaxElevation(maxElevation)
+  , m_MaxSkew(maxSkew)
+{
+    BOB_ASSERT(!cameras.empty());
+    BOB_ASSERT(cameras.size() == calibrations.size());
+    BOB_ASSERT(minElevation < maxElevation);
+
+    for (size_t i = 0; i < cameras.size(); i++) {
+        BOB_ASSERT(cameras[i]);
+        BOB_ASSERT(cameras[i]->getOutputSize() == calibrations[i].resolution);
+
+        m_Cameras.emplace_back();
+        m_Cameras.back().input = std::move(cameras[i]);
+        m_Cameras.back().calibration = std::move(calibrations[i]);
+    }
+
+    createLUT();
+}
+
+std::string
+StitchingInput::getCameraName() const
+{
+    return "stitched";
+}
+
+units::frequency::hertz_t
+StitchingInput::getFrameRate() const
+{
+    // We can only go as fast as the slowest camera
+    auto frameRate = m_Cameras[0].input->getFrameRate();
+    for (const auto &camera : m_Cameras) {
+        frameRate = units::math::min(frameRate, camera.input->getFrameRate());
+    }
+    return frameRate;
+}
+
+cv::Size
+StitchingInput::getOutputSize() const
+{
+    return m_OutputSize;
+}
+
+bool
+StitchingInput::needsUnwrapping() const
+{
+    // Our output is already a panorama
+    return false;
+}
+
+void
+StitchingInput::setOutputSize(const cv::Size &outputSize)
+{
+    m_OutputSize = outputSize;
+    createLUT();
+}
+
+bool
+StitchingInput::readFrame(cv::Mat &outFrame)
+{
+    if (!readFrames()) {
+        return false;
+    }
+
+    std::vector<const uint8_t *> frames;
+    for (const auto &camera : m_Cameras) {
+        BOB_ASSERT(camera.frame.type() == CV_8UC3 && camera.frame.isContinuous());
+        frames.push_back(camera.frame.ptr<uint8_t>());
+    }
+
+    outFrame.create(m_OutputSize, CV_8UC3);
+    cv::parallel_for_(cv::Range(0, m_OutputSize.height), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            const auto lutRow = m_LUT.ptr<cv::Vec2i>(i);
+            auto outRow = outFrame.ptr<uint8_t>(i);
+            for (int j = 0; j < m_OutputSize.width; j++, outRow += 3) {
+                const auto &entry = lutRow[j];
+                if (entry[0] < 0) {
+                    std::fill_n(outRow, 3, 0);
+                } else {
+                    std::copy_n(frames[entry[0]] + 3 * entry[1], 3, outRow);
+                }
+            }
+        }
+    });
+
+    return true;
+}
+
+bool
+StitchingInput::readGreyscaleFrame(cv::Mat &outFrame)
+{
+    if (!readFrames()) {
+        return false;
+    }
+
+    std::vector<const uint8_t *> frames;
+    for (const auto &camera : m_Cameras) {
+        BOB_ASSERT(camera.frame.type() == CV_8UC3 && camera.frame.isContinuous());
+        frames.push_back(camera.frame.ptr<uint8_t>());
+    }
+
+    // Convert to greyscale as we go, rather than in a separate pass
+    outFrame.create(m_OutputSize, CV_8UC1);
+    cv::parallel_for_(cv::Range(0, m_OutputSize.height), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            const auto lutRow = m_LUT.ptr<cv::Vec2i>(i);
+            auto outRow = outFrame.ptr<uint8_t>(i);
+            for (int j = 0; j < m_OutputSize.width; j++) {
+                const auto &entry = lutRow[j];
+                if (entry[0] < 0) {
+                    outRow[j] = 0;
+                } else {
+                    const uint8_t *pixel = frames[entry[0]] + 3 * entry[1];
+                    outRow[j] = ImgProc::bgrToGrey(pixel[0], pixel[1], pixel[2]);
+                }
+            }
+        }
+    });
+
+    return true;
+}
+
+size_t
+StitchingInput::getNumDroppedFrames() const
+{
+    return m_NumDroppedFrames;
+}
+
+void
+StitchingInput::createLUT()
+{
+    BOB_ASSERT(m_OutputSize.width > 0 && m_OutputSize.height > 0);
+
+    std::vector<cv::Matx33d> rotations;
+    for (const auto &camera : m_Cameras) {
+        rotations.push_back(getCameraRotation(camera.calibration));
+    }
+
+    const double minElevation = toRadians(m_MinElevation);
+    const double elevationRange = toRadians(m_MaxElevation) - minElevation;
+    m_LUT.create(m_OutputSize, CV_32SC2);
+    cv::parallel_for_(cv::Range(0, m_OutputSize.height), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            // Rows go from the highest elevation to the lowest
+            const double elevation = minElevation + elevationRange * (1.0 - (i + 0.5) / m_OutputSize.height);
+            auto lutRow = m_LUT.ptr<cv::Vec2i>(i);
+            for (int j = 0; j < m_OutputSize.width; j++) {
+                // The centre column faces forwards and azimuth increases to the left
+                const double azimuth = CV_PI - 2.0 * CV_PI * (j + 0.5) / m_OutputSize.width;
+                const cv::Vec3d direction{ std::cos(elevation) * std::cos(azimuth),
+                                           std::cos(elevation) * std::sin(azimuth),
+                                           std::sin(elevation) };
+
+                lutRow[j] = { -1, 0 };
+                double bestFraction = std::numeric_limits<double>::infinity();
+                for (size_t c = 0; c < m_Cameras.size(); c++) {
+                    const auto &calibration = m_Cameras[c].calibration;
+
+                    // In the camera's frame, the optical axis is x
+                    const cv::Vec3d local = rotations[c].t() * direction;
+                    const double angle = std::acos(std::max(-1.0, std::min(1.0, local[0])));
+                    const double fraction = angle / toRadians(calibration.maxAngle);
+                    if (fraction > 1.0 || fraction >= bestFraction) {
+                        continue;
+                    }
+
+                    // Left and up in the world are left and up in the image
+                    const double norm = std::hypot(local[1], local[2]);
+                    const double radius = calibration.pixelsPerRadian * angle;
+                    const double u = calibration.centre.x - (norm > 0.0 ? radius * local[1] / norm : 0.0);
+                    const double v = calibration.centre.y - (norm > 0.0 ? radius * local[2] / norm : 0.0);
+                    const int x = cvRound(u), y = cvRound(v);
+                    if (x < 0 || x >= calibration.resolution.width ||
+                            y < 0 || y >= calibration.resolution.height) {
+                        continue;
+                    }
+
+                    bestFraction = fraction;
+                    lutRow[j] = { static_cast<int>(c), y * calibration.resolution.width + x };
+                }
+            }
+        }
+    });
+}
+
+bool
+StitchingInput::readFrames()
+{
+    // Keep only the latest frame from each camera
+    for (auto &camera : m_Cameras) {
+        if (camera.input->readFrame(camera.frame)) {
+            camera.arrivalTime = std::chrono::steady_clock::now();
+            camera.isNew = true;
+        }
+    }
+
+    if (!std::all_of(m_Cameras.cbegin(), m_Cameras.cend(), [](const auto &camera) { return camera.isNew; })) {
+        return false;
+    }
+
+    // If the frames are too far apart, drop the oldest and wait for its camera to catch up
+    const auto times = std::minmax_element(m_Cameras.begin(), m_Cameras.end(), [](const auto &a, const auto &b) {
+        return a.arrivalTime < b.arrivalTime;
+    });
+    const millisecond_t skew = times.second->arrivalTime - times.first->arrivalTime;
+    if (skew > m_MaxSkew) {
+        times.first->isNew = false;
+        m_NumDroppedFrames++;
+        return false;
+    }
+
+    for (auto &camera : m_Cameras) {
+        camera.isNew = false;
+    }
+    return true;
+}
+} // Video
+} // BoBRobotics
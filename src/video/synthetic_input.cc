@@ -0,0 +1,378 @@
+// BoB robotics includes
+#include "common/macros.h"
+#include "imgproc/grey.h"
+#include "imgproc/opencv_unwrap_360.h"
+#include "video/synthetic_input.h"
+
+// Standard C includes
+#include <cmath>
+
+// Standard C++ includes
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <utility>
+
+using namespace units::literals;
+
+namespace BoBRobotics {
+namespace Video {
+namespace {
+// The world is a square of this size, centred on the origin
+constexpr double WorldSize = 80.0;
+constexpr size_t NumLandmarks = 80;
+constexpr double CameraHeight = 1.0;
+
+template<typename PixelType>
+PixelType
+toPixel(const cv::Vec3b &colour);
+
+template<>
+cv::Vec3b
+toPixel<cv::Vec3b>(const cv::Vec3b &colour)
+{
+    return colour;
+}
+
+template<>
+uchar
+toPixel<uchar>(const cv::Vec3b &colour)
+{
+    // Greyscale frames match ones converted with cv::cvtColor
+    return ImgProc::bgrToGrey(colour[0], colour[1], colour[2]);
+}
+
+cv::Vec3b
+scale(const cv::Vec3b &colour, double factor)
+{
+    return { cv::saturate_cast<uchar>(colour[0] * factor),
+             cv::saturate_cast<uchar>(colour[1] * factor),
+             cv::saturate_cast<uchar>(colour[2] * factor) };
+}
+
+// Wrap an angle into [0, 360)
+double
+wrapDegrees(double angle)
+{
+    angle = std::fmod(angle, 360.0);
+    return angle < 0.0 ? angle + 360.0 : angle;
+}
+
+// A landmark as seen from the agent's current pose
+struct View
+{
+    double distance, centreColumn, halfWidth, top, bottom;
+    cv::Vec3b colour;
+};
+} // anonymous namespace
+
+SyntheticInput::SyntheticInput(const cv::Size &size, hertz_t frameRate,
+                               bool wrapped, uint32_t seed)
+  : m_FrameRate(frameRate)
+  , m_Wrapped(wrapped)
+  , m_Trajectory(circle())
+{
+    BOB_ASSERT(frameRate.value() > 0);
+
+    std::mt19937 rng{ seed };
+    std::uniform_real_distribution<double> position{ -WorldSize / 2, WorldSize / 2 };
+    std::uniform_real_distribution<double> radius{ 0.3, 2.5 };
+    std::uniform_real_distribution<double> height{ 1.0, 12.0 };
+    std::uniform_int_distribution<int> colour{ 40, 220 };
+    m_Landmarks.resize(NumLandmarks);
+    for (auto &landmark : m_Landmarks) {
+        landmark.x = meter_t{ position(rng) };
+        landmark.y = meter_t{ position(rng) };
+        landmark.radius = meter_t{ radius(rng) };
+        landmark.height = meter_t{ height(rng) };
+        landmark.colour = cv::Vec3b(static_cast<uchar>(colour(rng)),
+                                    static_cast<uchar>(colour(rng)),
+                                    static_cast<uchar>(colour(rng)));
+    }
+
+    // The hills are a few overlapping sine waves
+    std::uniform_real_distribution<double> phase{ 0.0, 2.0 * CV_PI };
+    double phases[5];
+    for (auto &p : phases) {
+        p = phase(rng);
+    }
+    m_Hills.resize(360);
+    for (int az = 0; az < 360; az++) {
+        double elevation = 3.0;
+        for (int k = 1; k <= 5; k++) {
+            elevation += 2.0 / k * std::sin(k * az * CV_PI / 180.0 + phases[k - 1]);
+        }
+        m_Hills[az] = degree_t{ std::max(0.5, elevation) };
+    }
+
+    setOutputSize(size);
+}
+
+std::string
+SyntheticInput::getCameraName() const
+{
+    return CameraName;
+}
+
+units::frequency::hertz_t
+SyntheticInput::getFrameRate() const
+{
+    return m_FrameRate;
+}
+
+cv::Size
+SyntheticInput::getOutputSize() const
+{
+    return m_Size;
+}
+
+bool
+SyntheticInput::needsUnwrapping() const
+{
+    return m_Wrapped;
+}
+
+void
+SyntheticInput::setOutputSize(const cv::Size &outSize)
+{
+    BOB_ASSERT(outSize.width > 0 && outSize.height > 0);
+    m_Size = outSize;
+    if (m_Wrapped) {
+        createWrapLUT();
+    } else {
+        m_PanoramaSize = m_Size;
+    }
+}
+
+bool
+SyntheticInput::readFrame(cv::Mat &outFrame)
+{
+    return readFrame(outFrame, false);
+}
+
+bool
+SyntheticInput::readGreyscaleFrame(cv::Mat &outFrame)
+{
+    return readFrame(outFrame, true);
+}
+
+void
+SyntheticInput::setTrajectory(Trajectory trajectory)
+{
+    m_Trajectory = std::move(trajectory);
+    m_FrameCount = 0;
+}
+
+void
+SyntheticInput::setRealTime(bool realTime)
+{
+    m_RealTime = realTime;
+}
+
+const SyntheticInput::Pose &
+SyntheticInput::getPose() const
+{
+    return m_Pose;
+}
+
+units::time::second_t
+SyntheticInput::getTime() const
+{
+    return m_FrameCount ? (m_FrameCount - 1) / m_FrameRate : 0_s;
+}
+
+void
+SyntheticInput::renderPanorama(const Pose &pose, cv::Mat &outFrame, bool greyscale) const
+{
+    if (greyscale) {
+        outFrame.create(m_PanoramaSize, CV_8UC1);
+        render<uchar>(pose, outFrame);
+    } else {
+        outFrame.create(m_PanoramaSize, CV_8UC3);
+        render<cv::Vec3b>(pose, outFrame);
+    }
+}
+
+SyntheticInput::Trajectory
+SyntheticInput::circle(meter_t radius, units::velocity::meters_per_second_t speed)
+{
+    BOB_ASSERT(radius.value() > 0);
+    return [radius, speed](second_t time) {
+        const units::angle::radian_t angle{ (speed * time / radius).value() };
+        return Pose{ radius * units::math::cos(angle), radius * units::math::sin(angle),
+                     degree_t{ angle } + 90_deg };
+    };
+}
+
+bool
+SyntheticInput::readFrame(cv::Mat &outFrame, bool greyscale)
+{
+    const second_t time = m_FrameCount / m_FrameRate;
+    if (m_RealTime) {
+        const auto now = std::chrono::steady_clock::now();
+        if (m_FrameCount == 0) {
+            m_StartTime = now;
+        }
+        const std::chrono::duration<double> sinceStart{ time.value() };
+        std::this_thread::sleep_until(m_StartTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(sinceStart));
+    }
+    m_Pose = m_Trajectory(time);
+    m_FrameCount++;
+
+    if (!m_Wrapped) {
+        renderPanorama(m_Pose, outFrame, greyscale);
+        return true;
+    }
+
+    // Look up each pixel of the camera image in the panorama
+    renderPanorama(m_Pose, m_Panorama, greyscale);
+    outFrame.create(m_Size, m_Panorama.type());
+    const size_t elemSize = m_Panorama.elemSize();
+    cv::parallel_for_(cv::Range(0, m_Size.height), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++) {
+            const int32_t *lut = &m_WrapLUT[y * m_Size.width];
+            uchar *out = outFrame.ptr(y);
+            for (int x = 0; x < m_Size.width; x++, out += elemSize) {
+                if (lut[x] < 0) {
+                    std::fill_n(out, elemSize, 0);
+                } else {
+                    std::copy_n(m_Panorama.data + lut[x] * elemSize, elemSize, out);
+                }
+            }
+        }
+    });
+    return true;
+}
+
+void
+SyntheticInput::createWrapLUT()
+{
+    // Make the panorama big enough that there's a pixel for each one round the outside of the mirror
+    const ImgProc::OpenCVUnwrap360 unwrapper{ m_Size, { 1, 1 }, CameraName };
+    const int inner = unwrapper.m_InnerPixel, outer = unwrapper.m_OuterPixel;
+    BOB_ASSERT(outer > inner);
+    m_PanoramaSize = { static_cast<int>(std::lround(2.0 * CV_PI * outer)), outer - inner };
+
+    // Invert the mapping OpenCVUnwrap360 uses
+    m_WrapLUT.resize(m_Size.area());
+    const double offset = unwrapper.m_OffsetAngle.value();
+    for (int y = 0; y < m_Size.height; y++) {
+        for (int x = 0; x < m_Size.width; x++) {
+            const double dx = x - unwrapper.m_CentrePixel.x;
+            const double dy = y - unwrapper.m_CentrePixel.y;
+            double rowFrac = (std::hypot(dx, dy) - inner) / (outer - inner);
+            if (unwrapper.m_Flip) {
+                rowFrac = 1.0 - rowFrac;
+            }
+            const auto row = static_cast<int>(std::lround(rowFrac * m_PanoramaSize.height));
+            const double theta = wrapDegrees(std::atan2(-dx, dy) * 180.0 / CV_PI - offset);
+            const int col = static_cast<int>(std::lround(theta / 360.0 * m_PanoramaSize.width)) % m_PanoramaSize.width;
+
+            const bool inside = rowFrac >= 0.0 && rowFrac <= 1.0 && row < m_PanoramaSize.height;
+            m_WrapLUT[y * m_Size.width + x] = inside ? row * m_PanoramaSize.width + col : -1;
+        }
+    }
+}
+
+template<typename PixelType>
+void
+SyntheticInput::render(const Pose &pose, cv::Mat &panorama) const
+{
+    const int width = panorama.cols, height = panorama.rows;
+    const double degreesPerPixel = 360.0 / width;
+    const double heading = pose.yaw().value();
+
+    // Elevation of the centre of each row, with the horizon in the middle of the image
+    const auto rowElevation = [&](int row) {
+        return (height / 2.0 - row - 0.5) * degreesPerPixel;
+    };
+    const auto elevationRow = [&](double elevation) {
+        return static_cast<int>(std::lround(height / 2.0 - elevation / degreesPerPixel));
+    };
+
+    // Sky gets paler towards the horizon and the ground darker towards our feet
+    std::vector<PixelType> background(height);
+    for (int row = 0; row < height; row++) {
+        const double elevation = rowElevation(row);
+        const double t = std::min(1.0, std::abs(elevation) / 90.0);
+        background[row] = elevation >= 0.0 ? toPixel<PixelType>(scale({ 235, 190, 150 }, 1.0 - 0.3 * t))
+                                           : toPixel<PixelType>(scale({ 70, 100, 120 }, 1.0 - 0.5 * t));
+    }
+
+    // Work out where each landmark is, furthest first, so nearer ones are drawn over them
+    std::vector<View> views;
+    views.reserve(m_Landmarks.size());
+    for (const auto &landmark : m_Landmarks) {
+        const double dx = (landmark.x - pose.x()).value();
+        const double dy = (landmark.y - pose.y()).value();
+        const double distance = std::hypot(dx, dy);
+        const double radius = landmark.radius.value();
+
+        // We're inside it, so can't see it
+        if (distance <= radius) {
+            continue;
+        }
+
+        View view;
+        view.distance = distance;
+        // Bearing relative to our heading, in [-180, 180), anticlockwise (i.e. leftwards) being positive
+        const double bearing = wrapDegrees(std::atan2(dy, dx) * 180.0 / CV_PI - heading + 180.0) - 180.0;
+        view.centreColumn = width / 2.0 - bearing / degreesPerPixel;
+        view.halfWidth = std::asin(radius / distance) * 180.0 / CV_PI / degreesPerPixel;
+        view.top = std::atan((landmark.height.value() - CameraHeight) / distance) * 180.0 / CV_PI;
+        view.bottom = std::atan(-CameraHeight / distance) * 180.0 / CV_PI;
+        view.colour = landmark.colour;
+        views.push_back(view);
+    }
+    std::sort(views.begin(), views.end(), [](const View &a, const View &b) {
+        return a.distance > b.distance;
+    });
+
+    // Render vertical strips of the panorama in parallel
+    cv::parallel_for_(cv::Range(0, width), [&](const cv::Range &range) {
+        for (int row = 0; row < height; row++) {
+            std::fill(panorama.ptr<PixelType>(row) + range.start,
+                      panorama.ptr<PixelType>(row) + range.end,
+                      background[row]);
+        }
+
+        // Distant hills only move as we turn
+        for (int col = range.start; col < range.end; col++) {
+            const double azimuth = wrapDegrees(heading + (width / 2.0 - col - 0.5) * degreesPerPixel);
+            const int az0 = static_cast<int>(azimuth) % 360;
+            const double frac = azimuth - std::floor(azimuth);
+            const double hill = (1.0 - frac) * m_Hills[az0].value() + frac * m_Hills[(az0 + 1) % 360].value();
+            const int top = std::max(0, elevationRow(hill));
+            for (int row = top; row < height / 2; row++) {
+                const double shade = 0.8 + 0.2 * (row - top) / (height / 2.0 - top);
+                panorama.at<PixelType>(row, col) = toPixel<PixelType>(scale({ 110, 140, 120 }, shade));
+            }
+        }
+
+        // Landmarks are shaded like cylinders lit from the front
+        for (const auto &view : views) {
+            const int top = std::max(0, elevationRow(view.top));
+            const int bottom = std::min(height, elevationRow(view.bottom) + 1);
+            const int first = static_cast<int>(std::floor(view.centreColumn - view.halfWidth));
+            const int last = static_cast<int>(std::floor(view.centreColumn + view.halfWidth));
+            for (int c = first; c <= last; c++) {
+                // The landmark may straddle the edges of the panorama
+                const int col = (c % width + width) % width;
+                if (col < range.start || col >= range.end) {
+                    continue;
+                }
+
+                const double u = (c + 0.5 - view.centreColumn) / std::max(view.halfWidth, 0.5);
+                if (std::abs(u) > 1.0) {
+                    continue;
+                }
+                const auto pixel = toPixel<PixelType>(scale(view.colour, 0.5 + 0.5 * std::sqrt(1.0 - u * u)));
+                for (int row = top; row < bottom; row++) {
+                    panorama.at<PixelType>(row, col) = pixel;
+                }
+            }
+        }
+    });
+}
+} // Video
+} // BoBRobotics
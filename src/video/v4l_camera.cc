@@ -4,10 +4,15 @@
 #include "plog/Log.h"
 
 // Standard C includes
+#include <cerrno>
 #include <cstring>
 
+// Standard C++ includes
+#include <utility>
+
 // POSIX includes
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -15,61 +20,206 @@
 namespace BoBRobotics {
 namespace Video {
 
+//------------------------------------------------------------------------
+// BoBRobotics::Video::Video4LinuxDevice
+//------------------------------------------------------------------------
+Video4LinuxDevice::~Video4LinuxDevice()
+{}
+
+//------------------------------------------------------------------------
+// BoBRobotics::Video::Video4LinuxFileDevice
+//------------------------------------------------------------------------
+Video4LinuxFileDevice::Video4LinuxFileDevice(int fd)
+  : m_FD(fd)
+{}
+
+Video4LinuxFileDevice::~Video4LinuxFileDevice()
+{
+    ::close(m_FD);
+}
+
+int
+Video4LinuxFileDevice::ioctl(unsigned long request, void *arg)
+{
+    // Retry if we're interrupted by a signal
+    int ret;
+    do {
+        ret = ::ioctl(m_FD, request, arg);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+void *
+Video4LinuxFileDevice::mmap(size_t length, off_t offset)
+{
+    return ::mmap(nullptr,
+                  length,                 // Length of buffer returned from V4L
+                  PROT_READ | PROT_WRITE, // Buffer is for RW access
+                  MAP_SHARED,             // Buffer is shared with other processes i.e.
+                                          // kernel driver
+                  m_FD,                   // Camera device to map within
+                  offset);                // Offset into device 'file'
+                                          // where buffer should be mapped
+}
+
+int
+Video4LinuxFileDevice::munmap(void *address, size_t length)
+{
+    return ::munmap(address, length);
+}
+
+int
+Video4LinuxFileDevice::poll(int timeoutMs)
+{
+    pollfd fds{ m_FD, POLLIN, 0 };
+    int ret;
+    do {
+        ret = ::poll(&fds, 1, timeoutMs);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+//------------------------------------------------------------------------
+// BoBRobotics::Video::Video4LinuxCamera::Frame
+//------------------------------------------------------------------------
+Video4LinuxCamera::Frame::Frame(Video4LinuxCamera &camera, const v4l2_buffer &bufferInfo, const void *data)
+  : m_Camera(&camera)
+  , m_BufferInfo(bufferInfo)
+  , m_Data(data)
+{}
+
+Video4LinuxCamera::Frame::Frame(Frame &&other) noexcept
+  : m_Camera(other.m_Camera)
+  , m_BufferInfo(other.m_BufferInfo)
+  , m_Data(other.m_Data)
+{
+    other.m_Camera = nullptr;
+    other.m_Data = nullptr;
+}
+
+Video4LinuxCamera::Frame &
+Video4LinuxCamera::Frame::operator=(Frame &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        std::swap(m_Camera, other.m_Camera);
+        std::swap(m_BufferInfo, other.m_BufferInfo);
+        std::swap(m_Data, other.m_Data);
+    }
+    return *this;
+}
+
+Video4LinuxCamera::Frame::~Frame()
+{
+    release();
+}
+
+Video4LinuxCamera::Frame::operator bool() const
+{
+    return m_Camera != nullptr;
+}
+
+void
+Video4LinuxCamera::Frame::release()
+{
+    if (!m_Camera) {
+        return;
+    }
+
+    // We can't throw from destructors, so just warn if we can't requeue the buffer
+    try {
+        m_Camera->enqueue(m_BufferInfo);
+    } catch (Error &e) {
+        LOG_WARNING << e.what();
+    }
+    m_Camera = nullptr;
+    m_Data = nullptr;
+}
+
+const void *
+Video4LinuxCamera::Frame::getData() const
+{
+    return m_Data;
+}
+
+uint32_t
+Video4LinuxCamera::Frame::getSize() const
+{
+    return m_BufferInfo.bytesused;
+}
+
+uint32_t
+Video4LinuxCamera::Frame::getSequence() const
+{
+    return m_BufferInfo.sequence;
+}
+
+std::chrono::microseconds
+Video4LinuxCamera::Frame::getTimestamp() const
+{
+    return std::chrono::seconds(m_BufferInfo.timestamp.tv_sec) +
+           std::chrono::microseconds(m_BufferInfo.timestamp.tv_usec);
+}
+
+//------------------------------------------------------------------------
+// BoBRobotics::Video::Video4LinuxCamera
+//------------------------------------------------------------------------
 Video4LinuxCamera::Error::Error(const std::string &msg)
   : std::runtime_error(msg + " (" + strerror(errno) + ")")
 {}
 
 Video4LinuxCamera::Video4LinuxCamera()
-  : m_Camera(-1)
-  , m_Frame(0)
-  , m_Buffer{ nullptr, nullptr }
 {}
 
 Video4LinuxCamera::Video4LinuxCamera(const std::string &device,
                                      unsigned int width,
                                      unsigned int height,
-                                     uint32_t pixelFormat)
+                                     uint32_t pixelFormat,
+                                     unsigned int numBuffers)
   : Video4LinuxCamera()
 {
-    open(device, width, height, pixelFormat);
+    open(device, width, height, pixelFormat, numBuffers);
 }
 
 Video4LinuxCamera::~Video4LinuxCamera()
 {
-    if (m_Camera >= 0) {
-        // Stop video streaming
-        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        if (ioctl(m_Camera, VIDIOC_STREAMOFF, &type) < 0) {
-            LOG_WARNING << "Could not stop streaming (" << strerror(errno)
-                        << ")";
-        }
-
-        // munmap buffers
-        if ((m_Buffer[0] && munmap(m_Buffer[0], m_BufferInfo[0].length) == -1) ||
-            (m_Buffer[1] && munmap(m_Buffer[1], m_BufferInfo[1].length) == -1)) {
-            LOG_WARNING << "Could not free buffers ("
-                        << strerror(errno) << ")";
-        }
-
-        // Close camera
-        close(m_Camera);
-    }
+    close();
 }
 
 void
 Video4LinuxCamera::open(const std::string &device,
                         unsigned int width,
                         unsigned int height,
-                        uint32_t pixelFormat)
+                        uint32_t pixelFormat,
+                        unsigned int numBuffers)
 {
     // Open camera
-    if ((m_Camera = ::open(device.c_str(), O_RDWR)) < 0) {
+    const int fd = ::open(device.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
         throw Error("Could not open camera");
     }
 
+    open(std::make_unique<Video4LinuxFileDevice>(fd), width, height, pixelFormat, numBuffers);
+}
+
+void
+Video4LinuxCamera::open(std::unique_ptr<Video4LinuxDevice> device,
+                        unsigned int width,
+                        unsigned int height,
+                        uint32_t pixelFormat,
+                        unsigned int numBuffers)
+{
+    if (numBuffers < 2) {
+        throw std::invalid_argument("At least two buffers are needed");
+    }
+
+    close();
+    m_Device = std::move(device);
+
     // Query capabilities
     v4l2_capability cap;
-    if (ioctl(m_Camera, VIDIOC_QUERYCAP, &cap) < 0) {
+    memset(&cap, 0, sizeof(v4l2_capability));
+    if (m_Device->ioctl(VIDIOC_QUERYCAP, &cap) < 0) {
         throw Error("Could not query capabilities");
     }
 
@@ -92,23 +242,33 @@ Video4LinuxCamera::open(const std::string &device,
     format.fmt.pix.height = height;
 
     // Set format
-    if (ioctl(m_Camera, VIDIOC_S_FMT, &format) < 0) {
+    if (m_Device->ioctl(VIDIOC_S_FMT, &format) < 0) {
         throw Error("Cannot set format");
     }
 
-    // Fill buffer request structure to request two buffers
+    // Fill buffer request structure to request buffers
     v4l2_requestbuffers bufferRequest;
     memset(&bufferRequest, 0, sizeof(v4l2_requestbuffers));
     bufferRequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     bufferRequest.memory = V4L2_MEMORY_MMAP;
-    bufferRequest.count = 2;
+    bufferRequest.count = numBuffers;
 
-    if (ioctl(m_Camera, VIDIOC_REQBUFS, &bufferRequest) < 0) {
+    if (m_Device->ioctl(VIDIOC_REQBUFS, &bufferRequest) < 0) {
         throw Error("Cannot request buffers");
     }
 
+    // The driver may give us a different number of buffers
+    if (bufferRequest.count < 2) {
+        throw Error("Not enough buffer memory");
+    }
+    if (bufferRequest.count != numBuffers) {
+        LOG_WARNING << "Requested " << numBuffers << " buffers but got " << bufferRequest.count;
+    }
+
     // Loop through buffers
-    for (unsigned int i = 0; i < 2; i++) {
+    m_Buffers.assign(bufferRequest.count, nullptr);
+    m_BufferInfo.resize(bufferRequest.count);
+    for (unsigned int i = 0; i < bufferRequest.count; i++) {
         // Fill buffer structure
         memset(&m_BufferInfo[i], 0, sizeof(v4l2_buffer));
         m_BufferInfo[i].type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -116,44 +276,36 @@ Video4LinuxCamera::open(const std::string &device,
         m_BufferInfo[i].index = i;
 
         // Query buffers
-        if (ioctl(m_Camera, VIDIOC_QUERYBUF, &m_BufferInfo[i]) < 0) {
+        if (m_Device->ioctl(VIDIOC_QUERYBUF, &m_BufferInfo[i]) < 0) {
             throw Error("Cannot query buffer");
         }
 
         LOG_DEBUG << "Queried " << m_BufferInfo[i].length << " byte buffer";
 
         // Map memory
-        m_Buffer[i] = mmap(
-                nullptr,
-                m_BufferInfo[i]
-                        .length,           // Length of buffer returned from V4L
-                PROT_READ | PROT_WRITE,    // Buffer is for RW access
-                MAP_SHARED,                // Buffer is shared with other processes i.e.
-                                           // kernel driver
-                m_Camera,                  // Camera device to map within
-                m_BufferInfo[i].m.offset); // Offset into device 'file'
-                                           // where buffer should be mapped
-        if (m_Buffer[i] == MAP_FAILED) {   // NOLINT
+        void *buffer = m_Device->mmap(m_BufferInfo[i].length, m_BufferInfo[i].m.offset);
+        if (buffer == MAP_FAILED) { // NOLINT
             throw Error("Cannot mmap buffer");
         }
+        m_Buffers[i] = buffer;
 
         // Zero buffer
-        memset(m_Buffer[i], 0, m_BufferInfo[i].length);
+        memset(m_Buffers[i], 0, m_BufferInfo[i].length);
+    }
+
+    // Enqueue all our buffers onto the device's incoming queue
+    for (const auto &bufferInfo : m_BufferInfo) {
+        enqueue(bufferInfo);
     }
 
     // Start video streaming
     int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (ioctl(m_Camera, VIDIOC_STREAMON, &type) < 0) {
+    if (m_Device->ioctl(VIDIOC_STREAMON, &type) < 0) {
         throw Error("Cannot start streaming");
     }
 
-    // Enqueue our buffer onto the device's incoming queue
-    if (ioctl(m_Camera, VIDIOC_QBUF, &m_BufferInfo[0]) < 0) {
-        throw Error("Cannot enqueue buffer");
-    }
-
-    // Ensure that frame is zeroed
-    m_Frame = 0;
+    m_HasSequence = false;
+    m_NumDroppedFrames = 0;
 }
 
 void
@@ -164,7 +316,7 @@ Video4LinuxCamera::enumerateControls(const std::function<void(const v4l2_queryct
     memset(&queryControl, 0, sizeof(v4l2_queryctrl));
     queryControl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
 
-    while (ioctl(m_Camera, VIDIOC_QUERYCTRL, &queryControl) == 0) {
+    while (m_Device->ioctl(VIDIOC_QUERYCTRL, &queryControl) == 0) {
         // If this control isn't disabled
         if (!(queryControl.flags & V4L2_CTRL_FLAG_DISABLED)) {
             processControl(queryControl);
@@ -184,32 +336,73 @@ Video4LinuxCamera::queryControl(uint32_t id, v4l2_queryctrl &queryControl)
     memset(&queryControl, 0, sizeof(v4l2_queryctrl));
     queryControl.id = id;
 
-    if (ioctl(m_Camera, VIDIOC_QUERYCTRL, &queryControl) < 0) {
+    if (m_Device->ioctl(VIDIOC_QUERYCTRL, &queryControl) < 0) {
         throw Error("Cannot query controls");
     }
 }
 
-uint32_t
-Video4LinuxCamera::capture(void *&buffer)
+Video4LinuxCamera::Frame
+Video4LinuxCamera::captureFrame(int timeoutMs)
 {
-    // Dequeue this frame's buffer from device's outgoing queue
-    if (ioctl(m_Camera, VIDIOC_DQBUF, &m_BufferInfo[m_Frame]) < 0) {
-        throw Error("Cannot dequeue buffer");
+    // If we're holding every buffer, the driver has nowhere to put frames
+    if (m_NumQueued == 0) {
+        errno = ENOBUFS;
+        throw Error("All buffers are in use");
     }
 
-    // Pass out buffer data and length
-    buffer = m_Buffer[m_Frame];
-    uint32_t sizebytes = m_BufferInfo[m_Frame].length;
+    // Wait for a buffer to be filled
+    const int ret = m_Device->poll(timeoutMs);
+    if (ret < 0) {
+        throw Error("Cannot poll camera");
+    }
+    if (ret == 0) {
+        return {};
+    }
 
-    // Increment frame number
-    m_Frame = (m_Frame + 1) % 2;
+    // Dequeue the oldest filled buffer from device's outgoing queue
+    v4l2_buffer bufferInfo;
+    memset(&bufferInfo, 0, sizeof(v4l2_buffer));
+    bufferInfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    bufferInfo.memory = V4L2_MEMORY_MMAP;
+    if (m_Device->ioctl(VIDIOC_DQBUF, &bufferInfo) < 0) {
+        // Poll can wake up spuriously
+        if (errno == EAGAIN) {
+            return {};
+        }
+        throw Error("Cannot dequeue buffer");
+    }
+    m_NumQueued--;
 
-    // Enqueue next buffer onto the device's incoming queue
-    if (ioctl(m_Camera, VIDIOC_QBUF, &m_BufferInfo[m_Frame]) < 0) {
-        throw Error("Cannot enqueue buffer");
+    // Check whether the driver skipped any frames
+    if (m_HasSequence) {
+        m_NumDroppedFrames += static_cast<uint32_t>(bufferInfo.sequence - m_LastSequence - 1);
     }
+    m_HasSequence = true;
+    m_LastSequence = bufferInfo.sequence;
+
+    return Frame{ *this, bufferInfo, m_Buffers[bufferInfo.index] };
+}
+
+uint32_t
+Video4LinuxCamera::capture(void *&buffer)
+{
+    // Give back the previous frame's buffer, then wait for the next frame
+    m_CaptureFrame.release();
+    do {
+        // We can still wake up without a frame, if poll() does so spuriously
+        m_CaptureFrame = captureFrame();
+    } while (!m_CaptureFrame);
 
-    return sizebytes;
+    // Pass out buffer data and length
+    buffer = const_cast<void *>(m_CaptureFrame.getData());
+    return m_CaptureFrame.getSize();
+}
+
+void
+Video4LinuxCamera::flush()
+{
+    m_CaptureFrame.release();
+    while (m_NumQueued > 0 && captureFrame(0)) {}
 }
 
 int32_t
@@ -221,7 +414,7 @@ Video4LinuxCamera::getControlValue(uint32_t id) const
     control.id = id;
 
     // Get control value
-    if (ioctl(m_Camera, VIDIOC_G_CTRL, &control) < 0) {
+    if (m_Device->ioctl(VIDIOC_G_CTRL, &control) < 0) {
         throw Error("Cannot get control value");
     } else {
         return control.value;
@@ -238,11 +431,65 @@ Video4LinuxCamera::setControlValue(uint32_t id, int32_t value)
     control.value = value;
 
     // Get control value
-    if (ioctl(m_Camera, VIDIOC_S_CTRL, &control) < 0) {
+    if (m_Device->ioctl(VIDIOC_S_CTRL, &control) < 0) {
         throw Error("Cannot set control value");
     }
 }
 
+unsigned int
+Video4LinuxCamera::getNumBuffers() const
+{
+    return static_cast<unsigned int>(m_Buffers.size());
+}
+
+uint64_t
+Video4LinuxCamera::getNumDroppedFrames() const
+{
+    return m_NumDroppedFrames;
+}
+
+void
+Video4LinuxCamera::close()
+{
+    if (!m_Device) {
+        return;
+    }
+
+    m_CaptureFrame.release();
+
+    // Stop video streaming
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (m_Device->ioctl(VIDIOC_STREAMOFF, &type) < 0) {
+        LOG_WARNING << "Could not stop streaming (" << strerror(errno)
+                    << ")";
+    }
+
+    // munmap buffers
+    for (size_t i = 0; i < m_Buffers.size(); i++) {
+        if (m_Buffers[i] && m_Device->munmap(m_Buffers[i], m_BufferInfo[i].length) == -1) {
+            LOG_WARNING << "Could not free buffers ("
+                        << strerror(errno) << ")";
+        }
+    }
+    m_Buffers.clear();
+    m_BufferInfo.clear();
+    m_NumQueued = 0;
+
+    // Close camera
+    m_Device.reset();
+}
+
+void
+Video4LinuxCamera::enqueue(const v4l2_buffer &bufferInfo)
+{
+    // Enqueue buffer onto the device's incoming queue
+    v4l2_buffer info = bufferInfo;
+    if (m_Device->ioctl(VIDIOC_QBUF, &info) < 0) {
+        throw Error("Cannot enqueue buffer");
+    }
+    m_NumQueued++;
+}
+
 } // Video
 } // BoBRobotics
 #endif // linux
@@ -0,0 +1,75 @@
+// BoB robotics includes
+#include "imgproc/bee_eye.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C++ includes
+#include <vector>
+
+using namespace BoBRobotics::ImgProc;
+
+namespace {
+// Each entry is the input pixel (x, y) and the output pixel (column, row) for the left eye
+const float EyeData[][4] = { { 1.5f, 2.0f, 0.0f, 0.0f },
+                             { 5.0f, 3.0f, 10.0f, 1.0f },
+                             { 50.0f, 3.0f, 20.0f, 2.0f } }; // Outside the image
+const int EyeSize[2] = { 140, 100 };
+const int ImageSize[2] = { 40, 30 };
+
+cv::Mat
+makeImage(int seed)
+{
+    cv::Mat image(ImageSize[1], ImageSize[0], CV_8UC3);
+    cv::randu(image, cv::Scalar::all(seed), cv::Scalar::all(255));
+    return image;
+}
+} // anonymous namespace
+
+TEST(BeeEye, getEyeView)
+{
+    BeeEye::Map map{ EyeData, EyeSize, ImageSize, /*useMask=*/false };
+    const auto image = makeImage(0);
+    cv::Mat out;
+    map.getEyeView(image, out);
+    ASSERT_EQ(out.size(), map.getEyeSize());
+    ASSERT_EQ(out.type(), CV_8UC3);
+
+    // Left eye
+    EXPECT_EQ(out.at<cv::Vec3b>(0, 15), image.at<cv::Vec3b>(2, 1));
+    EXPECT_EQ(out.at<cv::Vec3b>(1, 25), image.at<cv::Vec3b>(3, 5));
+    EXPECT_EQ(out.at<cv::Vec3b>(2, 35), cv::Vec3b(0, 0, 0));
+
+    // Right eye is mirrored (and its columns wrap onto the next row)
+    EXPECT_EQ(out.at<cv::Vec3b>(1, 124), image.at<cv::Vec3b>(2, 39));
+    EXPECT_EQ(out.at<cv::Vec3b>(2, 114), image.at<cv::Vec3b>(3, 35));
+
+    // Everything else is black
+    cv::Mat rest = out.clone();
+    for (const auto &pixel : { cv::Point(15, 0), cv::Point(25, 1), cv::Point(124, 1), cv::Point(114, 2) }) {
+        rest.at<cv::Vec3b>(pixel) = cv::Vec3b(0, 0, 0);
+    }
+    EXPECT_EQ(cv::countNonZero(rest.reshape(1)), 0);
+
+    // The output buffer is reused
+    const auto data = out.data;
+    map.getEyeView(makeImage(1), out);
+    EXPECT_EQ(out.data, data);
+}
+
+TEST(BeeEye, getEyeViews)
+{
+    BeeEye::Map map{ EyeData, EyeSize, ImageSize, /*useMask=*/false };
+    std::vector<cv::Mat> images, views;
+    for (int i = 0; i < 10; i++) {
+        images.push_back(makeImage(i));
+    }
+    map.getEyeViews(images, views);
+    ASSERT_EQ(views.size(), images.size());
+
+    cv::Mat expected;
+    for (size_t i = 0; i < images.size(); i++) {
+        map.getEyeView(images[i], expected);
+        EXPECT_EQ(cv::norm(views[i], expected, cv::NORM_INF), 0.0);
+    }
+}
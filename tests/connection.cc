@@ -0,0 +1,122 @@
+// BoB robotics includes
+#include "net/client.h"
+#include "net/server.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C includes
+#include <cstring>
+
+// Standard C++ includes
+#include <array>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace BoBRobotics::Net;
+
+namespace {
+constexpr uint16_t TestPort = 20483;
+
+struct TestPayload
+{
+    double x;
+    uint32_t count;
+};
+
+// Lets tests write to the socket directly
+class RawClient
+  : public Client
+{
+public:
+    using Client::Client;
+    using Client::getSocket;
+};
+} // anonymous namespace
+
+TEST(Connection, BinaryProtocol)
+{
+    Server server{ TestPort };
+    Client client{ "127.0.0.1", TestPort, true };
+    const auto connection = server.waitForConnection();
+
+    // Client asks to switch when it reads HEY and server replies
+    EXPECT_EQ(client.readNextCommand(), "HEY");
+    EXPECT_TRUE(client.isBinary());
+    EXPECT_EQ(connection->readNextCommand(), "BIN");
+    EXPECT_TRUE(connection->isBinary());
+    EXPECT_EQ(client.readNextCommand(), "BIN");
+
+    // Messages
+    TestPayload received{};
+    connection->setMessageHandler(FirstUserMessage, [&](Connection &, const Message &message) {
+        received = message.get<TestPayload>();
+    });
+    client.getSocketWriter().sendMessage(FirstUserMessage, TestPayload{ 1.5, 42 });
+    EXPECT_EQ(connection->readNextCommand(), "");
+    EXPECT_EQ(received.x, 1.5);
+    EXPECT_EQ(received.count, 42U);
+
+    // Text commands, followed by more data than fits in the receive buffer
+    std::vector<uint8_t> data(Connection::DefaultBufferSize * 3), readData(data.size());
+    std::iota(data.begin(), data.end(), 0);
+    connection->setCommandHandler("DAT", [&](Connection &connection, const Command &command) {
+        ASSERT_EQ(command.size(), 2U);
+        ASSERT_EQ(std::stoul(command[1]), readData.size());
+        connection.read(readData.data(), readData.size());
+    });
+    {
+        auto socket = client.getSocketWriter();
+        socket.send("DAT " + std::to_string(data.size()) + "\n");
+        socket.send(data.data(), data.size());
+    }
+    EXPECT_EQ(connection->readNextCommand(), "DAT");
+    EXPECT_EQ(readData, data);
+
+    // Unhandled message types are errors, as with commands
+    client.getSocketWriter().sendMessage(FirstUserMessage + 1, std::array<float, 2>{ { 0.f, 1.f } });
+    EXPECT_THROW(connection->readNextCommand(), BadCommandError);
+}
+
+TEST(Connection, TextProtocol)
+{
+    Server server{ TestPort };
+    Client client{ "127.0.0.1", TestPort };
+    const auto connection = server.waitForConnection();
+
+    // Clients which don't ask for the binary protocol keep using text
+    EXPECT_EQ(client.readNextCommand(), "HEY");
+    EXPECT_FALSE(client.isBinary());
+    connection->setCommandHandler("TST", [](Connection &, const Command &command) {
+        EXPECT_EQ(command, Command({ "TST", "1", "2" }));
+    });
+    client.getSocketWriter().send("TST 1 2\n");
+    EXPECT_EQ(connection->readNextCommand(), "TST");
+    EXPECT_FALSE(connection->isBinary());
+    EXPECT_THROW(client.getSocketWriter().sendMessage(FirstUserMessage, 1), std::runtime_error);
+}
+
+TEST(Connection, MessageTooLarge)
+{
+    Server server{ TestPort };
+    RawClient client{ "127.0.0.1", TestPort, true };
+    const auto connection = server.waitForConnection();
+    EXPECT_EQ(client.readNextCommand(), "HEY");
+    EXPECT_EQ(connection->readNextCommand(), "BIN");
+    EXPECT_EQ(client.readNextCommand(), "BIN");
+
+    const std::vector<uint8_t> data(Connection::MaxMessageSize + 1);
+    EXPECT_THROW(client.getSocketWriter().sendMessage(FirstUserMessage, data.data(), data.size()),
+                 std::runtime_error);
+
+    // Only the header is sent, so this fails without reading (or allocating) the payload
+    connection->setMessageHandler(FirstUserMessage, [](Connection &, const Message &) {});
+    const uint32_t length = Connection::MaxMessageSize + 1;
+    std::array<uint8_t, sizeof(length) + 1> header;
+    std::memcpy(header.data(), &length, sizeof(length));
+    header.back() = FirstUserMessage;
+    client.getSocket().send(header.data(), header.size());
+    EXPECT_THROW(connection->readNextCommand(), BadCommandError);
+}
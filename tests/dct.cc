@@ -2,15 +2,27 @@
 
 // BoB robotics includes
 #include "imgproc/dct_hash.h"
+#include "imgproc/roll.h"
 
 // Google Test
 #include <gtest/gtest.h>
 
 // Standard C++ includes
+#include <algorithm>
 #include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
 
 using namespace BoBRobotics::ImgProc::DCTHash;
 
+/*
+ * computeHashes() and computeRotatedHashes() compute the DCT in double
+ * precision rather than with cv::dct(), so coefficients very close to the
+ * median can be rounded onto the other side of it.
+ */
+constexpr int MaxRoundingDistance = 1;
+
 TEST(DCT, computeHash)
 {
     cv::Mat scratch;
@@ -30,3 +42,95 @@ TEST(DCT, distance)
     EXPECT_EQ(distance(0, 1), 1);
     EXPECT_EQ(distance(std::numeric_limits<uint64_t>::max(), 0), 64);
 }
+
+TEST(DCT, computeHashes)
+{
+    std::vector<cv::Mat> floatImages;
+    std::vector<std::bitset<64>> expected;
+    for (const auto &image : TestImages) {
+        floatImages.emplace_back();
+        image.convertTo(floatImages.back(), CV_32FC1, 1.0 / 255);
+        expected.push_back(computeHash(floatImages.back()));
+    }
+
+    const auto floatHashes = computeHashes(floatImages);
+    const auto byteHashes = computeHashes(std::vector<cv::Mat>(TestImages.begin(), TestImages.end()));
+    ASSERT_EQ(floatHashes.size(), expected.size());
+    ASSERT_EQ(byteHashes.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_LE(distance(floatHashes[i], expected[i]), MaxRoundingDistance);
+        EXPECT_LE(distance(byteHashes[i], expected[i]), MaxRoundingDistance);
+    }
+}
+
+TEST(DCT, computeRotatedHashes)
+{
+    constexpr size_t NumRotations = 9;
+    const cv::Mat &image = TestImages[0];
+    cv::Mat rolled, floatImage;
+
+    const auto hashes = computeRotatedHashes(image, NumRotations);
+    ASSERT_EQ(hashes.size(), NumRotations);
+    for (size_t i = 0; i < NumRotations; i++) {
+        // roll() only works on 8-bit images, so convert afterwards
+        BoBRobotics::ImgProc::roll(image, rolled, i * image.cols / NumRotations);
+        rolled.convertTo(floatImage, CV_32FC1, 1.0 / 255);
+        EXPECT_LE(distance(hashes[i], computeHash(floatImage)), MaxRoundingDistance);
+    }
+
+    const auto best = rotatedDistance(hashes, hashes[3]);
+    EXPECT_EQ(best.first, 0);
+    EXPECT_EQ(best.second, 3U);
+}
+
+TEST(DCT, HashIndex)
+{
+    // Random hashes, plus some which are only a few bits away from others
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint64_t> hashDist;
+    std::uniform_int_distribution<int> bitDist(0, 63);
+    std::vector<std::bitset<64>> hashes;
+    for (int i = 0; i < 20000; i++) {
+        if (i % 4 == 3) {
+            auto hash = hashes[i - 1];
+            for (int j = 0; j < i % 7; j++) {
+                hash.flip(bitDist(rng));
+            }
+            hashes.push_back(hash);
+        } else {
+            hashes.push_back(hashDist(rng));
+        }
+    }
+    const HashIndex index{ hashes };
+    ASSERT_EQ(index.size(), hashes.size());
+
+    for (int i = 0; i < 20; i++) {
+        auto query = hashes[i * 97];
+        query.flip(bitDist(rng));
+        if (i % 2) {
+            query = hashDist(rng);
+        }
+
+        std::vector<std::pair<size_t, int>> expected;
+        for (size_t j = 0; j < hashes.size(); j++) {
+            expected.emplace_back(j, distance(hashes[j], query));
+        }
+        std::sort(expected.begin(), expected.end(), [](const auto &a, const auto &b) {
+            return std::make_pair(a.second, a.first) < std::make_pair(b.second, b.first);
+        });
+
+        const auto nearest = index.nearest(query, 5);
+        ASSERT_EQ(nearest.size(), 5U);
+        for (size_t j = 0; j < nearest.size(); j++) {
+            EXPECT_EQ(nearest[j].second, expected[j].second);
+            EXPECT_EQ(nearest[j].second, distance(hashes[nearest[j].first], query));
+        }
+
+        const int maxDistance = 10;
+        const auto end = std::find_if(expected.begin(), expected.end(), [&](const auto &result) {
+            return result.second > maxDistance;
+        });
+        const std::vector<std::pair<size_t, int>> within(expected.begin(), end);
+        EXPECT_EQ(index.withinDistance(query, maxDistance), within);
+    }
+}
@@ -0,0 +1,72 @@
+#include "common.h"
+
+// BoB robotics includes
+#include "video/frame_capture.h"
+
+// Standard C++ includes
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace BoBRobotics::Video;
+using namespace std::literals;
+
+namespace {
+// Gives frames filled with an increasing counter, one every millisecond
+class CountingInput : public Input
+{
+public:
+    virtual cv::Size getOutputSize() const override { return { 16, 8 }; }
+
+    virtual bool readFrame(cv::Mat &outFrame) override
+    {
+        std::this_thread::sleep_for(1ms);
+        outFrame.create(getOutputSize(), CV_8UC3);
+        outFrame.setTo(cv::Scalar::all(++m_Count % 256));
+        return true;
+    }
+
+private:
+    int m_Count = 0;
+};
+} // anonymous namespace
+
+TEST(FrameCapture, WaitForFrame)
+{
+    CountingInput input;
+    FrameCapture capture{ input, 3 };
+
+    auto frame = capture.waitForFrame();
+    ASSERT_TRUE(frame);
+    for (int i = 0; i < 20; i++) {
+        auto next = capture.waitForNextFrame(frame);
+        ASSERT_TRUE(next);
+        EXPECT_GT(next->sequence, frame->sequence);
+        EXPECT_GE(next->timestamp, frame->timestamp);
+        EXPECT_EQ(next->image.size(), input.getOutputSize());
+        frame = std::move(next);
+    }
+    EXPECT_TRUE(capture.isRunning());
+
+    capture.stop();
+    EXPECT_FALSE(capture.isRunning());
+    EXPECT_FALSE(capture.waitForFrame(capture.getLatestFrame()->sequence));
+}
+
+TEST(FrameCapture, HeldFramesAreNotOverwritten)
+{
+    CountingInput input;
+    FrameCapture capture{ input, 2 };
+
+    // Hold on to every buffer, so the capture thread has to drop frames
+    const auto first = capture.waitForFrame();
+    const auto value = first->image.at<cv::Vec3b>(0, 0);
+    const auto second = capture.waitForNextFrame(first);
+    ASSERT_TRUE(second);
+    std::this_thread::sleep_for(20ms);
+
+    EXPECT_EQ(first->image.at<cv::Vec3b>(0, 0), value);
+    EXPECT_GT(capture.getNumDroppedFrames(), 0U);
+    EXPECT_EQ(capture.getLatestFrame(), second);
+    EXPECT_FALSE(capture.waitForFrame(second->sequence, 5ms));
+}
@@ -0,0 +1,148 @@
+// BoB robotics includes
+#include "video/frame_codec.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C includes
+#include <cstdint>
+#include <cstring>
+
+// Standard C++ includes
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+using namespace BoBRobotics::Video;
+
+namespace {
+cv::Mat
+makeFrame(int type, int seed)
+{
+    cv::Mat frame(30, 40, type);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    // Draw something which moves, over a static background
+    cv::rectangle(frame, cv::Rect(seed, seed, 8, 8), cv::Scalar::all(seed * 20), cv::FILLED);
+    return frame;
+}
+
+void
+expectEqual(const cv::Mat &expected, const cv::Mat &actual)
+{
+    ASSERT_EQ(expected.size(), actual.size());
+    ASSERT_EQ(expected.type(), actual.type());
+    EXPECT_EQ(cv::norm(expected, actual, cv::NORM_INF), 0.0);
+}
+
+// Send frames through an encoder and separate decoder
+void
+testLossless(const std::string &spec, const std::vector<cv::Mat> &frames)
+{
+    const auto encoder = FrameCodec::create(spec);
+    const auto decoder = FrameCodec::create(spec);
+    std::vector<uchar> buffer;
+    cv::Mat decoded;
+    for (const auto &frame : frames) {
+        encoder->encode(frame, buffer);
+        decoder->decode(buffer.data(), buffer.size(), decoded);
+        expectEqual(frame, decoded);
+    }
+}
+} // anonymous namespace
+
+TEST(FrameCodec, create)
+{
+    EXPECT_EQ(FrameCodec::create("jpeg:80")->getName(), "jpeg");
+    EXPECT_EQ(FrameCodec::create("delta:10")->getName(), "delta");
+    for (const auto &name : FrameCodec::getNames()) {
+        EXPECT_EQ(FrameCodec::create(name)->getName(), name);
+    }
+    EXPECT_THROW(FrameCodec::create("gif"), std::invalid_argument);
+}
+
+TEST(FrameCodec, JPEG)
+{
+    const cv::Mat frame(30, 40, CV_8UC3, cv::Scalar(10, 100, 200));
+    JPEGCodec codec{ 90 };
+    std::vector<uchar> buffer;
+    cv::Mat decoded;
+    codec.encode(frame, buffer);
+    codec.decode(buffer.data(), buffer.size(), decoded);
+    ASSERT_EQ(decoded.size(), frame.size());
+    ASSERT_EQ(decoded.type(), frame.type());
+    EXPECT_LT(cv::norm(frame, decoded, cv::NORM_INF), 5.0);
+}
+
+TEST(FrameCodec, Lossless)
+{
+    for (const auto &spec : { "png", "raw", "delta" }) {
+        testLossless(spec, { makeFrame(CV_8UC1, 0), makeFrame(CV_8UC3, 1) });
+    }
+}
+
+TEST(FrameCodec, RawROI)
+{
+    const cv::Mat frame = makeFrame(CV_8UC3, 0);
+    testLossless("raw", { frame(cv::Rect(3, 4, 20, 10)) });
+    testLossless("delta", { frame(cv::Rect(3, 4, 20, 10)) });
+}
+
+TEST(FrameCodec, Delta)
+{
+    // Greyscale frames which change a little at a time, then change size
+    std::vector<cv::Mat> frames;
+    const cv::Mat background = makeFrame(CV_8UC1, 0);
+    for (int i = 0; i < 10; i++) {
+        cv::Mat frame = background.clone();
+        cv::rectangle(frame, cv::Rect(i, i, 8, 8), cv::Scalar::all(i * 20), cv::FILLED);
+        frames.push_back(frame);
+    }
+    frames.push_back(makeFrame(CV_8UC3, 5));
+    testLossless("delta", frames);
+    testLossless("delta:3", frames);
+
+    // Frames after the first should be much smaller than raw ones
+    DeltaCodec codec;
+    std::vector<uchar> first, second;
+    codec.encode(frames[0], first);
+    codec.encode(frames[1], second);
+    EXPECT_GT(first.size(), frames[0].total());
+    EXPECT_LT(second.size(), frames[0].total() / 4);
+
+    // Delta frames can't be decoded without what came before
+    DeltaCodec decoder;
+    cv::Mat decoded;
+    EXPECT_THROW(decoder.decode(second.data(), second.size(), decoded), std::runtime_error);
+}
+
+TEST(FrameCodec, BadHeaders)
+{
+    // A raw frame's header is its rows, columns and type
+    RawCodec raw;
+    std::vector<uchar> buffer;
+    raw.encode(makeFrame(CV_8UC1, 0), buffer);
+    const auto setHeader = [](std::vector<uchar> &frame, size_t offset,
+                              const std::array<int32_t, 3> &header) {
+        std::memcpy(&frame[offset], header.data(), sizeof(header));
+    };
+
+    // Each of these should be rejected before anything is allocated
+    cv::Mat decoded;
+    for (const auto &header : std::vector<std::array<int32_t, 3>>{ { -30, 40, CV_8UC1 },
+                                                                   { 30, 0, CV_8UC1 },
+                                                                   { 30, 40, -1 },
+                                                                   { 30, 40, 1 << 20 },
+                                                                   { 1 << 30, 1 << 30, CV_64FC1 },
+                                                                   { 30, 41, CV_8UC1 } }) {
+        auto bad = buffer;
+        setHeader(bad, 0, header);
+        EXPECT_THROW(raw.decode(bad.data(), bad.size(), decoded), std::runtime_error);
+    }
+
+    // A tiny delta key frame can't describe a huge black frame
+    DeltaCodec delta;
+    delta.encode(cv::Mat::zeros(30, 40, CV_8UC1), buffer);
+    setHeader(buffer, 1, { 1 << 15, 1 << 15, CV_8UC1 });
+    EXPECT_THROW(delta.decode(buffer.data(), buffer.size(), decoded), std::runtime_error);
+}
@@ -0,0 +1,209 @@
+// BoB robotics includes
+#include "net/frame_fragments.h"
+#include "net/udp_socket.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C++ includes
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace BoBRobotics::Net;
+
+namespace {
+constexpr size_t MaxDatagramSize = 100;
+
+// Keeps datagrams rather than sending them
+class DatagramRecorder
+  : public DatagramSender
+{
+public:
+    std::vector<std::vector<uint8_t>> datagrams;
+
+    virtual void send(const void *data, size_t length) override
+    {
+        const auto bytes = reinterpret_cast<const uint8_t *>(data);
+        datagrams.emplace_back(bytes, bytes + length);
+    }
+};
+
+std::vector<uint8_t>
+makeFrame(size_t size, uint8_t seed)
+{
+    std::vector<uint8_t> frame(size);
+    std::iota(frame.begin(), frame.end(), seed);
+    return frame;
+}
+
+// Fragment some frames, each of which is a different size
+std::vector<std::vector<uint8_t>>
+fragment(const std::vector<std::vector<uint8_t>> &frames)
+{
+    DatagramRecorder recorder;
+    FrameFragmenter fragmenter{ recorder, MaxDatagramSize };
+    for (const auto &frame : frames) {
+        fragmenter.send(frame.data(), frame.size());
+    }
+    return recorder.datagrams;
+}
+} // anonymous namespace
+
+TEST(FrameFragments, RoundTrip)
+{
+    const std::vector<std::vector<uint8_t>> frames{ makeFrame(1000, 0), makeFrame(0, 1),
+                                                    makeFrame(84, 2), makeFrame(85, 3) };
+    const auto datagrams = fragment(frames);
+    for (const auto &datagram : datagrams) {
+        EXPECT_LE(datagram.size(), MaxDatagramSize);
+    }
+
+    FrameReassembler reassembler;
+    size_t numFrames = 0;
+    for (const auto &datagram : datagrams) {
+        if (reassembler.addDatagram(datagram.data(), datagram.size())) {
+            ASSERT_LT(numFrames, frames.size());
+            EXPECT_EQ(reassembler.getFrame(), frames[numFrames]);
+            numFrames++;
+        }
+    }
+    EXPECT_EQ(numFrames, frames.size());
+    EXPECT_EQ(reassembler.getNumDroppedFrames(), 0U);
+}
+
+TEST(FrameFragments, Reordered)
+{
+    const std::vector<std::vector<uint8_t>> frames{ makeFrame(500, 0), makeFrame(500, 1) };
+    auto datagrams = fragment(frames);
+
+    // Interleave the two frames' datagrams, backwards
+    const size_t half = datagrams.size() / 2;
+    std::vector<std::vector<uint8_t>> shuffled;
+    for (size_t i = 0; i < half; i++) {
+        shuffled.push_back(datagrams[half - 1 - i]);
+        shuffled.push_back(datagrams[datagrams.size() - 1 - i]);
+    }
+
+    FrameReassembler reassembler;
+    std::vector<std::vector<uint8_t>> received;
+    for (const auto &datagram : shuffled) {
+        if (reassembler.addDatagram(datagram.data(), datagram.size())) {
+            received.push_back(reassembler.getFrame());
+        }
+    }
+    EXPECT_EQ(received, frames);
+}
+
+TEST(FrameFragments, Lost)
+{
+    const std::vector<std::vector<uint8_t>> frames{ makeFrame(250, 0), makeFrame(250, 1), makeFrame(250, 2) };
+    auto datagrams = fragment(frames);
+
+    // Lose part of the second frame, and deliver some of the first one late
+    const size_t perFrame = datagrams.size() / 3;
+    const auto late = datagrams[1];
+    datagrams.erase(datagrams.begin() + perFrame + 1);
+    datagrams.erase(datagrams.begin() + 1);
+    datagrams.push_back(late);
+
+    FrameReassembler reassembler;
+    std::vector<std::vector<uint8_t>> received;
+    for (const auto &datagram : datagrams) {
+        if (reassembler.addDatagram(datagram.data(), datagram.size())) {
+            received.push_back(reassembler.getFrame());
+        }
+    }
+    ASSERT_EQ(received.size(), 1U);
+    EXPECT_EQ(received[0], frames[2]);
+    EXPECT_EQ(reassembler.getNumDroppedFrames(), 2U);
+}
+
+TEST(FrameFragments, Malformed)
+{
+    auto datagrams = fragment({ makeFrame(150, 0) });
+    FrameReassembler reassembler;
+    EXPECT_FALSE(reassembler.addDatagram(datagrams[0].data(), 10));
+
+    // Claim to be beyond the end of the frame
+    auto datagram = datagrams[0];
+    datagram[11] = 200;
+    EXPECT_FALSE(reassembler.addDatagram(datagram.data(), datagram.size()));
+
+    // Fragments which don't tile the frame
+    datagram = datagrams[1];
+    datagram[11] = 80;
+    EXPECT_FALSE(reassembler.addDatagram(datagram.data(), datagram.size()));
+    datagram = datagrams[0];
+    datagram[15] = 3;
+    EXPECT_FALSE(reassembler.addDatagram(datagram.data(), datagram.size()));
+
+    // An implausibly large frame
+    datagram = datagrams[0];
+    std::fill_n(datagram.begin() + 4, 4, 0xff);
+    EXPECT_FALSE(reassembler.addDatagram(datagram.data(), datagram.size()));
+    FrameReassembler small{ 4, 100 };
+    EXPECT_FALSE(small.addDatagram(datagrams[0].data(), datagrams[0].size()));
+
+    // None of which stops the real frame getting through
+    ASSERT_EQ(datagrams.size(), 2U);
+    EXPECT_FALSE(reassembler.addDatagram(datagrams[0].data(), datagrams[0].size()));
+    EXPECT_TRUE(reassembler.addDatagram(datagrams[1].data(), datagrams[1].size()));
+    EXPECT_EQ(reassembler.getFrame(), makeFrame(150, 0));
+}
+
+TEST(FrameFragments, LossyLoopback)
+{
+    UDPSocket receiver;
+    UDPSocket sender;
+    sender.connect("127.0.0.1", receiver.getPort());
+    LossyDatagramSender lossy{ sender, 0.05, 0.2, 42 };
+    FrameFragmenter fragmenter{ lossy, 1000 };
+
+    constexpr size_t numFrames = 20;
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t i = 0; i < numFrames; i++) {
+        frames.push_back(makeFrame(5000 + i, static_cast<uint8_t>(i)));
+        fragmenter.send(frames.back().data(), frames.back().size());
+    }
+    lossy.flush();
+
+    FrameReassembler reassembler;
+    std::vector<uint8_t> datagram(2000);
+    size_t numReceived = 0, lastFrame = 0;
+    while (const size_t size = receiver.receive(datagram.data(), datagram.size(), 100)) {
+        if (reassembler.addDatagram(datagram.data(), size)) {
+            // Frames are intact and in order
+            const auto &frame = reassembler.getFrame();
+            const size_t index = frame.size() - 5000;
+            ASSERT_LT(index, numFrames);
+            EXPECT_EQ(frame, frames[index]);
+            EXPECT_TRUE(numReceived == 0 || index > lastFrame);
+            lastFrame = index;
+            numReceived++;
+        }
+    }
+
+    EXPECT_GT(lossy.getNumDropped(), 0U);
+    EXPECT_GT(numReceived, 0U);
+    EXPECT_LT(numReceived, numFrames);
+    EXPECT_EQ(numReceived + reassembler.getNumDroppedFrames() + (numFrames - 1 - lastFrame), numFrames);
+}
+
+TEST(FrameFragments, SenderAddress)
+{
+    UDPSocket receiver;
+    UDPSocket sender;
+    sender.connect("127.0.0.1", receiver.getPort());
+    const std::vector<uint8_t> sent{ 1, 2, 3 };
+    sender.send(sent.data(), sent.size());
+
+    std::vector<uint8_t> received(16);
+    std::string fromAddress;
+    const size_t size = receiver.receive(received.data(), received.size(), fromAddress, 1000);
+    ASSERT_EQ(size, sent.size());
+    received.resize(size);
+    EXPECT_EQ(received, sent);
+    EXPECT_EQ(fromAddress, "127.0.0.1");
+}
@@ -0,0 +1,22 @@
+#include "common.h"
+
+// BoB robotics includes
+#include "common/hash.h"
+
+using namespace BoBRobotics;
+
+TEST(FNV1aHash, KnownValues)
+{
+    EXPECT_EQ(hashString(""), 0xcbf29ce484222325ULL);
+    EXPECT_EQ(hashString("a"), 0xaf63dc4c8601ec8cULL);
+    EXPECT_EQ(hashString("foobar"), 0x85944171f73967e8ULL);
+    EXPECT_EQ(toHexString(hashString("a")), "af63dc4c8601ec8c");
+    EXPECT_EQ(toHexString(255), "00000000000000ff");
+}
+
+TEST(FNV1aHash, Incremental)
+{
+    FNV1aHash hash;
+    hash.add("foo").add(std::string{ "bar" });
+    EXPECT_EQ(hash.get(), hashString("foobar"));
+}
@@ -1,8 +1,25 @@
 #include <gtest/gtest.h>
 
 // BoB robotics includes
+#include "common/path.h"
 #include "navigation/image_database.h"
+#include "navigation/image_database_cache.h"
 
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+// Standard C includes
+#include <ctime>
+
+// Standard C++ includes
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+using namespace BoBRobotics;
 using namespace BoBRobotics::Navigation;
 
 TEST(ImageDatabase, fileNameCompare) {
@@ -19,3 +36,296 @@ TEST(ImageDatabase, fileNameCompare) {
     // Check that we fall back on alphabetical comparison if strings don't match
     check("frame2.png", "image1.png");
 }
+
+static void comparePackedDatabase(PackedImageDatabase::FrameFormat frameFormat)
+{
+    const auto routePath = Path::getRepoPath() / "docs_source" / "example_image_databases" / "example_route";
+    const auto packedPath = Path::getProgramDirectory() / "example_route_test.bobdb";
+    if (packedPath.exists()) {
+        packedPath.remove_file();
+    }
+
+    const ImageDatabase original{ routePath };
+    original.pack(packedPath, frameFormat);
+
+    const ImageDatabase packed{ packedPath };
+    EXPECT_TRUE(packed.isPacked());
+    EXPECT_TRUE(packed.isRoute());
+    EXPECT_EQ(packed.getResolution(), original.getResolution());
+    ASSERT_EQ(packed.size(), original.size());
+    for (size_t i = 0; i < original.size(); i++) {
+        EXPECT_EQ(packed[i].position, original[i].position);
+        EXPECT_EQ(packed[i].heading, original[i].heading);
+        EXPECT_EQ(packed[i].getPath().filename(), original[i].getPath().filename());
+
+        for (bool greyscale : { false, true }) {
+            const cv::Mat expected = original[i].load(greyscale);
+            const cv::Mat actual = packed[i].load(greyscale);
+            ASSERT_EQ(actual.size(), expected.size());
+            ASSERT_EQ(actual.type(), expected.type());
+            EXPECT_EQ(cv::norm(actual, expected, cv::NORM_L1), 0.0);
+        }
+    }
+
+    packedPath.remove_file();
+}
+
+TEST(ImageDatabase, PackEncoded)
+{
+    comparePackedDatabase(PackedImageDatabase::FrameFormat::Encoded);
+}
+
+TEST(ImageDatabase, PackRaw)
+{
+    comparePackedDatabase(PackedImageDatabase::FrameFormat::Raw);
+}
+
+TEST(ImageDatabase, PackUnfinished)
+{
+    const auto packedPath = Path::getProgramDirectory() / "unfinished_test.bobdb";
+    {
+        PackedImageDatabase::Writer writer{ packedPath, PackedImageDatabase::FrameFormat::Raw,
+                                            true, {}, "" };
+        writer.addFrame(cv::Mat::zeros(10, 20, CV_8UC1), {}, "", {});
+        EXPECT_TRUE(packedPath.exists());
+    }
+
+    // Files which weren't closed aren't valid, so they are removed
+    EXPECT_FALSE(packedPath.exists());
+}
+
+TEST(ImageDatabase, LoadCSV)
+{
+    const auto dbPath = Path::getProgramDirectory() / "csv_test_database";
+    if (dbPath.exists()) {
+        filesystem::remove_all(dbPath);
+    }
+    ASSERT_TRUE(filesystem::create_directory(dbPath));
+
+    // Irregular spacing, Windows line endings and a missing trailing newline
+    {
+        std::ofstream ofs((dbPath / "database_entries.csv").str(), std::ios::binary);
+        ofs << "X [mm], Y [mm], Z [mm], Heading [degrees], Filename, Colour\r\n"
+            << "1.5,  -2, 3e2, 90, image_00000.png, red\r\n"
+            << "\r\n"
+            << "4, 5, 6,  -45 ,image_00001.png,blue\r\n"
+            << "7, 8, 9, 0, image_00002.png, red";
+    }
+
+    const ImageDatabase database{ dbPath };
+    filesystem::remove_all(dbPath);
+
+    ASSERT_EQ(database.size(), 3);
+    EXPECT_EQ(database.getExtraFieldNames(), std::vector<std::string>{ "Colour" });
+
+    using namespace units::literals;
+    EXPECT_EQ(database[0].position, (Vector3<units::length::millimeter_t>{ 1.5_mm, -2_mm, 300_mm }));
+    EXPECT_EQ(database[0].heading, 90_deg);
+    EXPECT_EQ(database[1].heading, -45_deg);
+    EXPECT_EQ(database[2].position[2], 9_mm);
+
+    EXPECT_EQ(database[1].getPath(), dbPath / "image_00001.png");
+    EXPECT_EQ(database[0].getExtraField("Colour"), "red");
+    EXPECT_EQ(database[1].getExtraField("Colour"), "blue");
+    EXPECT_EQ(&database[0].getExtraField("Colour"), &database[2].getExtraField("Colour"));
+    EXPECT_FALSE(database[0].hasExtraField("Size"));
+}
+
+TEST(ImageDatabase, ForEachImageVideo)
+{
+    const auto dbPath = Path::getProgramDirectory() / "video_test_database";
+    if (dbPath.exists()) {
+        filesystem::remove_all(dbPath);
+    }
+    ASSERT_TRUE(filesystem::create_directory(dbPath));
+
+    // Give each frame a different brightness, so we can tell them apart
+    constexpr int numFrames = 200;
+    const auto videoPath = dbPath / "video.avi";
+    {
+        cv::VideoWriter writer{ videoPath.str(), cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                                10.0, { 32, 16 } };
+        ASSERT_TRUE(writer.isOpened());
+        for (int i = 0; i < numFrames; i++) {
+            writer.write(cv::Mat{ 16, 32, CV_8UC3, cv::Scalar::all(i) });
+        }
+    }
+
+    const ImageDatabase database{ videoPath };
+    ASSERT_EQ(database.size(), numFrames);
+    for (size_t frameSkip : { 1, 3 }) {
+        std::vector<int> seen(numFrames / frameSkip, 0);
+        database.forEachImage([&](size_t i, const cv::Mat &image) {
+            ASSERT_LT(i, seen.size());
+            seen[i]++;
+            EXPECT_NEAR(cv::mean(image)[0], static_cast<double>(i * frameSkip), 2.0);
+        }, frameSkip);
+
+        // Every image should be delivered exactly once
+        EXPECT_TRUE(std::all_of(seen.cbegin(), seen.cend(), [](int n) { return n == 1; }));
+    }
+
+    filesystem::remove_all(dbPath);
+}
+
+TEST(ImageDatabaseCache, LoadImages)
+{
+    const auto routePath = Path::getRepoPath() / "docs_source" / "example_image_databases" / "example_route";
+    const auto cachePath = Path::getProgramDirectory() / "image_cache_test";
+    if (cachePath.exists()) {
+        filesystem::remove_all(cachePath);
+    }
+
+    const ImageDatabase database{ routePath };
+    const cv::Size size{ 90, 25 };
+    const auto expected = database.loadImages(size);
+    {
+        ImageDatabaseCache cache{ cachePath };
+
+        // The first load fills the cache and the second is served from it
+        for (int i = 0; i < 2; i++) {
+            const auto images = cache.loadImages(database, size);
+            ASSERT_EQ(images.size(), expected.size());
+            for (size_t j = 0; j < images.size(); j++) {
+                ASSERT_EQ(images[j].size(), size);
+                EXPECT_EQ(cv::norm(images[j], expected[j], cv::NORM_L1), 0.0);
+            }
+        }
+        const uint64_t oneEntrySize = cache.getSize();
+        EXPECT_GT(oneEntrySize, 0);
+
+        // Different parameters give a new entry
+        cache.loadImages(database, size, 1, false);
+        EXPECT_GT(cache.getSize(), oneEntrySize);
+    }
+
+    // If the cache is too small, old entries are evicted when adding new ones
+    {
+        const uint64_t maxSize = 3 * size.area() * 3 / 2;
+        ImageDatabaseCache cache{ cachePath, maxSize };
+        cache.loadImages(database, { 45, 12 });
+        EXPECT_LE(cache.getSize(), maxSize);
+        cache.clear();
+        EXPECT_EQ(cache.getSize(), 0);
+    }
+
+    // Temporary files left by crashed processes are removed once they're stale
+    {
+        const auto staleTempPath = cachePath / "stale.bobdb.0123456789abcdef.tmp";
+        const auto freshTempPath = cachePath / "fresh.bobdb.0123456789abcdef.tmp";
+        std::ofstream(staleTempPath.str()) << std::string(100, 'x');
+        std::ofstream(freshTempPath.str()) << std::string(10, 'x');
+        utimbuf times;
+        times.actime = times.modtime = std::time(nullptr) - 2 * 60 * 60;
+        ASSERT_EQ(utime(staleTempPath.str().c_str(), &times), 0);
+
+        ImageDatabaseCache cache{ cachePath };
+        EXPECT_EQ(cache.getSize(), 110U);
+        cache.clear();
+        EXPECT_FALSE(staleTempPath.exists());
+        EXPECT_TRUE(freshTempPath.exists());
+        EXPECT_EQ(cache.getSize(), 10U);
+    }
+
+    filesystem::remove_all(cachePath);
+}
+
+TEST(ImageDatabaseCache, LoadUnwrapped)
+{
+    const auto routePath = Path::getRepoPath() / "docs_source" / "example_image_databases" / "example_route";
+    const auto cachePath = Path::getProgramDirectory() / "image_cache_unwrap_test";
+    if (cachePath.exists()) {
+        filesystem::remove_all(cachePath);
+    }
+
+    const ImageDatabase database{ routePath };
+    ImageDatabaseCache cache{ cachePath };
+
+    // Unwrappers which only differ in output size need separate entries
+    for (int i = 0; i < 2; i++) {
+        for (const cv::Size size : { cv::Size{ 90, 25 }, cv::Size{ 180, 50 } }) {
+            const ImgProc::OpenCVUnwrap360 unwrapper{ database.getResolution(), size };
+            const auto images = cache.loadUnwrapped(database, unwrapper, 2);
+            ASSERT_EQ(images.size(), database.size() / 2);
+
+            cv::Mat expected;
+            unwrapper.unwrap(database[0].load(), expected);
+            ASSERT_EQ(images[0].size(), size);
+            EXPECT_EQ(cv::norm(images[0], expected, cv::NORM_L1), 0.0);
+        }
+    }
+
+    filesystem::remove_all(cachePath);
+}
+
+TEST(ImageDatabase, AsyncRouteRecorder)
+{
+    const auto dbPath = Path::getProgramDirectory() / "async_recorder_test_database";
+    constexpr int numFrames = 20;
+    {
+        ImageDatabase database{ dbPath, true };
+        ImageDatabase::AsyncWriterOptions options;
+        options.numThreads = 3;
+        options.maxQueueLength = 4;
+        options.dropWhenFull = false;
+        auto recorder = database.getAsyncRouteRecorder(options, "png", { "Index" });
+
+        // Reuse the same buffer for every frame, like a camera would
+        cv::Mat frame{ 16, 32, CV_8UC1 };
+        for (int i = 0; i < numFrames; i++) {
+            frame.setTo(i);
+            recorder.record(Vector3<units::length::millimeter_t>::nan(),
+                            units::angle::degree_t{ static_cast<double>(i) }, frame, i);
+        }
+        recorder.save();
+
+        const auto stats = recorder.getStatistics();
+        EXPECT_EQ(stats.framesQueued, numFrames);
+        EXPECT_EQ(stats.framesWritten, numFrames);
+        EXPECT_EQ(stats.framesDropped, 0);
+        EXPECT_LE(stats.maxQueueLength, options.maxQueueLength);
+    }
+
+    const ImageDatabase database{ dbPath };
+    ASSERT_EQ(database.size(), numFrames);
+    for (int i = 0; i < numFrames; i++) {
+        EXPECT_EQ(database[i].heading.value(), i);
+        EXPECT_EQ(database[i].getExtraField("Index"), std::to_string(i));
+
+        const cv::Mat expected{ 16, 32, CV_8UC1, cv::Scalar(i) };
+        EXPECT_EQ(cv::norm(database[i].load(), expected, cv::NORM_L1), 0.0);
+    }
+
+    filesystem::remove_all(dbPath);
+}
+
+TEST(ImageDatabase, Stream)
+{
+    const auto routePath = Path::getRepoPath() / "docs_source" / "example_image_databases" / "example_route";
+    const ImageDatabase database{ routePath };
+    const cv::Size size{ 90, 25 };
+    const auto expected = database.loadImages(size, 2);
+
+    auto stream = database.stream(size, 2, true, 3);
+    ASSERT_EQ(stream.size(), expected.size());
+    size_t count = 0;
+    for (auto &frame : stream) {
+        ASSERT_EQ(frame.getIndex(), count);
+        EXPECT_EQ(cv::norm(frame.getImage(), expected[count], cv::NORM_L1), 0.0);
+        count++;
+    }
+    EXPECT_EQ(count, expected.size());
+
+    // Holding on to every buffer means no more frames can be decoded
+    auto stream2 = database.stream(size, 1, true, 2);
+    auto frame0 = stream2.next();
+    auto frame1 = stream2.next();
+    EXPECT_THROW(stream2.next(), std::runtime_error);
+
+    // ...but once one is released, we can carry on
+    frame0.release();
+    const auto frame2 = stream2.next();
+    ASSERT_TRUE(frame2);
+    EXPECT_EQ(frame2.getIndex(), 2);
+    EXPECT_EQ(frame1.getIndex(), 1);
+}
@@ -0,0 +1,132 @@
+// BoB robotics includes
+#include "common/circstat.h"
+#include "common/path.h"
+#include "navigation/image_database_index.h"
+
+// Third-party includes
+#include "third_party/units.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C++ includes
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace BoBRobotics;
+using namespace BoBRobotics::Navigation;
+using namespace units::angle;
+using namespace units::length;
+
+namespace {
+std::vector<ImageDatabase::Entry>
+getRandomEntries(size_t count, bool flat)
+{
+    std::mt19937 rng{ 42 };
+    std::uniform_real_distribution<double> posDist{ -5000.0, 5000.0 };
+    std::uniform_real_distribution<double> headingDist{ -180.0, 180.0 };
+
+    std::vector<ImageDatabase::Entry> entries(count);
+    for (auto &entry : entries) {
+        entry.position = { millimeter_t{ posDist(rng) }, millimeter_t{ posDist(rng) },
+                           millimeter_t{ flat ? 0.0 : posDist(rng) / 10.0 } };
+        entry.heading = degree_t{ headingDist(rng) };
+    }
+
+    // Entries without positions should be ignored
+    entries[count / 2].position = Vector3<millimeter_t>::nan();
+
+    return entries;
+}
+
+double
+getDistance(const ImageDatabase::Entry &entry, const Vector3<millimeter_t> &position)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < (std::isnan(position[2].value()) ? 2 : 3); i++) {
+        const double diff = (entry.position[i] - position[i]).value();
+        sum += diff * diff;
+    }
+    return std::sqrt(sum);
+}
+
+// Brute force search, for comparison
+std::vector<size_t>
+getNearest(const std::vector<ImageDatabase::Entry> &entries,
+           const Vector3<millimeter_t> &position, size_t k,
+           degree_t heading = 0_deg, degree_t maxHeadingDifference = 360_deg)
+{
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!std::isnan(entries[i].position[0].value()) &&
+                units::math::abs(circularDistance(entries[i].heading, heading)) <= maxHeadingDifference) {
+            indices.push_back(i);
+        }
+    }
+    std::sort(indices.begin(), indices.end(), [&](size_t a, size_t b) {
+        return getDistance(entries[a], position) < getDistance(entries[b], position);
+    });
+    indices.resize(std::min(k, indices.size()));
+    return indices;
+}
+} // anonymous namespace
+
+TEST(ImageDatabaseIndex, Nearest)
+{
+    const auto entries = getRandomEntries(2000, false);
+    const ImageDatabaseIndex index{ entries };
+    EXPECT_EQ(index.size(), entries.size() - 1);
+
+    std::mt19937 rng{ 1 };
+    std::uniform_real_distribution<double> posDist{ -6000.0, 6000.0 };
+    for (int i = 0; i < 50; i++) {
+        const Vector3<millimeter_t> position{ millimeter_t{ posDist(rng) },
+                                              millimeter_t{ posDist(rng) },
+                                              millimeter_t{ posDist(rng) / 10.0 } };
+        EXPECT_EQ(index.nearest(position, 5), getNearest(entries, position, 5));
+
+        // 2D query
+        const Vector3<millimeter_t> position2D{ position[0], position[1], millimeter_t{ NAN } };
+        EXPECT_EQ(index.nearest(position2D, 3), getNearest(entries, position2D, 3));
+
+        EXPECT_EQ(index.nearest(position, 4, 90_deg, 20_deg),
+                  getNearest(entries, position, 4, 90_deg, 20_deg));
+    }
+}
+
+TEST(ImageDatabaseIndex, WithinRadius)
+{
+    const auto entries = getRandomEntries(2000, true);
+    const ImageDatabaseIndex index{ entries };
+
+    const Vector3<millimeter_t> position{ 100_mm, -300_mm, 0_mm };
+    const auto found = index.withinRadius(position, 800_mm);
+    ASSERT_FALSE(found.empty());
+
+    auto expected = getNearest(entries, position, entries.size());
+    expected.erase(std::find_if(expected.begin(), expected.end(), [&](size_t i) {
+                       return getDistance(entries[i], position) > 800.0;
+                   }),
+                   expected.end());
+    EXPECT_EQ(found, expected);
+}
+
+TEST(ImageDatabaseIndex, SaveLoad)
+{
+    auto entries = getRandomEntries(500, false);
+    const ImageDatabaseIndex index{ entries };
+    const auto indexPath = Path::getProgramDirectory() / "test_index.bin";
+    index.save(indexPath);
+
+    const auto loaded = ImageDatabaseIndex::load(indexPath, entries);
+    ASSERT_TRUE(loaded);
+    const Vector3<millimeter_t> position{ 0_mm, 0_mm, 0_mm };
+    EXPECT_EQ(loaded->nearest(position, 10), index.nearest(position, 10));
+
+    // If the entries change, the saved index is out of date
+    entries[3].position[0] += 1_mm;
+    EXPECT_FALSE(ImageDatabaseIndex::load(indexPath, entries));
+
+    indexPath.remove_file();
+}
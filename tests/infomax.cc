@@ -64,3 +64,34 @@ TEST(InfoMax, NonExplodingWeights)
         }
     });
 }
+
+// Check that a serialised network is loaded back with the same state
+TEST(InfoMax, SerialiseDeserialise)
+{
+    const auto filepath = Path::getProgramDirectory() / "infomax_serialised.bin";
+
+    InfoMaxRotater<> infomax{ TestImageSize, /*learningRate=*/1e-5f, /*seed=*/42 };
+    for (size_t i = 0; i < 10; i++) {
+        infomax.train(TestImages[i]);
+    }
+    infomax.serialise(filepath);
+
+    auto loaded = InfoMaxRotater<>::deserialise(filepath);
+    EXPECT_TRUE(loaded.isMemoryMapped());
+    EXPECT_EQ(loaded.getUnwrapResolution(), TestImageSize);
+    EXPECT_EQ(loaded.getNumSnapshots(), 10u);
+    EXPECT_FLOAT_EQ(loaded.getLearningRate(), 1e-5f);
+    compareFloatMatrices(loaded.getWeights(), infomax.getWeights());
+    EXPECT_FLOAT_EQ(loaded.test(TestImages[20]), infomax.test(TestImages[20]));
+
+    // Training a loaded network should copy the weights rather than failing
+    loaded.train(TestImages[10]);
+    infomax.train(TestImages[10]);
+    EXPECT_FALSE(loaded.isMemoryMapped());
+    compareFloatMatrices(loaded.getWeights(), infomax.getWeights());
+
+    // Loading with the wrong floating-point type should fail
+    EXPECT_THROW(InfoMax<double>::deserialise(filepath), std::runtime_error);
+
+    filepath.remove_file();
+}
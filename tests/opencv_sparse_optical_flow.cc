@@ -0,0 +1,95 @@
+// BoB robotics includes
+#include "imgproc/opencv_sparse_optical_flow.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+
+// Standard C includes
+#include <cmath>
+
+// Standard C++ includes
+#include <vector>
+
+using namespace BoBRobotics::ImgProc;
+
+namespace {
+// A smooth random texture, which Lucas-Kanade can track
+cv::Mat
+getTexture(const cv::Size &size)
+{
+    cv::Mat image{ size, CV_8UC1 };
+    cv::RNG rng{ 42 };
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(image, image, { 7, 7 }, 2.0);
+    return image;
+}
+
+// Roll a panorama right, as if the camera turned left
+cv::Mat
+rollRight(const cv::Mat &image, int pixels)
+{
+    cv::Mat rolled;
+    cv::hconcat(image.colRange(image.cols - pixels, image.cols),
+                image.colRange(0, image.cols - pixels), rolled);
+    return rolled;
+}
+} // anonymous namespace
+
+TEST(OpenCVSparseOpticalFlow, Rotation)
+{
+    const cv::Size size{ 360, 60 };
+    const cv::Mat image = getTexture(size);
+    OpenCVSparseOpticalFlow flow{ size, { 36, 4 } };
+    EXPECT_FALSE(flow.calculate(image));
+
+    // Each pixel is one degree, so this is a 3 degree rotation
+    ASSERT_TRUE(flow.calculate(rollRight(image, 3)));
+    size_t numTracked = 0;
+    for (size_t i = 0; i < flow.getPoints().size(); i++) {
+        if (flow.getStatus()[i]) {
+            numTracked++;
+            EXPECT_NEAR(flow.getFlow()[i].y, 0.0, 0.5);
+        }
+    }
+    EXPECT_GT(numTracked, flow.getPoints().size() / 2);
+
+    const auto motion = flow.estimateEgoMotion();
+    EXPECT_NEAR(motion.rotation.value(), 3.0, 0.3);
+    EXPECT_NEAR(motion.translation, 0.0, 0.3);
+}
+
+TEST(OpenCVSparseOpticalFlow, Translation)
+{
+    // Flow proportional to sin(azimuth) is forwards translation, not rotation
+    const cv::Size size{ 360, 60 };
+    std::vector<cv::Point2f> points;
+    for (int x = 5; x < size.width; x += 10) {
+        points.emplace_back(static_cast<float>(x), 30.f);
+    }
+
+    /*
+     * Shift each column of a texture by the flow we want, so that each point
+     * sees a locally uniform shift
+     */
+    const cv::Mat image = getTexture(size);
+    cv::Mat mapX{ size, CV_32FC1 }, mapY{ size, CV_32FC1 };
+    for (int y = 0; y < size.height; y++) {
+        for (int x = 0; x < size.width; x++) {
+            const double azimuth = 2.0 * CV_PI * x / size.width - CV_PI;
+            mapX.at<float>(y, x) = static_cast<float>(x - 2.0 * std::sin(azimuth));
+            mapY.at<float>(y, x) = static_cast<float>(y);
+        }
+    }
+    cv::Mat moved;
+    cv::remap(image, moved, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_REFLECT);
+
+    OpenCVSparseOpticalFlow sparseFlow{ size, points };
+    EXPECT_FALSE(sparseFlow.calculate(image));
+    ASSERT_TRUE(sparseFlow.calculate(moved));
+    const auto motion = sparseFlow.estimateEgoMotion();
+    EXPECT_NEAR(motion.rotation.value(), 0.0, 0.3);
+    EXPECT_NEAR(motion.translation, 2.0, 0.3);
+}
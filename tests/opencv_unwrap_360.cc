@@ -0,0 +1,117 @@
+#include "common.h"
+
+// BoB robotics includes
+#include "common/path.h"
+#include "imgproc/opencv_unwrap_360.h"
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+
+using namespace BoBRobotics;
+using namespace BoBRobotics::ImgProc;
+
+namespace {
+OpenCVUnwrap360
+getUnwrapper()
+{
+    // The outer radius goes beyond the edge of the image, so some pixels are black
+    return OpenCVUnwrap360({ 320, 240 }, { 180, 50 }, 0.5, 0.45, 0.1, 0.6, 15_deg, true);
+}
+
+cv::Mat
+getRandomImage(int type)
+{
+    cv::Mat image{ 240, 320, type };
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+    return image;
+}
+
+void
+expectEqual(const cv::Mat &a, const cv::Mat &b)
+{
+    ASSERT_EQ(a.size(), b.size());
+    ASSERT_EQ(a.type(), b.type());
+    EXPECT_EQ(cv::norm(a, b, cv::NORM_INF), 0.0);
+}
+} // anonymous namespace
+
+TEST(OpenCVUnwrap360, UnwrapGreyscale)
+{
+    const auto unwrapper = getUnwrapper();
+    for (const int type : { CV_8UC3, CV_8UC4 }) {
+        const cv::Mat input = getRandomImage(type);
+        cv::Mat unwrapped, expected, output;
+        unwrapper.unwrap(input, unwrapped);
+        cv::cvtColor(unwrapped, expected, (type == CV_8UC3) ? cv::COLOR_BGR2GRAY : cv::COLOR_BGRA2GRAY);
+
+        unwrapper.unwrapGreyscale(input, output);
+        expectEqual(output, expected);
+    }
+}
+
+TEST(OpenCVUnwrap360, UnwrapTo)
+{
+    const auto unwrapper = getUnwrapper();
+    const cv::Mat input = getRandomImage(CV_8UC3);
+    cv::Mat unwrapped;
+    unwrapper.unwrap(input, unwrapped);
+
+    for (const cv::Size size : { cv::Size{ 180, 50 }, cv::Size{ 90, 25 }, cv::Size{ 72, 19 }, cv::Size{ 360, 100 } }) {
+        cv::Mat expected, output;
+
+        // Without colour conversion
+        cv::resize(unwrapped, expected, size, 0.0, 0.0, cv::INTER_NEAREST);
+        unwrapper.unwrapTo(input, output, size);
+        expectEqual(output, expected);
+
+        // With conversion to greyscale
+        cv::Mat grey;
+        cv::cvtColor(unwrapped, grey, cv::COLOR_RGB2GRAY);
+        cv::resize(grey, expected, size, 0.0, 0.0, cv::INTER_NEAREST);
+        unwrapper.unwrapTo(input, output, size, cv::COLOR_RGB2GRAY);
+        expectEqual(output, expected);
+
+        // A conversion which isn't done in a single pass
+        cv::Mat hsv;
+        cv::cvtColor(unwrapped, hsv, cv::COLOR_BGR2HSV);
+        cv::resize(hsv, expected, size, 0.0, 0.0, cv::INTER_NEAREST);
+        unwrapper.unwrapTo(input, output, size, cv::COLOR_BGR2HSV);
+        expectEqual(output, expected);
+    }
+}
+
+TEST(OpenCVUnwrap360, MapCache)
+{
+    const cv::Mat input = getRandomImage(CV_8UC3);
+    cv::Mat expected, output;
+    getUnwrapper().unwrap(input, expected);
+
+    const auto cachePath = Path::getProgramDirectory() / "unwrap_map_cache_test";
+    if (cachePath.exists()) {
+        filesystem::remove_all(cachePath);
+    }
+    OpenCVUnwrap360::setMapCacheDirectory(cachePath);
+
+    // The first unwrapper generates and saves the maps and the second loads them
+    for (int i = 0; i < 2; i++) {
+        auto unwrapper = getUnwrapper();
+        unwrapper.unwrap(input, output);
+        expectEqual(output, expected);
+        EXPECT_TRUE(cachePath.exists());
+    }
+
+    // Maps loaded from the cache can still be changed
+    {
+        auto unwrapper = getUnwrapper();
+        unwrapper.m_Flip = false;
+        unwrapper.updateMaps();
+        unwrapper.unwrap(input, output);
+
+        OpenCVUnwrap360::setMapCacheDirectory({});
+        OpenCVUnwrap360 unflipped({ 320, 240 }, { 180, 50 }, 0.5, 0.45, 0.1, 0.6, 15_deg, false);
+        unflipped.unwrap(input, expected);
+        expectEqual(output, expected);
+    }
+
+    filesystem::remove_all(cachePath);
+}
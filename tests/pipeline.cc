@@ -0,0 +1,78 @@
+// BoB robotics includes
+#include "video/pipeline.h"
+#include "video/synthetic_input.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C++ includes
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+using namespace BoBRobotics;
+using namespace BoBRobotics::Video;
+
+TEST(Pipeline, Stages)
+{
+    SyntheticInput input{ { 360, 60 } }, reference{ { 360, 60 } };
+    Pipeline pipeline{ input };
+    pipeline.add<ColourConversionStage>(cv::COLOR_BGR2GRAY)
+            .add<ResizeStage>(cv::Size{ 90, 15 }, cv::INTER_AREA)
+            .add("invert", [](cv::Mat &image) { cv::bitwise_not(image, image); });
+    EXPECT_EQ(pipeline.getOutputSize(), cv::Size(90, 15));
+    pipeline.start();
+
+    // Each frame should match the one with the same number, processed in turn
+    cv::Mat frame, colour, expected;
+    uint64_t sequence, referenceSequence = 0;
+    Pipeline::TimePoint captureTime;
+    for (int i = 0; i < 10; i++) {
+        while (!pipeline.readFrame(frame, sequence, captureTime)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ASSERT_GT(sequence, referenceSequence);
+        while (referenceSequence < sequence) {
+            ASSERT_TRUE(reference.readFrame(colour));
+            referenceSequence++;
+        }
+
+        cv::cvtColor(colour, expected, cv::COLOR_BGR2GRAY);
+        cv::resize(expected, expected, { 90, 15 }, 0.0, 0.0, cv::INTER_AREA);
+        cv::bitwise_not(expected, expected);
+        ASSERT_EQ(frame.size(), expected.size());
+        EXPECT_EQ(cv::norm(frame, expected, cv::NORM_INF), 0.0);
+    }
+    pipeline.stop();
+
+    // Input, three stages and the whole pipeline
+    const auto statistics = pipeline.getStatistics();
+    ASSERT_EQ(statistics.size(), 5U);
+    EXPECT_EQ(statistics[0].name, "input");
+    EXPECT_EQ(statistics[3].name, "invert");
+    EXPECT_GE(statistics[4].numFrames, sequence);
+}
+
+TEST(Pipeline, NoStages)
+{
+    SyntheticInput input{ { 90, 15 } };
+    Pipeline pipeline{ input, true };
+    pipeline.start();
+
+    cv::Mat frame;
+    ASSERT_TRUE(pipeline.waitForFrame(frame));
+    EXPECT_EQ(frame.type(), CV_8UC1);
+    EXPECT_EQ(frame.size(), cv::Size(90, 15));
+}
+
+TEST(Pipeline, Error)
+{
+    SyntheticInput input{ { 90, 15 } };
+    Pipeline pipeline{ input };
+    pipeline.add("fail", [](cv::Mat &) { throw std::runtime_error("Stage failed"); });
+    pipeline.start();
+
+    // Errors on the pipeline's threads are rethrown to the reader
+    cv::Mat frame;
+    EXPECT_THROW(pipeline.waitForFrame(frame), std::runtime_error);
+}
@@ -0,0 +1,111 @@
+// BoB robotics includes
+#include "common/path.h"
+#include "navigation/image_database.h"
+#include "video/replay/replay_input.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C++ includes
+#include <chrono>
+
+using namespace BoBRobotics;
+using namespace BoBRobotics::Video;
+using namespace std::literals;
+
+namespace {
+cv::Mat
+makeFrame(int value)
+{
+    return cv::Mat(12, 16, CV_8UC3, cv::Scalar::all(value));
+}
+
+// Write a log with a frame every 10ms
+filesystem::path
+writeLog(size_t numFrames)
+{
+    const auto path = Path::getProgramDirectory() / "replay_input_test.boblog";
+    CaptureLogWriter writer{ path, "raw", "pixpro_usb" };
+    for (size_t i = 0; i < numFrames; i++) {
+        writer.write(makeFrame(static_cast<int>(i)), i * 10ms);
+    }
+    return path;
+}
+} // anonymous namespace
+
+TEST(ReplayInput, CaptureLog)
+{
+    constexpr size_t numFrames = 20;
+    const auto path = writeLog(numFrames);
+    {
+        ReplayInput replay{ path, ReplayInput::AsFastAsPossible, 4 };
+        ASSERT_EQ(replay.size(), numFrames);
+        EXPECT_EQ(replay.getOutputSize(), cv::Size(16, 12));
+        EXPECT_EQ(replay.getCameraName(), "pixpro_usb");
+        EXPECT_TRUE(replay.needsUnwrapping());
+        EXPECT_NEAR(replay.getFrameRate().value(), 100.0, 1e-6);
+
+        cv::Mat frame;
+        size_t index;
+        ReplayInput::Duration timestamp;
+        for (size_t i = 0; i < numFrames; i++) {
+            ASSERT_TRUE(replay.readFrame(frame, index, timestamp));
+            EXPECT_EQ(index, i);
+            EXPECT_EQ(timestamp, i * 10ms);
+            EXPECT_EQ(cv::norm(frame, makeFrame(static_cast<int>(i)), cv::NORM_INF), 0.0);
+        }
+        EXPECT_TRUE(replay.isFinished());
+        EXPECT_FALSE(replay.readFrame(frame));
+
+        // Seek backwards and forwards
+        replay.seek(5);
+        ASSERT_TRUE(replay.readFrame(frame, index, timestamp));
+        EXPECT_EQ(index, 5U);
+        replay.seekTime(145ms);
+        ASSERT_TRUE(replay.readGreyscaleFrame(frame));
+        EXPECT_EQ(frame.type(), CV_8UC1);
+        EXPECT_EQ(frame.at<uchar>(0, 0), 15);
+        EXPECT_EQ(replay.getPosition(), 16U);
+    }
+    path.remove_file();
+}
+
+TEST(ReplayInput, Pacing)
+{
+    constexpr size_t numFrames = 11;
+    const auto path = writeLog(numFrames);
+    {
+        // 100ms of frames at double speed should take about 50ms
+        ReplayInput replay{ path, 2.0 };
+        cv::Mat frame;
+
+        // Frames are paced from when the first one is read, so start timing before that
+        const auto startTime = std::chrono::steady_clock::now();
+        replay.readFrameSync(frame);
+        while (replay.readFrame(frame))
+            ;
+        const auto elapsed = std::chrono::steady_clock::now() - startTime;
+        EXPECT_GE(elapsed, 50ms);
+        EXPECT_LT(elapsed, 500ms);
+    }
+    path.remove_file();
+}
+
+TEST(ReplayInput, ImageDatabase)
+{
+    const auto routePath = Path::getRepoPath() / "docs_source" / "example_image_databases" / "example_route";
+    const Navigation::ImageDatabase database{ routePath };
+    ReplayInput replay{ routePath, ReplayInput::AsFastAsPossible };
+    ASSERT_EQ(replay.size(), database.size());
+    EXPECT_EQ(replay.getOutputSize(), database.getResolution());
+    EXPECT_EQ(replay.getCameraName(), "opengl");
+
+    const size_t middle = database.size() / 2;
+    replay.seek(middle);
+    for (size_t i = middle; i < database.size(); i++) {
+        cv::Mat frame;
+        ASSERT_TRUE(replay.readFrame(frame));
+        EXPECT_EQ(cv::norm(frame, database[i].load(false), cv::NORM_L1), 0.0);
+    }
+    EXPECT_TRUE(replay.isFinished());
+}
@@ -0,0 +1,119 @@
+// BoB robotics includes
+#include "video/see3cam_cu40_demosaic.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// OpenCV includes
+#include <opencv2/imgproc.hpp>
+
+// Standard C++ includes
+#include <random>
+#include <vector>
+
+using namespace BoBRobotics::Video::See3CAM_CU40Demosaic;
+
+namespace {
+// Not a multiple of the vector width across, so the vectorised code leaves some over
+const cv::Size BayerSize{ 2 * 38, 2 * 12 };
+const cv::Size SuperPixelSize{ BayerSize.width / 2, BayerSize.height / 2 };
+
+// Synthetic raw frames, either 10-bit (as the sensor gives) or any 16-bit value
+std::vector<uint16_t>
+makeBayer(uint16_t mask, unsigned int seed)
+{
+    std::mt19937 rng{ seed };
+    std::vector<uint16_t> bayer(BayerSize.area());
+    for (auto &value : bayer) {
+        value = static_cast<uint16_t>(rng()) & mask;
+    }
+    return bayer;
+}
+
+template<typename T>
+void
+testSuperPixel()
+{
+    for (const uint16_t mask : { 0x3FF, 0xFFFF }) {
+        const auto bayer = makeBayer(mask, mask);
+
+        cv::Mat expected(SuperPixelSize, CV_8UC3), output(SuperPixelSize, CV_8UC3);
+        superPixelScalar<T>(bayer.data(), BayerSize, expected);
+        superPixel<T>(bayer.data(), BayerSize, output);
+        EXPECT_EQ(cv::countNonZero((expected != output).reshape(1)), 0);
+
+        // Half size
+        cv::Mat half(SuperPixelSize / 2, CV_8UC3), expectedHalf;
+        superPixel<T>(bayer.data(), BayerSize, half);
+        cv::resize(expected, expectedHalf, half.size(), 0.0, 0.0, cv::INTER_NEAREST);
+        EXPECT_EQ(cv::countNonZero((expectedHalf != half).reshape(1)), 0);
+    }
+}
+} // anonymous namespace
+
+TEST(See3CAM_CU40Demosaic, PixelScale)
+{
+    testSuperPixel<PixelScale>();
+}
+
+TEST(See3CAM_CU40Demosaic, PixelClamp)
+{
+    testSuperPixel<PixelClamp>();
+}
+
+TEST(See3CAM_CU40Demosaic, WhiteBalanceCoolWhite)
+{
+    testSuperPixel<WhiteBalanceCoolWhite>();
+}
+
+TEST(See3CAM_CU40Demosaic, WhiteBalanceU30)
+{
+    testSuperPixel<WhiteBalanceU30>();
+}
+
+TEST(See3CAM_CU40Demosaic, Greyscale)
+{
+    for (const uint16_t mask : { 0x3FF, 0xFFFF }) {
+        const auto bayer = makeBayer(mask, mask + 1);
+
+        cv::Mat expected(SuperPixelSize, CV_8UC1), output(SuperPixelSize, CV_8UC1);
+        superPixelGreyscaleScalar(bayer.data(), BayerSize, expected);
+        superPixelGreyscale(bayer.data(), BayerSize, output);
+        EXPECT_EQ(cv::countNonZero(expected != output), 0);
+    }
+}
+
+TEST(See3CAM_CU40Demosaic, LUT)
+{
+    const auto bayer = makeBayer(0x3FF, 1);
+    cv::Mat full(SuperPixelSize, CV_8UC3), fullGrey(SuperPixelSize, CV_8UC1);
+    superPixelScalar<WhiteBalanceU30>(bayer.data(), BayerSize, full);
+    superPixelGreyscaleScalar(bayer.data(), BayerSize, fullGrey);
+
+    // Look up a few super-pixels, backwards, with some missing
+    const int numSuperPixels = SuperPixelSize.area();
+    cv::Mat lut(3, 5, CV_32SC1);
+    for (int i = 0; i < lut.rows * lut.cols; i++) {
+        lut.at<int32_t>(i) = (i % 4 == 3) ? -1 : numSuperPixels - 1 - 29 * i;
+    }
+
+    cv::Mat output, outputGrey;
+    superPixelLUT<WhiteBalanceU30>(bayer.data(), BayerSize, lut, output);
+    superPixelGreyscaleLUT(bayer.data(), BayerSize, lut, outputGrey);
+    ASSERT_EQ(output.size(), lut.size());
+    ASSERT_EQ(output.type(), CV_8UC3);
+    ASSERT_EQ(outputGrey.size(), lut.size());
+    ASSERT_EQ(outputGrey.type(), CV_8UC1);
+    for (int i = 0; i < lut.rows * lut.cols; i++) {
+        const int32_t offset = lut.at<int32_t>(i);
+        const int y = i / lut.cols, x = i % lut.cols;
+        if (offset < 0) {
+            EXPECT_EQ(output.at<cv::Vec3b>(y, x), cv::Vec3b(0, 0, 0));
+            EXPECT_EQ(outputGrey.at<uint8_t>(y, x), 0);
+        } else {
+            const int sy = offset / SuperPixelSize.width, sx = offset % SuperPixelSize.width;
+            EXPECT_EQ(output.at<cv::Vec3b>(y, x), full.at<cv::Vec3b>(sy, sx));
+            EXPECT_EQ(outputGrey.at<uint8_t>(y, x), fullGrey.at<uint8_t>(sy, sx));
+        }
+    }
+}
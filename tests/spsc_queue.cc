@@ -0,0 +1,69 @@
+// BoB robotics includes
+#include "common/spsc_queue.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C++ includes
+#include <memory>
+#include <thread>
+
+using namespace BoBRobotics;
+
+TEST(SPSCQueue, Bounded)
+{
+    SPSCQueue<int> queue{ 3 };
+    EXPECT_TRUE(queue.isEmpty());
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(queue.tryPush(i));
+    }
+    EXPECT_TRUE(queue.isFull());
+    int item = 3;
+    EXPECT_FALSE(queue.tryPush(item));
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(queue.tryPop(item));
+        EXPECT_EQ(item, i);
+    }
+    EXPECT_FALSE(queue.tryPop(item));
+}
+
+TEST(SPSCQueue, Threads)
+{
+    constexpr int numItems = 100000;
+    SPSCQueue<std::unique_ptr<int>> queue{ 4 };
+    std::thread producer{ [&]() {
+        for (int i = 0; i < numItems; i++) {
+            auto item = std::make_unique<int>(i);
+            ASSERT_TRUE(queue.push(item));
+        }
+        queue.close();
+    } };
+
+    // Items arrive in order and none are lost after closing
+    std::unique_ptr<int> item;
+    int expected = 0;
+    while (queue.pop(item)) {
+        ASSERT_EQ(*item, expected++);
+    }
+    EXPECT_EQ(expected, numItems);
+    producer.join();
+}
+
+TEST(SPSCQueue, Close)
+{
+    SPSCQueue<int> queue{ 1 };
+    int item = 0;
+    ASSERT_TRUE(queue.push(item));
+
+    // Wake a thread blocked on a full queue
+    std::thread closer{ [&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        queue.close();
+    } };
+    EXPECT_FALSE(queue.push(item));
+    closer.join();
+
+    EXPECT_TRUE(queue.pop(item));
+    EXPECT_FALSE(queue.pop(item));
+}
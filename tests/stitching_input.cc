@@ -0,0 +1,78 @@
+#include "common.h"
+
+// BoB robotics includes
+#include "video/stitching_input.h"
+
+// Standard C++ includes
+#include <memory>
+#include <vector>
+
+using namespace BoBRobotics;
+using namespace BoBRobotics::Video;
+using namespace units::angle;
+using namespace units::literals;
+
+namespace {
+// Always gives frames of one colour
+class ColourInput : public Input
+{
+public:
+    ColourInput(const cv::Scalar &colour)
+      : m_Colour(colour)
+    {}
+
+    virtual cv::Size getOutputSize() const override { return { 200, 200 }; }
+
+    virtual bool readFrame(cv::Mat &outFrame) override
+    {
+        outFrame.create(getOutputSize(), CV_8UC3);
+        outFrame.setTo(m_Colour);
+        return true;
+    }
+
+private:
+    const cv::Scalar m_Colour;
+};
+
+FisheyeCalibration
+getCalibration(degree_t yaw)
+{
+    FisheyeCalibration calibration;
+    calibration.resolution = { 200, 200 };
+    calibration.centre = { 100.0, 100.0 };
+    calibration.maxAngle = 100_deg;
+    calibration.pixelsPerRadian = 100.0 / units::angle::radian_t{ calibration.maxAngle }.value();
+    calibration.yaw = yaw;
+    return calibration;
+}
+} // anonymous namespace
+
+TEST(StitchingInput, Stitch)
+{
+    const cv::Vec3b front{ 10, 20, 30 }, back{ 200, 100, 50 };
+    std::vector<std::unique_ptr<Input>> cameras;
+    cameras.emplace_back(std::make_unique<ColourInput>(cv::Scalar{ 10, 20, 30 }));
+    cameras.emplace_back(std::make_unique<ColourInput>(cv::Scalar{ 200, 100, 50 }));
+    StitchingInput input{ std::move(cameras), { getCalibration(0_deg), getCalibration(180_deg) },
+                          { 360, 90 }, -45_deg, 45_deg };
+    EXPECT_FALSE(input.needsUnwrapping());
+    EXPECT_EQ(input.getOutputSize(), cv::Size(360, 90));
+
+    cv::Mat frame;
+    ASSERT_TRUE(input.readFrame(frame));
+    ASSERT_EQ(frame.size(), cv::Size(360, 90));
+    ASSERT_EQ(frame.type(), CV_8UC3);
+
+    // The centre of the panorama is straight ahead and the edges behind
+    EXPECT_EQ(frame.at<cv::Vec3b>(45, 180), front);
+    EXPECT_EQ(frame.at<cv::Vec3b>(45, 100), front);
+    EXPECT_EQ(frame.at<cv::Vec3b>(45, 0), back);
+    EXPECT_EQ(frame.at<cv::Vec3b>(45, 359), back);
+
+    // Greyscale frames are converted as cv::cvtColor would
+    cv::Mat grey, expected;
+    ASSERT_TRUE(input.readGreyscaleFrame(grey));
+    cv::cvtColor(frame, expected, cv::COLOR_BGR2GRAY);
+    EXPECT_EQ(cv::norm(grey, expected, cv::NORM_INF), 0.0);
+    EXPECT_EQ(input.getNumDroppedFrames(), 0);
+}
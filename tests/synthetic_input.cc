@@ -0,0 +1,77 @@
+// BoB robotics includes
+#include "video/synthetic_input.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+using namespace BoBRobotics;
+using namespace BoBRobotics::Video;
+using namespace units::literals;
+
+TEST(SyntheticInput, Deterministic)
+{
+    SyntheticInput input1{ { 360, 60 }, 30_Hz, false, 1 };
+    SyntheticInput input2{ { 360, 60 }, 30_Hz, false, 1 };
+    SyntheticInput input3{ { 360, 60 }, 30_Hz, false, 2 };
+
+    cv::Mat frame1, frame2, frame3;
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(input1.readFrame(frame1));
+        ASSERT_TRUE(input2.readFrame(frame2));
+        ASSERT_TRUE(input3.readFrame(frame3));
+        EXPECT_EQ(frame1.size(), cv::Size(360, 60));
+        EXPECT_EQ(frame1.type(), CV_8UC3);
+        EXPECT_EQ(cv::norm(frame1, frame2, cv::NORM_INF), 0.0);
+        EXPECT_GT(cv::norm(frame1, frame3, cv::NORM_INF), 0.0);
+    }
+}
+
+TEST(SyntheticInput, Trajectory)
+{
+    SyntheticInput input{ { 90, 20 }, 10_Hz };
+    input.setTrajectory([](units::time::second_t time) {
+        return SyntheticInput::Pose{ time * 10_mps, 0_m, 0_deg };
+    });
+
+    // The view changes as we move
+    cv::Mat frame, lastFrame;
+    for (int i = 0; i < 10; i++) {
+        input.readGreyscaleFrame(frame);
+        EXPECT_EQ(frame.type(), CV_8UC1);
+        if (i > 0) {
+            EXPECT_GT(cv::norm(frame, lastFrame, cv::NORM_L1), 0.0);
+        }
+        frame.copyTo(lastFrame);
+    }
+    EXPECT_DOUBLE_EQ(input.getTime().value(), 0.9);
+    EXPECT_DOUBLE_EQ(input.getPose().x().value(), 9.0);
+}
+
+TEST(SyntheticInput, Greyscale)
+{
+    SyntheticInput input{ { 180, 40 } };
+    cv::Mat colour, greyscale, expected;
+    input.renderPanorama(input.getPose(), colour);
+    input.renderPanorama(input.getPose(), greyscale, true);
+    cv::cvtColor(colour, expected, cv::COLOR_BGR2GRAY);
+    EXPECT_EQ(cv::norm(greyscale, expected, cv::NORM_INF), 0.0);
+}
+
+TEST(SyntheticInput, Wrapped)
+{
+    SyntheticInput input{ { 240, 240 }, 30_Hz, true };
+    EXPECT_TRUE(input.needsUnwrapping());
+
+    cv::Mat wrapped, panorama, unwrapped;
+    ASSERT_TRUE(input.readFrame(wrapped));
+    EXPECT_EQ(wrapped.size(), cv::Size(240, 240));
+    input.renderPanorama(input.getPose(), panorama);
+
+    /*
+     * Unwrapping should give back the panorama, apart from where pixels have
+     * been rounded to a neighbouring one
+     */
+    const auto unwrapper = input.createUnwrapper(panorama.size());
+    unwrapper.unwrap(wrapped, unwrapped);
+    EXPECT_LT(cv::norm(unwrapped, panorama, cv::NORM_L1), 0.05 * cv::norm(panorama, cv::NORM_L1));
+}
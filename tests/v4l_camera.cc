@@ -0,0 +1,243 @@
+#ifdef __linux__
+// BoB robotics includes
+#include "video/v4l_camera.h"
+
+// Google Test
+#include <gtest/gtest.h>
+
+// Standard C includes
+#include <cerrno>
+#include <cstring>
+
+// Standard C++ includes
+#include <deque>
+#include <memory>
+#include <vector>
+
+using namespace BoBRobotics::Video;
+
+namespace {
+// A device which "captures" frames when told to
+class FakeDevice
+  : public Video4LinuxDevice
+{
+public:
+    static constexpr uint32_t BufferSize = 64;
+
+    // Buffers queued by the camera, and filled ones ready to be dequeued
+    std::deque<uint32_t> incoming, outgoing;
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<v4l2_buffer> bufferInfo;
+    unsigned int maxBuffers = 8;
+    uint32_t sequence = 0;
+    bool isStreaming = false;
+
+    // Number of times to wake up from poll() without a frame being ready to dequeue
+    unsigned int numSpuriousWakeups = 0;
+
+    // Fill the oldest queued buffer, skipping some sequence numbers if the driver "dropped" frames
+    void produceFrame(uint32_t numDropped = 0)
+    {
+        ASSERT_FALSE(incoming.empty());
+        const auto index = incoming.front();
+        incoming.pop_front();
+
+        sequence += numDropped;
+        std::fill(buffers[index].begin(), buffers[index].end(), static_cast<uint8_t>(sequence));
+        bufferInfo[index].sequence = sequence++;
+        bufferInfo[index].bytesused = BufferSize;
+        bufferInfo[index].timestamp.tv_sec = 1;
+        bufferInfo[index].timestamp.tv_usec = bufferInfo[index].sequence;
+        outgoing.push_back(index);
+    }
+
+    virtual int ioctl(unsigned long request, void *arg) override
+    {
+        switch (request) {
+        case VIDIOC_QUERYCAP:
+            static_cast<v4l2_capability *>(arg)->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+            return 0;
+        case VIDIOC_S_FMT:
+            return 0;
+        case VIDIOC_REQBUFS: {
+            auto request = static_cast<v4l2_requestbuffers *>(arg);
+            request->count = std::min(request->count, maxBuffers);
+            buffers.assign(request->count, std::vector<uint8_t>(BufferSize));
+            bufferInfo.resize(request->count);
+            return 0;
+        }
+        case VIDIOC_QUERYBUF: {
+            auto info = static_cast<v4l2_buffer *>(arg);
+            info->length = BufferSize;
+            info->m.offset = info->index * BufferSize;
+            bufferInfo[info->index] = *info;
+            return 0;
+        }
+        case VIDIOC_QBUF:
+            incoming.push_back(static_cast<v4l2_buffer *>(arg)->index);
+            return 0;
+        case VIDIOC_DQBUF:
+            if (numSpuriousWakeups > 0) {
+                numSpuriousWakeups--;
+                errno = EAGAIN;
+                return -1;
+            }
+            if (outgoing.empty()) {
+                errno = EAGAIN;
+                return -1;
+            }
+            *static_cast<v4l2_buffer *>(arg) = bufferInfo[outgoing.front()];
+            outgoing.pop_front();
+            return 0;
+        case VIDIOC_STREAMON:
+            isStreaming = true;
+            return 0;
+        case VIDIOC_STREAMOFF:
+            isStreaming = false;
+            return 0;
+        default:
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    virtual void *mmap(size_t, off_t offset) override
+    {
+        return buffers[offset / BufferSize].data();
+    }
+
+    virtual int munmap(void *, size_t) override
+    {
+        return 0;
+    }
+
+    virtual int poll(int) override
+    {
+        return (outgoing.empty() && numSpuriousWakeups == 0) ? 0 : 1;
+    }
+};
+
+constexpr uint32_t FakeDevice::BufferSize;
+
+FakeDevice *
+openFake(Video4LinuxCamera &camera, unsigned int numBuffers)
+{
+    auto device = std::make_unique<FakeDevice>();
+    auto devicePtr = device.get();
+    camera.open(std::move(device), 8, 4, V4L2_PIX_FMT_GREY, numBuffers);
+    return devicePtr;
+}
+} // anonymous namespace
+
+TEST(Video4LinuxCamera, QueuesAllBuffers)
+{
+    Video4LinuxCamera camera;
+    const auto device = openFake(camera, 4);
+    EXPECT_TRUE(device->isStreaming);
+    EXPECT_EQ(camera.getNumBuffers(), 4U);
+    EXPECT_EQ(device->incoming.size(), 4U);
+
+    // The driver can give us fewer buffers than we ask for
+    Video4LinuxCamera camera2;
+    EXPECT_EQ(openFake(camera2, 16)->incoming.size(), 8U);
+}
+
+TEST(Video4LinuxCamera, FramesRequeueOnRelease)
+{
+    Video4LinuxCamera camera;
+    const auto device = openFake(camera, 3);
+
+    // No frame ready
+    EXPECT_FALSE(camera.captureFrame(0));
+
+    device->produceFrame();
+    device->produceFrame();
+    auto frame1 = camera.captureFrame(0);
+    auto frame2 = camera.captureFrame(0);
+    ASSERT_TRUE(frame1);
+    ASSERT_TRUE(frame2);
+    EXPECT_EQ(frame1.getSequence(), 0U);
+    EXPECT_EQ(frame2.getSequence(), 1U);
+    EXPECT_EQ(frame2.getSize(), FakeDevice::BufferSize);
+    EXPECT_EQ(frame2.getTimestamp(), std::chrono::microseconds(1000001));
+    EXPECT_EQ(static_cast<const uint8_t *>(frame2.getData())[0], 1);
+    EXPECT_EQ(device->incoming.size(), 1U);
+
+    // Moving a frame doesn't requeue its buffer
+    auto moved = std::move(frame1);
+    EXPECT_FALSE(frame1);
+    EXPECT_EQ(device->incoming.size(), 1U);
+
+    moved.release();
+    EXPECT_EQ(device->incoming.size(), 2U);
+    {
+        auto frame3 = std::move(frame2);
+    }
+    EXPECT_EQ(device->incoming.size(), 3U);
+}
+
+TEST(Video4LinuxCamera, AllBuffersHeld)
+{
+    Video4LinuxCamera camera;
+    const auto device = openFake(camera, 2);
+    device->produceFrame();
+    device->produceFrame();
+    const auto frame1 = camera.captureFrame(0);
+    const auto frame2 = camera.captureFrame(0);
+    EXPECT_THROW(camera.captureFrame(0), Video4LinuxCamera::Error);
+}
+
+TEST(Video4LinuxCamera, DroppedFrames)
+{
+    Video4LinuxCamera camera;
+    const auto device = openFake(camera, 4);
+    device->produceFrame();
+    device->produceFrame(2);
+    device->produceFrame(1);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(camera.captureFrame(0));
+    }
+    EXPECT_EQ(camera.getNumDroppedFrames(), 3U);
+}
+
+TEST(Video4LinuxCamera, Capture)
+{
+    Video4LinuxCamera camera;
+    const auto device = openFake(camera, 2);
+    device->produceFrame();
+
+    // The buffer capture() gives out is held until the next call
+    void *data = nullptr;
+    EXPECT_EQ(camera.capture(data), FakeDevice::BufferSize);
+    EXPECT_EQ(data, device->buffers[0].data());
+    EXPECT_EQ(device->incoming.size(), 1U);
+
+    device->produceFrame();
+    camera.capture(data);
+    EXPECT_EQ(data, device->buffers[1].data());
+    EXPECT_EQ(device->incoming.size(), 1U);
+
+    // Flushing throws away frames which are waiting
+    device->produceFrame();
+    camera.flush();
+    EXPECT_EQ(device->incoming.size(), 2U);
+    EXPECT_TRUE(device->outgoing.empty());
+}
+
+TEST(Video4LinuxCamera, CaptureSpuriousWakeup)
+{
+    Video4LinuxCamera camera;
+    const auto device = openFake(camera, 2);
+    device->produceFrame();
+    device->bufferInfo[0].bytesused = FakeDevice::BufferSize / 2;
+
+    // capture() waits again rather than passing out an empty frame
+    device->numSpuriousWakeups = 1;
+    EXPECT_FALSE(camera.captureFrame(0));
+    device->numSpuriousWakeups = 1;
+    void *data = nullptr;
+    EXPECT_EQ(camera.capture(data), FakeDevice::BufferSize / 2);
+    EXPECT_EQ(data, device->buffers[0].data());
+    EXPECT_EQ(device->numSpuriousWakeups, 0U);
+}
+#endif // __linux__
@@ -0,0 +1,48 @@
+// BoB robotics includes
+#include "navigation/image_database.h"
+
+// Third-party includes
+#include "third_party/CLI11.hpp"
+
+// Standard C++ includes
+#include <string>
+
+using namespace BoBRobotics;
+
+int bobMain(int argc, char **argv)
+{
+    bool raw = false, unpack = false, greyscale = false;
+    std::string imageFormat = "png";
+
+    CLI::App app{ "Tool for converting image databases to and from single .bobdb files." };
+    app.allow_extras();
+    app.add_flag("--raw", raw, "Store uncompressed frames rather than image files");
+    app.add_flag("-u,--unpack", unpack, "Convert a .bobdb file back into a folder of images");
+    app.add_option("-f,--format", imageFormat, "Image format to use when unpacking");
+    app.add_flag("-g,--greyscale", greyscale, "Convert images to greyscale when unpacking");
+    CLI11_PARSE(app, argc, argv);
+    if (app.remaining_size() != 1) {
+        std::cout << app.help();
+        return EXIT_FAILURE;
+    }
+
+    const filesystem::path inPath{ app.remaining()[0] };
+    const Navigation::ImageDatabase database(inPath);
+    if (unpack) {
+        // Name the new folder after the .bobdb file, minus its extension
+        std::string name = inPath.filename();
+        name.resize(name.size() - inPath.extension().size() - 1);
+
+        const filesystem::path outPath = inPath.parent_path() / ("unpacked_" + name);
+        std::cout << "Creating new database in " << outPath << "\n";
+        database.unpack(outPath, imageFormat, greyscale);
+    } else {
+        using FrameFormat = Navigation::PackedImageDatabase::FrameFormat;
+        const filesystem::path outPath = inPath.parent_path() /
+                                         (database.getName() + "." + Navigation::PackedImageDatabase::Extension);
+        std::cout << "Packing database into " << outPath << "\n";
+        database.pack(outPath, raw ? FrameFormat::Raw : FrameFormat::Encoded);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,10 +1,12 @@
 // BoB robotics includes
+#include "common/stopwatch.h"
 #include "navigation/image_database.h"
 
 // Third-party includes
 #include "third_party/CLI11.hpp"
 
 // Standard C++ includes
+#include <chrono>
 #include <string>
 
 using namespace BoBRobotics;
@@ -14,6 +16,7 @@ int bobMain(int argc, char **argv)
     std::vector<size_t> size{ 720, 150 };
     size_t frameSkip = 1;
     bool greyscale = false;
+    Navigation::ImageDatabase::PipelineOptions options{};
 
     CLI::App app{ "Tool for unwrapping image databases." };
     app.allow_extras();
@@ -21,6 +24,10 @@ int bobMain(int argc, char **argv)
     auto opt = app.add_option("-r,--resolution", size, "Resolution of unwrapped images");
     opt->expected(2);
     app.add_flag("-g,--greyscale", greyscale, "Convert images to greyscale");
+    app.add_option("-j,--threads", options.numThreads,
+                   "Number of threads to use (default: one per core)");
+    app.add_option("-b,--buffers", options.maxFramesInFlight,
+                   "Maximum number of frames being processed at once (default: four per thread)");
     CLI11_PARSE(app, argc, argv);
     if (app.remaining_size() != 1) {
         std::cout << app.help();
@@ -33,7 +40,15 @@ int bobMain(int argc, char **argv)
     const filesystem::path outPath = inPath.parent_path() /
                                         ("unwrapped_" + inPath.filename());
     std::cout << "Creating new database in " << outPath << "\n";
-    database.unwrap(outPath, { (int) size[0], (int) size[1] }, frameSkip, greyscale);
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+    database.unwrap(outPath, { (int) size[0], (int) size[1] }, frameSkip, greyscale, options);
+
+    const std::chrono::duration<double> elapsed = stopwatch.elapsed();
+    const size_t numFrames = database.size() / frameSkip;
+    std::cout << "Unwrapped " << numFrames << " frames in " << elapsed.count() << "s ("
+              << numFrames / elapsed.count() << " fps)\n";
 
     return EXIT_SUCCESS;
 }